@@ -24,9 +24,14 @@ if(USE_OPENMP)
   # However, this naïve method will force any user of Caffe to add the same kludge
   # into their buildsystem again, so we put these options into per-target PUBLIC
   # compile options and link flags, so that they will be exported properly.
-  find_package(OpenMP REQUIRED)
-  list(APPEND Caffe_LINKER_LIBS PRIVATE ${OpenMP_CXX_FLAGS})
-  list(APPEND Caffe_COMPILE_OPTIONS PRIVATE ${OpenMP_CXX_FLAGS})
+  find_package(OpenMP)
+  if(OPENMP_FOUND)
+    list(APPEND Caffe_LINKER_LIBS PRIVATE ${OpenMP_CXX_FLAGS})
+    list(APPEND Caffe_COMPILE_OPTIONS PRIVATE ${OpenMP_CXX_FLAGS})
+  else()
+    message(WARNING "OpenMP not found; fused solver updates will run on one thread")
+    set(USE_OPENMP OFF)
+  endif()
 endif()
 
 # ---[ Google-glog
@@ -70,10 +70,11 @@ function(caffe_pickup_caffe_sources root)
   # collect files
   file(GLOB test_hdrs    ${root}/include/caffe/test/test_*.h*)
   file(GLOB test_srcs    ${root}/src/caffe/test/test_*.cpp)
+  file(GLOB bench_srcs   ${root}/src/caffe/test/bench_*.cpp)
   file(GLOB_RECURSE hdrs ${root}/include/caffe/*.h*)
   file(GLOB_RECURSE srcs ${root}/src/caffe/*.cpp)
   list(REMOVE_ITEM  hdrs ${test_hdrs})
-  list(REMOVE_ITEM  srcs ${test_srcs})
+  list(REMOVE_ITEM  srcs ${test_srcs} ${bench_srcs})
 
   # adding headers to make the visible in some IDEs (Qt, VS, Xcode)
   list(APPEND srcs ${hdrs} ${PROJECT_BINARY_DIR}/caffe_config.h)
@@ -92,12 +93,14 @@ function(caffe_pickup_caffe_sources root)
   caffe_convert_absolute_paths(srcs)
   caffe_convert_absolute_paths(cuda)
   caffe_convert_absolute_paths(test_srcs)
+  caffe_convert_absolute_paths(bench_srcs)
   caffe_convert_absolute_paths(test_cuda)
 
   # propagate to parent scope
   set(srcs ${srcs} PARENT_SCOPE)
   set(cuda ${cuda} PARENT_SCOPE)
   set(test_srcs ${test_srcs} PARENT_SCOPE)
+  set(bench_srcs ${bench_srcs} PARENT_SCOPE)
   set(test_cuda ${test_cuda} PARENT_SCOPE)
 endfunction()
 
@@ -19,6 +19,25 @@ namespace boost { class mutex; }
 
 namespace caffe {
 
+/**
+ * @brief Estimated floating point operations and memory traffic of a forward
+ *        and a backward pass of a layer.
+ *
+ * Bytes count the compulsory traffic, reading and writing each blob once,
+ * plus any scratch buffers the layer streams through, so that
+ * flops / bytes is the arithmetic intensity of the roofline model.
+ */
+struct LayerCost {
+  LayerCost()
+      : forward_flops(0), backward_flops(0), forward_bytes(0),
+        backward_bytes(0) {}
+  double forward_flops;
+  // Computing all gradients, whether or not they are needed
+  double backward_flops;
+  double forward_bytes;
+  double backward_bytes;
+};
+
 /**
  * @brief An interface for the units of computation which can be composed into a
  *        Net.
@@ -151,6 +170,27 @@ class Layer {
       const vector<bool>& propagate_down,
       const vector<Blob<Dtype>*>& bottom);
 
+  /**
+   * @brief Estimates the work of the passes at the current shapes, as the
+   *        Profiler and `caffe profile` report it.
+   *
+   * The default counts the bytes of the blobs: forward reads the bottoms and
+   * parameters and writes the tops; backward reads the top diffs and bottom
+   * data and writes the bottom diffs, and reads, accumulates and writes the
+   * parameter diffs. FLOPs are unknown, i.e. zero, unless overridden.
+   */
+  virtual LayerCost Cost(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) const {
+    double bottoms = 0, tops = 0, params = 0;
+    for (int i = 0; i < bottom.size(); ++i) { bottoms += bottom[i]->count(); }
+    for (int i = 0; i < top.size(); ++i) { tops += top[i]->count(); }
+    for (int i = 0; i < blobs_.size(); ++i) { params += blobs_[i]->count(); }
+    LayerCost cost;
+    cost.forward_bytes = sizeof(Dtype) * (bottoms + tops + params);
+    cost.backward_bytes = sizeof(Dtype) * (tops + 2 * bottoms + 3 * params);
+    return cost;
+  }
+
   /**
    * @brief Returns the vector of learnable parameter blobs.
    */
@@ -257,6 +297,16 @@ class Layer {
    */
   virtual inline bool AutoTopBlobs() const { return false; }
 
+  /**
+   * @brief Return whether Forward can run again on the same bottoms and give
+   *        the same tops without changing the state of the layer, as
+   *        activation checkpointing does to recompute a segment.
+   *
+   * Layers that draw random numbers or update statistics in Forward return
+   * false, at least in the phases where they do.
+   */
+  virtual inline bool RepeatableForward() const { return true; }
+
   /**
    * @brief Return whether to allow force_backward for a given bottom blob
    *        index.
@@ -45,8 +45,12 @@ class BatchNormLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  virtual LayerCost Cost(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) const;
 
   virtual inline const char* type() const { return "BatchNorm"; }
+  // Without global stats each pass updates the moving averages.
+  virtual inline bool RepeatableForward() const { return use_global_stats_; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
@@ -27,6 +27,8 @@ class BiasLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  virtual LayerCost Cost(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) const;
 
   virtual inline const char* type() const { return "Bias"; }
   virtual inline int MinBottomBlobs() const { return 1; }
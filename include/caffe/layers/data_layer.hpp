@@ -1,6 +1,7 @@
 #ifndef CAFFE_DATA_LAYER_HPP_
 #define CAFFE_DATA_LAYER_HPP_
 
+#include <string>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -28,13 +29,33 @@ class DataLayer : public BasePrefetchingDataLayer<Dtype> {
  protected:
   void Next();
   bool Skip();
+  // Reads the next record of this solver, through the shuffle buffer.
+  void Read(Datum* datum);
   virtual void load_batch(Batch<Dtype>* batch);
 
   shared_ptr<db::DB> db_;
   shared_ptr<db::Cursor> cursor_;
   uint64_t offset_;
+  // Whether the cursor only visits the records of this solver
+  bool partitioned_;
+  vector<string> shuffle_buffer_;
+  shared_ptr<Caffe::RNG> shuffle_rng_;
 };
 
+/**
+ * @brief Returns the position of the index-th record read by the Data layer
+ *        of solver rank out of count, in the sequence of records a single
+ *        solver reads from a database of num_records records (where position
+ *        p holds record p % num_records). This holds for partitioned layers
+ *        (TRAIN, or TEST with partition_test) that do not shuffle.
+ *
+ * Each solver reads its part of the records over and over, or every count-th
+ * record if there are fewer records than solvers. The positions a solver
+ * reads increase with index, and over all solvers cover every position once.
+ */
+uint64_t PartitionedReadPosition(uint64_t index, int rank, int count,
+    uint64_t num_records);
+
 }  // namespace caffe
 
 #endif  // CAFFE_DATA_LAYER_HPP_
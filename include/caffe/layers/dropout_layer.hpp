@@ -39,6 +39,10 @@ class DropoutLayer : public NeuronLayer<Dtype> {
       const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Dropout"; }
+  // Each training pass draws a new mask.
+  virtual inline bool RepeatableForward() const {
+    return this->phase_ != TRAIN;
+  }
 
  protected:
   /**
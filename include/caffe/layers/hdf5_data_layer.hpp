@@ -7,20 +7,39 @@
 #include <vector>
 
 #include "caffe/blob.hpp"
+#include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/read_ahead.hpp"
 
 #include "caffe/layers/base_data_layer.hpp"
 
 namespace caffe {
 
+/**
+ * @brief Rows of the tops read from a range of one HDF5 file.
+ */
+template <typename Dtype>
+class HDF5Chunk {
+ public:
+  HDF5Chunk() : id_(-1) {}
+  // Index of the chunk in the layer's list, or -1 before it is read
+  int id_;
+  // Rows of each top, already in the order they are output
+  vector<shared_ptr<Blob<Dtype> > > blobs_;
+};
+
 /**
  * @brief Provides data to the Net from HDF5 files.
  *
+ * The files are read in chunks of hdf5_data_param.chunk_size rows, or whole,
+ * either when needed or ahead on a background thread.
+ *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
 template <typename Dtype>
-class HDF5DataLayer : public Layer<Dtype> {
+class HDF5DataLayer : public Layer<Dtype>, public InternalThread {
  public:
   explicit HDF5DataLayer(const LayerParameter& param)
       : Layer<Dtype>(param), offset_() {}
@@ -36,8 +55,11 @@ class HDF5DataLayer : public Layer<Dtype> {
   virtual inline int MinTopBlobs() const { return 1; }
 
  protected:
-  void Next();
+  void Next(int rows = 1);
   bool Skip();
+  // Skips the rows of other solvers, and returns how many of the next rows,
+  // at most max_rows, can be copied at once from the current chunk.
+  int NextRows(int max_rows);
 
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -47,16 +69,37 @@ class HDF5DataLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
+  virtual void InternalThreadEntry();
+  // Reads the next chunk of chunk_order_ into chunk.
+  virtual void LoadChunk(HDF5Chunk<Dtype>* chunk);
+  // Reads a whole file into hdf_blobs_, unshuffled. LoadChunk reads files
+  // that are not split in chunks with it, so subclasses that override it
+  // still load them their own way; chunked files are read by LoadChunk.
   virtual void LoadHDF5FileData(const char* filename);
+  void ShuffleRows(HDF5Chunk<Dtype>* chunk);
+  // Makes the next chunk current, reading it or waiting for the prefetch.
+  void NextChunk();
+  // Fetches the chunk that comes ahead chunks after the next one: its rows
+  // if the files are read in chunks, else its whole file.
+  void ReadAheadChunk(int ahead);
 
   std::vector<std::string> hdf_filenames_;
   unsigned int num_files_;
-  unsigned int current_file_;
+  // File and first row of each chunk
+  std::vector<unsigned int> chunk_files_;
+  std::vector<hsize_t> chunk_starts_;
+  // Order in which the chunks are read, and position of the next one in it
+  std::vector<unsigned int> chunk_order_;
+  unsigned int chunk_id_;
+  vector<shared_ptr<HDF5Chunk<Dtype> > > chunks_;
+  BlockingQueue<HDF5Chunk<Dtype>*> chunk_free_;
+  BlockingQueue<HDF5Chunk<Dtype>*> chunk_full_;
+  HDF5Chunk<Dtype>* current_chunk_;
   hsize_t current_row_;
+  // Tops read by LoadHDF5FileData
   std::vector<shared_ptr<Blob<Dtype> > > hdf_blobs_;
-  std::vector<unsigned int> data_permutation_;
-  std::vector<unsigned int> file_permutation_;
   uint64_t offset_;
+  shared_ptr<ReadAhead> read_ahead_;
 };
 
 }  // namespace caffe
@@ -7,24 +7,42 @@
 #include <vector>
 
 #include "caffe/blob.hpp"
+#include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
 
 namespace caffe {
 
 #define HDF5_DATA_DATASET_NAME "data"
 #define HDF5_DATA_LABEL_NAME "label"
 
+/**
+ * @brief Rows of data and label waiting to be appended to the output file.
+ */
+template <typename Dtype>
+class HDF5OutputBuffer {
+ public:
+  HDF5OutputBuffer() : rows_(0) {}
+  Blob<Dtype> data_, label_;
+  // Rows of data_ and label_ filled so far
+  int rows_;
+};
+
 /**
  * @brief Write blobs to disk as HDF5 files.
  *
+ * With hdf5_output_param.buffer_batches, the batches are buffered and then
+ * appended to chunked datasets that grow with every write, either when the
+ * buffer is full or on a background thread.
+ *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
 template <typename Dtype>
-class HDF5OutputLayer : public Layer<Dtype> {
+class HDF5OutputLayer : public Layer<Dtype>, public InternalThread {
  public:
   explicit HDF5OutputLayer(const LayerParameter& param)
-      : Layer<Dtype>(param), file_opened_(false) {}
+      : Layer<Dtype>(param), file_opened_(false), current_buffer_(NULL) {}
   virtual ~HDF5OutputLayer();
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -33,6 +51,8 @@ class HDF5OutputLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top) {}
 
   virtual inline const char* type() const { return "HDF5Output"; }
+  // Every pass appends its bottoms to the output file.
+  virtual inline bool RepeatableForward() const { return false; }
   // TODO: no limit on the number of blobs
   virtual inline int ExactNumBottomBlobs() const { return 2; }
   virtual inline int ExactNumTopBlobs() const { return 0; }
@@ -49,12 +69,24 @@ class HDF5OutputLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void SaveBlobs();
+  // Copies the rows of the bottoms, from data and label which may be on the
+  // GPU, into the current buffer, and flushes it when full.
+  void BufferBatch(const vector<Blob<Dtype>*>& bottom, const Dtype* data,
+      const Dtype* label);
+  // Writes or queues the current buffer, and makes an empty one current.
+  void FlushBuffer();
+  void WriteBuffer(HDF5OutputBuffer<Dtype>* buffer);
+  virtual void InternalThreadEntry();
 
   bool file_opened_;
   std::string file_name_;
   hid_t file_id_;
   Blob<Dtype> data_blob_;
   Blob<Dtype> label_blob_;
+  vector<shared_ptr<HDF5OutputBuffer<Dtype> > > buffers_;
+  BlockingQueue<HDF5OutputBuffer<Dtype>*> buffer_free_;
+  BlockingQueue<HDF5OutputBuffer<Dtype>*> buffer_full_;
+  HDF5OutputBuffer<Dtype>* current_buffer_;
 };
 
 }  // namespace caffe
@@ -11,6 +11,11 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/image_cache.hpp"
+#include "caffe/util/read_ahead.hpp"
+#include "caffe/util/worker_pool.hpp"
+
+namespace boost { class mutex; }
 
 namespace caffe {
 
@@ -36,9 +41,32 @@ class ImageDataLayer : public BasePrefetchingDataLayer<Dtype> {
   shared_ptr<Caffe::RNG> prefetch_rng_;
   virtual void ShuffleImages();
   virtual void load_batch(Batch<Dtype>* batch);
+  // Key of the image of line line_id in the cache.
+  string CacheKey(int line_id) const;
+  // Fetches the files of the next read_ahead batches in the background.
+  void ReadAheadLines();
+#ifdef USE_OPENCV
+  // Decodes the image of line line_id, or returns a view of it in the cache.
+  cv::Mat ReadImage(int line_id);
+#endif  // USE_OPENCV
+  // Reads and transforms the items of the batch that fall to worker.
+  void LoadItems(Batch<Dtype>* batch, Dtype* prefetch_data,
+      const vector<int>& batch_lines, int worker, vector<double>* read_time,
+      vector<double>* trans_time);
 
   vector<std::pair<std::string, int> > lines_;
   int lines_id_;
+  // Decoded images of lines_, if image_data_param.cache_file is set
+  shared_ptr<ImageCache> cache_;
+  shared_ptr<boost::mutex> cache_mutex_;
+  shared_ptr<WorkerPool> workers_;
+  // Transformers and transformed blobs of workers 1 and up; worker 0 uses
+  // data_transformer_ and transformed_data_
+  vector<shared_ptr<DataTransformer<Dtype> > > worker_transformers_;
+  vector<shared_ptr<Blob<Dtype> > > worker_transformed_data_;
+  shared_ptr<ReadAhead> read_ahead_;
+  // Next line to fetch ahead of lines_id_
+  int read_ahead_id_;
 };
 
 
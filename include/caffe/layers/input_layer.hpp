@@ -25,6 +25,11 @@ class InputLayer : public Layer<Dtype> {
   // Data layers have no bottoms, so reshaping is trivial.
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {}
+  // Holds the data assigned to it, moving nothing.
+  virtual LayerCost Cost(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) const {
+    return LayerCost();
+  }
 
   virtual inline const char* type() const { return "Input"; }
   virtual inline int ExactNumBottomBlobs() const { return 0; }
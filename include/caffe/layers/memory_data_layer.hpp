@@ -4,23 +4,34 @@
 #include <vector>
 
 #include "caffe/blob.hpp"
+#include "caffe/data_transformer.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 
 #include "caffe/layers/base_data_layer.hpp"
+#include "caffe/util/blocking_queue.hpp"
 
 namespace caffe {
 
 /**
  * @brief Provides data to the Net from memory.
  *
+ * With memory_data_param.buffers set, the layer streams batches through a
+ * ring of preallocated buffers: producers on any threads take free batches,
+ * fill them and add them, while Forward waits for the next added batch and
+ * hands the one before back. Producers wait while all batches are in use.
+ * AddDatumVector and AddMatVector transform each batch with one of a pool of
+ * transformers, one per buffer and each with its own random stream, so
+ * producers on several threads never share one.
+ *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
 template <typename Dtype>
 class MemoryDataLayer : public BaseDataLayer<Dtype> {
  public:
   explicit MemoryDataLayer(const LayerParameter& param)
-      : BaseDataLayer<Dtype>(param), has_new_data_(false) {}
+      : BaseDataLayer<Dtype>(param), has_new_data_(false),
+        current_batch_(NULL) {}
   virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
@@ -39,6 +50,13 @@ class MemoryDataLayer : public BaseDataLayer<Dtype> {
   void Reset(Dtype* data, Dtype* label, int n);
   void set_batch_size(int new_size);
 
+  // Takes a batch to fill in streaming mode, waiting for one if all are in
+  // use, or returning NULL if wait is false.
+  Batch<Dtype>* GetFreeBatch(bool wait = true);
+  // Queues a filled batch for Forward. In streaming mode, AddDatumVector and
+  // AddMatVector transform into free batches and add them this way too.
+  void AddBatch(Batch<Dtype>* batch);
+
   int batch_size() { return batch_size_; }
   int channels() { return channels_; }
   int height() { return height_; }
@@ -56,6 +74,13 @@ class MemoryDataLayer : public BaseDataLayer<Dtype> {
   Blob<Dtype> added_data_;
   Blob<Dtype> added_label_;
   bool has_new_data_;
+
+  vector<shared_ptr<Batch<Dtype> > > batches_;
+  vector<shared_ptr<DataTransformer<Dtype> > > transformers_;
+  BlockingQueue<DataTransformer<Dtype>*> transformer_free_;
+  BlockingQueue<Batch<Dtype>*> batch_free_;
+  BlockingQueue<Batch<Dtype>*> batch_full_;
+  Batch<Dtype>* current_batch_;
 };
 
 }  // namespace caffe
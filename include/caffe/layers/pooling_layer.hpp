@@ -23,8 +23,15 @@ class PoolingLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  virtual LayerCost Cost(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) const;
 
   virtual inline const char* type() const { return "Pooling"; }
+  // STOCHASTIC pooling samples its outputs at training time.
+  virtual inline bool RepeatableForward() const {
+    return this->phase_ != TRAIN || this->layer_param_.pooling_param().pool()
+        != PoolingParameter_PoolMethod_STOCHASTIC;
+  }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int MinTopBlobs() const { return 1; }
   // MAX POOL layers can output an extra top blob for the mask;
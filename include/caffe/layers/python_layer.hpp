@@ -10,6 +10,36 @@ namespace bp = boost::python;
 
 namespace caffe {
 
+/**
+ * @brief Holds the GIL for its scope. pycaffe lets go of the GIL while nets
+ *        compute, so C++ code calling into Python must take it back.
+ */
+class PyGILAcquire {
+ public:
+  PyGILAcquire() : state_(PyGILState_Ensure()) {}
+  ~PyGILAcquire() { PyGILState_Release(state_); }
+
+ private:
+  PyGILState_STATE state_;
+
+  DISABLE_COPY_AND_ASSIGN(PyGILAcquire);
+};
+
+/**
+ * @brief Lets other Python threads run for its scope, which must not use the
+ *        Python API except under a PyGILAcquire.
+ */
+class PyGILRelease {
+ public:
+  PyGILRelease() : state_(PyEval_SaveThread()) {}
+  ~PyGILRelease() { PyEval_RestoreThread(state_); }
+
+ private:
+  PyThreadState* state_;
+
+  DISABLE_COPY_AND_ASSIGN(PyGILRelease);
+};
+
 template <typename Dtype>
 class PythonLayer : public Layer<Dtype> {
  public:
@@ -24,6 +54,7 @@ class PythonLayer : public Layer<Dtype> {
         && !Caffe::multiprocess()) {
       LOG(FATAL) << "PythonLayer does not support CLI Multi-GPU, use train.py";
     }
+    PyGILAcquire gil;
     self_.attr("param_str") = bp::str(
         this->layer_param_.python_param().param_str());
     self_.attr("phase") = static_cast<int>(this->phase_);
@@ -31,18 +62,23 @@ class PythonLayer : public Layer<Dtype> {
   }
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+    PyGILAcquire gil;
     self_.attr("reshape")(bottom, top);
   }
 
   virtual inline const char* type() const { return "Python"; }
+  // Python layers may keep any state, or draw random numbers.
+  virtual inline bool RepeatableForward() const { return false; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+    PyGILAcquire gil;
     self_.attr("forward")(bottom, top);
   }
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+    PyGILAcquire gil;
     self_.attr("backward")(top, propagate_down, bottom);
   }
 
@@ -58,6 +58,8 @@ class RecurrentLayer : public Layer<Dtype> {
     // Can't propagate to sequence continuation indicators.
     return bottom_index != 1;
   }
+  // Forward carries the last hidden state over to the next call.
+  virtual inline bool RepeatableForward() const { return false; }
 
  protected:
   /**
@@ -1,6 +1,7 @@
 #ifndef CAFFE_WINDOW_DATA_LAYER_HPP_
 #define CAFFE_WINDOW_DATA_LAYER_HPP_
 
+#include <deque>
 #include <string>
 #include <utility>
 #include <vector>
@@ -11,6 +12,8 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/read_ahead.hpp"
+#include "caffe/util/worker_pool.hpp"
 
 namespace caffe {
 
@@ -37,8 +40,20 @@ class WindowDataLayer : public BasePrefetchingDataLayer<Dtype> {
  protected:
   virtual unsigned int PrefetchRand();
   virtual void load_batch(Batch<Dtype>* batch);
+  void SampleWindows(vector<vector<float> >* windows, vector<bool>* mirrors);
+  // Reads, crops and warps the sampled windows that fall to worker.
+  void LoadWindows(Dtype* top_data, const vector<vector<float> >& windows,
+      const vector<bool>& mirrors, int worker, vector<double>* read_time,
+      vector<double>* trans_time);
 
   shared_ptr<Caffe::RNG> prefetch_rng_;
+  shared_ptr<WorkerPool> workers_;
+  shared_ptr<ReadAhead> read_ahead_;
+  // Windows and mirror flags of the batches sampled ahead, oldest first
+  std::deque<vector<vector<float> > > sampled_windows_;
+  std::deque<vector<bool> > sampled_mirrors_;
+  // Windows loaded so far, to log the read ahead once per epoch
+  uint64_t windows_loaded_;
   vector<std::pair<std::string, vector<int> > > image_database_;
   enum WindowField { IMAGE_INDEX, LABEL, OVERLAP, X1, Y1, X2, Y2, NUM };
   vector<vector<float> > fg_windows_;
@@ -14,6 +14,8 @@
 
 namespace caffe {
 
+class FlatWeights;
+
 /**
  * @brief Connects Layer%s together into a directed acyclic graph (DAG)
  *        specified by a NetParameter.
@@ -91,6 +93,10 @@ class Net {
 
   /// @brief Updates the network weights based on the diff values computed.
   void Update();
+  /// @brief Returns the sum of squares of the diffs of all learnable params.
+  Dtype SumsqParamDiffs();
+  /// @brief Scales the diffs of all learnable params by a constant factor.
+  void ScaleParamDiffs(Dtype scale_factor);
   /**
    * @brief Shares weight data of owner blobs with shared blobs.
    *
@@ -114,10 +120,35 @@ class Net {
   void CopyTrainedLayersFrom(const string trained_filename);
   void CopyTrainedLayersFromBinaryProto(const string trained_filename);
   void CopyTrainedLayersFromHDF5(const string trained_filename);
+  /**
+   * @brief Loads weights written by ToFlat.
+   *
+   * With map set, parameters whose type matches Dtype point straight into a
+   * private mapping of the file instead of being copied, so loading only
+   * parses the index and pages are read on first use. The mapping is kept
+   * alive by the net. Nets with contiguous_params always copy.
+   */
+  void CopyTrainedLayersFromFlat(const string trained_filename,
+      bool map = true);
   /// @brief Writes the net to a proto.
   void ToProto(NetParameter* param, bool write_diff = false) const;
   /// @brief Writes the net to an HDF5 file.
   void ToHDF5(const string& filename, bool write_diff = false) const;
+  /**
+   * @brief Writes the net to a proto or an HDF5 file, taking the parameter
+   *        values from params, a copy of params() (e.g. a snapshot image).
+   *
+   * Only the structure of the net is read, so training can continue while
+   * these run on another thread.
+   */
+  void ToProto(NetParameter* param,
+      const vector<shared_ptr<Blob<Dtype> > >& params,
+      bool write_diff = false) const;
+  void ToHDF5(const string& filename,
+      const vector<shared_ptr<Blob<Dtype> > >& params,
+      bool write_diff = false) const;
+  /// @brief Writes the params of the net to a flat weight file.
+  void ToFlat(const string& filename) const;
 
   /// @brief returns the network name.
   inline const string& name() const { return name_; }
@@ -177,6 +208,45 @@ class Net {
   inline const vector<Blob<Dtype>*>& learnable_params() const {
     return learnable_params_;
   }
+  /// @brief returns the flat weight files that params() point into
+  inline const vector<shared_ptr<FlatWeights> >& mapped_weights() const {
+    return mapped_weights_;
+  }
+  /**
+   * @brief Whether the learnable params, and separately their diffs, are
+   *        slices of one contiguous arena (NetParameter.contiguous_params).
+   *
+   * The arenas hold the params in learnable_params() order. Their accessors
+   * first bring every slice up to date on the requested device, so the
+   * returned pointers can be used wherever the blobs themselves would be.
+   */
+  inline bool contiguous_params() const { return param_arena_count_ > 0; }
+  /// @brief Number of values in each parameter arena.
+  inline size_t param_arena_count() const { return param_arena_count_; }
+  const Dtype* param_arena_cpu_data() {
+    return SyncParamArena(false, false, false);
+  }
+  const Dtype* param_arena_cpu_diff() {
+    return SyncParamArena(true, false, false);
+  }
+  const Dtype* param_arena_gpu_data() {
+    return SyncParamArena(false, true, false);
+  }
+  const Dtype* param_arena_gpu_diff() {
+    return SyncParamArena(true, true, false);
+  }
+  Dtype* mutable_param_arena_cpu_data() {
+    return SyncParamArena(false, false, true);
+  }
+  Dtype* mutable_param_arena_cpu_diff() {
+    return SyncParamArena(true, false, true);
+  }
+  Dtype* mutable_param_arena_gpu_data() {
+    return SyncParamArena(false, true, true);
+  }
+  Dtype* mutable_param_arena_gpu_diff() {
+    return SyncParamArena(true, true, true);
+  }
   /// @brief returns the learnable parameter learning rate multipliers
   inline const vector<float>& params_lr() const { return params_lr_; }
   inline const vector<bool>& has_params_lr() const { return has_params_lr_; }
@@ -194,6 +264,18 @@ class Net {
   inline const vector<string>& param_display_names() const {
     return param_display_names_;
   }
+  /// @brief Number of activation checkpoint segments (0 if not enabled)
+  inline int num_checkpoint_segments() const {
+    return checkpoint_segment_starts_.size();
+  }
+  /// @brief Bytes of activation data and diffs without checkpointing
+  inline size_t activation_bytes() const { return activation_bytes_; }
+  /// @brief Bytes of activation data and diffs with checkpointing
+  inline size_t checkpointed_activation_bytes() const {
+    return checkpointed_activation_bytes_;
+  }
+  /// @brief Layer forwards recomputed by each backward pass
+  inline int recomputed_layers() const { return recomputed_layers_; }
   /// @brief Input and output blob numbers
   inline int num_inputs() const { return net_input_blobs_.size(); }
   inline int num_outputs() const { return net_output_blobs_.size(); }
@@ -272,6 +354,23 @@ class Net {
   void BackwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Update.
   void UpdateDebugInfo(const int param_id);
+  /// @brief Gives a layer params mapped from a flat weight file, before
+  ///        it is set up (NetParameter.lazy_weights).
+  void MapLayerWeights(const int layer_id, const FlatWeights& weights,
+      const vector<int>& entries);
+  void CopyTrainedLayersFromFlat(const shared_ptr<FlatWeights>& weights,
+      bool map);
+  /// @brief Moves the learnable params and diffs into contiguous arenas.
+  void InitParamArena();
+  /// @brief Mirrors the parameter arenas on the GPU, on first use.
+  void InitGPUParamArena();
+  /// @brief Syncs every slice of an arena to the CPU or GPU and returns it.
+  Dtype* SyncParamArena(bool diff, bool gpu, bool write);
+  /// @brief Splits the net into checkpoint segments and shares the storage
+  ///        of their interior activations.
+  void InitCheckpointing();
+  /// @brief Reruns the forward pass of a segment to restore its activations.
+  void RecomputeSegment(int segment);
 
   /// @brief The network name
   string name_;
@@ -326,6 +425,25 @@ class Net {
   /// the weight decay multipliers for learnable_params_
   vector<float> params_weight_decay_;
   vector<bool> has_params_decay_;
+  /// Contiguous storage of learnable_params_ data and diffs, if enabled
+  shared_ptr<SyncedMemory> param_data_arena_;
+  shared_ptr<SyncedMemory> param_diff_arena_;
+  size_t param_arena_count_;
+  Dtype* cpu_param_data_;
+  Dtype* cpu_param_diff_;
+  Dtype* gpu_param_data_;
+  Dtype* gpu_param_diff_;
+  /// Flat weight files that params_ point into
+  vector<shared_ptr<FlatWeights> > mapped_weights_;
+  /// Activation checkpointing: first layer of each segment, segment of each
+  /// layer, and the segment whose interior activations are currently valid
+  vector<int> checkpoint_segment_starts_;
+  vector<int> layer_segments_;
+  int resident_segment_;
+  shared_ptr<SyncedMemory> checkpoint_workspace_;
+  size_t activation_bytes_;
+  size_t checkpointed_activation_bytes_;
+  int recomputed_layers_;
   /// The bytes of memory used by this net
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
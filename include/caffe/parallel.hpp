@@ -16,6 +16,7 @@
 #include "caffe/solver.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/gradient_compression.hpp"
 #include "caffe/util/nccl.hpp"
 
 namespace caffe {
@@ -61,6 +62,8 @@ class GPUParams : public Params<Dtype> {
   using Params<Dtype>::size_;
   using Params<Dtype>::data_;
   using Params<Dtype>::diff_;
+  // False if the buffers are the net's own contiguous parameter arenas
+  bool own_buffers_;
 };
 
 template<typename Dtype>
@@ -100,15 +103,29 @@ class NCCL : public GPUParams<Dtype>,
    */
   void Run(const vector<int>& gpus, const char* restore);
 
+  /**
+   * Bytes sent by this solver for the last gradient exchange, i.e. after
+   * compression if it is enabled.
+   */
+  size_t bytes_on_wire() const;
+
  protected:
   void Init();
   void on_start() {}
   void run(int layer);  // Net callback
   void on_gradients_ready();
+  // All-gathers compressed gradients and averages them into diff_.
+  void ExchangeCompressed();
 
   ncclComm_t comm_;
   cudaStream_t stream_;
 
+  // Gradient compression, NULL if disabled
+  shared_ptr<GradientCompressor<Dtype> > compressor_;
+  shared_ptr<SyncedMemory> host_diff_;
+  shared_ptr<SyncedMemory> send_;
+  shared_ptr<SyncedMemory> recv_;
+
   shared_ptr<Solver<Dtype> > solver_;
   // Should not be necessary, https://github.com/NVIDIA/nccl/issues/37
   boost::barrier* barrier_;
@@ -6,8 +6,57 @@
 
 #include "caffe/solver.hpp"
 
+// The fused updates share their regularization with the CUDA kernels.
+#ifdef __CUDACC__
+#define CAFFE_HOST_DEVICE __host__ __device__
+#else
+#define CAFFE_HOST_DEVICE
+#endif
+
 namespace caffe {
 
+/**
+ * @brief Per element gradient normalization (for iter_size > 1) and
+ *        regularization, as done by the fused solver updates.
+ */
+template <typename Dtype>
+class GradientRegularizer {
+ public:
+  GradientRegularizer() : scale_(1), decay_(0), l1_(false) {}
+  GradientRegularizer(Dtype scale, Dtype decay, bool l1)
+      : scale_(scale), decay_(decay), l1_(l1) {}
+
+  CAFFE_HOST_DEVICE inline Dtype operator()(Dtype diff, Dtype data) const {
+    const Dtype grad = scale_ * diff;
+    if (!decay_) { return grad; }
+    const Dtype sign = Dtype((Dtype(0) < data) - (data < Dtype(0)));
+    return grad + decay_ * (l1_ ? sign : data);
+  }
+
+ protected:
+  Dtype scale_;
+  Dtype decay_;
+  bool l1_;
+};
+
+/**
+ * @brief The values a fused update of one learnable param reads and writes,
+ *        gathered on the solver thread so that the update itself only
+ *        touches raw pointers on the device it runs on.
+ */
+template <typename Dtype>
+struct FusedParam {
+  Dtype* data;
+  Dtype* diff;
+  Dtype* history;
+  // The second history of AdaDelta and Adam, NULL for the other solvers.
+  Dtype* update_history;
+  int count;
+  Dtype local_rate;
+  GradientRegularizer<Dtype> regularize;
+  bool gpu;
+};
+
 /**
  * @brief Optimizes the parameters of a Net using
  *        stochastic gradient descent (SGD) with momentum.
@@ -30,10 +79,25 @@ class SGDSolver : public Solver<Dtype> {
   virtual void Normalize(int param_id);
   virtual void Regularize(int param_id);
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  /**
+   * @brief Updates all learnable params with FusedUpdate. On the CPU the
+   *        values of all params, in arena order with contiguous_params, are
+   *        split evenly between the OpenMP threads.
+   */
+  void ApplyFusedUpdate(Dtype rate);
+  /**
+   * @brief Updates values [begin, end) of one param in a single pass, doing
+   *        the work of Normalize, Regularize, ComputeUpdateValue and
+   *        Net::Update. As in the unfused path, the diff holds the update
+   *        value afterwards. CPU updates of disjoint ranges run concurrently.
+   */
+  virtual void FusedUpdate(const FusedParam<Dtype>& param, int begin, int end);
+  GradientRegularizer<Dtype> GetRegularizer(int param_id);
   virtual void ClipGradients();
   virtual void SnapshotSolverState(const string& model_filename);
   virtual void SnapshotSolverStateToBinaryProto(const string& model_filename);
   virtual void SnapshotSolverStateToHDF5(const string& model_filename);
+  virtual void CopySolverState(vector<shared_ptr<Blob<Dtype> > >* history);
   virtual void RestoreSolverStateFromHDF5(const string& state_file);
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file);
   // history maintains the historical momentum data.
@@ -56,6 +120,7 @@ class NesterovSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(const FusedParam<Dtype>& param, int begin, int end);
 
   DISABLE_COPY_AND_ASSIGN(NesterovSolver);
 };
@@ -71,6 +136,7 @@ class AdaGradSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(const FusedParam<Dtype>& param, int begin, int end);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with AdaGrad.";
@@ -91,6 +157,7 @@ class RMSPropSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(const FusedParam<Dtype>& param, int begin, int end);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with RMSProp.";
@@ -115,6 +182,7 @@ class AdaDeltaSolver : public SGDSolver<Dtype> {
  protected:
   void AdaDeltaPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(const FusedParam<Dtype>& param, int begin, int end);
 
   DISABLE_COPY_AND_ASSIGN(AdaDeltaSolver);
 };
@@ -139,6 +207,7 @@ class AdamSolver : public SGDSolver<Dtype> {
  protected:
   void AdamPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(const FusedParam<Dtype>& param, int begin, int end);
 
   DISABLE_COPY_AND_ASSIGN(AdamSolver);
 };
@@ -1,6 +1,7 @@
 #ifndef CAFFE_SOLVER_HPP_
 #define CAFFE_SOLVER_HPP_
 #include <boost/function.hpp>
+#include <deque>
 #include <string>
 #include <vector>
 
@@ -8,6 +9,8 @@
 #include "caffe/solver_factory.hpp"
 #include "caffe/util/benchmark.hpp"
 
+namespace boost { class thread; }
+
 namespace caffe {
 
 /**
@@ -66,7 +69,10 @@ class Solver {
   // function that produces a SolverState protocol buffer that needs to be
   // written to disk together with the learned net.
   void Snapshot();
-  virtual ~Solver() {}
+  // Blocks until the snapshot being written in the background, if any, is on
+  // disk (see SolverParameter.snapshot_async).
+  void WaitForSnapshot();
+  virtual ~Solver();
   inline const SolverParameter& param() const { return param_; }
   inline shared_ptr<Net<Dtype> > net() { return net_; }
   inline const vector<shared_ptr<Net<Dtype> > >& test_nets() {
@@ -106,6 +112,35 @@ class Solver {
   virtual void SnapshotSolverState(const string& model_filename) = 0;
   virtual void RestoreSolverStateFromHDF5(const string& state_file) = 0;
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file) = 0;
+  // Writes a solver state made of the iteration counters and history blobs.
+  void WriteSolverStateToBinaryProto(const string& state_filename, int iter,
+      int current_step, const string& model_filename,
+      const vector<shared_ptr<Blob<Dtype> > >& history) const;
+  void WriteSolverStateToHDF5(const string& state_filename, int iter,
+      int current_step, const string& model_filename,
+      const vector<shared_ptr<Blob<Dtype> > >& history) const;
+  // Copies the history blobs of the solver state to host memory for an
+  // asynchronous snapshot, which writes them with WriteSolverStateTo*.
+  virtual void CopySolverState(vector<shared_ptr<Blob<Dtype> > >* history) {}
+  // Copies the data (and optionally diff) of a blob to a host blob, reusing
+  // the allocation of *copy if there is one.
+  static void CopyToHost(const Blob<Dtype>& blob, bool copy_diff,
+      shared_ptr<Blob<Dtype> >* copy);
+
+  // A copy of the weights and solver state, written in the background.
+  struct SnapshotImage {
+    int iter;
+    int current_step;
+    string model_filename;
+    string state_filename;
+    vector<shared_ptr<Blob<Dtype> > > params;
+    vector<shared_ptr<Blob<Dtype> > > history;
+  };
+  void SnapshotAsync();
+  void WriteSnapshot(shared_ptr<SnapshotImage> image);
+  // Records the files of a snapshot and deletes the snapshots beyond
+  // snapshot_retain.
+  void RetainSnapshot(const vector<string>& files);
   void DisplayOutputBlobs(const int net_id);
   void UpdateSmoothedLoss(Dtype loss, int start_iter, int average_loss);
 
@@ -129,6 +164,12 @@ class Solver {
   Timer iteration_timer_;
   float iterations_last_;
 
+  // Background snapshot writer, the image it writes (reused across
+  // snapshots), and the files of the snapshots written so far
+  shared_ptr<boost::thread> snapshot_thread_;
+  shared_ptr<SnapshotImage> snapshot_image_;
+  std::deque<vector<string> > snapshot_files_;
+
   DISABLE_COPY_AND_ASSIGN(Solver);
 };
 
@@ -3,6 +3,8 @@
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 
+#include <vector>
+
 #include "caffe/util/device_alternate.hpp"
 
 namespace caffe {
@@ -47,6 +49,27 @@ class CPUTimer : public Timer {
   virtual float MicroSeconds();
 };
 
+/**
+ * @brief Statistics of repeated timings, in the unit they were taken in. The
+ *        median and the 99th percentile are robust to the occasional outlier
+ *        that skews the mean.
+ */
+struct TimingStats {
+  TimingStats()
+      : samples(0), minimum(0), median(0), mean(0), p99(0), maximum(0),
+        stddev(0) {}
+  int samples;
+  double minimum;
+  double median;
+  double mean;
+  double p99;
+  double maximum;
+  // The sample standard deviation
+  double stddev;
+};
+
+TimingStats ComputeTimingStats(const std::vector<double>& samples);
+
 }  // namespace caffe
 
 #endif   // CAFFE_UTIL_BENCHMARK_H_
@@ -19,6 +19,13 @@ class Cursor {
   virtual string key() = 0;
   virtual string value() = 0;
   virtual bool valid() = 0;
+  // Restricts the cursor to a contiguous part of the records, the rank-th
+  // of count parts of about equal size. Returns false if the backend can't,
+  // in which case the cursor still visits every record.
+  virtual bool Partition(int rank, int count) { return false; }
+  // Visits the records in a new random order after every SeekToFirst,
+  // derived from seed. Returns false if the backend can't.
+  virtual bool Shuffle(unsigned int seed) { return false; }
 
   DISABLE_COPY_AND_ASSIGN(Cursor);
 };
@@ -41,6 +48,10 @@ class DB {
   virtual void Close() = 0;
   virtual Cursor* NewCursor() = 0;
   virtual Transaction* NewTransaction() = 0;
+  // Hints that about count records totalling bytes (keys and values) are
+  // about to be written, so that backends with a fixed size map can size it
+  // up front. Must be called while no transaction is open.
+  virtual void Reserve(size_t count, size_t bytes) { }
 
   DISABLE_COPY_AND_ASSIGN(DB);
 };
@@ -13,20 +13,40 @@ namespace caffe { namespace db {
 
 class LevelDBCursor : public Cursor {
  public:
-  explicit LevelDBCursor(leveldb::Iterator* iter)
-    : iter_(iter) {
+  // source is the path db was opened from.
+  LevelDBCursor(leveldb::Iterator* iter, leveldb::DB* db, const string& source)
+    : iter_(iter), db_(db), source_(source), partitioned_(false), size_(0),
+      remaining_(0) {
     SeekToFirst();
     CHECK(iter_->status().ok()) << iter_->status().ToString();
   }
   ~LevelDBCursor() { delete iter_; }
-  virtual void SeekToFirst() { iter_->SeekToFirst(); }
-  virtual void Next() { iter_->Next(); }
+  virtual void SeekToFirst();
+  virtual void Next();
   virtual string key() { return iter_->key().ToString(); }
   virtual string value() { return iter_->value().ToString(); }
-  virtual bool valid() { return iter_->Valid(); }
+  virtual bool valid() {
+    return iter_->Valid() && (!partitioned_ || remaining_ > 0);
+  }
+  // LevelDB doesn't know how many records it holds, so the first cursor of
+  // the process to partition a database into count parts finds them with two
+  // scans of its keys, which read every block of the database once more but
+  // leave the block cache alone: one counts the records, the other collects
+  // the first key of every part. The parts are kept for the cursors of the
+  // other ranks, which then only seek to their first key. The database must
+  // not change while the process reads it.
+  virtual bool Partition(int rank, int count);
 
  private:
   leveldb::Iterator* iter_;
+  leveldb::DB* db_;
+  string source_;
+  // First key and number of records of the partition
+  bool partitioned_;
+  string first_key_;
+  size_t size_;
+  // Records left in the partition, including the current one
+  size_t remaining_;
 };
 
 class LevelDBTransaction : public Transaction {
@@ -60,7 +80,8 @@ class LevelDB : public DB {
     }
   }
   virtual LevelDBCursor* NewCursor() {
-    return new LevelDBCursor(db_->NewIterator(leveldb::ReadOptions()));
+    return new LevelDBCursor(db_->NewIterator(leveldb::ReadOptions()), db_,
+        source_);
   }
   virtual LevelDBTransaction* NewTransaction() {
     return new LevelDBTransaction(db_);
@@ -68,6 +89,7 @@ class LevelDB : public DB {
 
  private:
   leveldb::DB* db_;
+  string source_;
 };
 
 
@@ -18,15 +18,16 @@ inline void MDB_CHECK(int mdb_status) {
 class LMDBCursor : public Cursor {
  public:
   explicit LMDBCursor(MDB_txn* mdb_txn, MDB_cursor* mdb_cursor)
-    : mdb_txn_(mdb_txn), mdb_cursor_(mdb_cursor), valid_(false) {
+    : mdb_txn_(mdb_txn), mdb_cursor_(mdb_cursor), valid_(false),
+      partitioned_(false), size_(0), remaining_(0) {
     SeekToFirst();
   }
   virtual ~LMDBCursor() {
     mdb_cursor_close(mdb_cursor_);
     mdb_txn_abort(mdb_txn_);
   }
-  virtual void SeekToFirst() { Seek(MDB_FIRST); }
-  virtual void Next() { Seek(MDB_NEXT); }
+  virtual void SeekToFirst();
+  virtual void Next();
   virtual string key() {
     return string(static_cast<const char*>(mdb_key_.mv_data), mdb_key_.mv_size);
   }
@@ -35,6 +36,9 @@ class LMDBCursor : public Cursor {
         mdb_value_.mv_size);
   }
   virtual bool valid() { return valid_; }
+  // Finds the first key of the part by stepping over the keys before it,
+  // once; the values of those records are never read.
+  virtual bool Partition(int rank, int count);
 
  private:
   void Seek(MDB_cursor_op op) {
@@ -51,20 +55,49 @@ class LMDBCursor : public Cursor {
   MDB_cursor* mdb_cursor_;
   MDB_val mdb_key_, mdb_value_;
   bool valid_;
+  // First key and number of records of the partition
+  bool partitioned_;
+  string first_key_;
+  size_t size_;
+  // Records left in the partition, including the current one
+  size_t remaining_;
 };
 
+// Streams puts into an open write transaction, without keeping copies of
+// them. Keys that are larger than every key so far (e.g. the sequential keys
+// of convert_imageset) are appended without a B-tree search. LMDB can only
+// grow the map while no write transaction is open, so before a put that
+// might not fit, the puts so far are committed and the map grows by at least
+// half. A transaction that has to grow the map is thus committed in parts,
+// and Commit only commits the last one; LMDB::Reserve sizes the map up front
+// to avoid this. The space a put takes is overestimated, but if a put or
+// commit still hits MDB_MAP_FULL, the puts since the last commit are lost
+// and writing fails.
 class LMDBTransaction : public Transaction {
  public:
-  explicit LMDBTransaction(MDB_env* mdb_env)
-    : mdb_env_(mdb_env) { }
+  explicit LMDBTransaction(MDB_env* mdb_env);
+  // Aborts whatever was put since the last commit.
+  virtual ~LMDBTransaction();
   virtual void Put(const string& key, const string& value);
   virtual void Commit();
 
  private:
-  MDB_env* mdb_env_;
-  vector<string> keys, values;
+  void Begin();
+  // Estimated number of bytes of map used by a put.
+  size_t PutBytes(size_t key_size, size_t value_size) const;
+  // Commits the open transaction and grows the map if a put of bytes might
+  // not fit.
+  void EnsureSpace(size_t bytes);
 
-  void DoubleMapSize();
+  MDB_env* mdb_env_;
+  MDB_txn* mdb_txn_;
+  MDB_dbi mdb_dbi_;
+  size_t page_size_;
+  // Estimated bytes used by the puts of the open transaction
+  size_t txn_bytes_;
+  // Largest key of the database, once known
+  string last_key_;
+  bool last_key_known_;
 
   DISABLE_COPY_AND_ASSIGN(LMDBTransaction);
 };
@@ -83,6 +116,7 @@ class LMDB : public DB {
   }
   virtual LMDBCursor* NewCursor();
   virtual LMDBTransaction* NewTransaction();
+  virtual void Reserve(size_t count, size_t bytes);
 
  private:
   MDB_env* mdb_env_;
@@ -0,0 +1,142 @@
+#ifndef CAFFE_UTIL_DB_RECORDS_HPP
+#define CAFFE_UTIL_DB_RECORDS_HPP
+
+#include <stdint.h>
+
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/util/db.hpp"
+
+namespace caffe { namespace db {
+
+/**
+ * The records format is a directory of append-only shard files and an index
+ * of every record:
+ *
+ *   shard_00000, ...   records of uint32 key size, uint32 value size, key,
+ *                      value
+ *   index              16 byte header (the magic, uint32 version, uint32
+ *                      reserved) followed by one RecordsIndexEntry per record
+ *
+ * All integers are in host byte order. The index and the shards are memory
+ * mapped for reading, so a cursor can move to any record in constant time,
+ * visit the records in a new random order every pass, and be restricted to
+ * the records of one rank without reading those of the others. Records only
+ * become visible once their index entries are written on Commit.
+ */
+const char kRecordsMagic[8] = {'C', 'A', 'F', 'F', 'E', 'R', 'E', 'C'};
+const uint32_t kRecordsVersion = 1;
+const size_t kRecordsHeaderSize = 16;
+
+struct RecordsIndexEntry {
+  uint64_t offset;  // of the record in its shard
+  uint32_t shard;
+  uint32_t size;    // of the record, including the key and value sizes
+};
+
+class MappedFile;
+
+class RecordsCursor : public Cursor {
+ public:
+  RecordsCursor(shared_ptr<MappedFile> index,
+      const vector<shared_ptr<MappedFile> >& shards);
+  virtual void SeekToFirst();
+  virtual void Next() { ++position_; }
+  virtual string key();
+  virtual string value();
+  virtual bool valid() { return position_ < end_ - begin_; }
+  virtual bool Partition(int rank, int count);
+  virtual bool Shuffle(unsigned int seed);
+
+  // Moves to the record at position of the current pass.
+  void Seek(size_t position) { position_ = position; }
+  // Number of records in a pass.
+  inline size_t size() const { return end_ - begin_; }
+
+ private:
+  // Returns the current record and sets its key and value sizes.
+  const char* record(uint32_t* key_size, uint32_t* value_size) const;
+
+  shared_ptr<MappedFile> index_;
+  vector<shared_ptr<MappedFile> > shards_;
+  const RecordsIndexEntry* entries_;
+  size_t begin_, end_, position_;
+  bool shuffle_;
+  unsigned int seed_, epoch_;
+  // Entries visited in a pass, when shuffling
+  vector<size_t> order_;
+};
+
+// Appends records to the shards of a directory, on behalf of its
+// transactions.
+class RecordsWriter {
+ public:
+  RecordsWriter(const string& source, int shard, uint64_t shard_size);
+  RecordsIndexEntry Append(const string& key, const string& value);
+  void Commit(const vector<RecordsIndexEntry>& entries);
+  inline void set_shard_size(uint64_t shard_size) {
+    shard_size_ = shard_size;
+  }
+
+ private:
+  const string source_;
+  uint64_t shard_size_;
+  int shard_;
+  uint64_t shard_offset_;
+  std::ofstream shard_stream_;
+  std::ofstream index_stream_;
+
+  DISABLE_COPY_AND_ASSIGN(RecordsWriter);
+};
+
+class RecordsTransaction : public Transaction {
+ public:
+  explicit RecordsTransaction(RecordsWriter* writer) : writer_(writer) {
+    CHECK_NOTNULL(writer_);
+  }
+  virtual void Put(const string& key, const string& value) {
+    entries_.push_back(writer_->Append(key, value));
+  }
+  virtual void Commit() {
+    writer_->Commit(entries_);
+    entries_.clear();
+  }
+
+ private:
+  RecordsWriter* writer_;
+  vector<RecordsIndexEntry> entries_;
+
+  DISABLE_COPY_AND_ASSIGN(RecordsTransaction);
+};
+
+class Records : public DB {
+ public:
+  Records() : shard_size_(kDefaultShardSize) { }
+  virtual ~Records() { Close(); }
+  // READ maps the index and shards; WRITE appends to an existing directory.
+  virtual void Open(const string& source, Mode mode);
+  virtual void Close();
+  virtual RecordsCursor* NewCursor();
+  virtual RecordsTransaction* NewTransaction();
+
+  // Size in bytes after which writing moves on to a new shard.
+  void set_shard_size(uint64_t shard_size);
+
+  static const uint64_t kDefaultShardSize = 1ULL << 30;
+
+ private:
+  string source_;
+  uint64_t shard_size_;
+  shared_ptr<MappedFile> index_;
+  vector<shared_ptr<MappedFile> > shards_;
+  shared_ptr<RecordsWriter> writer_;
+};
+
+string RecordsShardName(const string& source, int shard);
+
+}  // namespace db
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DB_RECORDS_HPP
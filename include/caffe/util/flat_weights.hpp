@@ -0,0 +1,106 @@
+#ifndef CAFFE_UTIL_FLAT_WEIGHTS_HPP_
+#define CAFFE_UTIL_FLAT_WEIGHTS_HPP_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * The flat weight format stores trained parameters as raw arrays that can be
+ * memory mapped and handed to blobs without parsing:
+ *
+ *   header     64 bytes, see FlatWeightsHeader
+ *   index      one record per blob: uint32 name length, layer name,
+ *              uint32 param index, uint32 type, uint32 num axes,
+ *              int64 dims[num axes], uint64 offset, uint64 bytes
+ *   data       the blob values, each array starting on a
+ *              kFlatWeightsAlignment boundary
+ *
+ * All integers are in host byte order. Aligning every array on a page
+ * boundary keeps the pages of one blob apart from its neighbours, so a
+ * mapping only faults in the blobs that are actually read.
+ */
+const char kFlatWeightsMagic[8] = {'C', 'A', 'F', 'F', 'E', 'F', 'L', 'T'};
+const uint32_t kFlatWeightsVersion = 1;
+const uint64_t kFlatWeightsAlignment = 4096;
+
+enum FlatWeightsType { FLAT_FLOAT = 0, FLAT_DOUBLE = 1 };
+
+struct FlatWeightsHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_blobs;
+  uint64_t index_bytes;
+  uint64_t file_bytes;
+  char reserved[32];
+};
+
+/// @brief Describes one parameter array of a flat weight file.
+struct FlatBlobInfo {
+  string layer_name;
+  int param_id;
+  FlatWeightsType type;
+  vector<int> shape;
+  uint64_t offset;
+  uint64_t bytes;
+};
+
+/// @brief Collects parameter blobs and writes them as a flat weight file.
+class FlatWeightsWriter {
+ public:
+  FlatWeightsWriter() {}
+
+  /// @brief Adds the data of blob, which must stay alive until Write.
+  template <typename Dtype>
+  void Add(const string& layer_name, int param_id, const Blob<Dtype>& blob);
+  void Write(const string& filename) const;
+
+ private:
+  vector<FlatBlobInfo> blobs_;
+  vector<const void*> data_;
+
+  DISABLE_COPY_AND_ASSIGN(FlatWeightsWriter);
+};
+
+/**
+ * @brief A read-only view of a flat weight file.
+ *
+ * The file is mapped copy-on-write: data(i) may be written to (e.g. by a
+ * solver fine-tuning mapped weights) without ever modifying the file.
+ * Pointers returned by data() are valid for the lifetime of the object.
+ */
+class FlatWeights {
+ public:
+  explicit FlatWeights(const string& filename);
+  ~FlatWeights();
+
+  /// @brief Returns whether filename starts with the flat weight magic.
+  static bool IsFlatWeights(const string& filename);
+
+  inline int num_blobs() const { return blobs_.size(); }
+  inline const FlatBlobInfo& info(int i) const { return blobs_[i]; }
+  inline void* data(int i) const {
+    return static_cast<char*>(map_) + blobs_[i].offset;
+  }
+  inline size_t size() const { return size_; }
+  /// @brief Hints that blob i is read sparsely, which turns off read-ahead.
+  void AdviseRandom(int i) const;
+  inline const string& filename() const { return filename_; }
+
+ private:
+  const string filename_;
+  void* map_;
+  size_t size_;
+  vector<FlatBlobInfo> blobs_;
+
+  DISABLE_COPY_AND_ASSIGN(FlatWeights);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FLAT_WEIGHTS_HPP_
@@ -0,0 +1,67 @@
+#ifndef CAFFE_UTIL_GRADIENT_COMPRESSION_HPP_
+#define CAFFE_UTIL_GRADIENT_COMPRESSION_HPP_
+
+#include <stdint.h>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Encodes a flattened gradient buffer into a compact wire format
+ *        and decodes received buffers back into a gradient.
+ *
+ * FP16 halves the size of the exchanged gradient. TOPK only sends the
+ * (index, value) pairs of the largest magnitude entries. With error feedback
+ * enabled, whatever was not transmitted (unsent entries, rounding error) is
+ * kept in a local residual and added to the gradient of the next iteration,
+ * so no gradient information is permanently dropped.
+ *
+ * Every call to Compress produces exactly max_bytes() bytes, which allows
+ * fixed size all-gather exchanges between solvers.
+ */
+template <typename Dtype>
+class GradientCompressor {
+ public:
+  GradientCompressor(const GradientCompressionParameter& param, size_t count);
+
+  /// @brief Encodes grad into buffer, which must hold max_bytes().
+  size_t Compress(const Dtype* grad, void* buffer);
+  /// @brief Decodes buffer and adds the result to grad.
+  void DecompressAdd(const void* buffer, Dtype* grad) const;
+
+  inline size_t count() const { return count_; }
+  /// @brief Number of entries sent per iteration by TOPK.
+  inline size_t k() const { return k_; }
+  /// @brief Size of one encoded gradient.
+  inline size_t max_bytes() const { return max_bytes_; }
+  /// @brief Size of the gradient without compression.
+  inline size_t uncompressed_bytes() const { return count_ * sizeof(Dtype); }
+  /// @brief Bytes produced by the last call to Compress.
+  inline size_t last_bytes() const { return last_bytes_; }
+  /// @brief Bytes produced by all calls to Compress so far.
+  inline uint64_t total_bytes() const { return total_bytes_; }
+  /// @brief Gradient left over from previous iterations (error feedback).
+  inline const vector<Dtype>& residual() const { return residual_; }
+
+ protected:
+  size_t CompressFP16(const Dtype* grad, void* buffer);
+  size_t CompressTopK(const Dtype* grad, void* buffer);
+
+  const GradientCompressionParameter param_;
+  const size_t count_;
+  size_t k_;
+  size_t max_bytes_;
+  size_t last_bytes_;
+  uint64_t total_bytes_;
+  vector<Dtype> residual_;
+  vector<uint32_t> indices_;
+
+  DISABLE_COPY_AND_ASSIGN(GradientCompressor);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_GRADIENT_COMPRESSION_HPP_
@@ -1,7 +1,11 @@
 #ifndef CAFFE_UTIL_HDF5_H_
 #define CAFFE_UTIL_HDF5_H_
 
+#include <stdint.h>
+
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "hdf5.h"
 #include "hdf5_hl.h"
@@ -10,6 +14,23 @@
 
 namespace caffe {
 
+/**
+ * @brief Holds the process-wide lock on HDF5 for its lifetime.
+ *
+ * HDF5 is not thread safe unless built so, and snapshots are written on a
+ * background thread while layers may read and write files on theirs, so
+ * every sequence of HDF5 calls holds it, from opening a file to closing it. The lock is recursive, and the functions
+ * below take it too.
+ */
+class HDF5Lock {
+ public:
+  HDF5Lock();
+  ~HDF5Lock();
+
+ private:
+  DISABLE_COPY_AND_ASSIGN(HDF5Lock);
+};
+
 template <typename Dtype>
 void hdf5_load_nd_dataset_helper(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
@@ -20,17 +41,47 @@ void hdf5_load_nd_dataset(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
     Blob<Dtype>* blob, bool reshape = false);
 
+// Reads only rows [start, start + rows) of the first axis of the dataset.
+template <typename Dtype>
+void hdf5_load_nd_dataset_rows(
+    hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
+    hsize_t start, hsize_t rows, Blob<Dtype>* blob);
+
+// Finds the byte ranges (offset, size) of the file in which rows
+// [start, start + rows) of the first axis of the dataset are stored, without
+// reading them: a part of a contiguous dataset, or the chunks holding the
+// rows of a chunked one. Returns false if they can't be found, e.g. for
+// chunked datasets with HDF5 older than 1.10.5.
+bool hdf5_get_rows_extents(hid_t file_id, const string& dataset_name,
+    hsize_t start, hsize_t rows, vector<pair<int64_t, int64_t> >* extents);
+
 template <typename Dtype>
 void hdf5_save_nd_dataset(
     const hid_t file_id, const string& dataset_name, const Blob<Dtype>& blob,
     bool write_diff = false);
 
+// Creates a dataset with an unlimited first axis and rows of row_shape,
+// stored in chunks of chunk_rows rows, gzipped if compression is positive.
+template <typename Dtype>
+void hdf5_create_extendible_dataset(
+    hid_t file_id, const string& dataset_name, const vector<int>& row_shape,
+    int chunk_rows, int compression = 0);
+
+// Appends the first rows rows of blob to an extendible dataset.
+template <typename Dtype>
+void hdf5_append_nd_dataset(
+    hid_t file_id, const string& dataset_name, const Blob<Dtype>& blob,
+    int rows);
+
 int hdf5_load_int(hid_t loc_id, const string& dataset_name);
 void hdf5_save_int(hid_t loc_id, const string& dataset_name, int i);
 string hdf5_load_string(hid_t loc_id, const string& dataset_name);
 void hdf5_save_string(hid_t loc_id, const string& dataset_name,
                       const string& s);
 
+vector<int> hdf5_get_dataset_shape(hid_t loc_id,
+    const string& dataset_name);
+
 int hdf5_get_num_links(hid_t loc_id);
 string hdf5_get_name_by_idx(hid_t loc_id, int idx);
 
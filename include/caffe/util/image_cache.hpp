@@ -0,0 +1,74 @@
+#ifndef CAFFE_UTIL_IMAGE_CACHE_HPP_
+#define CAFFE_UTIL_IMAGE_CACHE_HPP_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/// @brief Pixels of a cached image: rows x cols x channels uint8, row-major
+///        with interleaved channels, as in a continuous cv::Mat.
+struct CachedImage {
+  const uint8_t* data;
+  int rows;
+  int cols;
+  int channels;
+};
+
+/**
+ * @brief A persistent cache of decoded images in a memory-mapped file.
+ *
+ * The file holds a 4096 byte header followed by capacity bytes of entries:
+ * each entry is a header, the key and the pixels. New images are appended
+ * until the cache is full, and after that nothing is inserted or evicted.
+ * Epochs read the same images over and over, so evicting the oldest ones
+ * would, for a dataset larger than the cache, evict every image just before
+ * it is read again; keeping the first images instead serves them from the
+ * cache in every epoch. The file is sized up front and written through the
+ * mapping, so what was cached in one run is found again by the next; a file
+ * of another capacity is started over, and a full one is only started over
+ * if it is deleted.
+ *
+ * The cache is not thread safe, and a file must not be opened by two caches
+ * at once.
+ */
+class ImageCache {
+ public:
+  ImageCache(const string& filename, uint64_t capacity);
+  ~ImageCache();
+
+  /// @brief Returns whether key is cached, and if so points image at its
+  ///        pixels in the mapping, valid as long as the cache.
+  bool Lookup(const string& key, CachedImage* image) const;
+  /// @brief Copies the pixels of an image into the cache, unless they
+  ///        don't fit in the space left or key is already cached.
+  void Insert(const string& key, int rows, int cols, int channels,
+      const uint8_t* data);
+
+  inline int num_images() const { return index_.size(); }
+  inline uint64_t capacity() const { return capacity_; }
+  inline const string& filename() const { return filename_; }
+
+ private:
+  // Starts an empty cache.
+  void Reset();
+  // Rebuilds the index from the entries, returning false if they are corrupt.
+  bool Load();
+
+  const string filename_;
+  const uint64_t capacity_;
+  char* map_;
+  size_t map_size_;
+  // Offset after the file header of the entry of every key
+  std::map<string, uint64_t> index_;
+
+  DISABLE_COPY_AND_ASSIGN(ImageCache);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_IMAGE_CACHE_HPP_
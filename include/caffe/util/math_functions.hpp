@@ -70,6 +70,12 @@ void caffe_div(const int N, const Dtype* a, const Dtype* b, Dtype* y);
 template <typename Dtype>
 void caffe_powx(const int n, const Dtype* a, const Dtype b, Dtype* y);
 
+// Converts a float to IEEE 754 half precision (round to nearest even).
+uint16_t caffe_float_to_half(float value);
+
+// Converts an IEEE 754 half precision value to float.
+float caffe_half_to_float(uint16_t value);
+
 unsigned int caffe_rng_rand();
 
 template <typename Dtype>
@@ -0,0 +1,112 @@
+#ifndef CAFFE_UTIL_PROFILER_HPP_
+#define CAFFE_UTIL_PROFILER_HPP_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief One timed span of work, such as a layer pass or a wait for data.
+ */
+struct ProfileEvent {
+  // "forward", "backward", "recompute", "data" or "solver"
+  const char* category;
+  string name;
+  int thread;
+  // Microseconds since profiling started
+  int64_t start;
+  int64_t duration;
+  // Bytes of blob memory the thread allocated during the event
+  int64_t bytes;
+  // Estimated floating point operations, 0 if unknown
+  double flops;
+};
+
+/**
+ * @brief Records what nets and solvers spend their time on while enabled:
+ *        every layer pass, solver iteration and wait for data, from all
+ *        threads. Exports them as a Chrome trace (chrome://tracing) and as
+ *        a table summed over layers.
+ *
+ * Disabled, which is the default, instrumented code only tests a flag. In
+ * GPU mode events synchronize the device, so that they time the kernels.
+ * The flag and the clock are read without locks; only Record takes one.
+ */
+class Profiler {
+ public:
+  static Profiler& Get();
+  // Out of line, so that the header stays free of boost/atomic for NVCC.
+  static bool enabled();
+
+  // Drops the events recorded so far and starts recording.
+  void Start();
+  void Stop();
+
+  // Counts bytes allocated by the calling thread, while enabled.
+  static void Allocated(size_t bytes);
+  // Bytes the calling thread allocated while enabled.
+  static int64_t thread_allocated();
+
+  // Microseconds since Start.
+  int64_t Now() const;
+  void Record(const char* category, const string& name, int64_t start,
+      int64_t duration, int64_t bytes, double flops);
+
+  vector<ProfileEvent> events() const;
+  void WriteTrace(const string& filename) const;
+  // Calls, time, allocations and GFLOP/s per category and name.
+  string Summary() const;
+
+ private:
+  class sync;
+
+  Profiler();
+
+  shared_ptr<sync> sync_;
+  vector<ProfileEvent> events_;
+  int threads_;
+
+  DISABLE_COPY_AND_ASSIGN(Profiler);
+};
+
+// Quotes s as a JSON string, escaping what JSON requires.
+string JsonString(const string& s);
+
+/**
+ * @brief Records an event spanning its scope if the profiler is enabled.
+ */
+class ProfileScope {
+ public:
+  ProfileScope(const char* category, const string& name)
+      : active_(Profiler::enabled()) {
+    if (active_) { Begin(category, name); }
+  }
+  ~ProfileScope() {
+    if (active_) { End(); }
+  }
+
+  inline bool active() const { return active_; }
+  inline void set_flops(double flops) { flops_ = flops; }
+
+ private:
+  void Begin(const char* category, const string& name);
+  void End();
+
+  bool active_;
+  const char* category_;
+  string name_;
+  int64_t start_;
+  int64_t bytes_;
+  double flops_;
+
+  DISABLE_COPY_AND_ASSIGN(ProfileScope);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PROFILER_HPP_
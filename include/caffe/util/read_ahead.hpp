@@ -0,0 +1,88 @@
+#ifndef CAFFE_UTIL_READ_AHEAD_HPP_
+#define CAFFE_UTIL_READ_AHEAD_HPP_
+
+#include <stdint.h>
+
+#include <boost/function.hpp>
+
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+/**
+ Forward declare boost::thread instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class thread; }
+
+namespace caffe {
+
+/**
+ * @brief Fetches files into the page cache on background threads, ahead of
+ *        the data layers that read them.
+ *
+ * Fetch() only queues a file: a thread then advises the kernel with
+ * posix_fadvise(WILLNEED) and reads it through, so that the blocking read
+ * of the data layer, often on a network filesystem, finds it in memory.
+ * Layers that read only parts of files can queue a read of their own instead.
+ * At most capacity files wait in the queue: when the threads fall behind,
+ * the oldest, which the data layer is the most likely to have read already,
+ * are dropped. Queued files that are not fetched yet when the ReadAhead is
+ * destroyed are dropped too.
+ */
+class ReadAhead {
+ public:
+  ReadAhead(int threads, int capacity);
+  ~ReadAhead();
+
+  // Reads something ahead and returns the bytes it read, or a negative value
+  // if it couldn't.
+  typedef boost::function<int64_t()> Reader;
+
+  // Queues filename to be fetched, without waiting.
+  void Fetch(const string& filename);
+  // Queues reader to be run, without waiting.
+  void Fetch(const Reader& reader);
+
+  // Files queued but not fetched yet.
+  int pending() const;
+  // Files fetched, and bytes read, so far.
+  uint64_t files() const;
+  uint64_t bytes() const;
+  // Files dropped from a full queue so far.
+  uint64_t dropped() const;
+  // Time spent fetching, summed over the threads.
+  double seconds() const;
+  // Summary of the above, for logs.
+  string Summary() const;
+
+  // Readers of a whole file and of the byte ranges (offset, size) of a file,
+  // which go through the page cache like the data layer will.
+  static int64_t ReadFile(const string& filename);
+  static int64_t ReadRanges(const string& filename,
+      const vector<pair<int64_t, int64_t> >& ranges);
+
+ private:
+  class sync;
+
+  void Work();
+
+  shared_ptr<sync> sync_;
+  vector<shared_ptr<boost::thread> > threads_;
+  std::deque<Reader> queue_;
+  const int capacity_;
+  bool stopping_;
+  uint64_t files_;
+  uint64_t bytes_;
+  uint64_t dropped_;
+  double seconds_;
+
+  DISABLE_COPY_AND_ASSIGN(ReadAhead);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_READ_AHEAD_HPP_
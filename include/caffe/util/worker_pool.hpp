@@ -0,0 +1,55 @@
+#ifndef CAFFE_UTIL_WORKER_POOL_HPP_
+#define CAFFE_UTIL_WORKER_POOL_HPP_
+
+#include <boost/function.hpp>
+
+#include <vector>
+
+#include "caffe/common.hpp"
+
+/**
+ Forward declare boost::thread instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class thread; }
+
+namespace caffe {
+
+/**
+ * @brief A fixed set of workers that run each task together.
+ *
+ * Run(task) calls task(worker) once for every worker in [0, size()) and
+ * returns once all the calls have returned. Worker 0 is the calling thread,
+ * so a pool of size 1 starts no thread at all. Workers always get the same
+ * number, so a task can keep per worker state, e.g. RNG streams, and split
+ * its work statically to stay reproducible however the threads are
+ * scheduled. Data layers use it to load the items of a batch concurrently.
+ */
+class WorkerPool {
+ public:
+  explicit WorkerPool(int size);
+  ~WorkerPool();
+
+  void Run(const boost::function<void(int)>& task);
+  inline int size() const { return size_; }
+
+ private:
+  class sync;
+
+  void Work(int worker, int solver_count, int solver_rank, bool multiprocess);
+
+  const int size_;
+  shared_ptr<sync> sync_;
+  vector<shared_ptr<boost::thread> > threads_;
+  boost::function<void(int)> task_;
+  // Incremented by every Run, so that the workers can tell a new task
+  unsigned int generation_;
+  int pending_;
+  bool stopping_;
+
+  DISABLE_COPY_AND_ASSIGN(WorkerPool);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_WORKER_POOL_HPP_
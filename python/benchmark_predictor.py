@@ -0,0 +1,89 @@
+#!/usr/bin/env python
+"""
+benchmark_predictor.py measures how the inference throughput of a net scales
+with the number of Python threads predicting at once through a Predictor.
+
+Set OPENBLAS_NUM_THREADS=1 (or the equivalent for your BLAS) to measure the
+scaling of the threads themselves rather than that of the BLAS library.
+"""
+import argparse
+import sys
+import threading
+import time
+
+import numpy as np
+
+import caffe
+
+
+def run(predictor, inputs, threads, iterations):
+    """
+    Time iterations predictions on each of threads threads, returning the
+    wall time.
+    """
+    ready = [threading.Event() for _ in range(threads)]
+    start = threading.Event()
+
+    def worker(i):
+        predictor.predict(**inputs)  # warm up, making the thread net
+        ready[i].set()
+        start.wait()
+        for _ in range(iterations):
+            predictor.predict(**inputs)
+
+    workers = [threading.Thread(target=worker, args=(i,))
+               for i in range(threads)]
+    for t in workers:
+        t.start()
+    for r in ready:
+        r.wait()
+    begin = time.time()
+    start.set()
+    for t in workers:
+        t.join()
+    elapsed = time.time() - begin
+    return elapsed
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("model_def", help="Model definition file.")
+    parser.add_argument("--pretrained_model",
+                        help="Trained model weights file.")
+    parser.add_argument("--gpu", type=int,
+                        help="GPU to predict on, CPU if not given.")
+    parser.add_argument("--threads", default="1,2,4,8",
+                        help="Comma separated numbers of threads to try.")
+    parser.add_argument("--iterations", type=int, default=50,
+                        help="Predictions per thread.")
+    parser.add_argument("--batch_size", type=int,
+                        help="Batch size, that of the model if not given.")
+    args = parser.parse_args(argv[1:])
+
+    predictor = caffe.Predictor(args.model_def, args.pretrained_model,
+                                device=args.gpu)
+    inputs = {}
+    for in_ in predictor.inputs:
+        shape = list(predictor.net.blobs[in_].data.shape)
+        if args.batch_size:
+            shape[0] = args.batch_size
+        inputs[in_] = np.random.uniform(size=shape).astype(np.float32)
+    batch_size = inputs[predictor.inputs[0]].shape[0]
+
+    print("%8s %12s %10s %8s" % ("threads", "items/s", "ms/batch", "speedup"))
+    base = None
+    for threads in [int(t) for t in args.threads.split(',')]:
+        elapsed = run(predictor, inputs, threads, args.iterations)
+        batches = threads * args.iterations
+        throughput = batches * batch_size / elapsed
+        if base is None:
+            base = throughput
+        print("%8d %12.1f %10.2f %8.2f" % (
+            threads, throughput, 1000 * elapsed * threads / batches,
+            throughput / base))
+
+
+if __name__ == '__main__':
+    main(sys.argv)
@@ -7,10 +7,12 @@
 #include <boost/python.hpp>
 #include <boost/python/raw_function.hpp>
 #include <boost/python/suite/indexing/vector_indexing_suite.hpp>
+#include <boost/weak_ptr.hpp>
 #include <numpy/arrayobject.h>
 
 // these need to be included after boost on OS X
 #include <string>  // NOLINT(build/include_order)
+#include <utility>  // NOLINT(build/include_order)
 #include <vector>  // NOLINT(build/include_order)
 #include <fstream>  // NOLINT
 
@@ -70,6 +72,14 @@ void Log(const string& s) {
 
 void set_random_seed(unsigned int seed) { Caffe::set_random_seed(seed); }
 
+// The profiler of all nets and solvers of the process
+void StartProfiling() { Profiler::Get().Start(); }
+void StopProfiling() { Profiler::Get().Stop(); }
+void WriteProfileTrace(const string& filename) {
+  Profiler::Get().WriteTrace(filename);
+}
+string ProfileSummary() { return Profiler::Get().Summary(); }
+
 // For convenience, check that input files can be opened, and raise an
 // exception that boost will send to Python if not (caffe could still crash
 // later if the input files are disturbed before they are actually used, but
@@ -196,6 +206,28 @@ void Net_SetInputArrays(Net<Dtype>* net, bp::object data_obj,
       PyArray_DIMS(data_arr)[0]);
 }
 
+// Nets compute without the GIL, so that other Python threads can run.
+Dtype Net_ForwardFromTo(Net<Dtype>* net, int start, int end) {
+  PyGILRelease release;
+  return net->ForwardFromTo(start, end);
+}
+
+void Net_BackwardFromTo(Net<Dtype>* net, int start, int end) {
+  PyGILRelease release;
+  net->BackwardFromTo(start, end);
+}
+
+// Solvers train without the GIL too, their callbacks take it back.
+void Solver_Step(Solver<Dtype>* solver, int iters) {
+  PyGILRelease release;
+  solver->Step(iters);
+}
+
+void Solver_Solve(Solver<Dtype>* solver, const char* resume_file) {
+  PyGILRelease release;
+  solver->Solve(resume_file);
+}
+
 Solver<Dtype>* GetSolverFromFile(const string& filename) {
   SolverParameter param;
   ReadSolverParamsFromTextFileOrDie(filename, &param);
@@ -255,6 +287,68 @@ bp::object Blob_Reshape(bp::tuple args, bp::dict kwargs) {
   return bp::object();
 }
 
+// Arrays bound as the data of blobs by Blob_Bind, with the memory that
+// points to them. An array is released once no blob shares that memory
+// anymore, e.g. after a blob was reshaped to a larger size. The list is
+// never destroyed, as Python may be finalized by then.
+typedef std::pair<boost::weak_ptr<SyncedMemory>, bp::object> BoundArray;
+static vector<BoundArray>& bound_arrays = *new vector<BoundArray>();
+
+static void ReleaseUnboundArrays() {
+  for (int i = bound_arrays.size() - 1; i >= 0; --i) {
+    if (bound_arrays[i].first.expired()) {
+      bound_arrays.erase(bound_arrays.begin() + i);
+    }
+  }
+}
+
+bool Blob_Bound(const Blob<Dtype>& blob) {
+  for (int i = 0; i < bound_arrays.size(); ++i) {
+    if (bound_arrays[i].first.lock() == blob.data()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Makes a numpy array the data of the blob, reshaped to the array shape, so
+// that it is read and written in place. The blob keeps its own diff.
+void Blob_Bind(Blob<Dtype>* blob, bp::object array_obj) {
+  ReleaseUnboundArrays();
+  if (!PyArray_Check(array_obj.ptr())) {
+    throw std::runtime_error("Only numpy arrays can be bound to blobs");
+  }
+  PyArrayObject* arr = reinterpret_cast<PyArrayObject*>(array_obj.ptr());
+  if (!(PyArray_FLAGS(arr) & NPY_ARRAY_C_CONTIGUOUS)) {
+    throw std::runtime_error("bound array must be C contiguous");
+  }
+  if (PyArray_TYPE(arr) != NPY_FLOAT32) {
+    throw std::runtime_error("bound array must be float32");
+  }
+  if (!PyArray_ISALIGNED(arr) || !PyArray_ISWRITEABLE(arr)) {
+    throw std::runtime_error("bound array must be aligned and writeable");
+  }
+  if (PyArray_NDIM(arr) == 0 || PyArray_SIZE(arr) == 0) {
+    throw std::runtime_error("bound array must not be empty");
+  }
+  vector<int> shape(PyArray_DIMS(arr), PyArray_DIMS(arr) + PyArray_NDIM(arr));
+  Blob<Dtype> array_blob(shape);
+  array_blob.set_cpu_data(static_cast<Dtype*>(PyArray_DATA(arr)));
+  blob->Reshape(shape);
+  blob->ShareData(array_blob);
+  bound_arrays.push_back(BoundArray(array_blob.data(), array_obj));
+}
+
+// Gives the blob data of its own again, with the values of the bound array.
+void Blob_Unbind(Blob<Dtype>* blob) {
+  if (Blob_Bound(*blob)) {
+    Blob<Dtype> own_blob(blob->shape());
+    caffe_copy(blob->count(), blob->cpu_data(), own_blob.mutable_cpu_data());
+    blob->ShareData(own_blob);
+  }
+  ReleaseUnboundArrays();
+}
+
 bp::object BlobVec_add_blob(bp::tuple args, bp::dict kwargs) {
   if (bp::len(kwargs) > 0) {
     throw std::runtime_error("BlobVec.add_blob takes no kwargs");
@@ -279,9 +373,11 @@ class SolverCallback: public Solver<Dtype>::Callback {
   SolverCallback(bp::object on_start, bp::object on_gradients_ready)
     : on_start_(on_start), on_gradients_ready_(on_gradients_ready) { }
   virtual void on_gradients_ready() {
+    PyGILAcquire gil;
     on_gradients_ready_();
   }
   virtual void on_start() {
+    PyGILAcquire gil;
     on_start_();
   }
 };
@@ -313,6 +409,7 @@ class NetCallback: public Net<Dtype>::Callback {
 
  protected:
   virtual void run(int layer) {
+    PyGILAcquire gil;
     run_(layer);
   }
   bp::object run_;
@@ -376,8 +473,6 @@ bp::object NCCL_New_Uid() {
 }
 #endif
 
-BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SolveOverloads, Solve, 0, 1);
-
 BOOST_PYTHON_MODULE(_caffe) {
   // below, we prepend an underscore to methods that will be replaced
   // in Python
@@ -399,6 +494,10 @@ BOOST_PYTHON_MODULE(_caffe) {
   bp::def("solver_rank", &Caffe::solver_rank);
   bp::def("set_solver_rank", &Caffe::set_solver_rank);
   bp::def("set_multiprocess", &Caffe::set_multiprocess);
+  bp::def("start_profiling", &StartProfiling);
+  bp::def("stop_profiling", &StopProfiling);
+  bp::def("write_profile_trace", &WriteProfileTrace);
+  bp::def("profile_summary", &ProfileSummary);
 
   bp::def("layer_type_list", &LayerRegistry<Dtype>::LayerTypeList);
 
@@ -411,8 +510,8 @@ BOOST_PYTHON_MODULE(_caffe) {
             bp::arg("weights")=bp::object())))
     // Legacy constructor
     .def("__init__", bp::make_constructor(&Net_Init_Load))
-    .def("_forward", &Net<Dtype>::ForwardFromTo)
-    .def("_backward", &Net<Dtype>::BackwardFromTo)
+    .def("_forward", &Net_ForwardFromTo)
+    .def("_backward", &Net_BackwardFromTo)
     .def("reshape", &Net<Dtype>::Reshape)
     .def("clear_param_diffs", &Net<Dtype>::ClearParamDiffs)
     // The cast is to select a particular overload.
@@ -464,6 +563,9 @@ BOOST_PYTHON_MODULE(_caffe) {
     .add_property("count",    static_cast<int (Blob<Dtype>::*)() const>(
         &Blob<Dtype>::count))
     .def("reshape",           bp::raw_function(&Blob_Reshape))
+    .def("_bind",             &Blob_Bind)
+    .def("unbind",            &Blob_Unbind)
+    .add_property("bound",    &Blob_Bound)
 #ifndef CPU_ONLY
     .add_property("_gpu_data_ptr",
         reinterpret_cast<uintptr_t (Blob<Dtype>::*)()>(
@@ -501,9 +603,8 @@ BOOST_PYTHON_MODULE(_caffe) {
     .add_property("iter", &Solver<Dtype>::iter)
     .def("add_callback", &Solver_add_callback<Dtype>)
     .def("add_callback", &Solver_add_nccl)
-    .def("solve", static_cast<void (Solver<Dtype>::*)(const char*)>(
-          &Solver<Dtype>::Solve), SolveOverloads())
-    .def("step", &Solver<Dtype>::Step)
+    .def("solve", &Solver_Solve, (bp::arg("resume_file")=bp::object()))
+    .def("step", &Solver_Step)
     .def("restore", &Solver<Dtype>::Restore)
     .def("snapshot", &Solver<Dtype>::Snapshot)
     .def("share_weights", &share_weights)
@@ -570,6 +671,11 @@ BOOST_PYTHON_MODULE(_caffe) {
     .add_property("ms", &Timer::MilliSeconds);
   BP_REGISTER_SHARED_PTR_TO_PYTHON(Timer);
 
+#if PY_VERSION_HEX < 0x03070000
+  // Create the GIL, which nets release while they compute
+  PyEval_InitThreads();
+#endif
+
   // boost python expects a void (missing) return value, while import_array
   // returns NULL for python3. import_array1() forces a void return value.
   import_array1();
@@ -0,0 +1,91 @@
+#!/usr/bin/env python
+"""
+Predictor runs a Net from many threads at once.
+"""
+
+import threading
+
+import six
+
+import caffe
+
+
+class Predictor(object):
+    """
+    Predictor serves predictions of a net to any number of threads. Each
+    thread gets a net of its own for the activations, and these nets share
+    the weights of the first one, so that threads compute in parallel
+    while the GIL is released.
+
+    Parameters
+    ----------
+    model_file, pretrained_file : the net definition and its weights. The
+        definition must stay readable, as threads make their nets from it.
+    device : GPU to predict on, CPU if None. Caffe's mode is per thread,
+        so the predictor sets it in each thread that uses it, including
+        the one making it.
+    """
+    def __init__(self, model_file, pretrained_file=None, device=None):
+        self.model_file = model_file
+        self.device = device
+        self._local = threading.local()
+        self._set_mode()
+        if pretrained_file is None:
+            self.net = caffe.Net(model_file, caffe.TEST)
+        else:
+            self.net = caffe.Net(model_file, caffe.TEST,
+                                 weights=pretrained_file)
+        if device is not None:
+            # Copy the weights to the GPU here, as all threads would at once
+            # on their first prediction otherwise.
+            for params in six.itervalues(self.net.params):
+                for param in params:
+                    param._gpu_data_ptr
+        self.inputs = self.net.inputs
+        self.outputs = self.net.outputs
+
+    def _set_mode(self):
+        if self.device is None:
+            caffe.set_mode_cpu()
+        else:
+            caffe.set_mode_gpu()
+            caffe.set_device(self.device)
+
+    def thread_net(self):
+        """
+        The net of the calling thread, made on first use. Its weights are
+        those of the predictor and must not be changed.
+        """
+        net = getattr(self._local, 'net', None)
+        if net is None:
+            self._set_mode()
+            net = caffe.Net(self.model_file, caffe.TEST)
+            net.share_with(self.net)
+            self._local.net = net
+        return net
+
+    def predict(self, blobs=None, **inputs):
+        """
+        Forward inputs through the net of the calling thread.
+
+        Parameters
+        ----------
+        blobs : list of blobs to return in addition to output blobs.
+        inputs : Keys are input blob names and values are ndarrays. The net
+                 of the thread is reshaped to their batch size if need be.
+
+        Returns
+        -------
+        outs : {blob name: ndarray} dict of copies, which later predictions
+               do not overwrite.
+        """
+        net = self.thread_net()
+        reshape = False
+        for in_, data in six.iteritems(inputs):
+            if net.blobs[in_].data.shape != data.shape:
+                net.blobs[in_].reshape(*data.shape)
+                reshape = True
+        if reshape:
+            net.reshape()
+        outs = net.forward(blobs=blobs, **inputs)
+        return {out: outs[out].copy() for out in outs}
@@ -126,7 +126,20 @@ def _Net_forward(self, blobs=None, start=None, end=None, **kwargs):
         for in_, blob in six.iteritems(kwargs):
             if blob.shape[0] != self.blobs[in_].shape[0]:
                 raise Exception('Input is not batch sized')
-            self.blobs[in_].data[...] = blob
+            data = self.blobs[in_].data
+            # Arrays bound to the inputs are already in place, but other
+            # views of their memory, e.g. slices, still need copying
+            in_place = (blob.__array_interface__['data'][0] ==
+                        data.__array_interface__['data'][0] and
+                        blob.shape == data.shape and
+                        blob.strides == data.strides)
+            if not in_place:
+                data[...] = blob
+    # Bound inputs may have been written in place since the last pass, which
+    # taking their data as writable tells nets on the GPU.
+    for in_ in self.inputs:
+        if in_ not in kwargs and self.blobs[in_].bound:
+            self.blobs[in_].data
 
     self._forward(start_ind, end_ind)
 
@@ -258,6 +271,37 @@ def _Net_forward_backward_all(self, blobs=None, diffs=None, **kwargs):
     return all_outs, all_diffs
 
 
+def _Net_bind(self, **arrays):
+    """
+    Bind caller-owned arrays as the data of blobs, so that forward reads
+    inputs from them and writes outputs into them without copies.
+
+    Parameters
+    ----------
+    arrays : Keys are blob names and values are float32, C-contiguous,
+             aligned and writeable ndarrays. Input blobs take the shape of
+             their array and the net is reshaped to it, other blobs must
+             already have the shape of theirs.
+
+    The arrays are kept alive for as long as the blobs use them. A blob
+    reshaped to a larger size gets data of its own again, which its bound
+    property tells; Blob.unbind() does so explicitly.
+    """
+    inputs = [name for name in arrays if name in self.inputs]
+    for in_ in inputs:
+        self.blobs[in_]._bind(arrays[in_])
+    if inputs:
+        self.reshape()
+    for name, array in six.iteritems(arrays):
+        if name in inputs:
+            continue
+        if tuple(self.blobs[name].shape) != array.shape:
+            raise Exception('Array shape {} does not match blob {} of shape '
+                            '{}'.format(array.shape, name,
+                                        tuple(self.blobs[name].shape)))
+        self.blobs[name]._bind(array)
+
+
 def _Net_set_input_arrays(self, data, labels):
     """
     Set input arrays of the in-memory MemoryDataLayer.
@@ -337,6 +381,7 @@ Net.forward = _Net_forward
 Net.backward = _Net_backward
 Net.forward_all = _Net_forward_all
 Net.forward_backward_all = _Net_forward_backward_all
+Net.bind = _Net_bind
 Net.set_input_arrays = _Net_set_input_arrays
 Net._batch = _Net_batch
 Net.inputs = _Net_inputs
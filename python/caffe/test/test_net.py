@@ -166,6 +166,89 @@ class TestNet(unittest.TestCase):
                 self.assertEqual(abs(self.net.params[name][i].data
                     - net2.params[name][i].data).sum(), 0)
 
+class TestBind(unittest.TestCase):
+
+    TEST_NET = """
+input: "data" input_shape { dim: 5 dim: 3 }
+layer { type: 'InnerProduct' name: 'ip' bottom: 'data' top: 'ip'
+  inner_product_param { num_output: 4
+    weight_filler { type: 'gaussian' std: 1 }
+    bias_filler { type: 'constant' value: 1 } } }
+"""
+
+    def setUp(self):
+        f = tempfile.NamedTemporaryFile(mode='w+', delete=False)
+        f.write(self.TEST_NET)
+        f.close()
+        self.net = caffe.Net(f.name, caffe.TEST)
+        os.remove(f.name)
+
+    def expected(self, data):
+        w, b = self.net.params['ip']
+        return data.dot(w.data.T) + b.data
+
+    def test_bind(self):
+        data = np.random.uniform(size=(5, 3)).astype(np.float32)
+        ip = np.zeros((5, 4), dtype=np.float32)
+        self.net.bind(data=data, ip=ip)
+        self.assertTrue(self.net.blobs['data'].bound)
+        self.assertTrue(self.net.blobs['ip'].bound)
+        out = self.net.forward()
+        self.assertTrue(np.may_share_memory(out['ip'], ip))
+        np.testing.assert_allclose(ip, self.expected(data), rtol=1e-5)
+        # inputs written in place are read by the next pass
+        data[...] = np.random.uniform(size=data.shape)
+        self.net.forward()
+        np.testing.assert_allclose(ip, self.expected(data), rtol=1e-5)
+        # passing the bound array itself does not copy it
+        self.net.forward(data=data)
+        np.testing.assert_allclose(ip, self.expected(data), rtol=1e-5)
+
+    def test_bind_forward_view(self):
+        data = np.random.uniform(size=(5, 3)).astype(np.float32)
+        ip = np.zeros((5, 4), dtype=np.float32)
+        self.net.bind(data=data, ip=ip)
+        # a view of the bound array in another order is copied into it
+        reversed_data = data[::-1].copy()
+        self.net.forward(data=data[::-1])
+        np.testing.assert_array_equal(data, reversed_data)
+        np.testing.assert_allclose(ip, self.expected(reversed_data),
+                                   rtol=1e-5)
+
+    def test_bind_reshapes_inputs(self):
+        data = np.random.uniform(size=(2, 3)).astype(np.float32)
+        self.net.bind(data=data)
+        self.assertEqual(self.net.blobs['ip'].data.shape, (2, 4))
+        self.net.forward()
+        np.testing.assert_allclose(self.net.blobs['ip'].data,
+                                   self.expected(data), rtol=1e-5)
+
+    def test_bind_invalid(self):
+        with self.assertRaises(Exception):
+            self.net.bind(data=np.zeros((5, 3)))
+        with self.assertRaises(Exception):
+            self.net.bind(data=np.zeros((3, 5), dtype=np.float32).T)
+        with self.assertRaises(Exception):
+            self.net.bind(ip=np.zeros((5, 3), dtype=np.float32))
+        self.assertFalse(self.net.blobs['data'].bound)
+        self.assertFalse(self.net.blobs['ip'].bound)
+
+    def test_unbind(self):
+        data = np.ones((5, 3), dtype=np.float32)
+        self.net.bind(data=data)
+        self.net.blobs['data'].unbind()
+        self.assertFalse(self.net.blobs['data'].bound)
+        np.testing.assert_array_equal(self.net.blobs['data'].data, data)
+        data[...] = 2
+        self.assertTrue((self.net.blobs['data'].data == 1).all())
+
+    def test_reshape_unbinds(self):
+        data = np.ones((5, 3), dtype=np.float32)
+        self.net.bind(data=data)
+        self.net.blobs['data'].reshape(10, 3)
+        self.assertFalse(self.net.blobs['data'].bound)
+
+
 class TestLevels(unittest.TestCase):
 
     TEST_NET = """
@@ -0,0 +1,78 @@
+import unittest
+import tempfile
+import os
+import threading
+import numpy as np
+
+import caffe
+
+
+class TestPredictor(unittest.TestCase):
+
+    TEST_NET = """
+input: "data" input_shape { dim: 4 dim: 6 }
+layer { type: 'InnerProduct' name: 'ip' bottom: 'data' top: 'ip'
+  inner_product_param { num_output: 3
+    weight_filler { type: 'gaussian' std: 1 }
+    bias_filler { type: 'constant' value: 1 } } }
+layer { type: 'Softmax' name: 'prob' bottom: 'ip' top: 'prob' }
+"""
+
+    def setUp(self):
+        self.f = tempfile.NamedTemporaryFile(mode='w+', delete=False)
+        self.f.write(self.TEST_NET)
+        self.f.close()
+        self.predictor = caffe.Predictor(self.f.name)
+
+    def tearDown(self):
+        os.remove(self.f.name)
+
+    def expected(self, data):
+        w, b = self.predictor.net.params['ip']
+        ip = data.dot(w.data.T) + b.data
+        e = np.exp(ip - ip.max(axis=1, keepdims=True))
+        return e / e.sum(axis=1, keepdims=True)
+
+    def test_predict(self):
+        data = np.random.uniform(size=(4, 6)).astype(np.float32)
+        out = self.predictor.predict(data=data)
+        self.assertEqual(list(out.keys()), ['prob'])
+        np.testing.assert_allclose(out['prob'], self.expected(data),
+                                   rtol=1e-4)
+
+    def test_reshape(self):
+        data = np.random.uniform(size=(7, 6)).astype(np.float32)
+        out = self.predictor.predict(data=data)
+        self.assertEqual(out['prob'].shape, (7, 3))
+        np.testing.assert_allclose(out['prob'], self.expected(data),
+                                   rtol=1e-4)
+
+    def test_shared_weights(self):
+        net = self.predictor.thread_net()
+        self.assertIsNot(net, self.predictor.net)
+        self.assertIs(net, self.predictor.thread_net())
+        for name in net.params:
+            for p, shared in zip(net.params[name],
+                                 self.predictor.net.params[name]):
+                self.assertTrue(np.may_share_memory(p.data, shared.data))
+
+    def test_threads(self):
+        inputs = [np.random.uniform(size=(4, 6)).astype(np.float32)
+                  for _ in range(8)]
+        results = [None] * len(inputs)
+        nets = [None] * len(inputs)
+
+        def predict(i):
+            for _ in range(10):
+                results[i] = self.predictor.predict(data=inputs[i])['prob']
+            nets[i] = self.predictor.thread_net()
+
+        threads = [threading.Thread(target=predict, args=(i,))
+                   for i in range(len(inputs))]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        self.assertEqual(len(set(map(id, nets))), len(inputs))
+        for data, prob in zip(inputs, results):
+            np.testing.assert_allclose(prob, self.expected(data), rtol=1e-4)
@@ -254,6 +254,30 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+LayerCost BaseConvolutionLayer<Dtype>::Cost(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) const {
+  // Each group multiplies (conv_out_channels_ / group_) x kernel_dim_ weights
+  // by kernel_dim_ x conv_out_spatial_dim_ columns, for every image.
+  const double images = static_cast<double>(num_) * bottom.size();
+  const double gemm = 2. * images * conv_out_channels_ * kernel_dim_
+      * conv_out_spatial_dim_;
+  const double bias = bias_term_ ?
+      images * num_output_ * out_spatial_dim_ : 0;
+  LayerCost cost = Layer<Dtype>::Cost(bottom, top);
+  cost.forward_flops = gemm + bias;
+  // The weight and the bottom gradients take a GEMM each
+  cost.backward_flops = 2 * gemm + bias;
+  if (!is_1x1_) {
+    // The column buffer is written and read back once per image forward,
+    // and twice backward: for the weight and for the bottom gradient.
+    const double col = sizeof(Dtype) * images * col_buffer_.count();
+    cost.forward_bytes += 2 * col;
+    cost.backward_bytes += 4 * col;
+  }
+  return cost;
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
     const Dtype* weights, Dtype* output, bool skip_im2col) {
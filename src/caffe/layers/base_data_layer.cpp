@@ -8,6 +8,7 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/profiler.hpp"
 
 namespace caffe {
 
@@ -115,7 +116,10 @@ void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
   if (prefetch_current_) {
     prefetch_free_.push(prefetch_current_);
   }
-  prefetch_current_ = prefetch_full_.pop("Waiting for data");
+  {
+    ProfileScope profile("data", this->layer_param_.name());
+    prefetch_current_ = prefetch_full_.pop("Waiting for data");
+  }
   // Reshape to loaded data.
   top[0]->ReshapeLike(prefetch_current_->data_);
   top[0]->set_cpu_data(prefetch_current_->data_.mutable_cpu_data());
@@ -1,6 +1,7 @@
 #include <vector>
 
 #include "caffe/layers/base_data_layer.hpp"
+#include "caffe/util/profiler.hpp"
 
 namespace caffe {
 
@@ -10,7 +11,10 @@ void BasePrefetchingDataLayer<Dtype>::Forward_gpu(
   if (prefetch_current_) {
     prefetch_free_.push(prefetch_current_);
   }
-  prefetch_current_ = prefetch_full_.pop("Waiting for data");
+  {
+    ProfileScope profile("data", this->layer_param_.name());
+    prefetch_current_ = prefetch_full_.pop("Waiting for data");
+  }
   // Reshape to loaded data.
   top[0]->ReshapeLike(prefetch_current_->data_);
   top[0]->set_gpu_data(prefetch_current_->data_.mutable_gpu_data());
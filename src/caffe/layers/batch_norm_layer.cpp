@@ -83,6 +83,18 @@ void BatchNormLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+LayerCost BatchNormLayer<Dtype>::Cost(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) const {
+  LayerCost cost = Layer<Dtype>::Cost(bottom, top);
+  // Training computes the mean and variance, subtracts and divides; the
+  // global statistics leave only the subtraction and division.
+  const double count = bottom[0]->count();
+  cost.forward_flops = (use_global_stats_ ? 2 : 5) * count;
+  cost.backward_flops = (use_global_stats_ ? 1 : 7) * count;
+  return cost;
+}
+
 template <typename Dtype>
 void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
@@ -68,6 +68,17 @@ void BiasLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+LayerCost BiasLayer<Dtype>::Cost(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) const {
+  LayerCost cost = Layer<Dtype>::Cost(bottom, top);
+  // Backward copies the gradient through and sums it into the bias
+  const double count = top[0]->count();
+  cost.forward_flops = count;
+  cost.backward_flops = count;
+  return cost;
+}
+
 template <typename Dtype>
 void BiasLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -3,21 +3,38 @@
 #endif  // USE_OPENCV
 #include <stdint.h>
 
+#include <string>
 #include <vector>
 
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/rng.hpp"
 
 namespace caffe {
 
 template <typename Dtype>
 DataLayer<Dtype>::DataLayer(const LayerParameter& param)
   : BasePrefetchingDataLayer<Dtype>(param),
-    offset_() {
+    offset_(), partitioned_(false) {
   db_.reset(db::GetDB(param.data_param().backend()));
   db_->Open(param.data_param().source(), db::READ);
   cursor_.reset(db_->NewCursor());
+  // In test mode, only rank 0 runs, so every record is read
+  if (Caffe::solver_count() > 1 &&
+      (param.phase() == TRAIN || param.data_param().partition_test())) {
+    partitioned_ = cursor_->Partition(Caffe::solver_rank(),
+        Caffe::solver_count());
+  }
+  if (param.data_param().shuffle()) {
+    CHECK(cursor_->Shuffle(caffe_rng_rand()))
+        << DataParameter_DB_Name(param.data_param().backend())
+        << " databases can't be shuffled.";
+  }
+  if (param.data_param().shuffle_buffer() > 0) {
+    shuffle_rng_.reset(new Caffe::RNG(caffe_rng_rand()));
+  }
 }
 
 template <typename Dtype>
@@ -58,11 +75,16 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
 
 template <typename Dtype>
 bool DataLayer<Dtype>::Skip() {
+  if (partitioned_) {
+    // The cursor only visits the records of this solver
+    return false;
+  }
   int size = Caffe::solver_count();
   int rank = Caffe::solver_rank();
   bool keep = (offset_ % size) == rank ||
               // In test mode, only rank 0 runs, so avoid skipping
-              this->layer_param_.phase() == TEST;
+              (this->layer_param_.phase() == TEST &&
+               !this->layer_param_.data_param().partition_test());
   return !keep;
 }
 
@@ -77,6 +99,32 @@ void DataLayer<Dtype>::Next() {
   offset_++;
 }
 
+template<typename Dtype>
+void DataLayer<Dtype>::Read(Datum* datum) {
+  const int buffer_size = this->layer_param_.data_param().shuffle_buffer();
+  // Fill up the buffer before drawing the first record
+  while (shuffle_buffer_.size() < buffer_size) {
+    while (Skip()) {
+      Next();
+    }
+    shuffle_buffer_.push_back(cursor_->value());
+    Next();
+  }
+  while (Skip()) {
+    Next();
+  }
+  if (buffer_size == 0) {
+    datum->ParseFromString(cursor_->value());
+  } else {
+    caffe::rng_t* shuffle_rng =
+        static_cast<caffe::rng_t*>(shuffle_rng_->generator());
+    string& slot = shuffle_buffer_[(*shuffle_rng)() % buffer_size];
+    datum->ParseFromString(slot);
+    slot = cursor_->value();
+  }
+  Next();
+}
+
 // This function is called on prefetch thread
 template<typename Dtype>
 void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
@@ -92,10 +140,7 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   Datum datum;
   for (int item_id = 0; item_id < batch_size; ++item_id) {
     timer.Start();
-    while (Skip()) {
-      Next();
-    }
-    datum.ParseFromString(cursor_->value());
+    Read(&datum);
     read_time += timer.MicroSeconds();
 
     if (item_id == 0) {
@@ -121,7 +166,6 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       top_label[item_id] = datum.label();
     }
     trans_time += timer.MicroSeconds();
-    Next();
   }
   timer.Stop();
   batch_timer.Stop();
@@ -130,6 +174,23 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
 }
 
+uint64_t PartitionedReadPosition(uint64_t index, int rank, int count,
+    uint64_t num_records) {
+  CHECK_GE(rank, 0);
+  CHECK_LT(rank, count);
+  if (count == 1) {
+    return index;
+  }
+  if (num_records < count) {
+    // Unpartitioned, Skip keeps the records at offsets rank, rank + count...
+    return rank + index * count;
+  }
+  // The bounds of Cursor::Partition
+  const uint64_t begin = num_records * rank / count;
+  const uint64_t size = num_records * (rank + 1) / count - begin;
+  return begin + index % size + index / size * num_records;
+}
+
 INSTANTIATE_CLASS(DataLayer);
 REGISTER_LAYER_CLASS(Data);
 
@@ -43,6 +43,33 @@ void EltwiseLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+LayerCost EltwiseLayer<Dtype>::Cost(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) const {
+  LayerCost cost = Layer<Dtype>::Cost(bottom, top);
+  const double count = top[0]->count();
+  const double inputs = bottom.size();
+  switch (op_) {
+  case EltwiseParameter_EltwiseOp_PROD:
+    // Backward divides the product by each input
+    cost.forward_flops = (inputs - 1) * count;
+    cost.backward_flops = 2 * inputs * count;
+    break;
+  case EltwiseParameter_EltwiseOp_SUM:
+    // An axpy per input, and a scale of the gradient
+    cost.forward_flops = 2 * inputs * count;
+    cost.backward_flops = inputs * count;
+    break;
+  case EltwiseParameter_EltwiseOp_MAX:
+    cost.forward_flops = (inputs - 1) * count;
+    cost.backward_flops = inputs * count;
+    break;
+  default:
+    LOG(FATAL) << "Unknown elementwise operation.";
+  }
+  return cost;
+}
+
 template <typename Dtype>
 void EltwiseLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
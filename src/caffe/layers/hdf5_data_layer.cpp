@@ -1,13 +1,10 @@
-/*
-TODO:
-- load file in a separate thread ("prefetch")
-- can be smarter about the memcpy call instead of doing it row-by-row
-  :: use util functions caffe_copy, and Blob->offset()
-  :: don't forget to update hdf5_daa_layer.cu accordingly
-- add ability to shuffle filenames if flag is set
-*/
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "hdf5.h"
@@ -16,16 +13,108 @@ TODO:
 
 #include "caffe/layers/hdf5_data_layer.hpp"
 #include "caffe/util/hdf5.hpp"
+#include "caffe/util/profiler.hpp"
+#include "caffe/util/rng.hpp"
 
 namespace caffe {
 
 template <typename Dtype>
-HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() { }
+HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() {
+  this->StopInternalThread();
+}
+
+// Load the rows of the next chunk from its HDF5 file into the chunk blobs.
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::LoadChunk(HDF5Chunk<Dtype>* chunk) {
+  const HDF5DataParameter& hdf5_data_param =
+      this->layer_param_.hdf5_data_param();
+  if (chunk_id_ == chunk_order_.size()) {
+    chunk_id_ = 0;
+    if (hdf5_data_param.shuffle()) {
+      shuffle(chunk_order_.begin(), chunk_order_.end());
+    }
+    DLOG(INFO) << "Looping around to first chunk.";
+    if (read_ahead_) {
+      LOG_IF(INFO, Caffe::root_solver()) << this->layer_param_.name()
+          << ": " << read_ahead_->Summary();
+    }
+  }
+  if (read_ahead_) {
+    ReadAheadChunk(hdf5_data_param.read_ahead());
+  }
+  const int id = chunk_order_[chunk_id_++];
+  if (chunk->id_ == id) {
+    // Still in memory, e.g. the only chunk of a single file
+    if (hdf5_data_param.shuffle()) {
+      ShuffleRows(chunk);
+    }
+    return;
+  }
+
+  const char* filename = hdf_filenames_[chunk_files_[id]].c_str();
+  if (hdf5_data_param.chunk_size() == 0) {
+    LoadHDF5FileData(filename);
+    // The blobs the chunk held are free, and hold the next file
+    chunk->blobs_.swap(hdf_blobs_);
+    chunk->id_ = id;
+    if (hdf5_data_param.shuffle()) {
+      ShuffleRows(chunk);
+    }
+    return;
+  }
+  DLOG(INFO) << "Loading rows of HDF5 file: " << filename;
+  int top_size = this->layer_param_.top_size();
+  chunk->blobs_.resize(top_size);
+  for (int i = 0; i < top_size; ++i) {
+    if (!chunk->blobs_[i]) {
+      chunk->blobs_[i].reset(new Blob<Dtype>());
+    }
+  }
+  hsize_t rows;
+  {
+    HDF5Lock lock;
+    hid_t file_id = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (file_id < 0) {
+      LOG(FATAL) << "Failed opening HDF5 file: " << filename;
+    }
+
+    const int MIN_DATA_DIM = 1;
+    const int MAX_DATA_DIM = INT_MAX;
+
+    // MinTopBlobs==1 guarantees at least one top blob
+    const vector<int> shape =
+        hdf5_get_dataset_shape(file_id, this->layer_param_.top(0));
+    CHECK_GE(shape.size(), 1) << "Input must have at least 1 axis.";
+    const hsize_t start = chunk_starts_[id];
+    rows = std::min<hsize_t>(hdf5_data_param.chunk_size(), shape[0] - start);
+    for (int i = 0; i < top_size; ++i) {
+      if (i > 0) {
+        CHECK_EQ(hdf5_get_dataset_shape(file_id,
+            this->layer_param_.top(i))[0], shape[0]);
+      }
+      hdf5_load_nd_dataset_rows(file_id, this->layer_param_.top(i).c_str(),
+          MIN_DATA_DIM, MAX_DATA_DIM, start, rows, chunk->blobs_[i].get());
+    }
+
+    herr_t status = H5Fclose(file_id);
+    CHECK_GE(status, 0) << "Failed to close HDF5 file: " << filename;
+  }
+  chunk->id_ = id;
+
+  // Shuffle if needed.
+  if (hdf5_data_param.shuffle()) {
+    ShuffleRows(chunk);
+    DLOG(INFO) << "Successfully loaded " << rows << " rows (shuffled)";
+  } else {
+    DLOG(INFO) << "Successfully loaded " << rows << " rows";
+  }
+}
 
 // Load data and label from HDF5 filename into the class property blobs.
 template <typename Dtype>
 void HDF5DataLayer<Dtype>::LoadHDF5FileData(const char* filename) {
   DLOG(INFO) << "Loading HDF5 file: " << filename;
+  HDF5Lock lock;
   hid_t file_id = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
   if (file_id < 0) {
     LOG(FATAL) << "Failed opening HDF5 file: " << filename;
@@ -38,7 +127,9 @@ void HDF5DataLayer<Dtype>::LoadHDF5FileData(const char* filename) {
   const int MAX_DATA_DIM = INT_MAX;
 
   for (int i = 0; i < top_size; ++i) {
-    hdf_blobs_[i] = shared_ptr<Blob<Dtype> >(new Blob<Dtype>());
+    if (!hdf_blobs_[i]) {
+      hdf_blobs_[i].reset(new Blob<Dtype>());
+    }
     // Allow reshape here, as we are loading data not params
     hdf5_load_nd_dataset(file_id, this->layer_param_.top(i).c_str(),
         MIN_DATA_DIM, MAX_DATA_DIM, hdf_blobs_[i].get(), true);
@@ -53,19 +144,31 @@ void HDF5DataLayer<Dtype>::LoadHDF5FileData(const char* filename) {
   for (int i = 1; i < top_size; ++i) {
     CHECK_EQ(hdf_blobs_[i]->shape(0), num);
   }
-  // Default to identity permutation.
-  data_permutation_.clear();
-  data_permutation_.resize(hdf_blobs_[0]->shape(0));
-  for (int i = 0; i < hdf_blobs_[0]->shape(0); i++)
-    data_permutation_[i] = i;
+  DLOG(INFO) << "Successfully loaded " << num << " rows";
+}
 
-  // Shuffle if needed.
-  if (this->layer_param_.hdf5_data_param().shuffle()) {
-    std::random_shuffle(data_permutation_.begin(), data_permutation_.end());
-    DLOG(INFO) << "Successfully loaded " << hdf_blobs_[0]->shape(0)
-               << " rows (shuffled)";
-  } else {
-    DLOG(INFO) << "Successfully loaded " << hdf_blobs_[0]->shape(0) << " rows";
+// Permutes the rows of the chunk in memory, so that Forward copies them in
+// runs rather than one by one.
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::ShuffleRows(HDF5Chunk<Dtype>* chunk) {
+  const int rows = chunk->blobs_[0]->shape(0);
+  vector<int> permutation(rows);
+  for (int i = 0; i < rows; ++i) {
+    permutation[i] = i;
+  }
+  shuffle(permutation.begin(), permutation.end());
+  Blob<Dtype> rows_copy;
+  for (int i = 0; i < chunk->blobs_.size(); ++i) {
+    Blob<Dtype>* blob = chunk->blobs_[i].get();
+    const int data_dim = blob->count(1);
+    rows_copy.ReshapeLike(*blob);
+    caffe_copy(blob->count(), blob->cpu_data(),
+        rows_copy.mutable_cpu_data());
+    Dtype* data = blob->mutable_cpu_data();
+    for (int j = 0; j < rows; ++j) {
+      caffe_copy(data_dim, rows_copy.cpu_data() + permutation[j] * data_dim,
+          data + j * data_dim);
+    }
   }
 }
 
@@ -75,8 +178,10 @@ void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // Refuse transformation parameters since HDF5 is totally generic.
   CHECK(!this->layer_param_.has_transform_param()) <<
       this->type() << " does not transform data.";
+  const HDF5DataParameter& hdf5_data_param =
+      this->layer_param_.hdf5_data_param();
   // Read the source to parse the filenames.
-  const string& source = this->layer_param_.hdf5_data_param().source();
+  const string& source = hdf5_data_param.source();
   LOG(INFO) << "Loading list of HDF5 filenames from: " << source;
   hdf_filenames_.clear();
   std::ifstream source_file(source.c_str());
@@ -90,41 +195,162 @@ void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
   source_file.close();
   num_files_ = hdf_filenames_.size();
-  current_file_ = 0;
   LOG(INFO) << "Number of HDF5 files: " << num_files_;
   CHECK_GE(num_files_, 1) << "Must have at least 1 HDF5 filename listed in "
     << source;
 
-  file_permutation_.clear();
-  file_permutation_.resize(num_files_);
+  // Split the files in chunks, which only needs their number of rows.
+  const hsize_t chunk_size = hdf5_data_param.chunk_size();
+  chunk_files_.clear();
+  chunk_starts_.clear();
+  for (unsigned int i = 0; i < num_files_; ++i) {
+    hsize_t rows = 1;
+    if (chunk_size > 0) {
+      const char* filename = hdf_filenames_[i].c_str();
+      HDF5Lock lock;
+      hid_t file_id = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+      if (file_id < 0) {
+        LOG(FATAL) << "Failed opening HDF5 file: " << filename;
+      }
+      const vector<int> shape =
+          hdf5_get_dataset_shape(file_id, this->layer_param_.top(0));
+      CHECK_GE(shape.size(), 1) << "Input must have at least 1 axis.";
+      rows = shape[0];
+      herr_t status = H5Fclose(file_id);
+      CHECK_GE(status, 0) << "Failed to close HDF5 file: " << filename;
+    }
+    for (hsize_t start = 0; start < rows;
+         start += std::max<hsize_t>(chunk_size, 1)) {
+      chunk_files_.push_back(i);
+      chunk_starts_.push_back(start);
+    }
+  }
+  CHECK_GT(chunk_files_.size(), 0) << "No data in the files of " << source;
+  LOG_IF(INFO, chunk_size > 0) << "Number of chunks: " << chunk_files_.size();
+
+  chunk_order_.clear();
+  chunk_order_.resize(chunk_files_.size());
   // Default to identity permutation.
-  for (int i = 0; i < num_files_; i++) {
-    file_permutation_[i] = i;
+  for (int i = 0; i < chunk_order_.size(); i++) {
+    chunk_order_[i] = i;
   }
 
   // Shuffle if needed.
-  if (this->layer_param_.hdf5_data_param().shuffle()) {
-    std::random_shuffle(file_permutation_.begin(), file_permutation_.end());
+  if (hdf5_data_param.shuffle()) {
+    shuffle(chunk_order_.begin(), chunk_order_.end());
   }
+  chunk_id_ = 0;
 
-  // Load the first HDF5 file and initialize the line counter.
-  LoadHDF5FileData(hdf_filenames_[file_permutation_[current_file_]].c_str());
-  current_row_ = 0;
+  // Start fetching the chunks after the first in the background.
+  const int read_ahead = hdf5_data_param.read_ahead();
+  if (read_ahead > 0 && chunk_order_.size() > 1) {
+    read_ahead_.reset(new ReadAhead(hdf5_data_param.read_ahead_threads(),
+        read_ahead));
+    for (int i = 1; i < read_ahead; ++i) {
+      ReadAheadChunk(i);
+    }
+  }
+
+  // Load the first chunk, and the next ones in the background if needed.
+  const int prefetch = hdf5_data_param.prefetch();
+  chunks_.resize(prefetch + 1);
+  for (int i = 0; i < chunks_.size(); ++i) {
+    chunks_[i].reset(new HDF5Chunk<Dtype>());
+  }
+  current_chunk_ = chunks_[0].get();
+  if (prefetch > 0) {
+    for (int i = 0; i < chunks_.size(); ++i) {
+      chunk_free_.push(chunks_[i].get());
+    }
+    current_chunk_ = NULL;
+    StartInternalThread();
+  }
+  NextChunk();
 
   // Reshape blobs.
-  const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
+  const int batch_size = hdf5_data_param.batch_size();
   const int top_size = this->layer_param_.top_size();
   vector<int> top_shape;
   for (int i = 0; i < top_size; ++i) {
-    top_shape.resize(hdf_blobs_[i]->num_axes());
+    top_shape = current_chunk_->blobs_[i]->shape();
     top_shape[0] = batch_size;
-    for (int j = 1; j < top_shape.size(); ++j) {
-      top_shape[j] = hdf_blobs_[i]->shape(j);
-    }
     top[i]->Reshape(top_shape);
   }
 }
 
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      HDF5Chunk<Dtype>* chunk = chunk_free_.pop();
+      LoadChunk(chunk);
+      chunk_full_.push(chunk);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::NextChunk() {
+  ProfileScope profile("data", this->layer_param_.name());
+  if (this->layer_param_.hdf5_data_param().prefetch() > 0) {
+    if (current_chunk_) {
+      chunk_free_.push(current_chunk_);
+    }
+    current_chunk_ = chunk_full_.pop("Waiting for HDF5 data");
+  } else {
+    LoadChunk(current_chunk_);
+  }
+  current_row_ = 0;
+}
+
+// Reads the parts of an HDF5 file in which rows [start, start + rows) of the
+// datasets are stored, and drops them, bringing them into the page cache.
+// Only finding the parts holds the HDF5 lock: reading them, the slow part,
+// does not, so that the layer and other HDF5 users go on meanwhile. Returns
+// the bytes read, or -1 if the file can't be opened.
+static int64_t ReadAheadRows(const string& filename,
+    const vector<string>& datasets, hsize_t start, hsize_t rows) {
+  vector<pair<int64_t, int64_t> > ranges;
+  bool found = true;
+  {
+    HDF5Lock lock;
+    hid_t file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (file_id < 0) {
+      // The layer reports missing files when it reads them
+      return -1;
+    }
+    for (int i = 0; i < datasets.size() && found; ++i) {
+      found = hdf5_get_rows_extents(file_id, datasets[i], start, rows,
+          &ranges);
+    }
+    H5Fclose(file_id);
+  }
+  return found ? ReadAhead::ReadRanges(filename, ranges) :
+      ReadAhead::ReadFile(filename);
+}
+
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::ReadAheadChunk(int ahead) {
+  // Chunks of the next epoch are guessed from the current order, which may
+  // be shuffled again by then.
+  const int num_chunks = chunk_order_.size();
+  const int id = chunk_order_[(chunk_id_ + ahead) % num_chunks];
+  const string& filename = hdf_filenames_[chunk_files_[id]];
+  const hsize_t chunk_size =
+      this->layer_param_.hdf5_data_param().chunk_size();
+  if (chunk_size == 0) {
+    // The chunk is the whole file
+    read_ahead_->Fetch(filename);
+    return;
+  }
+  const vector<string> datasets(this->layer_param_.top().begin(),
+      this->layer_param_.top().end());
+  read_ahead_->Fetch(boost::bind(&ReadAheadRows, filename, datasets,
+      chunk_starts_[id], chunk_size));
+}
+
 template <typename Dtype>
 bool HDF5DataLayer<Dtype>::Skip() {
   int size = Caffe::solver_count();
@@ -136,43 +362,41 @@ bool HDF5DataLayer<Dtype>::Skip() {
 }
 
 template<typename Dtype>
-void HDF5DataLayer<Dtype>::Next() {
-  if (++current_row_ == hdf_blobs_[0]->shape(0)) {
-    if (num_files_ > 1) {
-      ++current_file_;
-      if (current_file_ == num_files_) {
-        current_file_ = 0;
-        if (this->layer_param_.hdf5_data_param().shuffle()) {
-          std::random_shuffle(file_permutation_.begin(),
-                              file_permutation_.end());
-        }
-        DLOG(INFO) << "Looping around to first file.";
-      }
-      LoadHDF5FileData(
-        hdf_filenames_[file_permutation_[current_file_]].c_str());
-    }
-    current_row_ = 0;
-    if (this->layer_param_.hdf5_data_param().shuffle())
-      std::random_shuffle(data_permutation_.begin(), data_permutation_.end());
+void HDF5DataLayer<Dtype>::Next(int rows) {
+  current_row_ += rows;
+  offset_ += rows;
+  if (current_row_ == current_chunk_->blobs_[0]->shape(0)) {
+    NextChunk();
+  }
+}
+
+template <typename Dtype>
+int HDF5DataLayer<Dtype>::NextRows(int max_rows) {
+  while (Skip()) {
+    Next();
+  }
+  // The rows of several solvers are interleaved one by one
+  if (Caffe::solver_count() > 1 && this->layer_param_.phase() != TEST) {
+    return 1;
   }
-  offset_++;
+  return std::min<hsize_t>(max_rows,
+      current_chunk_->blobs_[0]->shape(0) - current_row_);
 }
 
 template <typename Dtype>
 void HDF5DataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
-  for (int i = 0; i < batch_size; ++i) {
-    while (Skip()) {
-      Next();
-    }
+  for (int i = 0; i < batch_size; ) {
+    const int rows = NextRows(batch_size - i);
     for (int j = 0; j < this->layer_param_.top_size(); ++j) {
       int data_dim = top[j]->count() / top[j]->shape(0);
-      caffe_copy(data_dim,
-          &hdf_blobs_[j]->cpu_data()[data_permutation_[current_row_]
-            * data_dim], &top[j]->mutable_cpu_data()[i * data_dim]);
+      caffe_copy(rows * data_dim,
+          &current_chunk_->blobs_[j]->cpu_data()[current_row_ * data_dim],
+          &top[j]->mutable_cpu_data()[i * data_dim]);
     }
-    Next();
+    i += rows;
+    Next(rows);
   }
 }
 
@@ -1,3 +1,7 @@
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <string>
 #include <vector>
 
 #include "hdf5.h"
@@ -11,27 +15,141 @@ namespace caffe {
 template <typename Dtype>
 void HDF5OutputLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  file_name_ = this->layer_param_.hdf5_output_param().file_name();
+  const HDF5OutputParameter& hdf5_output_param =
+      this->layer_param_.hdf5_output_param();
+  file_name_ = hdf5_output_param.file_name();
+  HDF5Lock lock;
   file_id_ = H5Fcreate(file_name_.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
                        H5P_DEFAULT);
   CHECK_GE(file_id_, 0) << "Failed to open HDF5 file" << file_name_;
   file_opened_ = true;
+  if (hdf5_output_param.buffer_batches() == 0) {
+    return;
+  }
+
+  // Buffer whole batches, and write them to datasets that grow as needed.
+  const int rows = hdf5_output_param.buffer_batches() * bottom[0]->shape(0);
+  buffers_.resize(hdf5_output_param.async() ? 2 : 1);
+  for (int i = 0; i < buffers_.size(); ++i) {
+    buffers_[i].reset(new HDF5OutputBuffer<Dtype>());
+    vector<int> shape = bottom[0]->shape();
+    shape[0] = rows;
+    buffers_[i]->data_.Reshape(shape);
+    shape = bottom[1]->shape();
+    shape[0] = rows;
+    buffers_[i]->label_.Reshape(shape);
+  }
+  for (int i = 0; i < 2; ++i) {
+    const string name = i == 0 ? HDF5_DATA_DATASET_NAME : HDF5_DATA_LABEL_NAME;
+    const vector<int> row_shape(bottom[i]->shape().begin() + 1,
+        bottom[i]->shape().end());
+    // Chunks of about 1 MB fit the default chunk cache of the readers.
+    const int row_size = std::max(bottom[i]->count(1), 1);
+    const int chunk_rows = std::max(1, std::min<int>(rows,
+        (1 << 20) / (row_size * sizeof(Dtype))));
+    hdf5_create_extendible_dataset<Dtype>(file_id_, name, row_shape,
+        chunk_rows, hdf5_output_param.compression());
+  }
+  current_buffer_ = buffers_[0].get();
+  if (hdf5_output_param.async()) {
+    for (int i = 1; i < buffers_.size(); ++i) {
+      buffer_free_.push(buffers_[i].get());
+    }
+    StartInternalThread();
+  }
 }
 
 template <typename Dtype>
 HDF5OutputLayer<Dtype>::~HDF5OutputLayer<Dtype>() {
+  if (current_buffer_) {
+    if (current_buffer_->rows_ > 0) {
+      FlushBuffer();
+    }
+    if (is_started()) {
+      // Wait for the buffers being written
+      for (int i = 1; i < buffers_.size(); ++i) {
+        buffer_free_.pop();
+      }
+      StopInternalThread();
+    }
+  }
   if (file_opened_) {
+    HDF5Lock lock;
     herr_t status = H5Fclose(file_id_);
     CHECK_GE(status, 0) << "Failed to close HDF5 file " << file_name_;
   }
 }
 
+template <typename Dtype>
+void HDF5OutputLayer<Dtype>::BufferBatch(const vector<Blob<Dtype>*>& bottom,
+    const Dtype* data, const Dtype* label) {
+  const int num = bottom[0]->shape(0);
+  const int data_dim = current_buffer_->data_.count(1);
+  const int label_dim = current_buffer_->label_.count(1);
+  CHECK_EQ(bottom[0]->count(1), data_dim)
+      << "data rows must keep the same size";
+  CHECK_EQ(bottom[1]->count(1), label_dim)
+      << "label rows must keep the same size";
+  CHECK_LE(num, current_buffer_->data_.shape(0))
+      << "batch is larger than the buffer";
+  if (current_buffer_->rows_ + num > current_buffer_->data_.shape(0)) {
+    FlushBuffer();
+  }
+  HDF5OutputBuffer<Dtype>* buffer = current_buffer_;
+  caffe_copy(num * data_dim, data,
+      buffer->data_.mutable_cpu_data() + buffer->rows_ * data_dim);
+  caffe_copy(num * label_dim, label,
+      buffer->label_.mutable_cpu_data() + buffer->rows_ * label_dim);
+  buffer->rows_ += num;
+  if (buffer->rows_ == buffer->data_.shape(0)) {
+    FlushBuffer();
+  }
+}
+
+template <typename Dtype>
+void HDF5OutputLayer<Dtype>::FlushBuffer() {
+  if (is_started()) {
+    buffer_full_.push(current_buffer_);
+    current_buffer_ = buffer_free_.pop("Waiting for HDF5 output to be written");
+  } else {
+    WriteBuffer(current_buffer_);
+  }
+}
+
+template <typename Dtype>
+void HDF5OutputLayer<Dtype>::WriteBuffer(HDF5OutputBuffer<Dtype>* buffer) {
+  DLOG(INFO) << "Appending " << buffer->rows_ << " rows to HDF5 file "
+      << file_name_;
+  // Also taken by the helpers, but this keeps both appends together while
+  // other threads read or write their own files
+  HDF5Lock lock;
+  hdf5_append_nd_dataset(file_id_, HDF5_DATA_DATASET_NAME, buffer->data_,
+      buffer->rows_);
+  hdf5_append_nd_dataset(file_id_, HDF5_DATA_LABEL_NAME, buffer->label_,
+      buffer->rows_);
+  buffer->rows_ = 0;
+}
+
+template <typename Dtype>
+void HDF5OutputLayer<Dtype>::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      HDF5OutputBuffer<Dtype>* buffer = buffer_full_.pop();
+      WriteBuffer(buffer);
+      buffer_free_.push(buffer);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
 template <typename Dtype>
 void HDF5OutputLayer<Dtype>::SaveBlobs() {
   // TODO: no limit on the number of blobs
   LOG(INFO) << "Saving HDF5 file " << file_name_;
   CHECK_EQ(data_blob_.num(), label_blob_.num()) <<
       "data blob and label blob must have the same batch size";
+  HDF5Lock lock;
   hdf5_save_nd_dataset(file_id_, HDF5_DATA_DATASET_NAME, data_blob_);
   hdf5_save_nd_dataset(file_id_, HDF5_DATA_LABEL_NAME, label_blob_);
   LOG(INFO) << "Successfully saved " << data_blob_.num() << " rows";
@@ -42,6 +160,10 @@ void HDF5OutputLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   CHECK_GE(bottom.size(), 2);
   CHECK_EQ(bottom[0]->num(), bottom[1]->num());
+  if (current_buffer_) {
+    BufferBatch(bottom, bottom[0]->cpu_data(), bottom[1]->cpu_data());
+    return;
+  }
   data_blob_.Reshape(bottom[0]->num(), bottom[0]->channels(),
                      bottom[0]->height(), bottom[0]->width());
   label_blob_.Reshape(bottom[1]->num(), bottom[1]->channels(),
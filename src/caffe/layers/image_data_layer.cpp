@@ -1,8 +1,14 @@
 #ifdef USE_OPENCV
 #include <opencv2/core/core.hpp>
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
 #include <iostream>  // NOLINT(readability/streams)
+#include <numeric>
+#include <sstream>
 #include <string>
 #include <utility>
 #include <vector>
@@ -27,8 +33,6 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const int new_height = this->layer_param_.image_data_param().new_height();
   const int new_width  = this->layer_param_.image_data_param().new_width();
-  const bool is_color  = this->layer_param_.image_data_param().is_color();
-  string root_folder = this->layer_param_.image_data_param().root_folder();
 
   CHECK((new_height == 0 && new_width == 0) ||
       (new_height > 0 && new_width > 0)) << "Current implementation requires "
@@ -62,6 +66,37 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
   LOG(INFO) << "A total of " << lines_.size() << " images.";
 
+  if (this->layer_param_.image_data_param().has_cache_file()) {
+    string cache_file = this->layer_param_.image_data_param().cache_file();
+    if (Caffe::solver_count() > 1) {
+      std::ostringstream rank;
+      rank << "." << Caffe::solver_rank();
+      cache_file += rank.str();
+    }
+    const uint64_t cache_size = static_cast<uint64_t>(
+        this->layer_param_.image_data_param().cache_size_mb()) << 20;
+    cache_.reset(new ImageCache(cache_file, cache_size));
+    cache_mutex_.reset(new boost::mutex());
+  }
+  const int threads = this->layer_param_.image_data_param().threads();
+  CHECK_GT(threads, 0) << "At least one thread is required";
+  workers_.reset(new WorkerPool(threads));
+  for (int i = 1; i < threads; ++i) {
+    // Each worker draws its crops and mirrors from a stream of its own
+    shared_ptr<DataTransformer<Dtype> > transformer(
+        new DataTransformer<Dtype>(this->transform_param_, this->phase_));
+    transformer->InitRand();
+    worker_transformers_.push_back(transformer);
+    worker_transformed_data_.push_back(
+        shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
+  if (this->layer_param_.image_data_param().read_ahead() > 0) {
+    read_ahead_.reset(new ReadAhead(
+        this->layer_param_.image_data_param().read_ahead_threads(),
+        this->layer_param_.image_data_param().read_ahead() *
+        this->layer_param_.image_data_param().batch_size()));
+  }
+
   lines_id_ = 0;
   // Check if we would need to randomly skip a few data points
   if (this->layer_param_.image_data_param().rand_skip()) {
@@ -71,10 +106,9 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
     CHECK_GT(lines_.size(), skip) << "Not enough points to skip";
     lines_id_ = skip;
   }
+  read_ahead_id_ = lines_id_;
   // Read an image, and use it to initialize the top blob.
-  cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-                                    new_height, new_width, is_color);
-  CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
+  cv::Mat cv_img = ReadImage(lines_id_);
   // Use data_transformer to infer the expected blob shape from a cv_image.
   vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_img);
   this->transformed_data_.Reshape(top_shape);
@@ -105,31 +139,93 @@ void ImageDataLayer<Dtype>::ShuffleImages() {
   shuffle(lines_.begin(), lines_.end(), prefetch_rng);
 }
 
+template <typename Dtype>
+string ImageDataLayer<Dtype>::CacheKey(int line_id) const {
+  const ImageDataParameter& image_data_param =
+      this->layer_param_.image_data_param();
+  // The same file read at another size or in gray is another image
+  std::ostringstream key;
+  key << image_data_param.root_folder() << lines_[line_id].first << "|"
+      << image_data_param.new_height() << "x" << image_data_param.new_width()
+      << "|" << (image_data_param.is_color() ? "color" : "gray");
+  return key.str();
+}
+
+template <typename Dtype>
+void ImageDataLayer<Dtype>::ReadAheadLines() {
+  const ImageDataParameter& image_data_param =
+      this->layer_param_.image_data_param();
+  // Only up to the end of the epoch, as the next one may be shuffled again
+  const int end = std::min<int>(lines_.size(), lines_id_ +
+      image_data_param.read_ahead() * image_data_param.batch_size());
+  for (read_ahead_id_ = std::max(read_ahead_id_, lines_id_);
+       read_ahead_id_ < end; ++read_ahead_id_) {
+    if (cache_) {
+      CachedImage cached;
+      boost::mutex::scoped_lock lock(*cache_mutex_);
+      if (cache_->Lookup(CacheKey(read_ahead_id_), &cached)) {
+        continue;
+      }
+    }
+    read_ahead_->Fetch(image_data_param.root_folder() +
+        lines_[read_ahead_id_].first);
+  }
+}
+
+template <typename Dtype>
+cv::Mat ImageDataLayer<Dtype>::ReadImage(int line_id) {
+  const ImageDataParameter& image_data_param =
+      this->layer_param_.image_data_param();
+  const int new_height = image_data_param.new_height();
+  const int new_width = image_data_param.new_width();
+  const bool is_color = image_data_param.is_color();
+  const string filename = image_data_param.root_folder() +
+      lines_[line_id].first;
+  if (!cache_) {
+    cv::Mat cv_img = ReadImageToCVMat(filename, new_height, new_width,
+        is_color);
+    CHECK(cv_img.data) << "Could not load " << lines_[line_id].first;
+    return cv_img;
+  }
+  const string key = CacheKey(line_id);
+  CachedImage cached;
+  boost::mutex::scoped_lock lock(*cache_mutex_);
+  if (!cache_->Lookup(key, &cached)) {
+    lock.unlock();
+    cv::Mat cv_img = ReadImageToCVMat(filename, new_height, new_width,
+        is_color);
+    CHECK(cv_img.data) << "Could not load " << lines_[line_id].first;
+    CHECK_EQ(cv_img.depth(), CV_8U) << "Image data type must be unsigned byte";
+    CHECK(cv_img.isContinuous());
+    lock.lock();
+    cache_->Insert(key, cv_img.rows, cv_img.cols, cv_img.channels(),
+        cv_img.data);
+    return cv_img;
+  }
+  // A view of the mapping, which cached images are never evicted from
+  return cv::Mat(cached.rows, cached.cols, CV_8UC(cached.channels),
+      const_cast<uint8_t*>(cached.data));
+}
+
 // This function is called on prefetch thread
 template <typename Dtype>
 void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   CPUTimer batch_timer;
   batch_timer.Start();
-  double read_time = 0;
-  double trans_time = 0;
-  CPUTimer timer;
   CHECK(batch->data_.count());
   CHECK(this->transformed_data_.count());
   ImageDataParameter image_data_param = this->layer_param_.image_data_param();
   const int batch_size = image_data_param.batch_size();
-  const int new_height = image_data_param.new_height();
-  const int new_width = image_data_param.new_width();
-  const bool is_color = image_data_param.is_color();
-  string root_folder = image_data_param.root_folder();
 
   // Reshape according to the first image of each batch
   // on single input batches allows for inputs of varying dimension.
-  cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-      new_height, new_width, is_color);
-  CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
+  cv::Mat cv_img = ReadImage(lines_id_);
   // Use data_transformer to infer the expected blob shape from a cv_img.
   vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_img);
   this->transformed_data_.Reshape(top_shape);
+  for (int i = 0; i < worker_transformed_data_.size(); ++i) {
+    worker_transformed_data_[i]->Reshape(top_shape);
+  }
   // Reshape batch according to the batch_size.
   top_shape[0] = batch_size;
   batch->data_.Reshape(top_shape);
@@ -137,23 +233,13 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   Dtype* prefetch_data = batch->data_.mutable_cpu_data();
   Dtype* prefetch_label = batch->label_.mutable_cpu_data();
 
-  // datum scales
+  // Take the lines of the whole batch first, so that the workers only
+  // read and transform them
+  vector<int> batch_lines(batch_size);
   const int lines_size = lines_.size();
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    // get a blob
-    timer.Start();
     CHECK_GT(lines_size, lines_id_);
-    cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-        new_height, new_width, is_color);
-    CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
-    read_time += timer.MicroSeconds();
-    timer.Start();
-    // Apply transformations (mirror, crop...) to the image
-    int offset = batch->data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(prefetch_data + offset);
-    this->data_transformer_->Transform(cv_img, &(this->transformed_data_));
-    trans_time += timer.MicroSeconds();
-
+    batch_lines[item_id] = lines_id_;
     prefetch_label[item_id] = lines_[lines_id_].second;
     // go to the next iter
     lines_id_++;
@@ -161,15 +247,59 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       // We have reached the end. Restart from the first.
       DLOG(INFO) << "Restarting data prefetching from start.";
       lines_id_ = 0;
+      if (read_ahead_) {
+        read_ahead_id_ = 0;
+        LOG_IF(INFO, Caffe::root_solver()) << this->layer_param_.name()
+            << ": " << read_ahead_->Summary();
+      }
       if (this->layer_param_.image_data_param().shuffle()) {
         ShuffleImages();
       }
     }
   }
+  if (read_ahead_) {
+    ReadAheadLines();
+  }
+  vector<double> read_time(workers_->size(), 0);
+  vector<double> trans_time(workers_->size(), 0);
+  workers_->Run(boost::bind(&ImageDataLayer<Dtype>::LoadItems, this, batch,
+      prefetch_data, boost::cref(batch_lines), _1, &read_time, &trans_time));
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
-  DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
-  DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  DLOG(INFO) << "     Read time: "
+      << std::accumulate(read_time.begin(), read_time.end(), 0.) / 1000
+      << " ms.";
+  DLOG(INFO) << "Transform time: "
+      << std::accumulate(trans_time.begin(), trans_time.end(), 0.) / 1000
+      << " ms.";
+}
+
+// This function is called on the workers, which take every
+// workers_->size()-th item of the batch.
+template <typename Dtype>
+void ImageDataLayer<Dtype>::LoadItems(Batch<Dtype>* batch,
+    Dtype* prefetch_data, const vector<int>& batch_lines, int worker,
+    vector<double>* read_time, vector<double>* trans_time) {
+  DataTransformer<Dtype>* transformer = this->data_transformer_.get();
+  Blob<Dtype>* transformed_data = &this->transformed_data_;
+  if (worker > 0) {
+    transformer = worker_transformers_[worker - 1].get();
+    transformed_data = worker_transformed_data_[worker - 1].get();
+  }
+  CPUTimer timer;
+  for (int item_id = worker; item_id < batch_lines.size();
+       item_id += workers_->size()) {
+    // get a blob
+    timer.Start();
+    cv::Mat cv_img = ReadImage(batch_lines[item_id]);
+    (*read_time)[worker] += timer.MicroSeconds();
+    timer.Start();
+    // Apply transformations (mirror, crop...) to the image
+    int offset = batch->data_.offset(item_id);
+    transformed_data->set_cpu_data(prefetch_data + offset);
+    transformer->Transform(cv_img, transformed_data);
+    (*trans_time)[worker] += timer.MicroSeconds();
+  }
 }
 
 INSTANTIATE_CLASS(ImageDataLayer);
@@ -80,6 +80,18 @@ void InnerProductLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+LayerCost InnerProductLayer<Dtype>::Cost(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) const {
+  const double gemm = 2. * M_ * K_ * N_;
+  const double bias = bias_term_ ? static_cast<double>(M_) * N_ : 0;
+  LayerCost cost = Layer<Dtype>::Cost(bottom, top);
+  cost.forward_flops = gemm + bias;
+  // The weight and the bottom gradients take a GEMM each
+  cost.backward_flops = 2 * gemm + bias;
+  return cost;
+}
+
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
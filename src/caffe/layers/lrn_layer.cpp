@@ -89,6 +89,29 @@ void LRNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+LayerCost LRNLayer<Dtype>::Cost(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) const {
+  LayerCost cost = Layer<Dtype>::Cost(bottom, top);
+  const double count = bottom[0]->count();
+  if (this->layer_param_.lrn_param().norm_region() ==
+      LRNParameter_NormRegion_ACROSS_CHANNELS) {
+    // The window sum slides across channels at two operations an element,
+    // besides the square, the scale and its power; the scale is kept for
+    // the backward pass.
+    cost.forward_flops = 6 * count;
+    cost.backward_flops = 10 * count;
+    cost.forward_bytes += sizeof(Dtype) * count;
+    cost.backward_bytes += sizeof(Dtype) * count;
+  } else {
+    // Average pooling of the squares, over size x size windows
+    const double window = static_cast<double>(size_) * size_;
+    cost.forward_flops = (window + 5) * count;
+    cost.backward_flops = (2 * window + 8) * count;
+  }
+  return cost;
+}
+
 template <typename Dtype>
 void LRNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
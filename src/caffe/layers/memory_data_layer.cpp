@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "caffe/layers/memory_data_layer.hpp"
+#include "caffe/util/profiler.hpp"
 
 namespace caffe {
 
@@ -28,6 +29,23 @@ void MemoryDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   labels_ = NULL;
   added_data_.cpu_data();
   added_label_.cpu_data();
+  // Allocate the streaming buffers up front, so that no batch allocates
+  const int buffers = this->layer_param_.memory_data_param().buffers();
+  for (int i = 0; i < buffers; ++i) {
+    shared_ptr<Batch<Dtype> > batch(new Batch<Dtype>());
+    batch->data_.Reshape(batch_size_, channels_, height_, width_);
+    batch->label_.Reshape(label_shape);
+    batch->data_.mutable_cpu_data();
+    batch->label_.mutable_cpu_data();
+    batches_.push_back(batch);
+    batch_free_.push(batch.get());
+    // At most one producer per buffer transforms at once
+    shared_ptr<DataTransformer<Dtype> > transformer(
+        new DataTransformer<Dtype>(this->transform_param_, this->phase_));
+    transformer->InitRand();
+    transformers_.push_back(transformer);
+    transformer_free_.push(transformer.get());
+  }
 }
 
 template <typename Dtype>
@@ -38,6 +56,24 @@ void MemoryDataLayer<Dtype>::AddDatumVector(const vector<Datum>& datum_vector) {
   CHECK_GT(num, 0) << "There is no datum to add.";
   CHECK_EQ(num % batch_size_, 0) <<
       "The added data must be a multiple of the batch size.";
+  if (!batches_.empty()) {
+    // Transform straight into free batches
+    Blob<Dtype> item(1, channels_, height_, width_);
+    for (int item_id = 0; item_id < num; item_id += batch_size_) {
+      Batch<Dtype>* batch = GetFreeBatch();
+      DataTransformer<Dtype>* transformer = transformer_free_.pop();
+      Dtype* top_label = batch->label_.mutable_cpu_data();
+      for (int i = 0; i < batch_size_; ++i) {
+        item.set_cpu_data(batch->data_.mutable_cpu_data()
+            + batch->data_.offset(i));
+        transformer->Transform(datum_vector[item_id + i], &item);
+        top_label[i] = datum_vector[item_id + i].label();
+      }
+      transformer_free_.push(transformer);
+      AddBatch(batch);
+    }
+    return;
+  }
   added_data_.Reshape(num, channels_, height_, width_);
   added_label_.Reshape(num, 1, 1, 1);
   // Apply data transformations (mirror, scale, crop...)
@@ -63,6 +99,24 @@ void MemoryDataLayer<Dtype>::AddMatVector(const vector<cv::Mat>& mat_vector,
   CHECK_GT(num, 0) << "There is no mat to add";
   CHECK_EQ(num % batch_size_, 0) <<
       "The added data must be a multiple of the batch size.";
+  if (!batches_.empty()) {
+    // Transform straight into free batches
+    Blob<Dtype> item(1, channels_, height_, width_);
+    for (int item_id = 0; item_id < num; item_id += batch_size_) {
+      Batch<Dtype>* batch = GetFreeBatch();
+      DataTransformer<Dtype>* transformer = transformer_free_.pop();
+      Dtype* top_label = batch->label_.mutable_cpu_data();
+      for (int i = 0; i < batch_size_; ++i) {
+        item.set_cpu_data(batch->data_.mutable_cpu_data()
+            + batch->data_.offset(i));
+        transformer->Transform(mat_vector[item_id + i], &item);
+        top_label[i] = labels[item_id + i];
+      }
+      transformer_free_.push(transformer);
+      AddBatch(batch);
+    }
+    return;
+  }
   added_data_.Reshape(num, channels_, height_, width_);
   added_label_.Reshape(num, 1, 1, 1);
   // Apply data transformations (mirror, scale, crop...)
@@ -83,6 +137,7 @@ template <typename Dtype>
 void MemoryDataLayer<Dtype>::Reset(Dtype* data, Dtype* labels, int n) {
   CHECK(data);
   CHECK(labels);
+  CHECK(batches_.empty()) << "Reset can't be used with buffers.";
   CHECK_EQ(n % batch_size_, 0) << "n must be a multiple of batch size";
   // Warn with transformation parameters since a memory array is meant to
   // be generic and no transformations are done with Reset().
@@ -99,14 +154,47 @@ template <typename Dtype>
 void MemoryDataLayer<Dtype>::set_batch_size(int new_size) {
   CHECK(!has_new_data_) <<
       "Can't change batch_size until current data has been consumed.";
+  CHECK(batches_.empty()) << "Can't change batch_size of buffers.";
   batch_size_ = new_size;
   added_data_.Reshape(batch_size_, channels_, height_, width_);
   added_label_.Reshape(batch_size_, 1, 1, 1);
 }
 
+template <typename Dtype>
+Batch<Dtype>* MemoryDataLayer<Dtype>::GetFreeBatch(bool wait) {
+  CHECK(!batches_.empty()) << "Streaming needs memory_data_param.buffers";
+  if (wait) {
+    return batch_free_.pop("Waiting for a free batch");
+  }
+  Batch<Dtype>* batch = NULL;
+  batch_free_.try_pop(&batch);
+  return batch;
+}
+
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::AddBatch(Batch<Dtype>* batch) {
+  CHECK(batch);
+  batch_full_.push(batch);
+}
+
 template <typename Dtype>
 void MemoryDataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (!batches_.empty()) {
+    // The previous batch is no longer in use once the net runs again
+    if (current_batch_) {
+      batch_free_.push(current_batch_);
+    }
+    {
+      ProfileScope profile("data", this->layer_param_.name());
+      current_batch_ = batch_full_.pop("Waiting for data");
+    }
+    top[0]->Reshape(batch_size_, channels_, height_, width_);
+    top[1]->Reshape(batch_size_, 1, 1, 1);
+    top[0]->set_cpu_data(current_batch_->data_.mutable_cpu_data());
+    top[1]->set_cpu_data(current_batch_->label_.mutable_cpu_data());
+    return;
+  }
   CHECK(data_) << "MemoryDataLayer needs to be initialized by calling Reset";
   top[0]->Reshape(batch_size_, channels_, height_, width_);
   top[1]->Reshape(batch_size_, 1, 1, 1);
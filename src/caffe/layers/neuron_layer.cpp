@@ -10,6 +10,17 @@ void NeuronLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   top[0]->ReshapeLike(*bottom[0]);
 }
 
+template <typename Dtype>
+LayerCost NeuronLayer<Dtype>::Cost(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) const {
+  LayerCost cost = Layer<Dtype>::Cost(bottom, top);
+  // Roughly an operation per element each way, which undercounts the
+  // transcendental functions.
+  cost.forward_flops = bottom[0]->count();
+  cost.backward_flops = bottom[0]->count();
+  return cost;
+}
+
 INSTANTIATE_CLASS(NeuronLayer);
 
 }  // namespace caffe
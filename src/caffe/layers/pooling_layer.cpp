@@ -122,6 +122,19 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+LayerCost PoolingLayer<Dtype>::Cost(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) const {
+  LayerCost cost = Layer<Dtype>::Cost(bottom, top);
+  // Every output reduces a kernel window, which backward spreads back out;
+  // MAX only routes each gradient to the argmax it recorded.
+  const double outputs = top[0]->count();
+  cost.forward_flops = outputs * kernel_h_ * kernel_w_;
+  cost.backward_flops = this->layer_param_.pooling_param().pool() ==
+      PoolingParameter_PoolMethod_MAX ? outputs : cost.forward_flops;
+  return cost;
+}
+
 // TODO(Yangqing): Is there a faster way to do pooling in the channel-first
 // case?
 template <typename Dtype>
@@ -113,6 +113,20 @@ void ScaleLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+LayerCost ScaleLayer<Dtype>::Cost(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) const {
+  LayerCost cost = Layer<Dtype>::Cost(bottom, top);
+  // A multiplication per element, whose backward scales the gradient and
+  // sums its product with the input into the scale's; the bias adds one
+  // more each way.
+  const double count = top[0]->count();
+  const double bias = bias_layer_ ? count : 0;
+  cost.forward_flops = count + bias;
+  cost.backward_flops = 3 * count + bias;
+  return cost;
+}
+
 template <typename Dtype>
 void ScaleLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
@@ -23,6 +23,18 @@ void SoftmaxLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   scale_.Reshape(scale_dims);
 }
 
+template <typename Dtype>
+LayerCost SoftmaxLayer<Dtype>::Cost(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) const {
+  LayerCost cost = Layer<Dtype>::Cost(bottom, top);
+  // The max, subtraction, exponential, sum and division; backward takes a
+  // dot product, a subtraction and a multiplication.
+  const double count = bottom[0]->count();
+  cost.forward_flops = 5 * count;
+  cost.backward_flops = 4 * count;
+  return cost;
+}
+
 template <typename Dtype>
 void SoftmaxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
@@ -22,6 +22,16 @@ void SplitLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+LayerCost SplitLayer<Dtype>::Cost(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) const {
+  // Forward shares the bottom; backward sums the top gradients into it.
+  LayerCost cost;
+  cost.backward_flops = static_cast<double>(top.size() - 1) * count_;
+  cost.backward_bytes = sizeof(Dtype) * (top.size() + 1.) * count_;
+  return cost;
+}
+
 template <typename Dtype>
 void SplitLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
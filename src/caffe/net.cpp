@@ -12,9 +12,11 @@
 #include "caffe/net.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/flat_weights.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/insert_splits.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/profiler.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
@@ -66,6 +68,17 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   param_id_vecs_.resize(param.layer_size());
   top_id_vecs_.resize(param.layer_size());
   bottom_need_backward_.resize(param.layer_size());
+  shared_ptr<FlatWeights> lazy_weights;
+  map<string, vector<int> > lazy_weight_entries;
+  if (param.has_lazy_weights()) {
+    CHECK(FlatWeights::IsFlatWeights(param.lazy_weights()))
+        << param.lazy_weights() << " is not a flat weight file; convert it "
+        << "with tools/convert_weights.";
+    lazy_weights.reset(new FlatWeights(param.lazy_weights()));
+    for (int i = 0; i < lazy_weights->num_blobs(); ++i) {
+      lazy_weight_entries[lazy_weights->info(i).layer_name].push_back(i);
+    }
+  }
   for (int layer_id = 0; layer_id < param.layer_size(); ++layer_id) {
     // Inherit phase from net if unset.
     if (!param.layer(layer_id).has_phase()) {
@@ -81,6 +94,10 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     }
     layers_.push_back(LayerRegistry<Dtype>::CreateLayer(layer_param));
     layer_names_.push_back(layer_param.name());
+    if (lazy_weight_entries.count(layer_param.name())) {
+      MapLayerWeights(layer_id, *lazy_weights,
+          lazy_weight_entries[layer_param.name()]);
+    }
     LOG_IF(INFO, Caffe::root_solver())
         << "Creating Layer " << layer_param.name();
     bool need_backward = false;
@@ -251,6 +268,16 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   ShareWeights();
+  param_arena_count_ = 0;
+  if (lazy_weights) {
+    // Maps or copies the params that MapLayerWeights could not set up
+    // (e.g. recurrent layers or partially shared params).
+    CopyTrainedLayersFromFlat(lazy_weights, true);
+  }
+  if (param.contiguous_params() && phase_ == TRAIN) {
+    InitParamArena();
+  }
+  InitCheckpointing();
   debug_info_ = param.debug_info();
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
@@ -521,13 +548,27 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
     for (int c = 0; c < before_forward_.size(); ++c) {
       before_forward_[c]->run(i);
     }
-    Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+    Dtype layer_loss;
+    {
+      ProfileScope profile("forward", layer_names_[i]);
+      layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+      if (profile.active()) {
+        profile.set_flops(layers_[i]->Cost(bottom_vecs_[i],
+            top_vecs_[i]).forward_flops);
+      }
+    }
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
     for (int c = 0; c < after_forward_.size(); ++c) {
       after_forward_[c]->run(i);
     }
   }
+  if (num_checkpoint_segments() > 0) {
+    // Only a segment computed from its first layer is complete.
+    const int segment = layer_segments_[end];
+    resident_segment_ =
+        (start <= checkpoint_segment_starts_[segment]) ? segment : -1;
+  }
   return loss;
 }
 
@@ -568,12 +609,23 @@ void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
   for (int i = start; i >= end; --i) {
+    if (num_checkpoint_segments() > 0 &&
+        layer_segments_[i] != resident_segment_) {
+      RecomputeSegment(layer_segments_[i]);
+    }
     for (int c = 0; c < before_backward_.size(); ++c) {
       before_backward_[c]->run(i);
     }
     if (layer_need_backward_[i]) {
-      layers_[i]->Backward(
-          top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
+      {
+        ProfileScope profile("backward", layer_names_[i]);
+        layers_[i]->Backward(
+            top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
+        if (profile.active()) {
+          profile.set_flops(layers_[i]->Cost(bottom_vecs_[i],
+              top_vecs_[i]).backward_flops);
+        }
+      }
       if (debug_info_) { BackwardDebugInfo(i); }
     }
     for (int c = 0; c < after_backward_.size(); ++c) {
@@ -767,9 +819,16 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
   }
 }
 
+static bool IsHDF5File(const string& filename) {
+  HDF5Lock lock;
+  return H5Fis_hdf5(filename.c_str()) > 0;
+}
+
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
-  if (H5Fis_hdf5(trained_filename.c_str())) {
+  if (FlatWeights::IsFlatWeights(trained_filename)) {
+    CopyTrainedLayersFromFlat(trained_filename);
+  } else if (IsHDF5File(trained_filename)) {
     CopyTrainedLayersFromHDF5(trained_filename);
   } else {
     CopyTrainedLayersFromBinaryProto(trained_filename);
@@ -786,6 +845,7 @@ void Net<Dtype>::CopyTrainedLayersFromBinaryProto(
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
+  HDF5Lock lock;
   hid_t file_hid = H5Fopen(trained_filename.c_str(), H5F_ACC_RDONLY,
                            H5P_DEFAULT);
   CHECK_GE(file_hid, 0) << "Couldn't open " << trained_filename;
@@ -834,6 +894,123 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
   H5Fclose(file_hid);
 }
 
+template <typename Dtype>
+void Net<Dtype>::MapLayerWeights(const int layer_id,
+    const FlatWeights& weights, const vector<int>& entries) {
+  const FlatWeightsType type =
+      sizeof(Dtype) == sizeof(double) ? FLAT_DOUBLE : FLAT_FLOAT;
+  // Params given in the prototxt take precedence. Otherwise every param of
+  // the layer must be in the file with the net's type; if not, the layer
+  // initializes its params as usual and they are loaded after Init.
+  vector<shared_ptr<Blob<Dtype> > >& blobs = layers_[layer_id]->blobs();
+  if (!blobs.empty()) {
+    return;
+  }
+  vector<shared_ptr<Blob<Dtype> > > mapped_blobs(entries.size());
+  for (int i = 0; i < entries.size(); ++i) {
+    const FlatBlobInfo& info = weights.info(entries[i]);
+    if (info.type != type || info.bytes == 0 ||
+        info.param_id >= mapped_blobs.size() || mapped_blobs[info.param_id]) {
+      return;
+    }
+    mapped_blobs[info.param_id].reset(new Blob<Dtype>(info.shape));
+    // The diff stays uninitialized, so it takes no memory until used.
+    mapped_blobs[info.param_id]->set_cpu_data(
+        static_cast<Dtype*>(weights.data(entries[i])));
+    if (info.param_id == 0 && layers_[layer_id]->layer_param().type() ==
+        "Embed") {
+      // Lookups only touch the pages of the rows they read.
+      weights.AdviseRandom(entries[i]);
+    }
+  }
+  blobs = mapped_blobs;
+  DLOG(INFO) << "Mapped " << blobs.size() << " params of layer "
+      << layer_names_[layer_id];
+}
+
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFromFlat(const string trained_filename,
+    bool map) {
+  shared_ptr<FlatWeights> weights(new FlatWeights(trained_filename));
+  CopyTrainedLayersFromFlat(weights, map);
+}
+
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFromFlat(
+    const shared_ptr<FlatWeights>& weights, bool map) {
+  const FlatWeightsType type =
+      sizeof(Dtype) == sizeof(double) ? FLAT_DOUBLE : FLAT_FLOAT;
+  // Arena slices cannot be redirected to the mapping.
+  map = map && !contiguous_params();
+  bool mapped = false;
+  for (int i = 0; i < weights->num_blobs(); ++i) {
+    const FlatBlobInfo& info = weights->info(i);
+    if (!layer_names_index_.count(info.layer_name)) {
+      if (info.param_id == 0) {
+        LOG(INFO) << "Ignoring source layer " << info.layer_name;
+      }
+      continue;
+    }
+    const int target_layer_id = layer_names_index_[info.layer_name];
+    DLOG(INFO) << "Copying source layer " << info.layer_name << " param "
+        << info.param_id;
+    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+        layers_[target_layer_id]->blobs();
+    CHECK_LT(info.param_id, target_blobs.size())
+        << "Incompatible number of blobs for layer " << info.layer_name;
+    Blob<Dtype>* target_blob = target_blobs[info.param_id].get();
+    if (target_blob->shape() != info.shape) {
+      LOG(FATAL) << "Cannot copy param " << info.param_id << " weights from "
+          << "layer '" << info.layer_name << "'; shape mismatch.  Source "
+          << "param shape is " << Blob<Dtype>(info.shape).shape_string()
+          << "; target param shape is " << target_blob->shape_string() << ". "
+          << "To learn this layer's parameters from scratch rather than "
+          << "copying from a saved net, rename the layer.";
+    }
+    if (info.type != type) {
+      Dtype* target_data = target_blob->mutable_cpu_data();
+      if (info.type == FLAT_DOUBLE) {
+        const double* source = static_cast<const double*>(weights->data(i));
+        for (int j = 0; j < target_blob->count(); ++j) {
+          target_data[j] = source[j];
+        }
+      } else {
+        const float* source = static_cast<const float*>(weights->data(i));
+        for (int j = 0; j < target_blob->count(); ++j) {
+          target_data[j] = source[j];
+        }
+      }
+    } else if (map && target_blob->count() > 0) {
+      target_blob->set_cpu_data(static_cast<Dtype*>(weights->data(i)));
+      mapped = true;
+    } else {
+      caffe_copy(target_blob->count(),
+          static_cast<const Dtype*>(weights->data(i)),
+          target_blob->mutable_cpu_data());
+    }
+  }
+  if (mapped) {
+    mapped_weights_.push_back(weights);
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::ToFlat(const string& filename) const {
+  FlatWeightsWriter writer;
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    const string& layer_name = layer_names_[layer_id];
+    for (int param_id = 0; param_id < layers_[layer_id]->blobs().size();
+         ++param_id) {
+      const int net_param_id = param_id_vecs_[layer_id][param_id];
+      // Only save params that own themselves, as ToHDF5 does
+      if (param_owners_[net_param_id] == -1) {
+        writer.Add(layer_name, param_id, *params_[net_param_id]);
+      }
+    }
+  }
+  writer.Write(filename);
+}
+
 template <typename Dtype>
 void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
   param->Clear();
@@ -846,8 +1023,33 @@ void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::ToProto(NetParameter* param,
+    const vector<shared_ptr<Blob<Dtype> > >& params, bool write_diff) const {
+  CHECK_EQ(params.size(), params_.size());
+  param->Clear();
+  param->set_name(name_);
+  for (int i = 0; i < layers_.size(); ++i) {
+    LayerParameter* layer_param = param->add_layer();
+    layer_param->CopyFrom(layers_[i]->layer_param());
+    layer_param->clear_blobs();
+    for (int j = 0; j < param_id_vecs_[i].size(); ++j) {
+      params[param_id_vecs_[i][j]]->ToProto(layer_param->add_blobs(),
+                                            write_diff);
+    }
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
+  ToHDF5(filename, params_, write_diff);
+}
+
+template <typename Dtype>
+void Net<Dtype>::ToHDF5(const string& filename,
+    const vector<shared_ptr<Blob<Dtype> > >& params, bool write_diff) const {
+  CHECK_EQ(params.size(), params_.size());
+  HDF5Lock lock;
   hid_t file_hid = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
       H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
@@ -883,12 +1085,12 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
       if (param_owners_[net_param_id] == -1) {
         // Only save params that own themselves
         hdf5_save_nd_dataset<Dtype>(layer_data_hid, dataset_name.str(),
-            *params_[net_param_id]);
+            *params[net_param_id]);
       }
       if (write_diff) {
         // Write diffs regardless of weight-sharing
         hdf5_save_nd_dataset<Dtype>(layer_diff_hid, dataset_name.str(),
-            *params_[net_param_id], true);
+            *params[net_param_id], true);
       }
     }
     H5Gclose(layer_data_hid);
@@ -905,13 +1107,103 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
 
 template <typename Dtype>
 void Net<Dtype>::Update() {
-  for (int i = 0; i < learnable_params_.size(); ++i) {
-    learnable_params_[i]->Update();
+  if (!contiguous_params()) {
+    for (int i = 0; i < learnable_params_.size(); ++i) {
+      learnable_params_[i]->Update();
+    }
+    return;
+  }
+  switch (Caffe::mode()) {
+  case Caffe::CPU: {
+    const Dtype* diff = param_arena_cpu_diff();
+    caffe_axpy<Dtype>(param_arena_count_, Dtype(-1), diff,
+                      mutable_param_arena_cpu_data());
+    break;
+  }
+  case Caffe::GPU: {
+#ifndef CPU_ONLY
+    const Dtype* diff = param_arena_gpu_diff();
+    caffe_gpu_axpy<Dtype>(param_arena_count_, Dtype(-1), diff,
+                          mutable_param_arena_gpu_data());
+#else
+    NO_GPU;
+#endif
+    break;
+  }
+  }
+}
+
+template <typename Dtype>
+Dtype Net<Dtype>::SumsqParamDiffs() {
+  Dtype sumsq = 0;
+  if (!contiguous_params()) {
+    for (int i = 0; i < learnable_params_.size(); ++i) {
+      sumsq += learnable_params_[i]->sumsq_diff();
+    }
+    return sumsq;
+  }
+  switch (Caffe::mode()) {
+  case Caffe::CPU: {
+    const Dtype* diff = param_arena_cpu_diff();
+    sumsq = caffe_cpu_dot(param_arena_count_, diff, diff);
+    break;
+  }
+  case Caffe::GPU: {
+#ifndef CPU_ONLY
+    const Dtype* diff = param_arena_gpu_diff();
+    caffe_gpu_dot(param_arena_count_, diff, diff, &sumsq);
+#else
+    NO_GPU;
+#endif
+    break;
+  }
+  }
+  return sumsq;
+}
+
+template <typename Dtype>
+void Net<Dtype>::ScaleParamDiffs(Dtype scale_factor) {
+  if (!contiguous_params()) {
+    for (int i = 0; i < learnable_params_.size(); ++i) {
+      learnable_params_[i]->scale_diff(scale_factor);
+    }
+    return;
+  }
+  switch (Caffe::mode()) {
+  case Caffe::CPU:
+    caffe_scal(param_arena_count_, scale_factor,
+               mutable_param_arena_cpu_diff());
+    break;
+  case Caffe::GPU:
+#ifndef CPU_ONLY
+    caffe_gpu_scal(param_arena_count_, scale_factor,
+                   mutable_param_arena_gpu_diff());
+#else
+    NO_GPU;
+#endif
+    break;
   }
 }
 
 template <typename Dtype>
 void Net<Dtype>::ClearParamDiffs() {
+  if (contiguous_params()) {
+    switch (Caffe::mode()) {
+    case Caffe::CPU:
+      caffe_set(param_arena_count_, static_cast<Dtype>(0),
+                mutable_param_arena_cpu_diff());
+      break;
+    case Caffe::GPU:
+#ifndef CPU_ONLY
+      caffe_gpu_set(param_arena_count_, static_cast<Dtype>(0),
+                    mutable_param_arena_gpu_diff());
+#else
+      NO_GPU;
+#endif
+      break;
+    }
+    return;
+  }
   for (int i = 0; i < learnable_params_.size(); ++i) {
     Blob<Dtype>* blob = learnable_params_[i];
     switch (Caffe::mode()) {
@@ -940,6 +1232,284 @@ void Net<Dtype>::ShareWeights() {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::InitParamArena() {
+  size_t count = 0;
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    count += learnable_params_[i]->count();
+  }
+  if (count == 0) { return; }
+  param_data_arena_.reset(new SyncedMemory(count * sizeof(Dtype)));
+  param_diff_arena_.reset(new SyncedMemory(count * sizeof(Dtype)));
+  cpu_param_data_ = static_cast<Dtype*>(param_data_arena_->mutable_cpu_data());
+  cpu_param_diff_ = static_cast<Dtype*>(param_diff_arena_->mutable_cpu_data());
+  gpu_param_data_ = NULL;
+  gpu_param_diff_ = NULL;
+  // Sharers hold the same SyncedMemory as their owner, so redirecting the
+  // owners is enough.
+  size_t offset = 0;
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    Blob<Dtype>* blob = learnable_params_[i];
+    caffe_copy(blob->count(), blob->cpu_data(), cpu_param_data_ + offset);
+    caffe_copy(blob->count(), blob->cpu_diff(), cpu_param_diff_ + offset);
+    blob->data()->set_cpu_data(cpu_param_data_ + offset);
+    blob->diff()->set_cpu_data(cpu_param_diff_ + offset);
+    offset += blob->count();
+  }
+  param_arena_count_ = count;
+  LOG_IF(INFO, Caffe::root_solver()) << "Learnable parameters stored "
+      << "contiguously (" << count << " values)";
+}
+
+template <typename Dtype>
+void Net<Dtype>::InitGPUParamArena() {
+#ifndef CPU_ONLY
+  // Gather the latest values in the host arenas, move them to the device in
+  // one copy each, and point every slice at its device copy.
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    learnable_params_[i]->cpu_data();
+    learnable_params_[i]->cpu_diff();
+  }
+  gpu_param_data_ = static_cast<Dtype*>(param_data_arena_->mutable_gpu_data());
+  gpu_param_diff_ = static_cast<Dtype*>(param_diff_arena_->mutable_gpu_data());
+  size_t offset = 0;
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    Blob<Dtype>* blob = learnable_params_[i];
+    blob->data()->set_gpu_data(gpu_param_data_ + offset);
+    blob->diff()->set_gpu_data(gpu_param_diff_ + offset);
+    offset += blob->count();
+  }
+#else
+  NO_GPU;
+#endif
+}
+
+template <typename Dtype>
+Dtype* Net<Dtype>::SyncParamArena(bool diff, bool gpu, bool write) {
+  CHECK(contiguous_params())
+      << "Net " << name_ << " was not set up with contiguous_params.";
+  if (gpu && !gpu_param_data_) {
+    InitGPUParamArena();
+  }
+  Dtype* arena;
+  if (gpu) {
+    arena = diff ? gpu_param_diff_ : gpu_param_data_;
+  } else {
+    arena = diff ? cpu_param_diff_ : cpu_param_data_;
+  }
+  // Slices already up to date on the device cost a pointer check each.
+  size_t offset = 0;
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    Blob<Dtype>* blob = learnable_params_[i];
+    SyncedMemory* mem = diff ? blob->diff().get() : blob->data().get();
+    const void* ptr;
+    if (gpu) {
+      ptr = write ? mem->mutable_gpu_data() : mem->gpu_data();
+    } else {
+      ptr = write ? mem->mutable_cpu_data() : mem->cpu_data();
+    }
+    CHECK(ptr == arena + offset) << "Learnable param " << i
+        << " no longer lives in the parameter arena; params must not be "
+        << "reshaped or reshared after Init.";
+    offset += blob->count();
+  }
+  return arena;
+}
+
+template <typename Dtype>
+void Net<Dtype>::InitCheckpointing() {
+  checkpoint_segment_starts_.clear();
+  layer_segments_.clear();
+  resident_segment_ = -1;
+  checkpoint_workspace_.reset();
+  activation_bytes_ = 0;
+  checkpointed_activation_bytes_ = 0;
+  recomputed_layers_ = 0;
+  if (phase_ != TRAIN) { return; }
+  // Each layer marked checkpoint ends a segment.
+  vector<int> segment_starts(1, 0);
+  for (int i = 0; i < layers_.size(); ++i) {
+    layer_segments_.push_back(segment_starts.size() - 1);
+    if (layers_[i]->layer_param().checkpoint() && i + 1 < layers_.size()) {
+      segment_starts.push_back(i + 1);
+    }
+  }
+  if (segment_starts.size() < 2) {
+    layer_segments_.clear();
+    return;
+  }
+  // Backward recomputes every segment but the last, so their layers must
+  // give the same tops again without updating any state.
+  for (int i = 0; i < segment_starts.back(); ++i) {
+    if (!bottom_vecs_[i].empty() && !layers_[i]->RepeatableForward()) {
+      LOG(FATAL) << "Layer " << layer_names_[i] << " (type "
+          << layers_[i]->type() << ") cannot be recomputed, since it is "
+          << "stochastic or updates its state in Forward; move it after the "
+          << "last checkpoint layer, "
+          << layer_names_[segment_starts.back() - 1] << ".";
+    }
+  }
+  // The first layer writing each blob, or -1 for net inputs. Blobs written
+  // in place by a later segment could not be recomputed.
+  vector<int> blob_producers(blobs_.size(), -1);
+  for (int i = 0; i < layers_.size(); ++i) {
+    for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+      const int blob_id = top_id_vecs_[i][j];
+      if (blob_producers[blob_id] < 0) {
+        blob_producers[blob_id] = i;
+      } else if (layer_segments_[blob_producers[blob_id]]
+                 != layer_segments_[i]) {
+        LOG(FATAL) << "Layer " << layer_names_[i] << " works in place on "
+            << "blob " << blob_names_[blob_id] << " from an earlier "
+            << "checkpoint segment; set checkpoint on " << layer_names_[i]
+            << " instead.";
+      }
+    }
+  }
+  // Kept blobs hold net inputs, the output of layers that are not recomputed
+  // (those without bottoms), losses, outputs, and anything used across
+  // segments.
+  vector<bool> blob_kept(blobs_.size(), false);
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    const int producer = blob_producers[blob_id];
+    blob_kept[blob_id] = producer < 0 || bottom_vecs_[producer].empty() ||
+        blob_loss_weights_[blob_id] != 0;
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    blob_kept[net_output_blob_indices_[i]] = true;
+  }
+  for (int i = 0; i < layers_.size(); ++i) {
+    for (int j = 0; j < bottom_id_vecs_[i].size(); ++j) {
+      const int blob_id = bottom_id_vecs_[i][j];
+      const int producer = blob_producers[blob_id];
+      if (producer < 0 || layer_segments_[producer] != layer_segments_[i]) {
+        blob_kept[blob_id] = true;
+      }
+    }
+  }
+  // Blobs can share storage (e.g. Flatten and Reshape in Reshape, Split in
+  // Forward), so storage is interior to a segment only if all of its blobs
+  // are. Segment -1 marks kept storage.
+  vector<SyncedMemory*> data_storage(blobs_.size());
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    data_storage[blob_id] = blobs_[blob_id]->data().get();
+  }
+  for (int i = 0; i < layers_.size(); ++i) {
+    if (layers_[i]->layer_param().type() != "Split") { continue; }
+    for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+      data_storage[top_id_vecs_[i][j]] = data_storage[bottom_id_vecs_[i][0]];
+    }
+  }
+  vector<SyncedMemory*> storage;
+  map<SyncedMemory*, int> storage_segments;
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    const int segment = blob_kept[blob_id] ? -1 :
+        layer_segments_[blob_producers[blob_id]];
+    SyncedMemory* blob_storage[2] = {
+        data_storage[blob_id], blobs_[blob_id]->diff().get() };
+    for (int k = 0; k < 2; ++k) {
+      map<SyncedMemory*, int>::iterator it =
+          storage_segments.find(blob_storage[k]);
+      if (it == storage_segments.end()) {
+        storage.push_back(blob_storage[k]);
+        storage_segments[blob_storage[k]] = segment;
+      } else if (it->second != segment) {
+        it->second = -1;
+      }
+    }
+  }
+  // Lay out the interior storage of every segment from the start of the
+  // shared workspace.
+  const size_t kAlignment = 256;
+  const int num_segments = segment_starts.size();
+  vector<size_t> segment_bytes(num_segments, 0);
+  vector<size_t> offsets(storage.size(), 0);
+  size_t kept_bytes = 0;
+  for (int i = 0; i < storage.size(); ++i) {
+    const size_t bytes = storage[i]->size();
+    activation_bytes_ += bytes;
+    const int segment = storage_segments[storage[i]];
+    if (segment < 0) {
+      kept_bytes += bytes;
+    } else {
+      offsets[i] = segment_bytes[segment];
+      segment_bytes[segment] +=
+          (bytes + kAlignment - 1) / kAlignment * kAlignment;
+    }
+  }
+  const size_t workspace_bytes =
+      *std::max_element(segment_bytes.begin(), segment_bytes.end());
+  if (workspace_bytes == 0) {
+    layer_segments_.clear();
+    return;
+  }
+  checkpoint_workspace_.reset(new SyncedMemory(workspace_bytes));
+  char* workspace;
+  switch (Caffe::mode()) {
+  case Caffe::CPU:
+    workspace = static_cast<char*>(checkpoint_workspace_->mutable_cpu_data());
+    for (int i = 0; i < storage.size(); ++i) {
+      if (storage_segments[storage[i]] >= 0) {
+        storage[i]->set_cpu_data(workspace + offsets[i]);
+      }
+    }
+    break;
+  case Caffe::GPU:
+#ifndef CPU_ONLY
+    workspace = static_cast<char*>(checkpoint_workspace_->mutable_gpu_data());
+    for (int i = 0; i < storage.size(); ++i) {
+      if (storage_segments[storage[i]] >= 0) {
+        storage[i]->set_gpu_data(workspace + offsets[i]);
+      }
+    }
+#else
+    NO_GPU;
+#endif
+    break;
+  }
+  checkpoint_segment_starts_ = segment_starts;
+  checkpointed_activation_bytes_ = kept_bytes + workspace_bytes;
+  // The last segment is still resident after the forward pass.
+  for (int s = 0; s < num_segments - 1; ++s) {
+    for (int i = segment_starts[s]; i < segment_starts[s + 1]; ++i) {
+      if (!bottom_vecs_[i].empty()) { ++recomputed_layers_; }
+    }
+  }
+  for (int s = 0; s < num_segments; ++s) {
+    const int end = (s + 1 < num_segments) ?
+        segment_starts[s + 1] - 1 : layers_.size() - 1;
+    LOG_IF(INFO, Caffe::root_solver()) << "Checkpoint segment " << s << ": "
+        << layer_names_[segment_starts[s]] << " -> " << layer_names_[end]
+        << ", " << segment_bytes[s] << " bytes of interior activations";
+  }
+  LOG_IF(INFO, Caffe::root_solver()) << "Activation checkpointing: "
+      << activation_bytes_ << " -> " << checkpointed_activation_bytes_
+      << " bytes (" << kept_bytes << " kept + " << workspace_bytes
+      << " shared), recomputing " << recomputed_layers_ << " of "
+      << layers_.size() << " layer forwards per backward pass";
+}
+
+template <typename Dtype>
+void Net<Dtype>::RecomputeSegment(int segment) {
+  const int start = checkpoint_segment_starts_[segment];
+  const int end = (segment + 1 < checkpoint_segment_starts_.size()) ?
+      checkpoint_segment_starts_[segment + 1] - 1 : layers_.size() - 1;
+  for (int i = start; i <= end; ++i) {
+    // Layers without bottoms (data layers) keep their tops and must not
+    // advance.
+    if (bottom_vecs_[i].empty()) { continue; }
+    CHECK(layers_[i]->RepeatableForward()) << "Cannot recompute layer "
+        << layer_names_[i] << "; run Forward from the start of its segment.";
+    ProfileScope profile("recompute", layer_names_[i]);
+    layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+    if (profile.active()) {
+      profile.set_flops(layers_[i]->Cost(bottom_vecs_[i],
+          top_vecs_[i]).forward_flops);
+    }
+  }
+  resident_segment_ = segment;
+}
+
 template <typename Dtype>
 bool Net<Dtype>::has_blob(const string& blob_name) const {
   return blob_names_index_.find(blob_name) != blob_names_index_.end();
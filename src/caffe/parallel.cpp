@@ -74,10 +74,20 @@ Params<Dtype>::Params(shared_ptr<Solver<Dtype> > root_solver)
 
 template<typename Dtype>
 GPUParams<Dtype>::GPUParams(shared_ptr<Solver<Dtype> > root_solver, int device)
-  : Params<Dtype>(root_solver) {
+  : Params<Dtype>(root_solver), own_buffers_(true) {
   int initial_device;
   CUDA_CHECK(cudaGetDevice(&initial_device));
 
+  // A net with contiguous params on this device already has the buffers.
+  Net<Dtype>* net = root_solver->net().get();
+  if (net->contiguous_params() && device == initial_device) {
+    data_ = net->mutable_param_arena_gpu_data();
+    diff_ = net->mutable_param_arena_gpu_diff();
+    caffe_gpu_set(size_, Dtype(0), diff_);
+    own_buffers_ = false;
+    return;
+  }
+
   // Allocate device buffers
   CUDA_CHECK(cudaSetDevice(device));
   CUDA_CHECK(cudaMalloc(&data_, size_ * sizeof(Dtype)));
@@ -95,8 +105,10 @@ GPUParams<Dtype>::GPUParams(shared_ptr<Solver<Dtype> > root_solver, int device)
 
 template<typename Dtype>
 GPUParams<Dtype>::~GPUParams() {
-  CUDA_CHECK(cudaFree(data_));
-  CUDA_CHECK(cudaFree(diff_));
+  if (own_buffers_) {
+    CUDA_CHECK(cudaFree(data_));
+    CUDA_CHECK(cudaFree(diff_));
+  }
 }
 
 template<typename Dtype>
@@ -141,6 +153,20 @@ void NCCL<Dtype>::Init() {
   if (solver_->param().layer_wise_reduce()) {
     CUDA_CHECK(cudaStreamCreateWithFlags(&stream_, cudaStreamNonBlocking));
   }
+  const GradientCompressionParameter& compression =
+      solver_->param().gradient_compression();
+  if (compression.method() != GradientCompressionParameter_Method_NONE) {
+    CHECK(!solver_->param().layer_wise_reduce())
+        << "Gradient compression requires layer_wise_reduce: false.";
+    compressor_.reset(new GradientCompressor<Dtype>(compression, size_));
+    host_diff_.reset(new SyncedMemory(size_ * sizeof(Dtype)));
+    send_.reset(new SyncedMemory(compressor_->max_bytes()));
+    recv_.reset(new SyncedMemory(compressor_->max_bytes() *
+                                 Caffe::solver_count()));
+    LOG_IF(INFO, Caffe::root_solver()) << "Gradient compression: "
+        << compressor_->uncompressed_bytes() << " -> "
+        << compressor_->max_bytes() << " bytes per exchange";
+  }
 }
 
 template<typename Dtype>
@@ -243,6 +269,8 @@ void NCCL<Dtype>::on_gradients_ready() {
 
     // Make sure reduction is done before applying gradients
     CUDA_CHECK(cudaStreamSynchronize(stream_));
+  } else if (compressor_) {
+    ExchangeCompressed();
   } else {
     if (barrier_) {  // NULL in multi process case
       barrier_->wait();
@@ -255,6 +283,47 @@ void NCCL<Dtype>::on_gradients_ready() {
   }
 }
 
+template<typename Dtype>
+void NCCL<Dtype>::ExchangeCompressed() {
+  // Compression runs on the host, sparse entries are scattered there too.
+  Dtype* grad = static_cast<Dtype*>(host_diff_->mutable_cpu_data());
+  caffe_copy(static_cast<int>(size_), diff_, grad);
+  compressor_->Compress(grad, send_->mutable_cpu_data());
+  const size_t chunk = compressor_->max_bytes();
+  if (barrier_) {  // NULL in multi process case
+    barrier_->wait();
+  }
+#if NCCL_MAJOR >= 2
+  NCCL_CHECK(ncclAllGather(send_->gpu_data(), recv_->mutable_gpu_data(),
+                           chunk, ncclChar, comm_, cudaStreamDefault));
+#else
+  NCCL_CHECK(ncclAllGather(send_->gpu_data(), static_cast<int>(chunk),
+                           ncclChar, recv_->mutable_gpu_data(), comm_,
+                           cudaStreamDefault));
+#endif
+  const char* gathered = static_cast<const char*>(recv_->cpu_data());
+  caffe_set(static_cast<int>(size_), Dtype(0), grad);
+  for (int i = 0; i < Caffe::solver_count(); ++i) {
+    compressor_->DecompressAdd(gathered + i * chunk, grad);
+  }
+  caffe_scal(static_cast<int>(size_), (Dtype) 1.0 / Caffe::solver_count(),
+             grad);
+  caffe_copy(static_cast<int>(size_), grad, diff_);
+
+  const SolverParameter& param = solver_->param();
+  if (param.display() && solver_->iter() % param.display() == 0) {
+    LOG_IF(INFO, Caffe::root_solver()) << "Gradient exchange: "
+        << compressor_->last_bytes() << " bytes on wire per solver ("
+        << compressor_->uncompressed_bytes() << " uncompressed, "
+        << compressor_->total_bytes() << " total)";
+  }
+}
+
+template<typename Dtype>
+size_t NCCL<Dtype>::bytes_on_wire() const {
+  return compressor_ ? compressor_->last_bytes() : size_ * sizeof(Dtype);
+}
+
 template<typename Dtype>
 class Worker : public InternalThread {
  public:
@@ -4,10 +4,12 @@
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
+#include "boost/thread.hpp"
 #include "caffe/solver.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/profiler.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
@@ -40,6 +42,11 @@ Solver<Dtype>::Solver(const string& param_file)
   Init(param);
 }
 
+template <typename Dtype>
+Solver<Dtype>::~Solver() {
+  WaitForSnapshot();
+}
+
 template <typename Dtype>
 void Solver<Dtype>::Init(const SolverParameter& param) {
   LOG_IF(INFO, Caffe::root_solver()) << "Initializing solver from parameters: "
@@ -207,11 +214,13 @@ void Solver<Dtype>::Step(int iters) {
   iteration_timer_.Start();
 
   while (iter_ < stop_iter) {
+    ProfileScope profile("solver", "iteration");
     // zero-init the params
     net_->ClearParamDiffs();
     if (param_.test_interval() && iter_ % param_.test_interval() == 0
         && (iter_ > 0 || param_.test_initialization())) {
       if (Caffe::root_solver()) {
+        ProfileScope profile_test("solver", "test");
         TestAll();
       }
       if (requested_early_exit_) {
@@ -261,10 +270,16 @@ void Solver<Dtype>::Step(int iters) {
         }
       }
     }
-    for (int i = 0; i < callbacks_.size(); ++i) {
-      callbacks_[i]->on_gradients_ready();
+    {
+      ProfileScope profile_gradients("solver", "gradients ready");
+      for (int i = 0; i < callbacks_.size(); ++i) {
+        callbacks_[i]->on_gradients_ready();
+      }
+    }
+    {
+      ProfileScope profile_update("solver", "update");
+      ApplyUpdate();
     }
-    ApplyUpdate();
 
     // Increment the internal iter_ counter -- its value should always indicate
     // the number of times the weights have been updated.
@@ -277,6 +292,7 @@ void Solver<Dtype>::Step(int iters) {
          && iter_ % param_.snapshot() == 0
          && Caffe::root_solver()) ||
          (request == SolverAction::SNAPSHOT)) {
+      ProfileScope profile_snapshot("solver", "snapshot");
       Snapshot();
     }
     if (SolverAction::STOP == request) {
@@ -312,6 +328,7 @@ void Solver<Dtype>::Solve(const char* resume_file) {
     Snapshot();
   }
   if (requested_early_exit_) {
+    WaitForSnapshot();
     LOG(INFO) << "Optimization stopped early.";
     return;
   }
@@ -333,6 +350,7 @@ void Solver<Dtype>::Solve(const char* resume_file) {
   if (param_.test_interval() && iter_ % param_.test_interval() == 0) {
     TestAll();
   }
+  WaitForSnapshot();
   LOG(INFO) << "Optimization Done.";
 }
 
@@ -423,19 +441,185 @@ void Solver<Dtype>::Test(const int test_net_id) {
 template <typename Dtype>
 void Solver<Dtype>::Snapshot() {
   CHECK(Caffe::root_solver());
+  if (param_.snapshot_async()) {
+    SnapshotAsync();
+    return;
+  }
   string model_filename;
+  string state_filename;
   switch (param_.snapshot_format()) {
   case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
     model_filename = SnapshotToBinaryProto();
+    state_filename = SnapshotFilename(".solverstate");
     break;
   case caffe::SolverParameter_SnapshotFormat_HDF5:
     model_filename = SnapshotToHDF5();
+    state_filename = SnapshotFilename(".solverstate.h5");
     break;
   default:
     LOG(FATAL) << "Unsupported snapshot format.";
   }
 
   SnapshotSolverState(model_filename);
+  vector<string> files;
+  files.push_back(model_filename);
+  files.push_back(state_filename);
+  RetainSnapshot(files);
+}
+
+template <typename Dtype>
+void Solver<Dtype>::SnapshotAsync() {
+  // The image is reused, so the previous write has to be done first.
+  WaitForSnapshot();
+  if (!snapshot_image_) {
+    snapshot_image_.reset(new SnapshotImage());
+  }
+  SnapshotImage* image = snapshot_image_.get();
+  image->iter = iter_;
+  image->current_step = current_step_;
+  switch (param_.snapshot_format()) {
+  case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
+    image->model_filename = SnapshotFilename(".caffemodel");
+    image->state_filename = SnapshotFilename(".solverstate");
+    break;
+  case caffe::SolverParameter_SnapshotFormat_HDF5:
+    image->model_filename = SnapshotFilename(".caffemodel.h5");
+    image->state_filename = SnapshotFilename(".solverstate.h5");
+    break;
+  default:
+    LOG(FATAL) << "Unsupported snapshot format.";
+  }
+  // Shared params are copied once, through their owner.
+  const vector<shared_ptr<Blob<Dtype> > >& params = net_->params();
+  const vector<int>& owners = net_->param_owners();
+  image->params.resize(params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    if (owners[i] < 0) {
+      CopyToHost(*params[i], param_.snapshot_diff(), &image->params[i]);
+    } else {
+      image->params[i] = image->params[owners[i]];
+    }
+  }
+  CopySolverState(&image->history);
+  snapshot_thread_.reset(new boost::thread(&Solver<Dtype>::WriteSnapshot,
+      this, snapshot_image_));
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WriteSnapshot(shared_ptr<SnapshotImage> image) {
+  const string model_temp = image->model_filename + ".tmp";
+  const string state_temp = image->state_filename + ".tmp";
+  switch (param_.snapshot_format()) {
+  case caffe::SolverParameter_SnapshotFormat_BINARYPROTO: {
+    LOG(INFO) << "Snapshotting to binary proto file " << image->model_filename
+        << " in the background";
+    NetParameter net_param;
+    net_->ToProto(&net_param, image->params, param_.snapshot_diff());
+    WriteProtoToBinaryFile(net_param, model_temp);
+    WriteSolverStateToBinaryProto(state_temp, image->iter,
+        image->current_step, image->model_filename, image->history);
+    break;
+  }
+  case caffe::SolverParameter_SnapshotFormat_HDF5:
+    LOG(INFO) << "Snapshotting to HDF5 file " << image->model_filename
+        << " in the background";
+    net_->ToHDF5(model_temp, image->params, param_.snapshot_diff());
+    WriteSolverStateToHDF5(state_temp, image->iter, image->current_step,
+        image->model_filename, image->history);
+    break;
+  default:
+    LOG(FATAL) << "Unsupported snapshot format.";
+  }
+  // The state refers to the model, so the model becomes visible first.
+  CHECK_EQ(std::rename(model_temp.c_str(), image->model_filename.c_str()), 0)
+      << "Failed to rename " << model_temp << " to " << image->model_filename;
+  CHECK_EQ(std::rename(state_temp.c_str(), image->state_filename.c_str()), 0)
+      << "Failed to rename " << state_temp << " to " << image->state_filename;
+  LOG(INFO) << "Snapshot of iteration " << image->iter << " written";
+  vector<string> files;
+  files.push_back(image->model_filename);
+  files.push_back(image->state_filename);
+  RetainSnapshot(files);
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WaitForSnapshot() {
+  if (snapshot_thread_) {
+    snapshot_thread_->join();
+    snapshot_thread_.reset();
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::RetainSnapshot(const vector<string>& files) {
+  // A snapshot requested twice for the same iteration overwrites the files.
+  if (!snapshot_files_.empty() && snapshot_files_.back() == files) { return; }
+  snapshot_files_.push_back(files);
+  if (param_.snapshot_retain() <= 0) { return; }
+  while (snapshot_files_.size() > param_.snapshot_retain()) {
+    const vector<string>& old_files = snapshot_files_.front();
+    for (int i = 0; i < old_files.size(); ++i) {
+      LOG(INFO) << "Removing old snapshot file " << old_files[i];
+      std::remove(old_files[i].c_str());
+    }
+    snapshot_files_.pop_front();
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::CopyToHost(const Blob<Dtype>& blob, bool copy_diff,
+    shared_ptr<Blob<Dtype> >* copy) {
+  if (!*copy) {
+    copy->reset(new Blob<Dtype>());
+  }
+  (*copy)->Reshape(blob.shape());
+  caffe_copy(blob.count(), blob.cpu_data(), (*copy)->mutable_cpu_data());
+  if (copy_diff) {
+    caffe_copy(blob.count(), blob.cpu_diff(), (*copy)->mutable_cpu_diff());
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WriteSolverStateToBinaryProto(
+    const string& state_filename, int iter, int current_step,
+    const string& model_filename,
+    const vector<shared_ptr<Blob<Dtype> > >& history) const {
+  SolverState state;
+  state.set_iter(iter);
+  state.set_learned_net(model_filename);
+  state.set_current_step(current_step);
+  state.clear_history();
+  for (int i = 0; i < history.size(); ++i) {
+    // Add history
+    BlobProto* history_blob = state.add_history();
+    history[i]->ToProto(history_blob);
+  }
+  WriteProtoToBinaryFile(state, state_filename.c_str());
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WriteSolverStateToHDF5(const string& state_filename,
+    int iter, int current_step, const string& model_filename,
+    const vector<shared_ptr<Blob<Dtype> > >& history) const {
+  HDF5Lock lock;
+  hid_t file_hid = H5Fcreate(state_filename.c_str(), H5F_ACC_TRUNC,
+      H5P_DEFAULT, H5P_DEFAULT);
+  CHECK_GE(file_hid, 0)
+      << "Couldn't open " << state_filename << " to save solver state.";
+  hdf5_save_int(file_hid, "iter", iter);
+  hdf5_save_string(file_hid, "learned_net", model_filename);
+  hdf5_save_int(file_hid, "current_step", current_step);
+  hid_t history_hid = H5Gcreate2(file_hid, "history", H5P_DEFAULT, H5P_DEFAULT,
+      H5P_DEFAULT);
+  CHECK_GE(history_hid, 0)
+      << "Error saving solver state to " << state_filename << ".";
+  for (int i = 0; i < history.size(); ++i) {
+    ostringstream oss;
+    oss << i;
+    hdf5_save_nd_dataset<Dtype>(history_hid, oss.str(), *history[i]);
+  }
+  H5Gclose(history_hid);
+  H5Fclose(file_hid);
 }
 
 template <typename Dtype>
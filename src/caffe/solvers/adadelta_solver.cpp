@@ -106,6 +106,45 @@ void AdaDeltaSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+#ifndef CPU_ONLY
+template <typename Dtype>
+void adadelta_fused_update_gpu(int N, Dtype* data, Dtype* diff, Dtype* h,
+    Dtype* h2, Dtype momentum, Dtype delta, Dtype local_rate,
+    const GradientRegularizer<Dtype>& regularize);
+#endif
+
+template <typename Dtype>
+void AdaDeltaSolver<Dtype>::FusedUpdate(const FusedParam<Dtype>& param,
+    int begin, int end) {
+  const Dtype delta = this->param_.delta();
+  const Dtype momentum = this->param_.momentum();
+  const Dtype local_rate = param.local_rate;
+  Dtype* data = param.data + begin;
+  Dtype* diff = param.diff + begin;
+  Dtype* history = param.history + begin;
+  Dtype* update_history = param.update_history + begin;
+  const int N = end - begin;
+  if (param.gpu) {
+#ifndef CPU_ONLY
+    adadelta_fused_update_gpu(N, data, diff, history, update_history,
+        momentum, delta, local_rate, param.regularize);
+#else
+    NO_GPU;
+#endif
+    return;
+  }
+  for (int i = 0; i < N; ++i) {
+    const Dtype grad = param.regularize(diff[i], data[i]);
+    history[i] = momentum * history[i] + (Dtype(1) - momentum) * grad * grad;
+    const Dtype update = grad *
+        std::sqrt((update_history[i] + delta) / (history[i] + delta));
+    update_history[i] = momentum * update_history[i] +
+        (Dtype(1) - momentum) * update * update;
+    diff[i] = local_rate * update;
+    data[i] -= diff[i];
+  }
+}
+
 INSTANTIATE_CLASS(AdaDeltaSolver);
 REGISTER_SOLVER_CLASS(AdaDelta);
 
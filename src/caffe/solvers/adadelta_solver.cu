@@ -1,3 +1,4 @@
+#include "caffe/sgd_solvers.hpp"
 #include "caffe/util/math_functions.hpp"
 
 
@@ -27,4 +28,31 @@ template void adadelta_update_gpu<float>(int , float*, float*, float*,
 template void adadelta_update_gpu<double>(int, double*, double*, double*,
     double, double, double);
 
+template <typename Dtype>
+__global__ void AdaDeltaFusedUpdate(int N, Dtype* data, Dtype* diff, Dtype* h,
+    Dtype* h2, Dtype momentum, Dtype delta, Dtype local_rate,
+    GradientRegularizer<Dtype> regularize) {
+  CUDA_KERNEL_LOOP(i, N) {
+    Dtype gi = regularize(diff[i], data[i]);
+    Dtype hi = h[i] = momentum * h[i] + (1-momentum) * gi * gi;
+    gi = gi * sqrt((h2[i] + delta) / (hi + delta));
+    h2[i] = momentum * h2[i] + (1-momentum) * gi * gi;
+    Dtype update = diff[i] = local_rate * gi;
+    data[i] -= update;
+  }
+}
+template <typename Dtype>
+void adadelta_fused_update_gpu(int N, Dtype* data, Dtype* diff, Dtype* h,
+    Dtype* h2, Dtype momentum, Dtype delta, Dtype local_rate,
+    const GradientRegularizer<Dtype>& regularize) {
+  AdaDeltaFusedUpdate<Dtype>  // NOLINT_NEXT_LINE(whitespace/operators)
+      <<<CAFFE_GET_BLOCKS(N), CAFFE_CUDA_NUM_THREADS>>>(
+      N, data, diff, h, h2, momentum, delta, local_rate, regularize);
+  CUDA_POST_KERNEL_CHECK;
+}
+template void adadelta_fused_update_gpu<float>(int, float*, float*, float*,
+    float*, float, float, float, const GradientRegularizer<float>&);
+template void adadelta_fused_update_gpu<double>(int, double*, double*, double*,
+    double*, double, double, double, const GradientRegularizer<double>&);
+
 }  // namespace caffe
@@ -88,6 +88,46 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+#ifndef CPU_ONLY
+template <typename Dtype>
+void adam_fused_update_gpu(int N, Dtype* data, Dtype* diff, Dtype* m,
+    Dtype* v, Dtype beta1, Dtype beta2, Dtype eps_hat,
+    Dtype corrected_local_rate, const GradientRegularizer<Dtype>& regularize);
+#endif
+
+template <typename Dtype>
+void AdamSolver<Dtype>::FusedUpdate(const FusedParam<Dtype>& param,
+    int begin, int end) {
+  const Dtype beta1 = this->param_.momentum();
+  const Dtype beta2 = this->param_.momentum2();
+  const Dtype eps_hat = this->param_.delta();
+  const int t = this->iter_ + 1;
+  const Dtype correction = std::sqrt(Dtype(1) - pow(beta2, t)) /
+      (Dtype(1.) - pow(beta1, t));
+  const Dtype corrected_local_rate = param.local_rate * correction;
+  Dtype* data = param.data + begin;
+  Dtype* diff = param.diff + begin;
+  Dtype* m = param.history + begin;
+  Dtype* v = param.update_history + begin;
+  const int N = end - begin;
+  if (param.gpu) {
+#ifndef CPU_ONLY
+    adam_fused_update_gpu(N, data, diff, m, v, beta1, beta2, eps_hat,
+        corrected_local_rate, param.regularize);
+#else
+    NO_GPU;
+#endif
+    return;
+  }
+  for (int i = 0; i < N; ++i) {
+    const Dtype grad = param.regularize(diff[i], data[i]);
+    m[i] = beta1 * m[i] + (Dtype(1) - beta1) * grad;
+    v[i] = beta2 * v[i] + (Dtype(1) - beta2) * grad * grad;
+    diff[i] = corrected_local_rate * m[i] / (std::sqrt(v[i]) + eps_hat);
+    data[i] -= diff[i];
+  }
+}
+
 INSTANTIATE_CLASS(AdamSolver);
 REGISTER_SOLVER_CLASS(Adam);
 
@@ -1,3 +1,4 @@
+#include "caffe/sgd_solvers.hpp"
 #include "caffe/util/math_functions.hpp"
 
 
@@ -26,4 +27,32 @@ template void adam_update_gpu<float>(int, float*, float*, float*,
 template void adam_update_gpu<double>(int, double*, double*, double*,
     double, double, double, double);
 
+template <typename Dtype>
+__global__ void AdamFusedUpdate(int N, Dtype* data, Dtype* diff, Dtype* m,
+    Dtype* v, Dtype beta1, Dtype beta2, Dtype eps_hat,
+    Dtype corrected_local_rate, GradientRegularizer<Dtype> regularize) {
+  CUDA_KERNEL_LOOP(i, N) {
+    Dtype gi = regularize(diff[i], data[i]);
+    Dtype mi = m[i] = m[i]*beta1 + gi*(1-beta1);
+    Dtype vi = v[i] = v[i]*beta2 + gi*gi*(1-beta2);
+    Dtype update = diff[i] = corrected_local_rate * mi / (sqrt(vi) + eps_hat);
+    data[i] -= update;
+  }
+}
+template <typename Dtype>
+void adam_fused_update_gpu(int N, Dtype* data, Dtype* diff, Dtype* m,
+    Dtype* v, Dtype beta1, Dtype beta2, Dtype eps_hat,
+    Dtype corrected_local_rate, const GradientRegularizer<Dtype>& regularize) {
+  AdamFusedUpdate<Dtype>  // NOLINT_NEXT_LINE(whitespace/operators)
+      <<<CAFFE_GET_BLOCKS(N), CAFFE_CUDA_NUM_THREADS>>>(
+      N, data, diff, m, v, beta1, beta2, eps_hat, corrected_local_rate,
+      regularize);
+  CUDA_POST_KERNEL_CHECK;
+}
+template void adam_fused_update_gpu<float>(int, float*, float*, float*,
+    float*, float, float, float, float, const GradientRegularizer<float>&);
+template void adam_fused_update_gpu<double>(int, double*, double*, double*,
+    double*, double, double, double, double,
+    const GradientRegularizer<double>&);
+
 }  // namespace caffe
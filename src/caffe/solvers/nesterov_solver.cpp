@@ -55,6 +55,41 @@ void NesterovSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+#ifndef CPU_ONLY
+template <typename Dtype>
+void nesterov_fused_update_gpu(int N, Dtype* data, Dtype* diff, Dtype* h,
+    Dtype momentum, Dtype local_rate,
+    const GradientRegularizer<Dtype>& regularize);
+#endif
+
+template <typename Dtype>
+void NesterovSolver<Dtype>::FusedUpdate(const FusedParam<Dtype>& param,
+    int begin, int end) {
+  const Dtype momentum = this->param_.momentum();
+  const Dtype local_rate = param.local_rate;
+  Dtype* data = param.data + begin;
+  Dtype* diff = param.diff + begin;
+  Dtype* history = param.history + begin;
+  const int N = end - begin;
+  if (param.gpu) {
+#ifndef CPU_ONLY
+    nesterov_fused_update_gpu(N, data, diff, history, momentum, local_rate,
+        param.regularize);
+#else
+    NO_GPU;
+#endif
+    return;
+  }
+  for (int i = 0; i < N; ++i) {
+    const Dtype grad = param.regularize(diff[i], data[i]);
+    const Dtype previous = history[i];
+    history[i] = momentum * previous + local_rate * grad;
+    // step back then over step
+    diff[i] = (Dtype(1) + momentum) * history[i] - momentum * previous;
+    data[i] -= diff[i];
+  }
+}
+
 INSTANTIATE_CLASS(NesterovSolver);
 REGISTER_SOLVER_CLASS(Nesterov);
 
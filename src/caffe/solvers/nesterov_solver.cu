@@ -1,3 +1,4 @@
+#include "caffe/sgd_solvers.hpp"
 #include "caffe/util/math_functions.hpp"
 
 
@@ -24,4 +25,29 @@ template void nesterov_update_gpu<float>(int, float*, float*, float, float);
 template void nesterov_update_gpu<double>(int, double*, double*, double,
     double);
 
+template <typename Dtype>
+__global__ void NesterovFusedUpdate(int N, Dtype* data, Dtype* diff, Dtype* h,
+    Dtype momentum, Dtype local_rate, GradientRegularizer<Dtype> regularize) {
+  CUDA_KERNEL_LOOP(i, N) {
+    Dtype gi = regularize(diff[i], data[i]);
+    Dtype hi = h[i];
+    Dtype hi_new = h[i] = momentum * hi + local_rate * gi;
+    Dtype update = diff[i] = (1+momentum) * hi_new - momentum * hi;
+    data[i] -= update;
+  }
+}
+template <typename Dtype>
+void nesterov_fused_update_gpu(int N, Dtype* data, Dtype* diff, Dtype* h,
+    Dtype momentum, Dtype local_rate,
+    const GradientRegularizer<Dtype>& regularize) {
+  NesterovFusedUpdate<Dtype>  // NOLINT_NEXT_LINE(whitespace/operators)
+      <<<CAFFE_GET_BLOCKS(N), CAFFE_CUDA_NUM_THREADS>>>(
+      N, data, diff, h, momentum, local_rate, regularize);
+  CUDA_POST_KERNEL_CHECK;
+}
+template void nesterov_fused_update_gpu<float>(int, float*, float*, float*,
+    float, float, const GradientRegularizer<float>&);
+template void nesterov_fused_update_gpu<double>(int, double*, double*,
+    double*, double, double, const GradientRegularizer<double>&);
+
 }  // namespace caffe
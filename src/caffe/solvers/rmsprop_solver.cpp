@@ -64,6 +64,40 @@ void RMSPropSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+#ifndef CPU_ONLY
+template <typename Dtype>
+void rmsprop_fused_update_gpu(int N, Dtype* data, Dtype* diff, Dtype* h,
+    Dtype rms_decay, Dtype delta, Dtype local_rate,
+    const GradientRegularizer<Dtype>& regularize);
+#endif
+
+template <typename Dtype>
+void RMSPropSolver<Dtype>::FusedUpdate(const FusedParam<Dtype>& param,
+    int begin, int end) {
+  const Dtype delta = this->param_.delta();
+  const Dtype rms_decay = this->param_.rms_decay();
+  const Dtype local_rate = param.local_rate;
+  Dtype* data = param.data + begin;
+  Dtype* diff = param.diff + begin;
+  Dtype* history = param.history + begin;
+  const int N = end - begin;
+  if (param.gpu) {
+#ifndef CPU_ONLY
+    rmsprop_fused_update_gpu(N, data, diff, history, rms_decay, delta,
+        local_rate, param.regularize);
+#else
+    NO_GPU;
+#endif
+    return;
+  }
+  for (int i = 0; i < N; ++i) {
+    const Dtype grad = param.regularize(diff[i], data[i]);
+    history[i] = rms_decay * history[i] + (Dtype(1) - rms_decay) * grad * grad;
+    diff[i] = local_rate * grad / (std::sqrt(history[i]) + delta);
+    data[i] -= diff[i];
+  }
+}
+
 INSTANTIATE_CLASS(RMSPropSolver);
 REGISTER_SOLVER_CLASS(RMSProp);
 
@@ -1,3 +1,4 @@
+#include "caffe/sgd_solvers.hpp"
 #include "caffe/util/math_functions.hpp"
 
 
@@ -25,4 +26,29 @@ template void rmsprop_update_gpu<float>(int, float*, float*, float, float,
 template void rmsprop_update_gpu<double>(int, double*, double*, double, double,
     double);
 
+template <typename Dtype>
+__global__ void RMSPropFusedUpdate(int N, Dtype* data, Dtype* diff, Dtype* h,
+    Dtype rms_decay, Dtype delta, Dtype local_rate,
+    GradientRegularizer<Dtype> regularize) {
+  CUDA_KERNEL_LOOP(i, N) {
+    Dtype gi = regularize(diff[i], data[i]);
+    Dtype hi = h[i] = rms_decay*h[i] + (1-rms_decay)*gi*gi;
+    Dtype update = diff[i] = local_rate * gi / (sqrt(hi) + delta);
+    data[i] -= update;
+  }
+}
+template <typename Dtype>
+void rmsprop_fused_update_gpu(int N, Dtype* data, Dtype* diff, Dtype* h,
+    Dtype rms_decay, Dtype delta, Dtype local_rate,
+    const GradientRegularizer<Dtype>& regularize) {
+  RMSPropFusedUpdate<Dtype>  // NOLINT_NEXT_LINE(whitespace/operators)
+      <<<CAFFE_GET_BLOCKS(N), CAFFE_CUDA_NUM_THREADS>>>(
+      N, data, diff, h, rms_decay, delta, local_rate, regularize);
+  CUDA_POST_KERNEL_CHECK;
+}
+template void rmsprop_fused_update_gpu<float>(int, float*, float*, float*,
+    float, float, float, const GradientRegularizer<float>&);
+template void rmsprop_fused_update_gpu<double>(int, double*, double*, double*,
+    double, double, double, const GradientRegularizer<double>&);
+
 }  // namespace caffe
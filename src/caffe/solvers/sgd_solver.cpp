@@ -1,6 +1,11 @@
+#include <algorithm>
 #include <string>
 #include <vector>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "caffe/sgd_solvers.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
@@ -88,20 +93,14 @@ template <typename Dtype>
 void SGDSolver<Dtype>::ClipGradients() {
   const Dtype clip_gradients = this->param_.clip_gradients();
   if (clip_gradients < 0) { return; }
-  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
-  Dtype sumsq_diff = 0;
-  for (int i = 0; i < net_params.size(); ++i) {
-    sumsq_diff += net_params[i]->sumsq_diff();
-  }
+  const Dtype sumsq_diff = this->net_->SumsqParamDiffs();
   const Dtype l2norm_diff = std::sqrt(sumsq_diff);
   if (l2norm_diff > clip_gradients) {
     Dtype scale_factor = clip_gradients / l2norm_diff;
     LOG(INFO) << "Gradient clipping: scaling down gradients (L2 norm "
         << l2norm_diff << " > " << clip_gradients << ") "
         << "by scale factor " << scale_factor;
-    for (int i = 0; i < net_params.size(); ++i) {
-      net_params[i]->scale_diff(scale_factor);
-    }
+    this->net_->ScaleParamDiffs(scale_factor);
   }
 }
 
@@ -113,13 +112,140 @@ void SGDSolver<Dtype>::ApplyUpdate() {
         << ", lr = " << rate;
   }
   ClipGradients();
-  for (int param_id = 0; param_id < this->net_->learnable_params().size();
-       ++param_id) {
-    Normalize(param_id);
-    Regularize(param_id);
-    ComputeUpdateValue(param_id, rate);
+  if (this->param_.fused_update()) {
+    ApplyFusedUpdate(rate);
+  } else {
+    for (int param_id = 0; param_id < this->net_->learnable_params().size();
+         ++param_id) {
+      Normalize(param_id);
+      Regularize(param_id);
+      ComputeUpdateValue(param_id, rate);
+    }
+    this->net_->Update();
+  }
+}
+
+template <typename Dtype>
+GradientRegularizer<Dtype> SGDSolver<Dtype>::GetRegularizer(int param_id) {
+  const Dtype accum_normalization = Dtype(1.) / this->param_.iter_size();
+  const Dtype local_decay = this->param_.weight_decay() *
+      this->net_->params_weight_decay()[param_id];
+  const string& regularization_type = this->param_.regularization_type();
+  if (local_decay && regularization_type != "L1" &&
+      regularization_type != "L2") {
+    LOG(FATAL) << "Unknown regularization type: " << regularization_type;
+  }
+  return GradientRegularizer<Dtype>(accum_normalization, local_decay,
+                                    regularization_type == "L1");
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::ApplyFusedUpdate(Dtype rate) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  const bool gpu = Caffe::mode() == Caffe::GPU;
+  // Sync everything here: the update threads must not touch SyncedMemory.
+  // With contiguous params the arenas are synced once for all params.
+  Dtype* data_arena = NULL;
+  Dtype* diff_arena = NULL;
+  if (this->net_->contiguous_params()) {
+    data_arena = gpu ? this->net_->mutable_param_arena_gpu_data() :
+        this->net_->mutable_param_arena_cpu_data();
+    diff_arena = gpu ? this->net_->mutable_param_arena_gpu_diff() :
+        this->net_->mutable_param_arena_cpu_diff();
+  }
+  const bool update_history = history_.size() >= 2 * net_params.size();
+  vector<FusedParam<Dtype> > params(net_params.size());
+  size_t offset = 0;
+  for (int param_id = 0; param_id < net_params.size(); ++param_id) {
+    Blob<Dtype>* blob = net_params[param_id];
+    FusedParam<Dtype>& param = params[param_id];
+    if (data_arena) {
+      param.data = data_arena + offset;
+      param.diff = diff_arena + offset;
+    } else {
+      param.data = gpu ? blob->mutable_gpu_data() : blob->mutable_cpu_data();
+      param.diff = gpu ? blob->mutable_gpu_diff() : blob->mutable_cpu_diff();
+    }
+    Blob<Dtype>* history = history_[param_id].get();
+    param.history = gpu ? history->mutable_gpu_data() :
+        history->mutable_cpu_data();
+    param.update_history = NULL;
+    if (update_history) {
+      history = history_[net_params.size() + param_id].get();
+      param.update_history = gpu ? history->mutable_gpu_data() :
+          history->mutable_cpu_data();
+    }
+    param.count = blob->count();
+    param.local_rate = rate * this->net_->params_lr()[param_id];
+    param.regularize = GetRegularizer(param_id);
+    param.gpu = gpu;
+    offset += blob->count();
+  }
+  if (gpu) {
+    for (int param_id = 0; param_id < params.size(); ++param_id) {
+      FusedUpdate(params[param_id], 0, params[param_id].count);
+    }
+    return;
+  }
+  const size_t count = offset;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+  {
+    // Each thread takes an equal share of all values across param
+    // boundaries, so small params such as biases cost no pass of their own.
+    int thread = 0;
+    int num_threads = 1;
+#ifdef _OPENMP
+    thread = omp_get_thread_num();
+    num_threads = omp_get_num_threads();
+#endif
+    const size_t begin = count * thread / num_threads;
+    const size_t end = count * (thread + 1) / num_threads;
+    size_t param_begin = 0;
+    for (int param_id = 0; param_id < params.size() && param_begin < end;
+         ++param_id) {
+      const size_t param_end = param_begin + params[param_id].count;
+      if (param_end > begin) {
+        FusedUpdate(params[param_id],
+            std::max(begin, param_begin) - param_begin,
+            std::min(end, param_end) - param_begin);
+      }
+      param_begin = param_end;
+    }
+  }
+}
+
+#ifndef CPU_ONLY
+template <typename Dtype>
+void sgd_fused_update_gpu(int N, Dtype* data, Dtype* diff, Dtype* h,
+    Dtype momentum, Dtype local_rate,
+    const GradientRegularizer<Dtype>& regularize);
+#endif
+
+template <typename Dtype>
+void SGDSolver<Dtype>::FusedUpdate(const FusedParam<Dtype>& param,
+    int begin, int end) {
+  const Dtype momentum = this->param_.momentum();
+  const Dtype local_rate = param.local_rate;
+  Dtype* data = param.data + begin;
+  Dtype* diff = param.diff + begin;
+  Dtype* history = param.history + begin;
+  const int N = end - begin;
+  if (param.gpu) {
+#ifndef CPU_ONLY
+    sgd_fused_update_gpu(N, data, diff, history, momentum, local_rate,
+        param.regularize);
+#else
+    NO_GPU;
+#endif
+    return;
+  }
+  for (int i = 0; i < N; ++i) {
+    const Dtype grad = param.regularize(diff[i], data[i]);
+    diff[i] = history[i] = momentum * history[i] + local_rate * grad;
+    data[i] -= diff[i];
   }
-  this->net_->Update();
 }
 
 template <typename Dtype>
@@ -266,20 +392,11 @@ void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
 template <typename Dtype>
 void SGDSolver<Dtype>::SnapshotSolverStateToBinaryProto(
     const string& model_filename) {
-  SolverState state;
-  state.set_iter(this->iter_);
-  state.set_learned_net(model_filename);
-  state.set_current_step(this->current_step_);
-  state.clear_history();
-  for (int i = 0; i < history_.size(); ++i) {
-    // Add history
-    BlobProto* history_blob = state.add_history();
-    history_[i]->ToProto(history_blob);
-  }
   string snapshot_filename = Solver<Dtype>::SnapshotFilename(".solverstate");
   LOG(INFO)
     << "Snapshotting solver state to binary proto file " << snapshot_filename;
-  WriteProtoToBinaryFile(state, snapshot_filename.c_str());
+  this->WriteSolverStateToBinaryProto(snapshot_filename, this->iter_,
+      this->current_step_, model_filename, history_);
 }
 
 template <typename Dtype>
@@ -288,24 +405,17 @@ void SGDSolver<Dtype>::SnapshotSolverStateToHDF5(
   string snapshot_filename =
       Solver<Dtype>::SnapshotFilename(".solverstate.h5");
   LOG(INFO) << "Snapshotting solver state to HDF5 file " << snapshot_filename;
-  hid_t file_hid = H5Fcreate(snapshot_filename.c_str(), H5F_ACC_TRUNC,
-      H5P_DEFAULT, H5P_DEFAULT);
-  CHECK_GE(file_hid, 0)
-      << "Couldn't open " << snapshot_filename << " to save solver state.";
-  hdf5_save_int(file_hid, "iter", this->iter_);
-  hdf5_save_string(file_hid, "learned_net", model_filename);
-  hdf5_save_int(file_hid, "current_step", this->current_step_);
-  hid_t history_hid = H5Gcreate2(file_hid, "history", H5P_DEFAULT, H5P_DEFAULT,
-      H5P_DEFAULT);
-  CHECK_GE(history_hid, 0)
-      << "Error saving solver state to " << snapshot_filename << ".";
+  this->WriteSolverStateToHDF5(snapshot_filename, this->iter_,
+      this->current_step_, model_filename, history_);
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::CopySolverState(
+    vector<shared_ptr<Blob<Dtype> > >* history) {
+  history->resize(history_.size());
   for (int i = 0; i < history_.size(); ++i) {
-    ostringstream oss;
-    oss << i;
-    hdf5_save_nd_dataset<Dtype>(history_hid, oss.str(), *history_[i]);
+    this->CopyToHost(*history_[i], false, &(*history)[i]);
   }
-  H5Gclose(history_hid);
-  H5Fclose(file_hid);
 }
 
 template <typename Dtype>
@@ -330,6 +440,7 @@ void SGDSolver<Dtype>::RestoreSolverStateFromBinaryProto(
 
 template <typename Dtype>
 void SGDSolver<Dtype>::RestoreSolverStateFromHDF5(const string& state_file) {
+  HDF5Lock lock;
   hid_t file_hid = H5Fopen(state_file.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
   CHECK_GE(file_hid, 0) << "Couldn't open solver state file " << state_file;
   this->iter_ = hdf5_load_int(file_hid, "iter");
@@ -1,3 +1,4 @@
+#include "caffe/sgd_solvers.hpp"
 #include "caffe/util/math_functions.hpp"
 
 
@@ -21,4 +22,28 @@ void sgd_update_gpu(int N, Dtype* g, Dtype* h, Dtype momentum,
 template void sgd_update_gpu<float>(int, float*, float*, float, float);
 template void sgd_update_gpu<double>(int, double*, double*, double, double);
 
+template <typename Dtype>
+__global__ void SGDFusedUpdate(int N, Dtype* data, Dtype* diff, Dtype* h,
+    Dtype momentum, Dtype local_rate, GradientRegularizer<Dtype> regularize) {
+  CUDA_KERNEL_LOOP(i, N) {
+    Dtype gi = regularize(diff[i], data[i]);
+    Dtype hi = h[i] = momentum*h[i] + local_rate*gi;
+    diff[i] = hi;
+    data[i] -= hi;
+  }
+}
+template <typename Dtype>
+void sgd_fused_update_gpu(int N, Dtype* data, Dtype* diff, Dtype* h,
+    Dtype momentum, Dtype local_rate,
+    const GradientRegularizer<Dtype>& regularize) {
+  SGDFusedUpdate<Dtype>  // NOLINT_NEXT_LINE(whitespace/operators)
+      <<<CAFFE_GET_BLOCKS(N), CAFFE_CUDA_NUM_THREADS>>>(
+      N, data, diff, h, momentum, local_rate, regularize);
+  CUDA_POST_KERNEL_CHECK;
+}
+template void sgd_fused_update_gpu<float>(int, float*, float*, float*, float,
+    float, const GradientRegularizer<float>&);
+template void sgd_fused_update_gpu<double>(int, double*, double*, double*,
+    double, double, const GradientRegularizer<double>&);
+
 }  // namespace caffe
@@ -0,0 +1,555 @@
+// Benchmarks every registered layer type, and optionally a net, across
+// shapes and numbers of threads, and reports the statistics of the timings
+// as JSON so that builds can be compared.
+//
+// Usage:
+//    bench.bin [-layers Convolution,Pooling] [-shapes 16x32x28x28]
+//        [-threads 1,2,4] [-model net.prototxt] [-output bench.json]
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>  // NOLINT(readability/streams)
+#include <iostream>  // NOLINT(readability/streams)
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/profiler.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using caffe::Blob;
+using caffe::Caffe;
+using caffe::JsonString;
+using caffe::Layer;
+using caffe::LayerParameter;
+using caffe::LayerRegistry;
+using caffe::Net;
+using caffe::shared_ptr;
+using caffe::string;
+using caffe::Timer;
+using caffe::TimingStats;
+using caffe::vector;
+
+DEFINE_string(layers, "all",
+    "The layer types to benchmark, separated by ',', 'all' for every "
+    "registered type or 'none' to benchmark only the -model.");
+DEFINE_string(shapes, "16x32x28x28,4x64x56x56",
+    "The N x C x H x W bottom shapes to benchmark the layers at, separated "
+    "by ','. C and H must be at least 3.");
+DEFINE_string(threads, "1",
+    "The numbers of threads to benchmark with, separated by ','. Each "
+    "thread runs its own instance of the layer or net.");
+DEFINE_string(model, "",
+    "Optional; a model definition to benchmark as a whole net.");
+DEFINE_int32(iterations, 50,
+    "The number of timed passes per thread.");
+DEFINE_int32(warmup, 5,
+    "The number of untimed passes per thread before the timed ones.");
+DEFINE_int32(gpu, -1,
+    "Optional; run in GPU mode on the given device ID.");
+DEFINE_string(output, "",
+    "Optional; the file to write the JSON report to, standard output if "
+    "not given.");
+
+// How to set up a layer type: its parameters, in text format with $N, $C,
+// $H and $W standing for the dimensions of the shape, and its bottoms, a
+// letter each:
+//   x  data of the shape            p  positive data of the shape
+//   v  data of shape N x CHW x 1 x 1
+//   t  targets in [0, 1] of the shape, not backpropagated to
+//   h  data of shape N x C x H/2 x W/2, not backpropagated to
+//   l  labels in [0, C) of shape N x 1 x H x W
+//   k  labels in [0, C) of shape N
+//   r  indices in [0, N) of shape N  b  alternating 0 and 1 of shape N
+//   c  sequence continuation of shape N x C, 0 at the first step
+struct LayerSetup {
+  const char* type;
+  const char* param;
+  const char* bottoms;
+  int tops;
+  bool backward;
+};
+
+static const LayerSetup kLayerSetups[] = {
+  {"AbsVal", "", "x", 1, true},
+  {"Accuracy", "", "xl", 1, false},
+  {"ArgMax", "", "x", 1, false},
+  {"BNLL", "", "x", 1, true},
+  {"BatchNorm", "", "x", 1, true},
+  {"BatchReindex", "", "xr", 1, true},
+  {"Bias", "bias_param { axis: 1 num_axes: 1 }", "x", 1, true},
+  {"Concat", "", "xx", 1, true},
+  {"ContrastiveLoss", "", "vvb", 1, true},
+  {"Convolution", "convolution_param { num_output: $C kernel_size: 3 "
+      "pad: 1 weight_filler { type: 'gaussian' std: 0.01 } }", "x", 1, true},
+  {"Crop", "crop_param { axis: 2 }", "xh", 1, true},
+  {"Deconvolution", "convolution_param { num_output: $C kernel_size: 3 "
+      "pad: 1 weight_filler { type: 'gaussian' std: 0.01 } }", "x", 1, true},
+  {"Dropout", "", "x", 1, true},
+  {"DummyData", "dummy_data_param { shape { dim: $N dim: $C dim: $H "
+      "dim: $W } data_filler { type: 'gaussian' } }", "", 1, false},
+  {"ELU", "", "x", 1, true},
+  {"Eltwise", "", "xx", 1, true},
+  {"Embed", "embed_param { num_output: $C input_dim: $C "
+      "weight_filler { type: 'gaussian' std: 0.01 } }", "l", 1, true},
+  {"EuclideanLoss", "", "xx", 1, true},
+  {"Exp", "", "x", 1, true},
+  {"Filter", "", "xb", 1, true},
+  {"Flatten", "", "x", 1, true},
+  {"HingeLoss", "", "xk", 1, true},
+  {"Im2col", "convolution_param { kernel_size: 3 pad: 1 }", "x", 1, true},
+  {"InnerProduct", "inner_product_param { num_output: $C "
+      "weight_filler { type: 'gaussian' std: 0.01 } }", "x", 1, true},
+  {"Input", "input_param { shape { dim: $N dim: $C dim: $H dim: $W } }",
+      "", 1, false},
+  {"LRN", "", "x", 1, true},
+  {"LSTM", "recurrent_param { num_output: $C "
+      "weight_filler { type: 'gaussian' std: 0.01 } }", "xc", 1, true},
+  {"Log", "", "p", 1, true},
+  {"MVN", "", "x", 1, true},
+  {"MultinomialLogisticLoss", "", "pk", 1, true},
+  {"PReLU", "", "x", 1, true},
+  {"Parameter", "parameter_param { shape { dim: $C dim: $H dim: $W } }",
+      "", 1, true},
+  {"Pooling", "pooling_param { pool: MAX kernel_size: 3 stride: 2 }", "x", 1,
+      true},
+  {"Power", "power_param { power: 2 }", "x", 1, true},
+  {"RNN", "recurrent_param { num_output: $C "
+      "weight_filler { type: 'gaussian' std: 0.01 } }", "xc", 1, true},
+  {"ReLU", "", "x", 1, true},
+  {"Reduction", "", "x", 1, true},
+  {"Reshape", "reshape_param { shape { dim: 0 dim: -1 } }", "x", 1, true},
+  {"SPP", "spp_param { pyramid_height: 2 }", "x", 1, true},
+  {"Scale", "scale_param { axis: 1 num_axes: 1 bias_term: true }", "x", 1,
+      true},
+  {"Sigmoid", "", "x", 1, true},
+  {"SigmoidCrossEntropyLoss", "", "xt", 1, true},
+  {"Silence", "", "x", 0, true},
+  {"Slice", "slice_param { axis: 1 slice_point: 1 }", "x", 2, true},
+  {"Softmax", "", "x", 1, true},
+  {"SoftmaxWithLoss", "", "xl", 1, true},
+  {"Split", "", "x", 2, true},
+  {"TanH", "", "x", 1, true},
+  {"Threshold", "", "x", 1, false},
+  {"Tile", "tile_param { axis: 1 tiles: 2 }", "x", 1, true},
+};
+
+// Why the other layer types are not benchmarked
+static const char* kSkipped[][2] = {
+  {"Data", "reads a database"},
+  {"HDF5Data", "reads HDF5 files"},
+  {"HDF5Output", "writes HDF5 files"},
+  {"ImageData", "reads image files"},
+  {"InfogainLoss", "needs an infogain matrix"},
+  {"LSTMUnit", "is benchmarked within LSTM"},
+  {"MemoryData", "needs data from its caller"},
+  {"Python", "runs Python code"},
+  {"WindowData", "reads image files"},
+};
+
+static void SetMode() {
+  if (FLAGS_gpu >= 0) {
+    Caffe::SetDevice(FLAGS_gpu);
+    Caffe::set_mode(Caffe::GPU);
+  } else {
+    Caffe::set_mode(Caffe::CPU);
+  }
+}
+
+static vector<int> Shape(int n, int c, int h, int w) {
+  vector<int> shape(4);
+  shape[0] = n;
+  shape[1] = c;
+  shape[2] = h;
+  shape[3] = w;
+  return shape;
+}
+
+// An instance of a benchmark, which each thread sets up for itself.
+class Runner {
+ public:
+  virtual ~Runner() {}
+  virtual void Forward() = 0;
+  virtual void Backward() = 0;
+};
+
+class LayerRunner : public Runner {
+ public:
+  LayerRunner(const LayerSetup& setup, const vector<int>& shape) {
+    const int n = shape[0], c = shape[1], h = shape[2], w = shape[3];
+    string text = setup.param;
+    boost::replace_all(text, "$N", caffe::format_int(n));
+    boost::replace_all(text, "$C", caffe::format_int(c));
+    boost::replace_all(text, "$H", caffe::format_int(h));
+    boost::replace_all(text, "$W", caffe::format_int(w));
+    LayerParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(text, &param))
+        << "Failed to parse the parameters of " << setup.type;
+    param.set_type(setup.type);
+    for (const char* bottom = setup.bottoms; *bottom; ++bottom) {
+      blobs_.push_back(shared_ptr<Blob<float> >(new Blob<float>()));
+      Blob<float>* blob = blobs_.back().get();
+      caffe::FillerParameter filler;
+      bool data = true;
+      switch (*bottom) {
+      case 'x':
+        blob->Reshape(shape);
+        filler.set_type("gaussian");
+        break;
+      case 'p':
+        blob->Reshape(shape);
+        filler.set_type("uniform");
+        filler.set_min(0.01);
+        break;
+      case 'v':
+        blob->Reshape(Shape(n, c * h * w, 1, 1));
+        filler.set_type("gaussian");
+        break;
+      case 't':
+        blob->Reshape(shape);
+        filler.set_type("uniform");
+        data = false;
+        break;
+      case 'h':
+        blob->Reshape(Shape(n, c, h / 2, w / 2));
+        filler.set_type("gaussian");
+        data = false;
+        break;
+      default:
+        blob->Reshape(IndexShape(*bottom, n, c, h, w));
+        FillIndices(*bottom, n, c, blob);
+        data = false;
+      }
+      if (filler.has_type()) {
+        shared_ptr<caffe::Filler<float> > filler_ptr(
+            caffe::GetFiller<float>(filler));
+        filler_ptr->Fill(blob);
+      }
+      bottom_.push_back(blob);
+      propagate_down_.push_back(data);
+    }
+    for (int i = 0; i < setup.tops; ++i) {
+      blobs_.push_back(shared_ptr<Blob<float> >(new Blob<float>()));
+      top_.push_back(blobs_.back().get());
+    }
+    layer_ = LayerRegistry<float>::CreateLayer(param);
+    layer_->SetUp(bottom_, top_);
+    // Gradients of ones, as the loss layers take
+    for (int i = 0; i < top_.size(); ++i) {
+      caffe::caffe_set(top_[i]->count(), 1.f, top_[i]->mutable_cpu_diff());
+    }
+  }
+
+  virtual void Forward() {
+    layer_->Forward(bottom_, top_);
+  }
+  virtual void Backward() {
+    layer_->Backward(top_, propagate_down_, bottom_);
+  }
+
+ private:
+  static vector<int> IndexShape(char code, int n, int c, int h, int w) {
+    switch (code) {
+    case 'l':
+      return Shape(n, 1, h, w);
+    case 'c': {
+      vector<int> shape(2);
+      shape[0] = n;
+      shape[1] = c;
+      return shape;
+    }
+    case 'k':
+    case 'r':
+    case 'b':
+      return vector<int>(1, n);
+    default:
+      LOG(FATAL) << "Unknown bottom " << code;
+    }
+    return vector<int>();
+  }
+
+  static void FillIndices(char code, int n, int c, Blob<float>* blob) {
+    float* data = blob->mutable_cpu_data();
+    for (int i = 0; i < blob->count(); ++i) {
+      switch (code) {
+      case 'l':
+      case 'k':
+        data[i] = (i * 7) % c;
+        break;
+      case 'r':
+        data[i] = n - 1 - i;
+        break;
+      case 'b':
+        data[i] = i % 2;
+        break;
+      case 'c':
+        data[i] = i < c ? 0 : 1;
+        break;
+      }
+    }
+  }
+
+  vector<shared_ptr<Blob<float> > > blobs_;
+  vector<Blob<float>*> bottom_, top_;
+  vector<bool> propagate_down_;
+  shared_ptr<Layer<float> > layer_;
+};
+
+class NetRunner : public Runner {
+ public:
+  explicit NetRunner(const string& model)
+      : net_(model, caffe::TRAIN) {}
+
+  virtual void Forward() {
+    net_.Forward();
+  }
+  virtual void Backward() {
+    net_.Backward();
+  }
+
+ private:
+  Net<float> net_;
+};
+
+// A layer at a shape, or the net, with some number of threads
+struct Case {
+  string name;
+  const LayerSetup* layer;
+  vector<int> shape;
+  int threads;
+  bool backward;
+  // The batch size, to count throughput in
+  int items;
+};
+
+struct Result {
+  TimingStats forward;
+  TimingStats backward;
+  double items_per_second;
+};
+
+// Sets up the instance of a thread, warms it up, waits for the others and
+// times its passes in milliseconds.
+static void RunThread(const Case* c, boost::barrier* ready,
+    vector<double>* forward, vector<double>* backward) {
+  SetMode();
+  Caffe::set_random_seed(1701);
+  shared_ptr<Runner> runner;
+  if (c->layer) {
+    runner.reset(new LayerRunner(*c->layer, c->shape));
+  } else {
+    runner.reset(new NetRunner(FLAGS_model));
+  }
+  for (int i = 0; i < FLAGS_warmup; ++i) {
+    runner->Forward();
+    if (c->backward) {
+      runner->Backward();
+    }
+  }
+  ready->wait();
+  Timer timer;
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    timer.Start();
+    runner->Forward();
+    forward->push_back(timer.MicroSeconds() / 1000.);
+    if (c->backward) {
+      timer.Start();
+      runner->Backward();
+      backward->push_back(timer.MicroSeconds() / 1000.);
+    }
+  }
+}
+
+static Result Run(const Case& c) {
+  vector<vector<double> > forward(c.threads), backward(c.threads);
+  boost::barrier ready(c.threads + 1);
+  boost::thread_group threads;
+  for (int i = 0; i < c.threads; ++i) {
+    threads.create_thread(boost::bind(&RunThread, &c, &ready, &forward[i],
+        &backward[i]));
+  }
+  ready.wait();
+  const boost::posix_time::ptime start =
+      boost::posix_time::microsec_clock::universal_time();
+  threads.join_all();
+  const double seconds = (boost::posix_time::microsec_clock::universal_time()
+      - start).total_microseconds() / 1e6;
+  vector<double> all_forward, all_backward;
+  for (int i = 0; i < c.threads; ++i) {
+    all_forward.insert(all_forward.end(), forward[i].begin(),
+        forward[i].end());
+    all_backward.insert(all_backward.end(), backward[i].begin(),
+        backward[i].end());
+  }
+  Result result;
+  result.forward = caffe::ComputeTimingStats(all_forward);
+  result.backward = caffe::ComputeTimingStats(all_backward);
+  result.items_per_second = seconds ?
+      static_cast<double>(c.items) * c.threads * FLAGS_iterations / seconds : 0;
+  return result;
+}
+
+static string JsonStats(const TimingStats& stats) {
+  std::ostringstream json;
+  json << "{\"samples\": " << stats.samples
+       << ", \"median_ms\": " << stats.median
+       << ", \"p99_ms\": " << stats.p99
+       << ", \"mean_ms\": " << stats.mean
+       << ", \"stddev_ms\": " << stats.stddev
+       << ", \"min_ms\": " << stats.minimum
+       << ", \"max_ms\": " << stats.maximum << "}";
+  return json.str();
+}
+
+static vector<int> ParseInts(const string& list, const char* separators) {
+  vector<string> fields;
+  boost::split(fields, list, boost::is_any_of(separators));
+  vector<int> ints;
+  for (int i = 0; i < fields.size(); ++i) {
+    if (fields[i].size()) {
+      ints.push_back(atoi(fields[i].c_str()));
+      CHECK_GT(ints.back(), 0) << "Expected positive numbers in " << list;
+    }
+  }
+  return ints;
+}
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;
+  gflags::SetUsageMessage("benchmark layers and nets\n"
+      "usage: bench.bin [FLAGS]");
+  caffe::GlobalInit(&argc, &argv);
+  SetMode();
+
+  vector<vector<int> > shapes;
+  vector<string> shape_strings;
+  boost::split(shape_strings, FLAGS_shapes, boost::is_any_of(","));
+  for (int i = 0; i < shape_strings.size(); ++i) {
+    shapes.push_back(ParseInts(shape_strings[i], "x"));
+    CHECK_EQ(4, shapes.back().size()) << "Shapes are N x C x H x W, not "
+        << shape_strings[i];
+  }
+  const vector<int> thread_counts = ParseInts(FLAGS_threads, ",");
+  CHECK_GT(thread_counts.size(), 0) << "Need a number of threads.";
+  CHECK_GT(FLAGS_iterations, 0);
+
+  // Every registered type is benchmarked, or reported as skipped
+  const vector<string> registered = LayerRegistry<float>::LayerTypeList();
+  std::set<string> selected;
+  if (FLAGS_layers == "all") {
+    selected.insert(registered.begin(), registered.end());
+  } else if (FLAGS_layers != "none") {
+    vector<string> types;
+    boost::split(types, FLAGS_layers, boost::is_any_of(","));
+    selected.insert(types.begin(), types.end());
+  }
+  std::map<string, const LayerSetup*> setups;
+  for (int i = 0; i < sizeof(kLayerSetups) / sizeof(kLayerSetups[0]); ++i) {
+    setups[kLayerSetups[i].type] = &kLayerSetups[i];
+  }
+  std::map<string, string> reasons;
+  for (int i = 0; i < sizeof(kSkipped) / sizeof(kSkipped[0]); ++i) {
+    reasons[kSkipped[i][0]] = kSkipped[i][1];
+  }
+  vector<Case> cases;
+  vector<std::pair<string, string> > skipped;
+  for (std::set<string>::const_iterator type = selected.begin();
+       type != selected.end(); ++type) {
+    CHECK(std::find(registered.begin(), registered.end(), *type)
+        != registered.end()) << "Unknown layer type " << *type
+        << " (known types: " << boost::join(registered, ", ") << ")";
+    if (!setups.count(*type)) {
+      skipped.push_back(std::make_pair(*type, reasons.count(*type) ?
+          reasons[*type] : "has no benchmark setup"));
+      continue;
+    }
+    for (int i = 0; i < shapes.size(); ++i) {
+      for (int j = 0; j < thread_counts.size(); ++j) {
+        Case c;
+        c.layer = setups[*type];
+        c.shape = shapes[i];
+        c.threads = thread_counts[j];
+        c.backward = c.layer->backward;
+        c.items = shapes[i][0];
+        c.name = *type + "/" + shape_strings[i] + "/threads:" +
+            caffe::format_int(c.threads);
+        cases.push_back(c);
+      }
+    }
+  }
+  if (FLAGS_model.size()) {
+    caffe::NetParameter param;
+    caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &param);
+    for (int j = 0; j < thread_counts.size(); ++j) {
+      Case c;
+      c.name = "net:" + (param.name().size() ? param.name() : FLAGS_model) +
+          "/threads:" + caffe::format_int(thread_counts[j]);
+      c.layer = NULL;
+      c.threads = thread_counts[j];
+      c.backward = true;
+      // Count iterations, as the batch size is the model's own
+      c.items = 1;
+      cases.push_back(c);
+    }
+  }
+
+  std::ostringstream json;
+  json << "{\"context\": {\"date\": " << JsonString(
+          boost::posix_time::to_iso_extended_string(
+          boost::posix_time::second_clock::universal_time()))
+       << ", \"version\": \"" << AS_STRING(CAFFE_VERSION) << "\""
+       << ", \"mode\": \"" << (FLAGS_gpu >= 0 ? "GPU" : "CPU") << "\""
+       << ", \"iterations\": " << FLAGS_iterations
+       << ", \"warmup\": " << FLAGS_warmup << "},\n\"benchmarks\": [";
+  for (int i = 0; i < cases.size(); ++i) {
+    const Case& c = cases[i];
+    LOG(INFO) << "Benchmarking " << c.name;
+    const Result result = Run(c);
+    json << (i ? ",\n" : "\n") << "{\"name\": " << JsonString(c.name)
+         << ", \"type\": " << JsonString(c.layer ? c.layer->type : "Net");
+    if (c.layer) {
+      json << ", \"shape\": [" << c.shape[0] << ", " << c.shape[1] << ", "
+           << c.shape[2] << ", " << c.shape[3] << "]";
+    }
+    json << ", \"threads\": " << c.threads
+         << ", \"forward\": " << JsonStats(result.forward)
+         << ", \"backward\": "
+         << (c.backward ? JsonStats(result.backward) : "null")
+         << ", \"items_per_second\": " << result.items_per_second << "}";
+  }
+  json << "\n],\n\"skipped\": [";
+  for (int i = 0; i < skipped.size(); ++i) {
+    json << (i ? ",\n" : "\n") << "{\"type\": " << JsonString(skipped[i].first)
+         << ", \"reason\": " << JsonString(skipped[i].second) << "}";
+  }
+  json << "\n]}\n";
+
+  if (FLAGS_output.size()) {
+    std::ofstream file(FLAGS_output.c_str());
+    CHECK(file) << "Failed to open " << FLAGS_output;
+    file << json.str();
+    CHECK(file) << "Failed to write " << FLAGS_output;
+    LOG(INFO) << "Benchmark report written to " << FLAGS_output;
+  } else {
+    std::cout << json.str();
+  }
+  return 0;
+}
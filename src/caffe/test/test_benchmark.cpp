@@ -1,5 +1,7 @@
 #include <boost/thread.hpp>
 
+#include <vector>
+
 #include "gtest/gtest.h"
 
 #include "caffe/common.hpp"
@@ -87,4 +89,28 @@ TYPED_TEST(BenchmarkTest, TestTimerSeconds) {
   EXPECT_TRUE(timer.has_run_at_least_once());
 }
 
+TEST(TimingStatsTest, TestStats) {
+  vector<double> samples;
+  for (int i = 100; i > 0; --i) {
+    samples.push_back(i);
+  }
+  const TimingStats stats = ComputeTimingStats(samples);
+  EXPECT_EQ(100, stats.samples);
+  EXPECT_EQ(1, stats.minimum);
+  EXPECT_EQ(100, stats.maximum);
+  EXPECT_DOUBLE_EQ(50.5, stats.median);
+  EXPECT_DOUBLE_EQ(50.5, stats.mean);
+  EXPECT_NEAR(99.01, stats.p99, 1e-9);
+  EXPECT_NEAR(29.0115, stats.stddev, 1e-4);
+}
+
+TEST(TimingStatsTest, TestFewSamples) {
+  EXPECT_EQ(0, ComputeTimingStats(vector<double>()).samples);
+  const TimingStats stats = ComputeTimingStats(vector<double>(1, 3.));
+  EXPECT_EQ(1, stats.samples);
+  EXPECT_EQ(3, stats.median);
+  EXPECT_EQ(3, stats.p99);
+  EXPECT_EQ(0, stats.stddev);
+}
+
 }  // namespace caffe
@@ -131,6 +131,161 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     Caffe::set_solver_rank(0);
   }
 
+  void TestPartition() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    int batch_size = 5;
+    data_param->set_batch_size(batch_size);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    Caffe::set_solver_count(2);
+    for (int dev = 0; dev < Caffe::solver_count(); ++dev) {
+      Caffe::set_solver_rank(dev);
+      DataLayer<Dtype> layer(param);
+      layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+      // Each solver reads only its own contiguous part of the records
+      const int begin = batch_size * dev / Caffe::solver_count();
+      const int end = batch_size * (dev + 1) / Caffe::solver_count();
+      int item = 0;
+      for (int iter = 0; iter < 10; ++iter) {
+        layer.Forward(blob_bottom_vec_, blob_top_vec_);
+        for (int i = 0; i < batch_size; ++i) {
+          EXPECT_EQ(begin + item % (end - begin),
+              blob_top_label_->cpu_data()[i]);
+          ++item;
+        }
+      }
+    }
+    Caffe::set_solver_count(1);
+    Caffe::set_solver_rank(0);
+  }
+
+  // Several solvers reading with partition_test together read exactly the
+  // rows a single solver reads, even when the records don't fill the batches.
+  void TestPartitionedReadPosition() {
+    LayerParameter param;
+    param.set_phase(TEST);
+    DataParameter* data_param = param.mutable_data_param();
+    const int batch_size = 2;
+    const int num_records = 5;
+    const uint64_t num_rows = 4 * batch_size;
+    data_param->set_batch_size(batch_size);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_partition_test(true);
+    const int counts[] = {1, 2, 3, 7};
+    vector<Dtype> expected;
+    for (int c = 0; c < 4; ++c) {
+      Caffe::set_solver_count(counts[c]);
+      vector<Dtype> rows;
+      vector<bool> written(num_rows, false);
+      for (int rank = 0; rank < counts[c]; ++rank) {
+        Caffe::set_solver_rank(rank);
+        DataLayer<Dtype> layer(param);
+        layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+        const int dim = blob_top_data_->count() / batch_size;
+        rows.resize(num_rows * dim);
+        uint64_t index = 0;
+        while (PartitionedReadPosition(index, rank, counts[c], num_records)
+               < num_rows) {
+          layer.Forward(blob_bottom_vec_, blob_top_vec_);
+          for (int i = 0; i < batch_size; ++i, ++index) {
+            const uint64_t row = PartitionedReadPosition(index, rank,
+                counts[c], num_records);
+            if (row >= num_rows) { break; }
+            EXPECT_FALSE(written[row]);
+            written[row] = true;
+            EXPECT_EQ(row % num_records, blob_top_label_->cpu_data()[i]);
+            caffe_copy(dim, blob_top_data_->cpu_data() + i * dim,
+                &rows[row * dim]);
+          }
+        }
+      }
+      for (uint64_t row = 0; row < num_rows; ++row) {
+        EXPECT_TRUE(written[row]);
+      }
+      if (counts[c] == 1) {
+        expected = rows;
+      }
+      ASSERT_EQ(expected.size(), rows.size());
+      for (int i = 0; i < rows.size(); ++i) {
+        EXPECT_EQ(expected[i], rows[i]);
+      }
+    }
+    Caffe::set_solver_count(1);
+    Caffe::set_solver_rank(0);
+  }
+
+  void TestShuffle() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    int batch_size = 5;
+    data_param->set_batch_size(batch_size);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_shuffle(true);
+    Caffe::set_random_seed(seed_);
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    int num_in_order = 0;
+    for (int iter = 0; iter < 10; ++iter) {
+      // Every batch is an epoch, so holds every label once
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      vector<bool> seen(batch_size, false);
+      bool in_order = true;
+      for (int i = 0; i < batch_size; ++i) {
+        const int label = blob_top_label_->cpu_data()[i];
+        ASSERT_GE(label, 0);
+        ASSERT_LT(label, batch_size);
+        EXPECT_FALSE(seen[label]);
+        seen[label] = true;
+        in_order &= label == i;
+      }
+      num_in_order += in_order;
+    }
+    EXPECT_LT(num_in_order, 10);
+  }
+
+  void TestShuffleBuffer() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    const int batch_size = 5;
+    const int buffer_size = 3;
+    data_param->set_batch_size(batch_size);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_shuffle_buffer(buffer_size);
+    vector<vector<int> > sequences(2);
+    for (int run = 0; run < 2; ++run) {
+      Caffe::set_random_seed(seed_);
+      DataLayer<Dtype> layer(param);
+      layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+      for (int iter = 0; iter < 10; ++iter) {
+        layer.Forward(blob_bottom_vec_, blob_top_vec_);
+        for (int i = 0; i < batch_size; ++i) {
+          sequences[run].push_back(blob_top_label_->cpu_data()[i]);
+        }
+      }
+    }
+    // The order is reproducible from the seed
+    EXPECT_EQ(sequences[0], sequences[1]);
+    // Every record is read once per pass, so no record can fall behind or
+    // get ahead of the others by more than the buffer
+    vector<int> counts(batch_size, 0);
+    int num_in_order = 0;
+    for (int i = 0; i < sequences[0].size(); ++i) {
+      ++counts[sequences[0][i]];
+      num_in_order += sequences[0][i] == i % batch_size;
+    }
+    for (int i = 0; i < batch_size; ++i) {
+      EXPECT_NEAR(sequences[0].size() / batch_size, counts[i], buffer_size);
+    }
+    EXPECT_LT(num_in_order, sequences[0].size());
+  }
+
   void TestReshape(DataParameter_DB backend) {
     const int num_inputs = 5;
     // Save data of varying shapes.
@@ -387,6 +542,21 @@ TYPED_TEST(DataLayerTest, TestSkipLevelDB) {
   this->TestSkip();
 }
 
+TYPED_TEST(DataLayerTest, TestPartitionLevelDB) {
+  this->Fill(false, DataParameter_DB_LEVELDB);
+  this->TestPartition();
+}
+
+TYPED_TEST(DataLayerTest, TestPartitionedReadPositionLevelDB) {
+  this->Fill(false, DataParameter_DB_LEVELDB);
+  this->TestPartitionedReadPosition();
+}
+
+TYPED_TEST(DataLayerTest, TestShuffleBufferLevelDB) {
+  this->Fill(false, DataParameter_DB_LEVELDB);
+  this->TestShuffleBuffer();
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLevelDB) {
   this->TestReshape(DataParameter_DB_LEVELDB);
 }
@@ -432,6 +602,21 @@ TYPED_TEST(DataLayerTest, TestSkipLMDB) {
   this->TestSkip();
 }
 
+TYPED_TEST(DataLayerTest, TestPartitionLMDB) {
+  this->Fill(false, DataParameter_DB_LMDB);
+  this->TestPartition();
+}
+
+TYPED_TEST(DataLayerTest, TestPartitionedReadPositionLMDB) {
+  this->Fill(false, DataParameter_DB_LMDB);
+  this->TestPartitionedReadPosition();
+}
+
+TYPED_TEST(DataLayerTest, TestShuffleBufferLMDB) {
+  this->Fill(false, DataParameter_DB_LMDB);
+  this->TestShuffleBuffer();
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLMDB) {
   this->TestReshape(DataParameter_DB_LMDB);
 }
@@ -465,5 +650,48 @@ TYPED_TEST(DataLayerTest, TestReadCropTestLMDB) {
 }
 
 #endif  // USE_LMDB
+
+TYPED_TEST(DataLayerTest, TestReadRecords) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_RECORDS);
+  this->TestRead();
+}
+
+TYPED_TEST(DataLayerTest, TestSkipRecords) {
+  // More solvers than records, so the records can't be partitioned
+  this->Fill(false, DataParameter_DB_RECORDS);
+  this->TestSkip();
+}
+
+TYPED_TEST(DataLayerTest, TestPartitionRecords) {
+  this->Fill(false, DataParameter_DB_RECORDS);
+  this->TestPartition();
+}
+
+TYPED_TEST(DataLayerTest, TestPartitionedReadPositionRecords) {
+  this->Fill(false, DataParameter_DB_RECORDS);
+  this->TestPartitionedReadPosition();
+}
+
+TYPED_TEST(DataLayerTest, TestShuffleRecords) {
+  this->Fill(false, DataParameter_DB_RECORDS);
+  this->TestShuffle();
+}
+
+TYPED_TEST(DataLayerTest, TestShuffleBufferRecords) {
+  this->Fill(false, DataParameter_DB_RECORDS);
+  this->TestShuffleBuffer();
+}
+
+TYPED_TEST(DataLayerTest, TestReshapeRecords) {
+  this->TestReshape(DataParameter_DB_RECORDS);
+}
+
+TYPED_TEST(DataLayerTest, TestReadCropTrainRecords) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_RECORDS);
+  this->TestReadCrop(TRAIN);
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
@@ -1,4 +1,5 @@
 #if defined(USE_LEVELDB) && defined(USE_LMDB) && defined(USE_OPENCV)
+#include <map>
 #include <string>
 
 #include "boost/scoped_ptr.hpp"
@@ -7,6 +8,7 @@
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -117,6 +119,26 @@ TYPED_TEST(DBTest, TestKeyValue) {
   EXPECT_FALSE(cursor->valid());
 }
 
+TYPED_TEST(DBTest, TestPartition) {
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  EXPECT_FALSE(cursor->Partition(0, 3));
+  EXPECT_TRUE(cursor->Partition(1, 2));
+  for (int pass = 0; pass < 2; ++pass) {
+    EXPECT_TRUE(cursor->valid());
+    EXPECT_EQ(cursor->key(), "fish-bike.jpg");
+    cursor->Next();
+    EXPECT_FALSE(cursor->valid());
+    cursor->SeekToFirst();
+  }
+  cursor.reset(db->NewCursor());
+  EXPECT_TRUE(cursor->Partition(0, 2));
+  EXPECT_EQ(cursor->key(), "cat.jpg");
+  cursor->Next();
+  EXPECT_FALSE(cursor->valid());
+}
+
 TYPED_TEST(DBTest, TestWrite) {
   scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
   db->Open(this->source_, db::WRITE);
@@ -132,5 +154,34 @@ TYPED_TEST(DBTest, TestWrite) {
   txn->Commit();
 }
 
+TYPED_TEST(DBTest, TestWriteGrowsMap) {
+  // 24MB of values in one transaction, more than the default LMDB map size.
+  // The first half of the keys sort before the existing ones and are
+  // inserted, the second half after them and are appended.
+  const int kNumValues = 24;
+  map<string, string> values;
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::WRITE);
+  scoped_ptr<db::Transaction> txn(db->NewTransaction());
+  for (int i = 0; i < kNumValues; ++i) {
+    const string key = (i < kNumValues / 2 ? "" : "z") + format_int(i, 2);
+    values[key] = string(1 << 20, 'a' + i);
+    txn->Put(key, values[key]);
+  }
+  txn->Commit();
+  txn.reset();
+  db->Close();
+  db->Open(this->source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  int count = 0;
+  for (; cursor->valid(); cursor->Next()) {
+    if (values.count(cursor->key())) {
+      EXPECT_EQ(values[cursor->key()], cursor->value());
+    }
+    ++count;
+  }
+  EXPECT_EQ(kNumValues + 2, count);
+}
+
 }  // namespace caffe
 #endif  // USE_LEVELDB, USE_LMDB and USE_OPENCV
@@ -0,0 +1,180 @@
+#include <fstream>  // NOLINT(readability/streams)
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "boost/scoped_ptr.hpp"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/db_records.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+using boost::scoped_ptr;
+
+class RecordsTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    MakeTempDir(&source_);
+    source_ += "/records";
+  }
+
+  static string Key(int i) {
+    std::ostringstream key;
+    key << "key_" << i;
+    return key.str();
+  }
+
+  static string Value(int i) {
+    return string(10 + i, static_cast<char>('a' + i % 26));
+  }
+
+  // Writes num records starting at first in two transactions, into shards
+  // of a few records each.
+  void Fill(int first, int num, db::Mode mode) {
+    db::Records db;
+    db.Open(source_, mode);
+    db.set_shard_size(100);
+    scoped_ptr<db::Transaction> txn(db.NewTransaction());
+    for (int i = first; i < first + num; ++i) {
+      txn->Put(Key(i), Value(i));
+      if (i == first + num / 2) {
+        txn->Commit();
+      }
+    }
+    txn->Commit();
+  }
+
+  string source_;
+};
+
+TEST_F(RecordsTest, TestGetDB) {
+  scoped_ptr<db::DB> db(db::GetDB(DataParameter_DB_RECORDS));
+  scoped_ptr<db::DB> db_by_name(db::GetDB("records"));
+}
+
+TEST_F(RecordsTest, TestReadWrite) {
+  Fill(0, 20, db::NEW);
+  // The records span several shards
+  std::ifstream shard(db::RecordsShardName(source_, 2).c_str());
+  EXPECT_TRUE(shard.good());
+  db::Records db;
+  db.Open(source_, db::READ);
+  scoped_ptr<db::RecordsCursor> cursor(db.NewCursor());
+  EXPECT_EQ(20, cursor->size());
+  for (int pass = 0; pass < 2; ++pass) {
+    for (int i = 0; i < 20; ++i) {
+      ASSERT_TRUE(cursor->valid());
+      EXPECT_EQ(Key(i), cursor->key());
+      EXPECT_EQ(Value(i), cursor->value());
+      cursor->Next();
+    }
+    EXPECT_FALSE(cursor->valid());
+    cursor->SeekToFirst();
+  }
+}
+
+TEST_F(RecordsTest, TestSeek) {
+  Fill(0, 20, db::NEW);
+  db::Records db;
+  db.Open(source_, db::READ);
+  scoped_ptr<db::RecordsCursor> cursor(db.NewCursor());
+  const int positions[] = {17, 3, 19, 0, 8};
+  for (int i = 0; i < 5; ++i) {
+    cursor->Seek(positions[i]);
+    ASSERT_TRUE(cursor->valid());
+    EXPECT_EQ(Key(positions[i]), cursor->key());
+    EXPECT_EQ(Value(positions[i]), cursor->value());
+  }
+  cursor->Seek(20);
+  EXPECT_FALSE(cursor->valid());
+}
+
+TEST_F(RecordsTest, TestAppend) {
+  Fill(0, 7, db::NEW);
+  Fill(7, 5, db::WRITE);
+  db::Records db;
+  db.Open(source_, db::READ);
+  scoped_ptr<db::RecordsCursor> cursor(db.NewCursor());
+  EXPECT_EQ(12, cursor->size());
+  for (int i = 0; i < 12; ++i) {
+    EXPECT_EQ(Key(i), cursor->key());
+    cursor->Next();
+  }
+}
+
+TEST_F(RecordsTest, TestUncommitted) {
+  {
+    db::Records db;
+    db.Open(source_, db::NEW);
+    scoped_ptr<db::Transaction> txn(db.NewTransaction());
+    txn->Put(Key(0), Value(0));
+    txn->Commit();
+    txn->Put(Key(1), Value(1));
+  }
+  db::Records db;
+  db.Open(source_, db::READ);
+  scoped_ptr<db::RecordsCursor> cursor(db.NewCursor());
+  EXPECT_EQ(1, cursor->size());
+  EXPECT_EQ(Key(0), cursor->key());
+}
+
+TEST_F(RecordsTest, TestPartition) {
+  Fill(0, 20, db::NEW);
+  db::Records db;
+  db.Open(source_, db::READ);
+  const int count = 3;
+  int expected = 0;
+  for (int rank = 0; rank < count; ++rank) {
+    scoped_ptr<db::RecordsCursor> cursor(db.NewCursor());
+    EXPECT_TRUE(cursor->Partition(rank, count));
+    EXPECT_GE(cursor->size(), 20 / count);
+    EXPECT_LE(cursor->size(), 20 / count + 1);
+    // The parts are contiguous and cover every record once
+    for (; cursor->valid(); cursor->Next()) {
+      EXPECT_EQ(Key(expected++), cursor->key());
+    }
+  }
+  EXPECT_EQ(20, expected);
+  scoped_ptr<db::RecordsCursor> cursor(db.NewCursor());
+  EXPECT_FALSE(cursor->Partition(0, 21));
+}
+
+TEST_F(RecordsTest, TestShuffle) {
+  Fill(0, 20, db::NEW);
+  db::Records db;
+  db.Open(source_, db::READ);
+  scoped_ptr<db::RecordsCursor> cursor(db.NewCursor());
+  scoped_ptr<db::RecordsCursor> same_seed(db.NewCursor());
+  EXPECT_TRUE(cursor->Partition(1, 2));
+  EXPECT_TRUE(cursor->Shuffle(1701));
+  EXPECT_TRUE(same_seed->Partition(1, 2));
+  EXPECT_TRUE(same_seed->Shuffle(1701));
+  vector<string> previous;
+  for (int pass = 0; pass < 3; ++pass) {
+    vector<string> keys;
+    std::set<string> unique;
+    for (; cursor->valid(); cursor->Next(), same_seed->Next()) {
+      EXPECT_EQ(same_seed->key(), cursor->key());
+      keys.push_back(cursor->key());
+      unique.insert(cursor->key());
+    }
+    // Every pass visits each record of the part once, in a new order
+    EXPECT_EQ(10, keys.size());
+    EXPECT_EQ(10, unique.size());
+    for (int i = 10; i < 20; ++i) {
+      EXPECT_EQ(1, unique.count(Key(i)));
+    }
+    EXPECT_NE(previous, keys);
+    previous = keys;
+    cursor->SeekToFirst();
+    same_seed->SeekToFirst();
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/sgd_solvers.hpp"
+#include "caffe/util/gradient_compression.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/rng.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class GradientCompressorTest : public ::testing::Test {
+ protected:
+  GradientCompressorTest() : count_(1000) {
+    Caffe::set_random_seed(1701);
+  }
+
+  void FillGradient(vector<Dtype>* grad) {
+    grad->resize(count_);
+    caffe_rng_gaussian<Dtype>(count_, Dtype(0), Dtype(1), &(*grad)[0]);
+  }
+
+  // Checks that transmitted + residual gradient equals the sum of all the
+  // gradients passed to the compressor.
+  void TestErrorFeedback(const GradientCompressionParameter& param) {
+    GradientCompressor<Dtype> compressor(param, count_);
+    vector<char> buffer(compressor.max_bytes());
+    vector<Dtype> grad;
+    vector<Dtype> expected(count_, Dtype(0));
+    vector<Dtype> received(count_, Dtype(0));
+    for (int iter = 0; iter < 10; ++iter) {
+      FillGradient(&grad);
+      caffe_axpy<Dtype>(count_, Dtype(1), &grad[0], &expected[0]);
+      EXPECT_EQ(compressor.max_bytes(),
+                compressor.Compress(&grad[0], &buffer[0]));
+      compressor.DecompressAdd(&buffer[0], &received[0]);
+    }
+    EXPECT_EQ(10 * compressor.max_bytes(), compressor.total_bytes());
+    for (int i = 0; i < count_; ++i) {
+      EXPECT_NEAR(expected[i], received[i] + compressor.residual()[i], 1e-4);
+    }
+  }
+
+  const int count_;
+};
+
+TYPED_TEST_CASE(GradientCompressorTest, TestDtypes);
+
+TYPED_TEST(GradientCompressorTest, TestNone) {
+  GradientCompressionParameter param;
+  GradientCompressor<TypeParam> compressor(param, this->count_);
+  EXPECT_EQ(this->count_ * sizeof(TypeParam), compressor.max_bytes());
+  vector<TypeParam> grad;
+  this->FillGradient(&grad);
+  vector<char> buffer(compressor.max_bytes());
+  compressor.Compress(&grad[0], &buffer[0]);
+  vector<TypeParam> received(this->count_, TypeParam(0));
+  compressor.DecompressAdd(&buffer[0], &received[0]);
+  for (int i = 0; i < this->count_; ++i) {
+    EXPECT_EQ(grad[i], received[i]);
+  }
+}
+
+TYPED_TEST(GradientCompressorTest, TestFP16) {
+  GradientCompressionParameter param;
+  param.set_method(GradientCompressionParameter_Method_FP16);
+  param.set_error_feedback(false);
+  GradientCompressor<TypeParam> compressor(param, this->count_);
+  EXPECT_EQ(this->count_ * 2, compressor.max_bytes());
+  vector<TypeParam> grad;
+  this->FillGradient(&grad);
+  vector<char> buffer(compressor.max_bytes());
+  compressor.Compress(&grad[0], &buffer[0]);
+  vector<TypeParam> received(this->count_, TypeParam(0));
+  compressor.DecompressAdd(&buffer[0], &received[0]);
+  for (int i = 0; i < this->count_; ++i) {
+    EXPECT_NEAR(grad[i], received[i], std::fabs(grad[i]) / 2048 + 1e-7);
+  }
+}
+
+TYPED_TEST(GradientCompressorTest, TestFP16ErrorFeedback) {
+  GradientCompressionParameter param;
+  param.set_method(GradientCompressionParameter_Method_FP16);
+  this->TestErrorFeedback(param);
+}
+
+TYPED_TEST(GradientCompressorTest, TestTopK) {
+  GradientCompressionParameter param;
+  param.set_method(GradientCompressionParameter_Method_TOPK);
+  param.set_topk_ratio(0.05);
+  param.set_error_feedback(false);
+  GradientCompressor<TypeParam> compressor(param, this->count_);
+  EXPECT_EQ(50, compressor.k());
+  EXPECT_EQ(50 * 8, compressor.max_bytes());
+  vector<TypeParam> grad;
+  this->FillGradient(&grad);
+  vector<char> buffer(compressor.max_bytes());
+  compressor.Compress(&grad[0], &buffer[0]);
+  vector<TypeParam> received(this->count_, TypeParam(0));
+  compressor.DecompressAdd(&buffer[0], &received[0]);
+  // Every sent entry is larger in magnitude than every dropped one.
+  TypeParam min_sent = 1e10;
+  TypeParam max_dropped = 0;
+  int sent = 0;
+  for (int i = 0; i < this->count_; ++i) {
+    if (received[i] != 0) {
+      ++sent;
+      EXPECT_NEAR(grad[i], received[i], 1e-6);
+      min_sent = std::min(min_sent, std::fabs(grad[i]));
+    } else {
+      max_dropped = std::max(max_dropped, std::fabs(grad[i]));
+    }
+  }
+  EXPECT_EQ(50, sent);
+  EXPECT_GT(min_sent, max_dropped);
+}
+
+TYPED_TEST(GradientCompressorTest, TestTopKErrorFeedback) {
+  GradientCompressionParameter param;
+  param.set_method(GradientCompressionParameter_Method_TOPK);
+  param.set_topk_ratio(0.1);
+  this->TestErrorFeedback(param);
+}
+
+// Trains the least squares problem of test_gradient_based_solver.cpp while
+// passing the gradients through a compressor, as one solver would see them
+// after an exchange.
+template <typename Dtype>
+class CompressedSolverTest : public CPUDeviceTest<Dtype> {
+ protected:
+  class Compression : public Solver<Dtype>::Callback {
+   public:
+    Compression(const GradientCompressionParameter& param, Net<Dtype>* net)
+        : net_(net) {
+      size_t count = 0;
+      for (int i = 0; i < net_->learnable_params().size(); ++i) {
+        count += net_->learnable_params()[i]->count();
+      }
+      compressor_.reset(new GradientCompressor<Dtype>(param, count));
+      grad_.resize(count);
+      buffer_.resize(compressor_->max_bytes());
+    }
+
+   protected:
+    void on_start() {}
+    void on_gradients_ready() {
+      const vector<Blob<Dtype>*>& params = net_->learnable_params();
+      Dtype* ptr = &grad_[0];
+      for (int i = 0; i < params.size(); ++i) {
+        caffe_copy(params[i]->count(), params[i]->cpu_diff(), ptr);
+        ptr += params[i]->count();
+      }
+      compressor_->Compress(&grad_[0], &buffer_[0]);
+      caffe_set(grad_.size(), Dtype(0), &grad_[0]);
+      compressor_->DecompressAdd(&buffer_[0], &grad_[0]);
+      ptr = &grad_[0];
+      for (int i = 0; i < params.size(); ++i) {
+        caffe_copy(params[i]->count(), ptr, params[i]->mutable_cpu_diff());
+        ptr += params[i]->count();
+      }
+    }
+
+    Net<Dtype>* net_;
+    shared_ptr<GradientCompressor<Dtype> > compressor_;
+    vector<Dtype> grad_;
+    vector<char> buffer_;
+  };
+
+  // Returns the training loss after num_iters iterations.
+  Dtype Train(GradientCompressionParameter_Method method, int num_iters) {
+    std::ostringstream proto;
+    proto <<
+       "max_iter: " << num_iters << " "
+       "base_lr: 0.01 "
+       "lr_policy: 'fixed' "
+       "solver_mode: CPU "
+       "snapshot_after_train: false "
+       "net_param { "
+       "  name: 'TestNetwork' "
+       "  layer { "
+       "    name: 'data' "
+       "    type: 'HDF5Data' "
+       "    hdf5_data_param { "
+       "      source: '" ABS_TEST_DATA_DIR "/solver_data_list.txt' "
+       "      batch_size: 4 "
+       "    } "
+       "    top: 'data' "
+       "    top: 'targets' "
+       "  } "
+       "  layer { "
+       "    name: 'innerprod' "
+       "    type: 'InnerProduct' "
+       "    inner_product_param { "
+       "      num_output: 1 "
+       "      weight_filler { type: 'gaussian' std: 1.0 } "
+       "      bias_filler { type: 'gaussian' std: 1.0 } "
+       "    } "
+       "    bottom: 'data' "
+       "    top: 'innerprod' "
+       "  } "
+       "  layer { "
+       "    name: 'loss' "
+       "    type: 'EuclideanLoss' "
+       "    bottom: 'innerprod' "
+       "    bottom: 'targets' "
+       "  } "
+       "} ";
+    SolverParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto.str(), &param));
+    param.mutable_gradient_compression()->set_method(method);
+    param.mutable_gradient_compression()->set_topk_ratio(0.1);
+    Caffe::set_random_seed(1701);
+    SGDSolver<Dtype> solver(param);
+    Compression compression(param.gradient_compression(),
+                            solver.net().get());
+    solver.add_callback(&compression);
+    solver.Solve();
+    Dtype loss;
+    solver.net()->Forward(&loss);
+    return loss;
+  }
+};
+
+TYPED_TEST_CASE(CompressedSolverTest, TestDtypes);
+
+TYPED_TEST(CompressedSolverTest, TestConvergence) {
+  typedef TypeParam Dtype;
+  const Dtype initial_loss =
+      this->Train(GradientCompressionParameter_Method_NONE, 0);
+  const Dtype loss = this->Train(GradientCompressionParameter_Method_NONE, 50);
+  const Dtype fp16_loss =
+      this->Train(GradientCompressionParameter_Method_FP16, 50);
+  const Dtype topk_loss =
+      this->Train(GradientCompressionParameter_Method_TOPK, 50);
+  EXPECT_LT(loss, initial_loss);
+  EXPECT_NEAR(loss, fp16_loss, 1e-2 * initial_loss);
+  EXPECT_LT(topk_loss, initial_loss);
+}
+
+}  // namespace caffe
@@ -1,11 +1,14 @@
 #include <string>
 #include <vector>
 
+#include "google/protobuf/text_format.h"
 #include "gtest/gtest.h"
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
+#include "caffe/layers/hdf5_data_layer.hpp"
 #include "caffe/layers/hdf5_output_layer.hpp"
+#include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
@@ -119,4 +122,152 @@ TYPED_TEST(HDF5OutputLayerTest, TestForward) {
       this->output_file_name_;
 }
 
+TYPED_TEST(HDF5OutputLayerTest, TestBufferedForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  hid_t file_id = H5Fopen(this->input_file_name_.c_str(), H5F_ACC_RDONLY,
+                          H5P_DEFAULT);
+  ASSERT_GE(file_id, 0)<< "Failed to open HDF5 file" <<
+      this->input_file_name_;
+  hdf5_load_nd_dataset(file_id, HDF5_DATA_DATASET_NAME, 0, 4,
+                       this->blob_data_, true);
+  hdf5_load_nd_dataset(file_id, HDF5_DATA_LABEL_NAME, 0, 4,
+                       this->blob_label_, true);
+  herr_t status = H5Fclose(file_id);
+  EXPECT_GE(status, 0)<< "Failed to close HDF5 file " <<
+      this->input_file_name_;
+  this->blob_bottom_vec_.push_back(this->blob_data_);
+  this->blob_bottom_vec_.push_back(this->blob_label_);
+
+  // Five batches through a buffer of two, written synchronously or not,
+  // compressed or not, all end up appended in order.
+  const int num_batches = 5;
+  for (int async = 0; async < 2; ++async) {
+    LayerParameter param;
+    HDF5OutputParameter* hdf5_output_param =
+        param.mutable_hdf5_output_param();
+    hdf5_output_param->set_file_name(this->output_file_name_);
+    hdf5_output_param->set_buffer_batches(2);
+    hdf5_output_param->set_async(async);
+    hdf5_output_param->set_compression(async ? 0 : 1);
+    {
+      HDF5OutputLayer<Dtype> layer(param);
+      layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      for (int i = 0; i < num_batches; ++i) {
+        layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      }
+    }
+    file_id = H5Fopen(this->output_file_name_.c_str(), H5F_ACC_RDONLY,
+                      H5P_DEFAULT);
+    ASSERT_GE(file_id, 0)<< "Failed to open HDF5 file" <<
+        this->output_file_name_;
+    Blob<Dtype> blob_data, blob_label;
+    hdf5_load_nd_dataset(file_id, HDF5_DATA_DATASET_NAME, 0, 4,
+                         &blob_data, true);
+    hdf5_load_nd_dataset(file_id, HDF5_DATA_LABEL_NAME, 0, 4,
+                         &blob_label, true);
+    status = H5Fclose(file_id);
+    EXPECT_GE(status, 0) << "Failed to close HDF5 file " <<
+        this->output_file_name_;
+
+    const int num = this->blob_data_->num();
+    ASSERT_EQ(num_batches * num, blob_data.num());
+    ASSERT_EQ(num_batches * num, blob_label.num());
+    for (int i = 0; i < blob_data.count(); ++i) {
+      EXPECT_EQ(this->blob_data_->cpu_data()[i % this->blob_data_->count()],
+          blob_data.cpu_data()[i]);
+    }
+    for (int i = 0; i < blob_label.count(); ++i) {
+      EXPECT_EQ(this->blob_label_->cpu_data()[i % this->blob_label_->count()],
+          blob_label.cpu_data()[i]);
+    }
+  }
+}
+
+TYPED_TEST(HDF5OutputLayerTest, TestAsyncWithPrefetchedInput) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The input is read by the prefetch and read ahead threads of an HDF5Data
+  // layer while its batches are written by the thread of an HDF5Output one
+  const string data_param =
+      "  hdf5_data_param { "
+      "    source: '" ABS_TEST_DATA_DIR "/sample_data_list.txt' "
+      "    batch_size: 4 "
+      "    chunk_size: 3 "
+      "    prefetch: 2 "
+      "    read_ahead: 2 "
+      "  } ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(
+      "layer { "
+      "  name: 'input' "
+      "  type: 'HDF5Data' "
+      "  top: 'data' "
+      "  top: 'label' " + data_param +
+      "} "
+      "layer { "
+      "  name: 'output' "
+      "  type: 'HDF5Output' "
+      "  bottom: 'data' "
+      "  bottom: 'label' "
+      "  hdf5_output_param { "
+      "    file_name: '" + this->output_file_name_ + "' "
+      "    buffer_batches: 1 "
+      "    async: true "
+      "  } "
+      "} ", &param));
+  // The same rows, read on this thread
+  LayerParameter input_param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(
+      "top: 'data' top: 'label' " + data_param, &input_param));
+  input_param.mutable_hdf5_data_param()->set_prefetch(0);
+  input_param.mutable_hdf5_data_param()->set_read_ahead(0);
+  HDF5DataLayer<Dtype> input(input_param);
+  Blob<Dtype> expected_data, expected_label, batch_data, batch_label;
+  vector<Blob<Dtype>*> input_top;
+  input_top.push_back(&batch_data);
+  input_top.push_back(&batch_label);
+  input.SetUp(this->blob_bottom_vec_, input_top);
+
+  const int num_batches = 12;
+  {
+    Net<Dtype> net(param);
+    for (int i = 0; i < num_batches; ++i) {
+      net.Forward();
+    }
+  }
+  for (int i = 0; i < num_batches; ++i) {
+    input.Forward(this->blob_bottom_vec_, input_top);
+    vector<int> shape = batch_data.shape();
+    shape[0] *= num_batches;
+    expected_data.Reshape(shape);
+    shape = batch_label.shape();
+    shape[0] *= num_batches;
+    expected_label.Reshape(shape);
+    caffe_copy(batch_data.count(), batch_data.cpu_data(),
+        expected_data.mutable_cpu_data() + i * batch_data.count());
+    caffe_copy(batch_label.count(), batch_label.cpu_data(),
+        expected_label.mutable_cpu_data() + i * batch_label.count());
+  }
+
+  hid_t file_id = H5Fopen(this->output_file_name_.c_str(), H5F_ACC_RDONLY,
+                          H5P_DEFAULT);
+  ASSERT_GE(file_id, 0)<< "Failed to open HDF5 file" <<
+      this->output_file_name_;
+  Blob<Dtype> blob_data, blob_label;
+  hdf5_load_nd_dataset(file_id, HDF5_DATA_DATASET_NAME, 0, 4,
+                       &blob_data, true);
+  hdf5_load_nd_dataset(file_id, HDF5_DATA_LABEL_NAME, 0, 4,
+                       &blob_label, true);
+  herr_t status = H5Fclose(file_id);
+  EXPECT_GE(status, 0) << "Failed to close HDF5 file " <<
+      this->output_file_name_;
+  ASSERT_EQ(expected_data.count(), blob_data.count());
+  ASSERT_EQ(expected_label.count(), blob_label.count());
+  for (int i = 0; i < blob_data.count(); ++i) {
+    EXPECT_EQ(expected_data.cpu_data()[i], blob_data.cpu_data()[i]);
+  }
+  for (int i = 0; i < blob_label.count(); ++i) {
+    EXPECT_EQ(expected_label.cpu_data()[i], blob_label.cpu_data()[i]);
+  }
+}
+
 }  // namespace caffe
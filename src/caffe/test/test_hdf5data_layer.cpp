@@ -1,4 +1,6 @@
+#include <fstream>  // NOLINT(readability/streams)
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "hdf5.h"
@@ -9,6 +11,7 @@
 #include "caffe/common.hpp"
 #include "caffe/layers/hdf5_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/hdf5.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -132,6 +135,115 @@ TYPED_TEST(HDF5DataLayerTest, TestRead) {
   }
 }
 
+TYPED_TEST(HDF5DataLayerTest, TestReadAhead) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.add_top("data");
+  param.add_top("label");
+  param.add_top("label2");
+  HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+  hdf5_data_param->set_batch_size(5);
+  hdf5_data_param->set_source(*(this->filename));
+  HDF5DataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Fetching the files ahead doesn't change what is read
+  hdf5_data_param->set_read_ahead(2);
+  Blob<Dtype> data, label;
+  vector<Blob<Dtype>*> top_vec;
+  top_vec.push_back(&data);
+  top_vec.push_back(&label);
+  top_vec.push_back(this->blob_top_label2_);
+  HDF5DataLayer<Dtype> read_ahead_layer(param);
+  read_ahead_layer.SetUp(this->blob_bottom_vec_, top_vec);
+  for (int iter = 0; iter < 10; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    read_ahead_layer.Forward(this->blob_bottom_vec_, top_vec);
+    for (int i = 0; i < data.count(); ++i) {
+      EXPECT_EQ(this->blob_top_data_->cpu_data()[i], data.cpu_data()[i]);
+    }
+    for (int i = 0; i < label.count(); ++i) {
+      EXPECT_EQ(this->blob_top_label_->cpu_data()[i], label.cpu_data()[i]);
+    }
+  }
+}
+
+TYPED_TEST(HDF5DataLayerTest, TestReadChunks) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.add_top("data");
+  param.add_top("label");
+  param.add_top("label2");
+  HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+  hdf5_data_param->set_batch_size(4);
+  hdf5_data_param->set_source(*(this->filename));
+  HDF5DataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Chunks that don't divide the files nor the batches, read in the
+  // background and read ahead on other threads, give the same rows as whole
+  // files
+  hdf5_data_param->set_chunk_size(3);
+  hdf5_data_param->set_prefetch(2);
+  hdf5_data_param->set_read_ahead(2);
+  hdf5_data_param->set_read_ahead_threads(2);
+  Blob<Dtype> data, label;
+  vector<Blob<Dtype>*> top_vec;
+  top_vec.push_back(&data);
+  top_vec.push_back(&label);
+  top_vec.push_back(this->blob_top_label2_);
+  HDF5DataLayer<Dtype> chunk_layer(param);
+  chunk_layer.SetUp(this->blob_bottom_vec_, top_vec);
+  EXPECT_TRUE(data.shape() == this->blob_top_data_->shape());
+  for (int iter = 0; iter < 12; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    chunk_layer.Forward(this->blob_bottom_vec_, top_vec);
+    for (int i = 0; i < data.count(); ++i) {
+      EXPECT_EQ(this->blob_top_data_->cpu_data()[i], data.cpu_data()[i]);
+    }
+    for (int i = 0; i < label.count(); ++i) {
+      EXPECT_EQ(this->blob_top_label_->cpu_data()[i], label.cpu_data()[i]);
+    }
+  }
+}
+
+TYPED_TEST(HDF5DataLayerTest, TestShuffleChunks) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.add_top("data");
+  param.add_top("label");
+  param.add_top("label2");
+  HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+  const int batch_size = 5;
+  hdf5_data_param->set_batch_size(batch_size);
+  hdf5_data_param->set_source(*(this->filename));
+  hdf5_data_param->set_shuffle(true);
+  hdf5_data_param->set_chunk_size(3);
+  hdf5_data_param->set_prefetch(1);
+  HDF5DataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Each epoch outputs the 20 rows of the two files once, each row being
+  // identified by its first value
+  const int row_size = this->blob_top_data_->count(1);
+  for (int epoch = 0; epoch < 3; ++epoch) {
+    vector<int> seen(20, 0);
+    for (int iter = 0; iter < 4; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      for (int i = 0; i < batch_size; ++i) {
+        const Dtype first = this->blob_top_data_->cpu_data()[i * row_size];
+        const int row = static_cast<int>(first) / row_size;
+        ASSERT_GE(row, 0);
+        ASSERT_LT(row, 20);
+        ++seen[row];
+        // Rows stay whole across tops
+        EXPECT_EQ(row % 10 + 1, this->blob_top_label_->cpu_data()[i]);
+        EXPECT_EQ(row % 10 + 2, this->blob_top_label2_->cpu_data()[i]);
+      }
+    }
+    for (int row = 0; row < 20; ++row) {
+      EXPECT_EQ(1, seen[row]) << "row " << row << " epoch " << epoch;
+    }
+  }
+}
+
 TYPED_TEST(HDF5DataLayerTest, TestSkip) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter param;
@@ -162,4 +274,37 @@ TYPED_TEST(HDF5DataLayerTest, TestSkip) {
   Caffe::set_solver_rank(0);
 }
 
+TEST(HDF5RowsExtentsTest, TestExtents) {
+  // sample_data.h5 stores its datasets contiguously, as floats, and
+  // sample_data_2_gzip.h5 in compressed chunks.
+  const string filename = ABS_TEST_DATA_DIR "/sample_data.h5";
+  hid_t file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  ASSERT_GE(file_id, 0);
+  vector<pair<int64_t, int64_t> > extents;
+  ASSERT_TRUE(hdf5_get_rows_extents(file_id, "data", 2, 3, &extents));
+  Blob<float> rows;
+  hdf5_load_nd_dataset_rows(file_id, "data", 1, INT_MAX, 2, 3, &rows);
+  H5Fclose(file_id);
+  // The extent holds exactly the bytes of the rows
+  ASSERT_EQ(1, extents.size());
+  ASSERT_EQ(rows.count() * sizeof(float), extents[0].second);
+  std::ifstream file(filename.c_str(), std::ios::binary);
+  file.seekg(extents[0].first);
+  vector<float> bytes(rows.count());
+  file.read(reinterpret_cast<char*>(bytes.data()), extents[0].second);
+  ASSERT_TRUE(file.good());
+  for (int i = 0; i < rows.count(); ++i) {
+    EXPECT_EQ(rows.cpu_data()[i], bytes[i]);
+  }
+
+  file_id = H5Fopen(ABS_TEST_DATA_DIR "/sample_data_2_gzip.h5",
+      H5F_ACC_RDONLY, H5P_DEFAULT);
+  ASSERT_GE(file_id, 0);
+  extents.clear();
+  if (hdf5_get_rows_extents(file_id, "data", 2, 3, &extents)) {
+    EXPECT_GT(extents.size(), 0);
+  }
+  H5Fclose(file_id);
+}
+
 }  // namespace caffe
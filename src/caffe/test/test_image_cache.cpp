@@ -0,0 +1,150 @@
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "boost/scoped_ptr.hpp"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/image_cache.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+using boost::scoped_ptr;
+
+class ImageCacheTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    MakeTempFilename(&filename_);
+  }
+
+  static string Key(int i) {
+    std::ostringstream key;
+    key << "image_" << i << "|8x8|color";
+    return key.str();
+  }
+
+  // An 8x8 color image of pixels derived from i.
+  static vector<uint8_t> Pixels(int i) {
+    vector<uint8_t> pixels(8 * 8 * 3);
+    for (int j = 0; j < pixels.size(); ++j) {
+      pixels[j] = static_cast<uint8_t>(i * 7 + j);
+    }
+    return pixels;
+  }
+
+  static void Insert(ImageCache* cache, int i) {
+    cache->Insert(Key(i), 8, 8, 3, &Pixels(i)[0]);
+  }
+
+  static void ExpectCached(const ImageCache& cache, int i) {
+    CachedImage image;
+    ASSERT_TRUE(cache.Lookup(Key(i), &image)) << Key(i);
+    EXPECT_EQ(8, image.rows);
+    EXPECT_EQ(8, image.cols);
+    EXPECT_EQ(3, image.channels);
+    EXPECT_EQ(Pixels(i), vector<uint8_t>(image.data, image.data + 8 * 8 * 3));
+  }
+
+  string filename_;
+};
+
+TEST_F(ImageCacheTest, TestInsertLookup) {
+  ImageCache cache(filename_, 1 << 20);
+  CachedImage image;
+  EXPECT_FALSE(cache.Lookup(Key(0), &image));
+  for (int i = 0; i < 10; ++i) {
+    Insert(&cache, i);
+  }
+  EXPECT_EQ(10, cache.num_images());
+  for (int i = 0; i < 10; ++i) {
+    ExpectCached(cache, i);
+  }
+  // Inserting a cached key again changes nothing
+  Insert(&cache, 3);
+  EXPECT_EQ(10, cache.num_images());
+}
+
+TEST_F(ImageCacheTest, TestReopen) {
+  {
+    ImageCache cache(filename_, 1 << 20);
+    for (int i = 0; i < 5; ++i) {
+      Insert(&cache, i);
+    }
+  }
+  ImageCache cache(filename_, 1 << 20);
+  EXPECT_EQ(5, cache.num_images());
+  for (int i = 0; i < 5; ++i) {
+    ExpectCached(cache, i);
+  }
+}
+
+TEST_F(ImageCacheTest, TestFull) {
+  // Each entry takes 256 bytes, so three fit with a small one in between.
+  ImageCache cache(filename_, 1000);
+  EXPECT_EQ(960, cache.capacity());
+  Insert(&cache, 0);
+  const uint8_t pixel = 42;
+  cache.Insert("small", 1, 1, 1, &pixel);
+  for (int i = 1; i < 20; ++i) {
+    Insert(&cache, i);
+  }
+  // The first images stay cached and later ones aren't inserted
+  EXPECT_EQ(4, cache.num_images());
+  for (int i = 0; i < 3; ++i) {
+    ExpectCached(cache, i);
+  }
+  CachedImage image;
+  EXPECT_TRUE(cache.Lookup("small", &image));
+  EXPECT_FALSE(cache.Lookup(Key(3), &image));
+  ImageCache reopened(filename_, 1000);
+  EXPECT_EQ(4, reopened.num_images());
+  for (int i = 0; i < 3; ++i) {
+    ExpectCached(reopened, i);
+  }
+}
+
+TEST_F(ImageCacheTest, TestEpochsLargerThanCache) {
+  // Room for 16 of the 64 images read in order every epoch
+  ImageCache cache(filename_, 16 * 256);
+  const int num_images = 64;
+  vector<int> hits(2, 0);
+  for (int epoch = 0; epoch < 2; ++epoch) {
+    for (int i = 0; i < num_images; ++i) {
+      CachedImage image;
+      if (cache.Lookup(Key(i), &image)) {
+        ++hits[epoch];
+      } else {
+        Insert(&cache, i);
+      }
+    }
+  }
+  EXPECT_EQ(0, hits[0]);
+  EXPECT_EQ(16, hits[1]);
+}
+
+TEST_F(ImageCacheTest, TestTooLarge) {
+  ImageCache cache(filename_, 256);
+  vector<uint8_t> pixels(16 * 16 * 3);
+  cache.Insert("large", 16, 16, 3, &pixels[0]);
+  EXPECT_EQ(0, cache.num_images());
+  Insert(&cache, 0);
+  ExpectCached(cache, 0);
+}
+
+TEST_F(ImageCacheTest, TestCapacityChange) {
+  {
+    ImageCache cache(filename_, 1 << 20);
+    Insert(&cache, 0);
+  }
+  // A file of another capacity is started over
+  ImageCache cache(filename_, 1 << 16);
+  EXPECT_EQ(0, cache.num_images());
+  Insert(&cache, 1);
+  ExpectCached(cache, 1);
+}
+
+}  // namespace caffe
@@ -215,5 +215,79 @@ TYPED_TEST(ImageDataLayerTest, TestSpace) {
   EXPECT_EQ(this->blob_top_label_->cpu_data()[0], 1);
 }
 
+TYPED_TEST(ImageDataLayerTest, TestCache) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(1);
+  image_data_param->set_source(this->filename_reshape_.c_str());
+  image_data_param->set_new_height(64);
+  image_data_param->set_new_width(48);
+  image_data_param->set_shuffle(false);
+  // Decode every image of two epochs without the cache
+  vector<vector<Dtype> > expected;
+  {
+    ImageDataLayer<Dtype> layer(param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int iter = 0; iter < 4; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      const Dtype* data = this->blob_top_data_->cpu_data();
+      expected.push_back(vector<Dtype>(data,
+          data + this->blob_top_data_->count()));
+    }
+  }
+  string cache_file;
+  MakeTempFilename(&cache_file);
+  image_data_param->set_cache_file(cache_file);
+  image_data_param->set_cache_size_mb(1);
+  // The first epoch fills the cache, the second and a new layer read it
+  for (int run = 0; run < 2; ++run) {
+    ImageDataLayer<Dtype> layer(param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int iter = 0; iter < 4; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      EXPECT_EQ(iter % 2, this->blob_top_label_->cpu_data()[0]);
+      ASSERT_EQ(expected[iter].size(), this->blob_top_data_->count());
+      const Dtype* data = this->blob_top_data_->cpu_data();
+      for (int i = 0; i < expected[iter].size(); ++i) {
+        ASSERT_EQ(expected[iter][i], data[i]);
+      }
+    }
+  }
+  ImageCache cache(cache_file, 1 << 20);
+  EXPECT_EQ(2, cache.num_images());
+}
+
+TYPED_TEST(ImageDataLayerTest, TestThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(5);
+  image_data_param->set_source(this->filename_reshape_.c_str());
+  image_data_param->set_new_height(64);
+  image_data_param->set_new_width(48);
+  image_data_param->set_shuffle(false);
+  vector<vector<Dtype> > expected;
+  for (int threads = 1; threads <= 3; ++threads) {
+    image_data_param->set_threads(threads);
+    ImageDataLayer<Dtype> layer(param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int iter = 0; iter < 2; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      // Each item is where it would be with a single thread
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ((iter * 5 + i) % 2, this->blob_top_label_->cpu_data()[i]);
+      }
+      const Dtype* data = this->blob_top_data_->cpu_data();
+      vector<Dtype> batch(data, data + this->blob_top_data_->count());
+      if (threads == 1) {
+        expected.push_back(batch);
+      } else {
+        EXPECT_TRUE(expected[iter] == batch);
+      }
+    }
+  }
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
@@ -1,6 +1,7 @@
 #include <stdint.h>  // for uint32_t & uint64_t
 #include <time.h>
 #include <cmath>  // for std::fabs
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -119,6 +120,32 @@ TYPED_TEST(CPUMathFunctionsTest, TestCopy) {
   }
 }
 
+TEST(HalfConversionTest, TestSpecialValues) {
+  EXPECT_EQ(0x0000, caffe_float_to_half(0.f));
+  EXPECT_EQ(0x8000, caffe_float_to_half(-0.f));
+  EXPECT_EQ(0x3c00, caffe_float_to_half(1.f));
+  EXPECT_EQ(0xc000, caffe_float_to_half(-2.f));
+  EXPECT_EQ(0x7bff, caffe_float_to_half(65504.f));
+  EXPECT_EQ(0x7c00, caffe_float_to_half(1e6f));
+  EXPECT_EQ(0x0001, caffe_float_to_half(std::pow(2.f, -24)));
+  EXPECT_EQ(0x0400, caffe_float_to_half(std::pow(2.f, -14)));
+  EXPECT_EQ(0x0000, caffe_float_to_half(1e-10f));
+  EXPECT_EQ(1.f, caffe_half_to_float(0x3c00));
+  EXPECT_EQ(-2.f, caffe_half_to_float(0xc000));
+  EXPECT_EQ(65504.f, caffe_half_to_float(0x7bff));
+  EXPECT_EQ(std::pow(2.f, -24), caffe_half_to_float(0x0001));
+}
+
+TEST(HalfConversionTest, TestRoundTrip) {
+  vector<float> values(1000);
+  caffe_rng_uniform<float>(values.size(), -100.f, 100.f, &values[0]);
+  for (int i = 0; i < values.size(); ++i) {
+    const float converted = caffe_half_to_float(caffe_float_to_half(values[i]));
+    // 11 bits of precision
+    EXPECT_NEAR(values[i], converted, std::fabs(values[i]) / 2048.f);
+  }
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
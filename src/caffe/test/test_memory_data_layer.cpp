@@ -2,6 +2,8 @@
 #include <opencv2/core/core.hpp>
 #endif  // USE_OPENCV
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <string>
 #include <vector>
 
@@ -115,6 +117,157 @@ TYPED_TEST(MemoryDataLayerTest, TestForward) {
   }
 }
 
+template <typename Dtype>
+void ProduceBatches(MemoryDataLayer<Dtype>* layer, const Blob<Dtype>* data,
+    const Blob<Dtype>* labels, int batches) {
+  const int batch_size = layer->batch_size();
+  for (int i = 0; i < batches; ++i) {
+    Batch<Dtype>* batch = layer->GetFreeBatch();
+    caffe_copy(batch->data_.count(),
+        data->cpu_data() + data->offset(batch_size * i),
+        batch->data_.mutable_cpu_data());
+    caffe_copy(batch_size, labels->cpu_data() + batch_size * i,
+        batch->label_.mutable_cpu_data());
+    layer->AddBatch(batch);
+  }
+}
+
+TYPED_TEST(MemoryDataLayerTest, TestStreaming) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  LayerParameter layer_param;
+  MemoryDataParameter* md_param = layer_param.mutable_memory_data_param();
+  md_param->set_batch_size(this->batch_size_);
+  md_param->set_channels(this->channels_);
+  md_param->set_height(this->height_);
+  md_param->set_width(this->width_);
+  md_param->set_buffers(2);
+  MemoryDataLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // The producer gets ahead of Forward by at most the two buffers
+  boost::thread producer(ProduceBatches<Dtype>, &layer, this->data_,
+      this->labels_, this->batches_);
+  for (int batch_num = 0; batch_num < this->batches_; ++batch_num) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int j = 0; j < this->data_blob_->count(); ++j) {
+      EXPECT_EQ(this->data_blob_->cpu_data()[j],
+          this->data_->cpu_data()[
+              this->data_->offset(1) * this->batch_size_ * batch_num + j]);
+    }
+    for (int j = 0; j < this->label_blob_->count(); ++j) {
+      EXPECT_EQ(this->label_blob_->cpu_data()[j],
+          this->labels_->cpu_data()[this->batch_size_ * batch_num + j]);
+    }
+  }
+  producer.join();
+  // Forward still holds the last batch
+  EXPECT_TRUE(layer.GetFreeBatch(false) != NULL);
+  EXPECT_TRUE(layer.GetFreeBatch(false) == NULL);
+}
+
+TYPED_TEST(MemoryDataLayerTest, TestStreamingAddDatumVector) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  LayerParameter param;
+  MemoryDataParameter* memory_data_param = param.mutable_memory_data_param();
+  memory_data_param->set_batch_size(this->batch_size_);
+  memory_data_param->set_channels(this->channels_);
+  memory_data_param->set_height(this->height_);
+  memory_data_param->set_width(this->width_);
+  memory_data_param->set_buffers(2);
+  MemoryDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  int num_iter = 5;
+  vector<Datum> datum_vector(this->batch_size_ * num_iter);
+  const size_t count = this->channels_ * this->height_ * this->width_;
+  for (int i = 0; i < this->batch_size_ * num_iter; ++i) {
+    datum_vector[i].set_channels(this->channels_);
+    datum_vector[i].set_height(this->height_);
+    datum_vector[i].set_width(this->width_);
+    datum_vector[i].set_label(i);
+    vector<char> pixels(count);
+    for (int j = 0; j < count; ++j) {
+      pixels[j] = (i + j) % 256;
+    }
+    datum_vector[i].set_data(&(pixels[0]), count);
+  }
+  // More batches than buffers, so adding waits for Forward
+  boost::thread producer(&MemoryDataLayer<Dtype>::AddDatumVector, &layer,
+      datum_vector);
+  for (int iter = 0; iter < num_iter; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    const Dtype* data = this->data_blob_->cpu_data();
+    for (int i = 0; i < this->batch_size_; ++i) {
+      const int item_id = this->batch_size_ * iter + i;
+      EXPECT_EQ(item_id, this->label_blob_->cpu_data()[i]);
+      for (int j = 0; j < count; ++j) {
+        EXPECT_EQ((item_id + j) % 256, data[i * count + j]);
+      }
+    }
+  }
+  producer.join();
+}
+
+TYPED_TEST(MemoryDataLayerTest, TestStreamingConcurrentTransforms) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  LayerParameter param;
+  MemoryDataParameter* memory_data_param = param.mutable_memory_data_param();
+  memory_data_param->set_batch_size(this->batch_size_);
+  memory_data_param->set_channels(this->channels_);
+  memory_data_param->set_height(this->height_);
+  memory_data_param->set_width(this->width_);
+  memory_data_param->set_buffers(3);
+  param.mutable_transform_param()->set_mirror(true);
+  MemoryDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int num_producers = 2;
+  const int num_iter = 4;
+  const size_t count = this->channels_ * this->height_ * this->width_;
+  vector<vector<Datum> > datum_vectors(num_producers);
+  for (int p = 0; p < num_producers; ++p) {
+    for (int i = 0; i < this->batch_size_ * num_iter; ++i) {
+      Datum datum;
+      datum.set_channels(this->channels_);
+      datum.set_height(this->height_);
+      datum.set_width(this->width_);
+      datum.set_label(p * this->batch_size_ * num_iter + i);
+      vector<char> pixels(count);
+      for (int j = 0; j < count; ++j) {
+        pixels[j] = (datum.label() + j) % 128;
+      }
+      datum.set_data(&(pixels[0]), count);
+      datum_vectors[p].push_back(datum);
+    }
+  }
+  // Producers mirroring at random on two threads at once each use their own
+  // transformer, so every item is its datum, mirrored or not
+  boost::thread_group producers;
+  for (int p = 0; p < num_producers; ++p) {
+    producers.create_thread(boost::bind(
+        &MemoryDataLayer<Dtype>::AddDatumVector, &layer,
+        boost::cref(datum_vectors[p])));
+  }
+  const int width = this->width_;
+  for (int iter = 0; iter < num_producers * num_iter; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    const Dtype* data = this->data_blob_->cpu_data();
+    for (int i = 0; i < this->batch_size_; ++i) {
+      const int label = this->label_blob_->cpu_data()[i];
+      bool original = true, mirrored = true;
+      for (int j = 0; j < count; ++j) {
+        const int w = j % width;
+        const Dtype value = data[i * count + j];
+        original = original && value == (label + j) % 128;
+        mirrored = mirrored &&
+            value == (label + j - w + width - 1 - w) % 128;
+      }
+      EXPECT_TRUE(original || mirrored) << "item " << label;
+    }
+  }
+  producers.join_all();
+}
+
 #ifdef USE_OPENCV
 TYPED_TEST(MemoryDataLayerTest, AddDatumVectorDefaultTransform) {
   typedef typename TypeParam::Dtype Dtype;
@@ -9,6 +9,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/net.hpp"
+#include "caffe/util/flat_weights.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 
@@ -68,7 +69,8 @@ class NetTest : public MultiDeviceTest<TypeParam> {
   }
 
   virtual void InitTinyNet(const bool force_backward = false,
-                           const bool accuracy_layer = false) {
+                           const bool accuracy_layer = false,
+                           const bool contiguous_params = false) {
     string proto =
         "name: 'TinyTestNetwork' "
         "layer { "
@@ -141,6 +143,9 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     if (force_backward) {
       proto += "force_backward: true ";
     }
+    if (contiguous_params) {
+      proto += "contiguous_params: true state { phase: TRAIN } ";
+    }
     InitNetFromProtoString(proto);
   }
 
@@ -564,6 +569,166 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
+  virtual void InitCheckpointedNet(const bool checkpoint) {
+    const string checkpoint_param =
+        checkpoint ? "  checkpoint: true " : "";
+    const string& proto =
+        "name: 'CheckpointedNetwork' "
+        "state { phase: TRAIN } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 4 dim: 8 } "
+        "    shape { dim: 4 dim: 2 } "
+        "    data_filler { type: 'gaussian' std: 1 } "
+        "    data_filler { type: 'gaussian' std: 1 } "
+        "  } "
+        "  top: 'data' "
+        "  top: 'target' "
+        "} "
+        "layer { "
+        "  name: 'ip1' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 16 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'ip1' "
+        "} "
+        "layer { "
+        "  name: 'sig1' "
+        "  type: 'Sigmoid' "
+        "  bottom: 'ip1' "
+        "  top: 'sig1' " + checkpoint_param +
+        "} "
+        "layer { "
+        "  name: 'ip2' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 16 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "  bottom: 'sig1' "
+        "  top: 'ip2' "
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'sig1' "
+        "  bottom: 'ip2' "
+        "  top: 'sum' "
+        "} "
+        "layer { "
+        "  name: 'sig2' "
+        "  type: 'Sigmoid' "
+        "  bottom: 'sum' "
+        "  top: 'sig2' " + checkpoint_param +
+        "} "
+        "layer { "
+        "  name: 'ip3' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 2 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "  bottom: 'sig2' "
+        "  top: 'ip3' "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'ip3' "
+        "  bottom: 'target' "
+        "} ";
+    InitNetFromProtoString(proto);
+  }
+
+  // Stochastic and stateful layers may only follow the last checkpoint,
+  // unless checkpoint_stateful puts one after them.
+  virtual void InitCheckpointedStatefulNet(const bool checkpoint,
+      const bool checkpoint_stateful = false) {
+    const string checkpoint_param =
+        checkpoint ? "  checkpoint: true " : "";
+    const string checkpoint_stateful_param =
+        checkpoint_stateful ? "  checkpoint: true " : "";
+    const string& proto =
+        "name: 'CheckpointedStatefulNetwork' "
+        "state { phase: TRAIN } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 4 dim: 8 } "
+        "    shape { dim: 4 dim: 2 } "
+        "    data_filler { type: 'gaussian' std: 1 } "
+        "    data_filler { type: 'gaussian' std: 1 } "
+        "  } "
+        "  top: 'data' "
+        "  top: 'target' "
+        "} "
+        "layer { "
+        "  name: 'ip1' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 16 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'ip1' "
+        "} "
+        "layer { "
+        "  name: 'sig1' "
+        "  type: 'Sigmoid' "
+        "  bottom: 'ip1' "
+        "  top: 'sig1' " + checkpoint_param +
+        "} "
+        "layer { "
+        "  name: 'ip2' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 16 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "  bottom: 'sig1' "
+        "  top: 'ip2' "
+        "} "
+        "layer { "
+        "  name: 'bn' "
+        "  type: 'BatchNorm' "
+        "  bottom: 'ip2' "
+        "  top: 'bn' "
+        "} "
+        "layer { "
+        "  name: 'drop' "
+        "  type: 'Dropout' "
+        "  bottom: 'bn' "
+        "  top: 'drop' " + checkpoint_stateful_param +
+        "} "
+        "layer { "
+        "  name: 'ip3' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 2 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "  bottom: 'drop' "
+        "  top: 'ip3' "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'ip3' "
+        "  bottom: 'target' "
+        "} ";
+    InitNetFromProtoString(proto);
+  }
+
   virtual void InitReshapableNet() {
     const string& proto =
         "name: 'ReshapableNetwork' "
@@ -1342,6 +1507,279 @@ TYPED_TEST(NetTest, TestSharedWeightsResume) {
   }
 }
 
+TYPED_TEST(NetTest, TestFlatWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  const bool kForceBackward = false;
+  const bool kAccuracyLayer = false;
+  this->InitTinyNet(kForceBackward, kAccuracyLayer);
+  shared_ptr<Net<Dtype> > source_net = this->net_;
+  string filename;
+  MakeTempFilename(&filename);
+  source_net->ToFlat(filename);
+  EXPECT_TRUE(FlatWeights::IsFlatWeights(filename));
+  const vector<shared_ptr<Blob<Dtype> > >& source_params =
+      source_net->params();
+  for (int map = 0; map < 2; ++map) {
+    Caffe::set_random_seed(this->seed_ + 1);
+    this->InitTinyNet(kForceBackward, kAccuracyLayer);
+    this->net_->CopyTrainedLayersFromFlat(filename, map);
+    const vector<shared_ptr<Blob<Dtype> > >& params = this->net_->params();
+    ASSERT_EQ(source_params.size(), params.size());
+    for (int i = 0; i < params.size(); ++i) {
+      ASSERT_EQ(source_params[i]->shape(), params[i]->shape());
+      for (int j = 0; j < params[i]->count(); ++j) {
+        EXPECT_EQ(source_params[i]->cpu_data()[j], params[i]->cpu_data()[j]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestFlatWeightsSharedWeightsResume) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  this->net_->ForwardBackward();
+  this->net_->Update();
+  Blob<Dtype>* ip1_weights = this->net_->layers()[1]->blobs()[0].get();
+  Blob<Dtype> shared_params;
+  const bool kReshape = true;
+  const bool kCopyDiff = false;
+  shared_params.CopyFrom(*ip1_weights, kCopyDiff, kReshape);
+  const int count = ip1_weights->count();
+  string filename;
+  MakeTempFilename(&filename);
+  this->net_->ToFlat(filename);
+
+  // Map the weights and train from them; the file must not change.
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  this->net_->CopyTrainedLayersFrom(filename);
+  ip1_weights = this->net_->layers()[1]->blobs()[0].get();
+  Blob<Dtype>* ip2_weights = this->net_->layers()[2]->blobs()[0].get();
+  EXPECT_EQ(ip1_weights->cpu_data(), ip2_weights->cpu_data());
+  EXPECT_EQ(ip1_weights->cpu_diff(), ip2_weights->cpu_diff());
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(shared_params.cpu_data()[i], ip1_weights->cpu_data()[i]);
+  }
+  this->net_->ForwardBackward();
+  this->net_->Update();
+
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  const bool kMap = false;
+  this->net_->CopyTrainedLayersFromFlat(filename, kMap);
+  ip1_weights = this->net_->layers()[1]->blobs()[0].get();
+  ip2_weights = this->net_->layers()[2]->blobs()[0].get();
+  EXPECT_EQ(ip1_weights->cpu_data(), ip2_weights->cpu_data());
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(shared_params.cpu_data()[i], ip1_weights->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestLazyWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+      "name: 'LazyWeightsNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'DummyData' "
+      "  dummy_data_param { "
+      "    shape { dim: 5 } "
+      "    data_filler { type: 'constant' value: 3 } "
+      "  } "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'embed' "
+      "  type: 'Embed' "
+      "  embed_param { "
+      "    input_dim: 10 "
+      "    num_output: 4 "
+      "    weight_filler { type: 'gaussian' } "
+      "    bias_filler { type: 'gaussian' } "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'embed' "
+      "} "
+      "layer { "
+      "  name: 'innerproduct' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 2 "
+      "    weight_filler { type: 'gaussian' } "
+      "    bias_filler { type: 'gaussian' } "
+      "  } "
+      "  bottom: 'embed' "
+      "  top: 'innerproduct' "
+      "} ";
+  this->InitNetFromProtoString(proto);
+  const vector<Blob<Dtype>*>& output = this->net_->Forward();
+  Blob<Dtype> expected_output;
+  expected_output.CopyFrom(*output[0], false, true);
+  string filename;
+  MakeTempFilename(&filename);
+  this->net_->ToFlat(filename);
+
+  Caffe::set_random_seed(this->seed_ + 1);
+  this->InitNetFromProtoString(
+      proto + "lazy_weights: '" + filename + "' ");
+  // Every param points into the mapping and has no diff allocated.
+  ASSERT_EQ(1, this->net_->mapped_weights().size());
+  const FlatWeights& weights = *this->net_->mapped_weights()[0];
+  const vector<shared_ptr<Blob<Dtype> > >& params = this->net_->params();
+  ASSERT_EQ(weights.num_blobs(), params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    EXPECT_EQ(weights.data(i), params[i]->cpu_data());
+    EXPECT_EQ(SyncedMemory::UNINITIALIZED, params[i]->diff()->head());
+  }
+  const vector<Blob<Dtype>*>& lazy_output = this->net_->Forward();
+  ASSERT_EQ(expected_output.count(), lazy_output[0]->count());
+  for (int i = 0; i < expected_output.count(); ++i) {
+    EXPECT_EQ(expected_output.cpu_data()[i], lazy_output[0]->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestContiguousParams) {
+  typedef typename TypeParam::Dtype Dtype;
+  const bool kForceBackward = false;
+  const bool kAccuracyLayer = false;
+  this->InitTinyNet(kForceBackward, kAccuracyLayer);
+  EXPECT_FALSE(this->net_->contiguous_params());
+  const bool kContiguousParams = true;
+  this->InitTinyNet(kForceBackward, kAccuracyLayer, kContiguousParams);
+  ASSERT_TRUE(this->net_->contiguous_params());
+  const vector<Blob<Dtype>*>& params = this->net_->learnable_params();
+  ASSERT_EQ(2, params.size());
+  EXPECT_EQ(params[0]->count() + params[1]->count(),
+            this->net_->param_arena_count());
+  // Check that the params are consecutive slices of the arenas.
+  const Dtype* data = this->net_->param_arena_cpu_data();
+  const Dtype* diff = this->net_->param_arena_cpu_diff();
+  EXPECT_EQ(data, params[0]->cpu_data());
+  EXPECT_EQ(diff, params[0]->cpu_diff());
+  EXPECT_EQ(data + params[0]->count(), params[1]->cpu_data());
+  EXPECT_EQ(diff + params[0]->count(), params[1]->cpu_diff());
+}
+
+TYPED_TEST(NetTest, TestContiguousParamsUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const bool kForceBackward = false;
+  const bool kAccuracyLayer = false;
+  const bool kCopyDiff = true;
+  // Run a step on separately allocated params as a reference.
+  Caffe::set_random_seed(this->seed_);
+  this->InitTinyNet(kForceBackward, kAccuracyLayer);
+  this->net_->ForwardBackward();
+  const Dtype sumsq = this->net_->SumsqParamDiffs();
+  this->net_->ScaleParamDiffs(Dtype(0.5));
+  this->net_->Update();
+  vector<shared_ptr<Blob<Dtype> > > expected_params;
+  this->CopyNetParams(!kCopyDiff, &expected_params);
+  // Run the same step on contiguous params.
+  Caffe::set_random_seed(this->seed_);
+  const bool kContiguousParams = true;
+  this->InitTinyNet(kForceBackward, kAccuracyLayer, kContiguousParams);
+  this->net_->ForwardBackward();
+  EXPECT_NEAR(sumsq, this->net_->SumsqParamDiffs(), 1e-4 * sumsq);
+  this->net_->ScaleParamDiffs(Dtype(0.5));
+  this->net_->Update();
+  const vector<shared_ptr<Blob<Dtype> > >& params = this->net_->params();
+  ASSERT_EQ(expected_params.size(), params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(expected_params[i]->cpu_data()[j], params[i]->cpu_data()[j]);
+    }
+  }
+  this->net_->ClearParamDiffs();
+  for (int i = 0; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(0, params[i]->cpu_diff()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestCheckpointing) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitCheckpointedNet(false);
+  EXPECT_EQ(0, this->net_->num_checkpoint_segments());
+  shared_ptr<Net<Dtype> > reference_net = this->net_;
+  Caffe::set_random_seed(this->seed_);
+  this->InitCheckpointedNet(true);
+  EXPECT_EQ(3, this->net_->num_checkpoint_segments());
+  // ip1 and sig1; split, ip2, sum and sig2
+  EXPECT_EQ(6, this->net_->recomputed_layers());
+  EXPECT_LT(this->net_->checkpointed_activation_bytes(),
+            this->net_->activation_bytes());
+  // Run several iterations to check that recomputation does not depend on
+  // stale workspace contents. DummyData draws new data on every forward.
+  for (int iter = 0; iter < 3; ++iter) {
+    Caffe::set_random_seed(this->seed_ + iter);
+    reference_net->ClearParamDiffs();
+    const Dtype loss = reference_net->ForwardBackward();
+    Caffe::set_random_seed(this->seed_ + iter);
+    this->net_->ClearParamDiffs();
+    EXPECT_EQ(loss, this->net_->ForwardBackward());
+    const vector<shared_ptr<Blob<Dtype> > >& expected_params =
+        reference_net->params();
+    const vector<shared_ptr<Blob<Dtype> > >& params = this->net_->params();
+    ASSERT_EQ(expected_params.size(), params.size());
+    for (int i = 0; i < params.size(); ++i) {
+      for (int j = 0; j < params[i]->count(); ++j) {
+        EXPECT_EQ(expected_params[i]->cpu_diff()[j],
+                  params[i]->cpu_diff()[j]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestCheckpointingStatefulLayers) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitCheckpointedStatefulNet(false);
+  shared_ptr<Net<Dtype> > reference_net = this->net_;
+  EXPECT_FALSE(reference_net->layer_by_name("bn")->RepeatableForward());
+  EXPECT_FALSE(reference_net->layer_by_name("drop")->RepeatableForward());
+  EXPECT_TRUE(reference_net->layer_by_name("ip2")->RepeatableForward());
+  Caffe::set_random_seed(this->seed_);
+  this->InitCheckpointedStatefulNet(true);
+  EXPECT_EQ(2, this->net_->num_checkpoint_segments());
+  // ip1 and sig1
+  EXPECT_EQ(2, this->net_->recomputed_layers());
+  // Dropout draws the same masks and BatchNorm updates its moving statistics
+  // once per pass, as neither is recomputed.
+  for (int iter = 0; iter < 3; ++iter) {
+    Caffe::set_random_seed(this->seed_ + iter);
+    reference_net->ClearParamDiffs();
+    const Dtype loss = reference_net->ForwardBackward();
+    Caffe::set_random_seed(this->seed_ + iter);
+    this->net_->ClearParamDiffs();
+    EXPECT_EQ(loss, this->net_->ForwardBackward());
+    const vector<shared_ptr<Blob<Dtype> > >& expected_params =
+        reference_net->params();
+    const vector<shared_ptr<Blob<Dtype> > >& params = this->net_->params();
+    ASSERT_EQ(expected_params.size(), params.size());
+    for (int i = 0; i < params.size(); ++i) {
+      for (int j = 0; j < params[i]->count(); ++j) {
+        EXPECT_EQ(expected_params[i]->cpu_data()[j],
+                  params[i]->cpu_data()[j]);
+        EXPECT_EQ(expected_params[i]->cpu_diff()[j],
+                  params[i]->cpu_diff()[j]);
+      }
+    }
+  }
+  // The moving statistics were updated once per iteration.
+  const shared_ptr<Layer<Dtype> > bn = this->net_->layer_by_name("bn");
+  EXPECT_NEAR(1 + 0.999 + 0.999 * 0.999, bn->blobs()[2]->cpu_data()[0],
+              1e-4);
+}
+
+TYPED_TEST(NetTest, TestCheckpointingStatefulLayersDeathTest) {
+  // BatchNorm and Dropout in a recomputed segment are rejected.
+  EXPECT_DEATH(this->InitCheckpointedStatefulNet(true, true),
+               "Layer bn .*cannot be recomputed");
+}
+
 TYPED_TEST(NetTest, TestParamPropagateDown) {
   typedef typename TypeParam::Dtype Dtype;
   const bool kBiasTerm = true, kForceBackward = false;
@@ -0,0 +1,174 @@
+#include <fstream>  // NOLINT(readability/streams)
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/layers/pooling_layer.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/profiler.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ProfilerTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    Caffe::set_mode(Caffe::CPU);
+    const string proto =
+        "name: 'TinyNet' "
+        "force_backward: true "
+        "layer { name: 'data' type: 'DummyData' top: 'data' "
+        "  dummy_data_param { shape { dim: 5 dim: 3 dim: 4 dim: 4 } "
+        "    data_filler { type: 'gaussian' } } } "
+        "layer { name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+        "  convolution_param { num_output: 2 kernel_size: 3 "
+        "    weight_filler { type: 'gaussian' } } } "
+        "layer { name: 'ip' type: 'InnerProduct' bottom: 'conv' top: 'ip' "
+        "  inner_product_param { num_output: 6 "
+        "    weight_filler { type: 'gaussian' } } } ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    net_.reset(new Net<float>(param));
+  }
+
+  virtual void TearDown() {
+    Profiler::Get().Stop();
+  }
+
+  // The events of the given category and name.
+  static vector<ProfileEvent> Events(const char* category,
+      const string& name) {
+    const vector<ProfileEvent> events = Profiler::Get().events();
+    vector<ProfileEvent> found;
+    for (int i = 0; i < events.size(); ++i) {
+      if (string(events[i].category) == category && events[i].name == name) {
+        found.push_back(events[i]);
+      }
+    }
+    return found;
+  }
+
+  shared_ptr<Net<float> > net_;
+};
+
+TEST_F(ProfilerTest, TestDisabled) {
+  Profiler::Get().Start();
+  Profiler::Get().Stop();
+  EXPECT_FALSE(Profiler::enabled());
+  net_->Forward();
+  net_->Backward();
+  EXPECT_EQ(0, Profiler::Get().events().size());
+}
+
+TEST_F(ProfilerTest, TestNetPasses) {
+  Profiler::Get().Start();
+  EXPECT_TRUE(Profiler::enabled());
+  net_->Forward();
+  net_->Forward();
+  net_->Backward();
+  Profiler::Get().Stop();
+  EXPECT_EQ(2, Events("forward", "data").size());
+  EXPECT_EQ(2, Events("forward", "conv").size());
+  EXPECT_EQ(2, Events("forward", "ip").size());
+  EXPECT_EQ(1, Events("backward", "conv").size());
+  EXPECT_EQ(1, Events("backward", "ip").size());
+  // 5 images, 2 x 27 weights by 27 x 4 columns
+  const vector<ProfileEvent> conv = Events("forward", "conv");
+  EXPECT_EQ(5 * 2. * 2 * 27 * 4 + 5 * 2 * 4, conv[0].flops);
+  // 5 x 8 by 8 x 6 weights, and the bias
+  const vector<ProfileEvent> ip = Events("backward", "ip");
+  EXPECT_EQ(2 * 2. * 5 * 8 * 6 + 5 * 6, ip[0].flops);
+  for (int i = 0; i < conv.size(); ++i) {
+    EXPECT_GE(conv[i].start, 0);
+    EXPECT_GE(conv[i].duration, 0);
+    EXPECT_EQ(ip[0].thread, conv[i].thread);
+  }
+  // The second pass reuses the memory of the first
+  EXPECT_EQ(0, Events("forward", "ip")[1].bytes);
+}
+
+TEST_F(ProfilerTest, TestAllocations) {
+  Profiler::Get().Start();
+  Blob<float> blob(2, 3, 4, 5);
+  const int64_t allocated = Profiler::thread_allocated();
+  {
+    ProfileScope profile("solver", "allocate");
+    EXPECT_TRUE(profile.active());
+    blob.mutable_cpu_data();
+  }
+  const int64_t bytes = 120 * sizeof(float);
+  EXPECT_EQ(allocated + bytes, Profiler::thread_allocated());
+  const vector<ProfileEvent> events = Events("solver", "allocate");
+  ASSERT_EQ(1, events.size());
+  EXPECT_EQ(bytes, events[0].bytes);
+}
+
+TEST_F(ProfilerTest, TestStartClears) {
+  Profiler::Get().Start();
+  net_->Forward();
+  EXPECT_GT(Profiler::Get().events().size(), 0);
+  Profiler::Get().Start();
+  EXPECT_EQ(0, Profiler::Get().events().size());
+}
+
+TEST_F(ProfilerTest, TestExport) {
+  Profiler::Get().Start();
+  net_->Forward();
+  net_->Backward();
+  Profiler::Get().Stop();
+  string filename;
+  MakeTempFilename(&filename);
+  Profiler::Get().WriteTrace(filename);
+  std::ifstream file(filename.c_str());
+  std::stringstream trace;
+  trace << file.rdbuf();
+  EXPECT_EQ(0, trace.str().find("{\"displayTimeUnit\": \"ms\", "
+      "\"traceEvents\": ["));
+  EXPECT_NE(string::npos, trace.str().find("{\"name\": \"conv\", "
+      "\"cat\": \"forward\", \"ph\": \"X\", \"pid\": 0, \"tid\": "));
+  EXPECT_NE(string::npos, trace.str().find("\"cat\": \"backward\""));
+  const string summary = Profiler::Get().Summary();
+  EXPECT_EQ(0, summary.find("category"));
+  EXPECT_NE(string::npos, summary.find("forward  conv"));
+  EXPECT_NE(string::npos, summary.find("backward ip"));
+}
+
+TEST_F(ProfilerTest, TestCost) {
+  net_->Forward();
+  // 240 inputs, 40 outputs and 56 parameters, through 5 x 108 columns
+  const LayerCost conv = net_->layer_by_name("conv")->Cost(
+      net_->bottom_vecs()[1], net_->top_vecs()[1]);
+  EXPECT_EQ(4 * (240 + 40 + 56) + 2 * 4 * 540, conv.forward_bytes);
+  EXPECT_EQ(4 * (40 + 2 * 240 + 3 * 56) + 4 * 4 * 540, conv.backward_bytes);
+  // 40 inputs, 30 outputs and 54 parameters
+  const LayerCost ip = net_->layer_by_name("ip")->Cost(
+      net_->bottom_vecs()[2], net_->top_vecs()[2]);
+  EXPECT_EQ(4 * (40 + 30 + 54), ip.forward_bytes);
+  EXPECT_EQ(4 * (30 + 2 * 40 + 3 * 54), ip.backward_bytes);
+  EXPECT_EQ(2 * 2. * 5 * 8 * 6 + 5 * 6, ip.backward_flops);
+
+  LayerParameter param;
+  param.mutable_pooling_param()->set_kernel_size(2);
+  param.mutable_pooling_param()->set_stride(2);
+  Blob<float> bottom(2, 3, 4, 4), top;
+  vector<Blob<float>*> bottom_vec(1, &bottom), top_vec(1, &top);
+  PoolingLayer<float> max_pool(param);
+  max_pool.SetUp(bottom_vec, top_vec);
+  LayerCost pool = max_pool.Cost(bottom_vec, top_vec);
+  EXPECT_EQ(24 * 4, pool.forward_flops);
+  EXPECT_EQ(24, pool.backward_flops);
+  EXPECT_EQ(4 * (96 + 24), pool.forward_bytes);
+  param.mutable_pooling_param()->set_pool(PoolingParameter_PoolMethod_AVE);
+  PoolingLayer<float> ave_pool(param);
+  ave_pool.SetUp(bottom_vec, top_vec);
+  pool = ave_pool.Cost(bottom_vec, top_vec);
+  EXPECT_EQ(24 * 4, pool.backward_flops);
+}
+
+}  // namespace caffe
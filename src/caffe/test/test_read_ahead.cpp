@@ -0,0 +1,96 @@
+#include <boost/thread.hpp>
+
+#include <fstream>  // NOLINT(readability/streams)
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/read_ahead.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ReadAheadTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    MakeTempDir(&directory_);
+  }
+
+  // Writes a file of size bytes and returns its name.
+  string WriteFile(int i, int size) {
+    std::ostringstream filename;
+    filename << directory_ << "/file_" << i;
+    std::ofstream file(filename.str().c_str(), std::ios::binary);
+    file << string(size, 'x');
+    return filename.str();
+  }
+
+  // Waits for read_ahead to fetch files files.
+  static void WaitFor(const ReadAhead& read_ahead, int files) {
+    for (int i = 0; i < 1000 && read_ahead.files() < files; ++i) {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    }
+  }
+
+  string directory_;
+};
+
+TEST_F(ReadAheadTest, TestFetch) {
+  ReadAhead read_ahead(3, 10);
+  uint64_t bytes = 0;
+  for (int i = 0; i < 10; ++i) {
+    const int size = 1000 * i + (3 << 20) * (i == 7);
+    read_ahead.Fetch(WriteFile(i, size));
+    bytes += size;
+  }
+  WaitFor(read_ahead, 10);
+  EXPECT_EQ(10, read_ahead.files());
+  EXPECT_EQ(bytes, read_ahead.bytes());
+  EXPECT_EQ(0, read_ahead.pending());
+  EXPECT_GE(read_ahead.seconds(), 0);
+}
+
+TEST_F(ReadAheadTest, TestMissingFile) {
+  ReadAhead read_ahead(1, 10);
+  read_ahead.Fetch(directory_ + "/missing");
+  read_ahead.Fetch(WriteFile(0, 100));
+  WaitFor(read_ahead, 1);
+  // Missing files are skipped without being counted
+  EXPECT_EQ(1, read_ahead.files());
+  EXPECT_EQ(100, read_ahead.bytes());
+}
+
+TEST_F(ReadAheadTest, TestCapacity) {
+  vector<string> filenames;
+  for (int i = 0; i < 100; ++i) {
+    filenames.push_back(WriteFile(i, 10));
+  }
+  ReadAhead read_ahead(1, 5);
+  for (int i = 0; i < filenames.size(); ++i) {
+    read_ahead.Fetch(filenames[i]);
+    EXPECT_LE(read_ahead.pending(), 5);
+  }
+  // Every file is either fetched or dropped, the oldest first
+  for (int i = 0; i < 1000 && read_ahead.pending() > 0; ++i) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+  }
+  WaitFor(read_ahead, 100 - read_ahead.dropped());
+  EXPECT_EQ(0, read_ahead.pending());
+  EXPECT_EQ(100, read_ahead.files() + read_ahead.dropped());
+  EXPECT_GE(read_ahead.files(), 5);
+}
+
+TEST_F(ReadAheadTest, TestDestroyPending) {
+  // Files still queued on destruction are dropped
+  ReadAhead read_ahead(1, 100);
+  for (int i = 0; i < 100; ++i) {
+    read_ahead.Fetch(WriteFile(i, 10));
+  }
+}
+
+}  // namespace caffe
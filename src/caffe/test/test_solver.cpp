@@ -1,3 +1,4 @@
+#include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <utility>
 #include <vector>
@@ -9,6 +10,7 @@
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/sgd_solvers.hpp"
 #include "caffe/solver.hpp"
+#include "caffe/util/io.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -106,4 +108,79 @@ TYPED_TEST(SolverTest, TestInitTrainTestNets) {
   EXPECT_TRUE(this->solver_->test_nets()[1]->has_layer("accuracy"));
 }
 
+TYPED_TEST(SolverTest, TestSnapshotAsyncRetain) {
+  typedef typename TypeParam::Dtype Dtype;
+  string snapshot_prefix;
+  MakeTempDir(&snapshot_prefix);
+  snapshot_prefix += "/snapshot";
+  const string& proto =
+     "base_lr: 0.01 "
+     "lr_policy: 'fixed' "
+     "momentum: 0.9 "
+     "max_iter: 4 "
+     "snapshot: 1 "
+     "snapshot_async: true "
+     "snapshot_retain: 2 "
+     "snapshot_format: HDF5 "
+     "snapshot_prefix: '" + snapshot_prefix + "' "
+     "net_param { "
+     "  name: 'TestNetwork' "
+     "  layer { "
+     "    name: 'data' "
+     "    type: 'DummyData' "
+     "    dummy_data_param { "
+     "      shape { dim: 5 dim: 3 } "
+     "      shape { dim: 5 dim: 1 } "
+     "      data_filler { type: 'gaussian' } "
+     "    } "
+     "    top: 'data' "
+     "    top: 'label' "
+     "  } "
+     "  layer { "
+     "    name: 'innerprod' "
+     "    type: 'InnerProduct' "
+     "    inner_product_param { "
+     "      num_output: 1 "
+     "      weight_filler { type: 'gaussian' } "
+     "    } "
+     "    bottom: 'data' "
+     "    top: 'innerprod' "
+     "  } "
+     "  layer { "
+     "    name: 'loss' "
+     "    type: 'EuclideanLoss' "
+     "    bottom: 'innerprod' "
+     "    bottom: 'label' "
+     "  } "
+     "} ";
+  this->InitSolverFromProtoString(proto);
+  this->solver_->Solve();
+  // Only the last two snapshots are kept, and no temporary files remain.
+  for (int iter = 1; iter <= 4; ++iter) {
+    ostringstream prefix;
+    prefix << snapshot_prefix << "_iter_" << iter;
+    const bool kept = iter > 2;
+    const string files[] = { prefix.str() + ".caffemodel.h5",
+                             prefix.str() + ".solverstate.h5" };
+    for (int i = 0; i < 2; ++i) {
+      EXPECT_EQ(kept, std::ifstream(files[i].c_str()).good()) << files[i];
+      EXPECT_FALSE(std::ifstream((files[i] + ".tmp").c_str()).good());
+    }
+  }
+  // The last snapshot restores the trained weights.
+  shared_ptr<Solver<Dtype> > trained_solver = this->solver_;
+  this->InitSolverFromProtoString(proto);
+  this->solver_->Restore((snapshot_prefix + "_iter_4.solverstate.h5").c_str());
+  EXPECT_EQ(4, this->solver_->iter());
+  const vector<Blob<Dtype>*>& expected_params =
+      trained_solver->net()->learnable_params();
+  const vector<Blob<Dtype>*>& params = this->solver_->net()->learnable_params();
+  ASSERT_EQ(expected_params.size(), params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(expected_params[i]->cpu_data()[j], params[i]->cpu_data()[j]);
+    }
+  }
+}
+
 }  // namespace caffe
@@ -0,0 +1,61 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/worker_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class WorkerPoolTest : public ::testing::Test {
+ public:
+  // Records the call of worker, and the thread it ran on.
+  void Record(int worker) {
+    boost::mutex::scoped_lock lock(mutex_);
+    ++calls_[worker];
+    thread_ids_[worker] = boost::this_thread::get_id();
+  }
+
+ protected:
+  void Reset(int size) {
+    calls_.assign(size, 0);
+    thread_ids_.assign(size, boost::thread::id());
+  }
+
+  boost::mutex mutex_;
+  vector<int> calls_;
+  vector<boost::thread::id> thread_ids_;
+};
+
+TEST_F(WorkerPoolTest, TestRun) {
+  const int size = 4;
+  WorkerPool pool(size);
+  EXPECT_EQ(size, pool.size());
+  for (int run = 0; run < 20; ++run) {
+    Reset(size);
+    pool.Run(boost::bind(&WorkerPoolTest::Record, this, _1));
+    // Run returns after every worker ran once, worker 0 on this thread
+    for (int worker = 0; worker < size; ++worker) {
+      EXPECT_EQ(1, calls_[worker]);
+    }
+    EXPECT_EQ(boost::this_thread::get_id(), thread_ids_[0]);
+    for (int worker = 1; worker < size; ++worker) {
+      EXPECT_NE(thread_ids_[0], thread_ids_[worker]);
+    }
+  }
+}
+
+TEST_F(WorkerPoolTest, TestSingleWorker) {
+  WorkerPool pool(1);
+  Reset(1);
+  pool.Run(boost::bind(&WorkerPoolTest::Record, this, _1));
+  EXPECT_EQ(1, calls_[0]);
+  EXPECT_EQ(boost::this_thread::get_id(), thread_ids_[0]);
+}
+
+}  // namespace caffe
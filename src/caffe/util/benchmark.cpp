@@ -1,5 +1,9 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 #include "caffe/common.hpp"
 #include "caffe/util/benchmark.hpp"
 
@@ -166,4 +170,41 @@ float CPUTimer::MicroSeconds() {
   return this->elapsed_microseconds_;
 }
 
+// Interpolates between the closest ranks of the sorted samples.
+static double Percentile(const vector<double>& sorted, double fraction) {
+  const double rank = fraction * (sorted.size() - 1);
+  const int below = static_cast<int>(rank);
+  if (below + 1 >= sorted.size()) {
+    return sorted.back();
+  }
+  return sorted[below] + (rank - below) * (sorted[below + 1] - sorted[below]);
+}
+
+TimingStats ComputeTimingStats(const vector<double>& samples) {
+  TimingStats stats;
+  stats.samples = samples.size();
+  if (samples.empty()) {
+    return stats;
+  }
+  vector<double> sorted(samples);
+  std::sort(sorted.begin(), sorted.end());
+  stats.minimum = sorted.front();
+  stats.maximum = sorted.back();
+  stats.median = Percentile(sorted, 0.5);
+  stats.p99 = Percentile(sorted, 0.99);
+  double sum = 0;
+  for (int i = 0; i < sorted.size(); ++i) {
+    sum += sorted[i];
+  }
+  stats.mean = sum / sorted.size();
+  if (sorted.size() > 1) {
+    double squares = 0;
+    for (int i = 0; i < sorted.size(); ++i) {
+      squares += (sorted[i] - stats.mean) * (sorted[i] - stats.mean);
+    }
+    stats.stddev = std::sqrt(squares / (sorted.size() - 1));
+  }
+  return stats;
+}
+
 }  // namespace caffe
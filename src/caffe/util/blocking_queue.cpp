@@ -1,7 +1,10 @@
 #include <boost/thread.hpp>
 #include <string>
 
+#include "caffe/data_transformer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
+#include "caffe/layers/hdf5_data_layer.hpp"
+#include "caffe/layers/hdf5_output_layer.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/util/blocking_queue.hpp"
 
@@ -87,5 +90,11 @@ size_t BlockingQueue<T>::size() const {
 
 template class BlockingQueue<Batch<float>*>;
 template class BlockingQueue<Batch<double>*>;
+template class BlockingQueue<DataTransformer<float>*>;
+template class BlockingQueue<DataTransformer<double>*>;
+template class BlockingQueue<HDF5Chunk<float>*>;
+template class BlockingQueue<HDF5Chunk<double>*>;
+template class BlockingQueue<HDF5OutputBuffer<float>*>;
+template class BlockingQueue<HDF5OutputBuffer<double>*>;
 
 }  // namespace caffe
@@ -1,7 +1,13 @@
 #ifdef USE_LEVELDB
 #include "caffe/util/db_leveldb.hpp"
 
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <map>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace caffe { namespace db {
 
@@ -15,9 +21,83 @@ void LevelDB::Open(const string& source, Mode mode) {
   leveldb::Status status = leveldb::DB::Open(options, source, &db_);
   CHECK(status.ok()) << "Failed to open leveldb " << source
                      << std::endl << status.ToString();
+  source_ = source;
   LOG(INFO) << "Opened leveldb " << source;
 }
 
+void LevelDBCursor::SeekToFirst() {
+  if (!partitioned_) {
+    iter_->SeekToFirst();
+    return;
+  }
+  iter_->Seek(first_key_);
+  remaining_ = size_;
+}
+
+void LevelDBCursor::Next() {
+  iter_->Next();
+  if (partitioned_) {
+    --remaining_;
+  }
+}
+
+// First key and number of records of each part of a database
+struct LevelDBParts {
+  vector<string> first_keys;
+  vector<size_t> sizes;
+};
+
+// Splits the records of db in count parts of about equal size, in key order,
+// with a scan of the keys that counts them and another that finds the first
+// key of each part. No parts are found if there are fewer records than parts.
+static void SplitRecords(leveldb::DB* db, int count, LevelDBParts* parts) {
+  leveldb::ReadOptions options;
+  options.fill_cache = false;
+  boost::scoped_ptr<leveldb::Iterator> iter(db->NewIterator(options));
+  size_t num_records = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ++num_records;
+  }
+  CHECK(iter->status().ok()) << iter->status().ToString();
+  if (num_records < count) {
+    return;
+  }
+  iter->SeekToFirst();
+  size_t index = 0;
+  for (int part = 0; part < count; ++part) {
+    const size_t begin = num_records * part / count;
+    for (; index < begin; ++index) {
+      iter->Next();
+    }
+    CHECK(iter->Valid()) << "LevelDB changed while it was split";
+    parts->first_keys.push_back(iter->key().ToString());
+    parts->sizes.push_back(num_records * (part + 1) / count - begin);
+  }
+}
+
+bool LevelDBCursor::Partition(int rank, int count) {
+  CHECK_GE(rank, 0);
+  CHECK_LT(rank, count);
+  // Parts found so far, by database path and number of parts
+  static boost::mutex mutex;
+  static map<pair<string, int>, LevelDBParts> split_records;
+  boost::mutex::scoped_lock lock(mutex);
+  const pair<string, int> split(source_, count);
+  if (!split_records.count(split)) {
+    SplitRecords(db_, count, &split_records[split]);
+  }
+  const LevelDBParts& parts = split_records[split];
+  if (parts.first_keys.empty()) {
+    // Some ranks would have no records at all
+    return false;
+  }
+  first_key_ = parts.first_keys[rank];
+  size_ = parts.sizes[rank];
+  partitioned_ = true;
+  SeekToFirst();
+  return true;
+}
+
 }  // namespace db
 }  // namespace caffe
 #endif  // USE_LEVELDB
@@ -3,6 +3,7 @@
 
 #include <sys/stat.h>
 
+#include <algorithm>
 #include <string>
 
 namespace caffe { namespace db {
@@ -35,6 +36,49 @@ void LMDB::Open(const string& source, Mode mode) {
   LOG_IF(INFO, Caffe::root_solver()) << "Opened lmdb " << source;
 }
 
+void LMDBCursor::SeekToFirst() {
+  if (!partitioned_) {
+    Seek(MDB_FIRST);
+    return;
+  }
+  mdb_key_.mv_size = first_key_.size();
+  mdb_key_.mv_data = const_cast<char*>(first_key_.data());
+  Seek(MDB_SET_RANGE);
+  remaining_ = size_;
+}
+
+void LMDBCursor::Next() {
+  if (partitioned_ && --remaining_ == 0) {
+    valid_ = false;
+    return;
+  }
+  Seek(MDB_NEXT);
+}
+
+bool LMDBCursor::Partition(int rank, int count) {
+  CHECK_GE(rank, 0);
+  CHECK_LT(rank, count);
+  MDB_stat stat;
+  MDB_CHECK(mdb_stat(mdb_txn_, mdb_cursor_dbi(mdb_cursor_), &stat));
+  const size_t num_records = stat.ms_entries;
+  if (num_records < count) {
+    // Some ranks would have no records at all
+    return false;
+  }
+  const size_t begin = num_records * rank / count;
+  partitioned_ = false;
+  Seek(MDB_FIRST);
+  for (size_t i = 0; i < begin; ++i) {
+    Seek(MDB_NEXT);
+  }
+  CHECK(valid_) << "LMDB has fewer records than its statistics say";
+  first_key_ = key();
+  size_ = num_records * (rank + 1) / count - begin;
+  partitioned_ = true;
+  SeekToFirst();
+  return true;
+}
+
 LMDBCursor* LMDB::NewCursor() {
   MDB_txn* mdb_txn;
   MDB_cursor* mdb_cursor;
@@ -48,66 +92,131 @@ LMDBTransaction* LMDB::NewTransaction() {
   return new LMDBTransaction(mdb_env_);
 }
 
-void LMDBTransaction::Put(const string& key, const string& value) {
-  keys.push_back(key);
-  values.push_back(value);
+void LMDB::Reserve(size_t count, size_t bytes) {
+  MDB_stat stat;
+  MDB_CHECK(mdb_env_stat(mdb_env_, &stat));
+  struct MDB_envinfo info;
+  MDB_CHECK(mdb_env_info(mdb_env_, &info));
+  const size_t page_size = stat.ms_psize;
+  // Records larger than half a page get overflow pages, which are half
+  // empty on average, and B-tree pages are not full either.
+  size_t new_size = (info.me_last_pgno + 1) * page_size +
+      (bytes + count * (page_size / 2)) / 4 * 5;
+  // Round up to a multiple of 1MB, itself a multiple of the page size.
+  new_size = ((new_size >> 20) + 1) << 20;
+  if (new_size > info.me_mapsize) {
+    LOG(INFO) << "Setting LMDB map size to " << (new_size >> 20) << "MB";
+    MDB_CHECK(mdb_env_set_mapsize(mdb_env_, new_size));
+  }
 }
 
-void LMDBTransaction::Commit() {
-  MDB_dbi mdb_dbi;
-  MDB_val mdb_key, mdb_data;
-  MDB_txn *mdb_txn;
-
-  // Initialize MDB variables
-  MDB_CHECK(mdb_txn_begin(mdb_env_, NULL, 0, &mdb_txn));
-  MDB_CHECK(mdb_dbi_open(mdb_txn, NULL, 0, &mdb_dbi));
-
-  for (int i = 0; i < keys.size(); i++) {
-    mdb_key.mv_size = keys[i].size();
-    mdb_key.mv_data = const_cast<char*>(keys[i].data());
-    mdb_data.mv_size = values[i].size();
-    mdb_data.mv_data = const_cast<char*>(values[i].data());
-
-    // Add data to the transaction
-    int put_rc = mdb_put(mdb_txn, mdb_dbi, &mdb_key, &mdb_data, 0);
-    if (put_rc == MDB_MAP_FULL) {
-      // Out of memory - double the map size and retry
-      mdb_txn_abort(mdb_txn);
-      mdb_dbi_close(mdb_env_, mdb_dbi);
-      DoubleMapSize();
-      Commit();
-      return;
+LMDBTransaction::LMDBTransaction(MDB_env* mdb_env)
+    : mdb_env_(mdb_env), mdb_txn_(NULL), txn_bytes_(0),
+      last_key_known_(false) {
+  MDB_stat stat;
+  MDB_CHECK(mdb_env_stat(mdb_env_, &stat));
+  page_size_ = stat.ms_psize;
+}
+
+LMDBTransaction::~LMDBTransaction() {
+  if (mdb_txn_ != NULL) {
+    mdb_txn_abort(mdb_txn_);
+  }
+}
+
+void LMDBTransaction::Begin() {
+  MDB_CHECK(mdb_txn_begin(mdb_env_, NULL, 0, &mdb_txn_));
+  MDB_CHECK(mdb_dbi_open(mdb_txn_, NULL, 0, &mdb_dbi_));
+  if (!last_key_known_) {
+    MDB_cursor* mdb_cursor;
+    MDB_val mdb_key, mdb_data;
+    MDB_CHECK(mdb_cursor_open(mdb_txn_, mdb_dbi_, &mdb_cursor));
+    int rc = mdb_cursor_get(mdb_cursor, &mdb_key, &mdb_data, MDB_LAST);
+    if (rc != MDB_NOTFOUND) {
+      MDB_CHECK(rc);
+      last_key_.assign(static_cast<const char*>(mdb_key.mv_data),
+          mdb_key.mv_size);
     }
-    // May have failed for some other reason
-    MDB_CHECK(put_rc);
+    mdb_cursor_close(mdb_cursor);
+    last_key_known_ = true;
   }
+}
 
-  // Commit the transaction
-  int commit_rc = mdb_txn_commit(mdb_txn);
-  if (commit_rc == MDB_MAP_FULL) {
-    // Out of memory - double the map size and retry
-    mdb_dbi_close(mdb_env_, mdb_dbi);
-    DoubleMapSize();
-    Commit();
-    return;
+size_t LMDBTransaction::PutBytes(size_t key_size, size_t value_size) const {
+  // Node header and page pointer
+  const size_t node_size = key_size + value_size + 16;
+  if (node_size > page_size_ / 2) {
+    // The value goes to its own overflow pages
+    return (value_size / page_size_ + 2) * page_size_ + key_size + 16;
   }
-  // May have failed for some other reason
-  MDB_CHECK(commit_rc);
+  // Pages that split on inserts are only half full
+  return 2 * node_size;
+}
 
-  // Cleanup after successful commit
-  mdb_dbi_close(mdb_env_, mdb_dbi);
-  keys.clear();
-  values.clear();
+// Fails when LMDB ran out of map, which leaves the transaction unusable.
+static void CheckMapNotFull(int mdb_status) {
+  CHECK_NE(mdb_status, MDB_MAP_FULL) << "LMDB map full: the puts since the "
+      << "last commit took more space than estimated and are lost. Reserve "
+      << "the size of the database before writing it.";
+  MDB_CHECK(mdb_status);
 }
 
-void LMDBTransaction::DoubleMapSize() {
-  struct MDB_envinfo current_info;
-  MDB_CHECK(mdb_env_info(mdb_env_, &current_info));
-  size_t new_size = current_info.me_mapsize * 2;
-  DLOG(INFO) << "Doubling LMDB map size to " << (new_size>>20) << "MB ...";
+void LMDBTransaction::EnsureSpace(size_t bytes) {
+  struct MDB_envinfo info;
+  MDB_CHECK(mdb_env_info(mdb_env_, &info));
+  // Pages in use after the last commit, the puts of the open transaction,
+  // and spare pages for the copy-on-write of the B-tree path and free list
+  size_t needed = (info.me_last_pgno + 1 + 64) * page_size_ + txn_bytes_ +
+      bytes;
+  if (needed <= info.me_mapsize) {
+    return;
+  }
+  if (mdb_txn_ != NULL) {
+    CheckMapNotFull(mdb_txn_commit(mdb_txn_));
+    mdb_txn_ = NULL;
+    txn_bytes_ = 0;
+    MDB_CHECK(mdb_env_info(mdb_env_, &info));
+    needed = (info.me_last_pgno + 1 + 64) * page_size_ + bytes;
+  }
+  size_t new_size = std::max(info.me_mapsize + info.me_mapsize / 2,
+      needed + needed / 4);
+  new_size = ((new_size >> 20) + 1) << 20;
+  DLOG(INFO) << "Growing LMDB map size to " << (new_size >> 20) << "MB ...";
   MDB_CHECK(mdb_env_set_mapsize(mdb_env_, new_size));
 }
 
+void LMDBTransaction::Put(const string& key, const string& value) {
+  const size_t bytes = PutBytes(key.size(), value.size());
+  EnsureSpace(bytes);
+  if (mdb_txn_ == NULL) {
+    Begin();
+  }
+  MDB_val mdb_key, mdb_data;
+  mdb_key.mv_size = key.size();
+  mdb_key.mv_data = const_cast<char*>(key.data());
+  mdb_data.mv_size = value.size();
+  mdb_data.mv_data = const_cast<char*>(value.data());
+  // LMDB compares keys as unsigned bytes, like string::compare
+  const bool append = key.compare(last_key_) > 0;
+  CheckMapNotFull(mdb_put(mdb_txn_, mdb_dbi_, &mdb_key, &mdb_data,
+      append ? MDB_APPEND : 0));
+  if (append) {
+    last_key_ = key;
+  }
+  txn_bytes_ += bytes;
+}
+
+void LMDBTransaction::Commit() {
+  if (mdb_txn_ == NULL) {
+    // Nothing was put
+    return;
+  }
+  int commit_rc = mdb_txn_commit(mdb_txn_);
+  mdb_txn_ = NULL;
+  txn_bytes_ = 0;
+  CheckMapNotFull(commit_rc);
+}
+
 }  // namespace db
 }  // namespace caffe
 #endif  // USE_LMDB
@@ -0,0 +1,279 @@
+#include "caffe/util/db_records.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "caffe/util/rng.hpp"
+
+namespace caffe { namespace db {
+
+// Read-only memory map of a whole file.
+class MappedFile {
+ public:
+  explicit MappedFile(const string& filename) : data_(NULL), size_(0) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    CHECK_NE(fd, -1) << "File not found: " << filename;
+    struct stat file_stat;
+    CHECK_EQ(fstat(fd, &file_stat), 0) << "Couldn't stat " << filename;
+    size_ = file_stat.st_size;
+    if (size_ > 0) {
+      void* map = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+      CHECK(map != MAP_FAILED) << "Couldn't map " << filename;
+      data_ = static_cast<const char*>(map);
+    }
+    close(fd);
+  }
+  ~MappedFile() {
+    if (data_ != NULL) {
+      munmap(const_cast<char*>(data_), size_);
+    }
+  }
+  inline const char* data() const { return data_; }
+  inline size_t size() const { return size_; }
+
+ private:
+  const char* data_;
+  size_t size_;
+
+  DISABLE_COPY_AND_ASSIGN(MappedFile);
+};
+
+string RecordsShardName(const string& source, int shard) {
+  char name[16];
+  snprintf(name, sizeof(name), "/shard_%05d", shard);
+  return source + name;
+}
+
+RecordsCursor::RecordsCursor(shared_ptr<MappedFile> index,
+    const vector<shared_ptr<MappedFile> >& shards)
+    : index_(index), shards_(shards), begin_(0), position_(0),
+      shuffle_(false), seed_(0), epoch_(0) {
+  CHECK_EQ(sizeof(RecordsIndexEntry), 16);
+  // The map is page aligned, so the entries are too.
+  entries_ = reinterpret_cast<const RecordsIndexEntry*>(
+      index_->data() + kRecordsHeaderSize);
+  end_ = (index_->size() - kRecordsHeaderSize) / sizeof(RecordsIndexEntry);
+}
+
+void RecordsCursor::SeekToFirst() {
+  position_ = 0;
+  if (shuffle_) {
+    order_.resize(size());
+    for (size_t i = 0; i < order_.size(); ++i) {
+      order_[i] = begin_ + i;
+    }
+    // Every pass is shuffled differently, but reproducibly from the seed.
+    rng_t rng(seed_ + epoch_);
+    shuffle(order_.begin(), order_.end(), &rng);
+    ++epoch_;
+  }
+}
+
+bool RecordsCursor::Partition(int rank, int count) {
+  CHECK_GE(rank, 0);
+  CHECK_LT(rank, count);
+  const size_t num_records =
+      (index_->size() - kRecordsHeaderSize) / sizeof(RecordsIndexEntry);
+  if (num_records < count) {
+    // Some ranks would have no records at all
+    return false;
+  }
+  begin_ = num_records * rank / count;
+  end_ = num_records * (rank + 1) / count;
+  SeekToFirst();
+  return true;
+}
+
+bool RecordsCursor::Shuffle(unsigned int seed) {
+  shuffle_ = true;
+  seed_ = seed;
+  epoch_ = 0;
+  SeekToFirst();
+  return true;
+}
+
+const char* RecordsCursor::record(uint32_t* key_size,
+    uint32_t* value_size) const {
+  CHECK(position_ < size()) << "Cursor is past the last record";
+  const RecordsIndexEntry& entry =
+      entries_[shuffle_ ? order_[position_] : begin_ + position_];
+  CHECK_LT(entry.shard, shards_.size()) << "Missing shard " << entry.shard;
+  const MappedFile& shard = *shards_[entry.shard];
+  CHECK_LE(entry.offset + entry.size, shard.size())
+      << "Truncated shard " << entry.shard;
+  const char* data = shard.data() + entry.offset;
+  memcpy(key_size, data, sizeof(*key_size));  // NOLINT(caffe/alt_fn)
+  memcpy(value_size, data + sizeof(*key_size),  // NOLINT(caffe/alt_fn)
+         sizeof(*value_size));
+  CHECK_EQ(sizeof(*key_size) + sizeof(*value_size) + *key_size + *value_size,
+      entry.size) << "Corrupt record in shard " << entry.shard;
+  return data + sizeof(*key_size) + sizeof(*value_size);
+}
+
+string RecordsCursor::key() {
+  uint32_t key_size, value_size;
+  const char* data = record(&key_size, &value_size);
+  return string(data, key_size);
+}
+
+string RecordsCursor::value() {
+  uint32_t key_size, value_size;
+  const char* data = record(&key_size, &value_size);
+  return string(data + key_size, value_size);
+}
+
+RecordsWriter::RecordsWriter(const string& source, int shard,
+    uint64_t shard_size)
+    : source_(source), shard_size_(shard_size), shard_(shard - 1),
+      shard_offset_(0) {
+  const string index_name = source_ + "/index";
+  index_stream_.open(index_name.c_str(),
+      std::ios::out | std::ios::app | std::ios::binary);
+  CHECK(index_stream_) << "Couldn't open " << index_name;
+}
+
+RecordsIndexEntry RecordsWriter::Append(const string& key,
+    const string& value) {
+  const uint32_t key_size = key.size();
+  const uint32_t value_size = value.size();
+  const uint64_t size = sizeof(key_size) + sizeof(value_size) + key.size() +
+      value.size();
+  CHECK_LE(size, std::numeric_limits<uint32_t>::max())
+      << "Record of key " << key << " is too large";
+  if (!shard_stream_.is_open() ||
+      (shard_offset_ > 0 && shard_offset_ + size > shard_size_)) {
+    // Shards are opened lazily, so that opening for WRITE and writing
+    // nothing doesn't leave an empty shard behind.
+    if (shard_stream_.is_open()) {
+      shard_stream_.close();
+      CHECK(shard_stream_) << "Error writing "
+          << RecordsShardName(source_, shard_);
+    }
+    ++shard_;
+    shard_offset_ = 0;
+    const string shard_name = RecordsShardName(source_, shard_);
+    shard_stream_.open(shard_name.c_str(),
+        std::ios::out | std::ios::trunc | std::ios::binary);
+    CHECK(shard_stream_) << "Couldn't open " << shard_name;
+  }
+  shard_stream_.write(reinterpret_cast<const char*>(&key_size),
+      sizeof(key_size));
+  shard_stream_.write(reinterpret_cast<const char*>(&value_size),
+      sizeof(value_size));
+  shard_stream_.write(key.data(), key.size());
+  shard_stream_.write(value.data(), value.size());
+  CHECK(shard_stream_) << "Error writing "
+      << RecordsShardName(source_, shard_);
+  RecordsIndexEntry entry;
+  entry.offset = shard_offset_;
+  entry.shard = shard_;
+  entry.size = size;
+  shard_offset_ += size;
+  return entry;
+}
+
+void RecordsWriter::Commit(const vector<RecordsIndexEntry>& entries) {
+  // The records must be in the shards before the index points to them.
+  if (shard_stream_.is_open()) {
+    shard_stream_.flush();
+    CHECK(shard_stream_) << "Error writing "
+        << RecordsShardName(source_, shard_);
+  }
+  if (!entries.empty()) {
+    index_stream_.write(reinterpret_cast<const char*>(&entries[0]),
+        entries.size() * sizeof(entries[0]));
+  }
+  index_stream_.flush();
+  CHECK(index_stream_) << "Error writing " << source_ << "/index";
+}
+
+const uint64_t Records::kDefaultShardSize;
+
+void Records::Open(const string& source, Mode mode) {
+  Close();
+  source_ = source;
+  const string index_name = source_ + "/index";
+  if (mode == NEW) {
+    CHECK_EQ(mkdir(source_.c_str(), 0744), 0)
+        << "mkdir " << source_ << " failed";
+    char header[kRecordsHeaderSize];
+    memset(header, 0, sizeof(header));  // NOLINT(caffe/alt_fn)
+    memcpy(header, kRecordsMagic,  // NOLINT(caffe/alt_fn)
+           sizeof(kRecordsMagic));
+    memcpy(header + sizeof(kRecordsMagic),  // NOLINT(caffe/alt_fn)
+           &kRecordsVersion, sizeof(kRecordsVersion));
+    std::ofstream index(index_name.c_str(),
+        std::ios::out | std::ios::trunc | std::ios::binary);
+    index.write(header, sizeof(header));
+    CHECK(index) << "Couldn't create " << index_name;
+  }
+  index_.reset(new MappedFile(index_name));
+  CHECK_GE(index_->size(), kRecordsHeaderSize)
+      << source_ << " is not a records directory.";
+  CHECK_EQ(memcmp(index_->data(), kRecordsMagic, sizeof(kRecordsMagic)), 0)
+      << source_ << " is not a records directory.";
+  uint32_t version;
+  memcpy(&version,  // NOLINT(caffe/alt_fn)
+         index_->data() + sizeof(kRecordsMagic), sizeof(version));
+  CHECK_EQ(version, kRecordsVersion)
+      << "Unsupported records version in " << source_;
+  int num_shards = 0;
+  while (access(RecordsShardName(source_, num_shards).c_str(), F_OK) == 0) {
+    ++num_shards;
+  }
+  if (mode == READ) {
+    for (int i = 0; i < num_shards; ++i) {
+      shards_.push_back(shared_ptr<MappedFile>(
+          new MappedFile(RecordsShardName(source_, i))));
+    }
+  } else {
+    const size_t partial = (index_->size() - kRecordsHeaderSize) %
+        sizeof(RecordsIndexEntry);
+    if (partial != 0) {
+      // A commit was interrupted; appending after it would misalign the
+      // index.
+      LOG(WARNING) << "Dropping a partial index entry of " << source_;
+      CHECK_EQ(truncate(index_name.c_str(), index_->size() - partial), 0)
+          << "Couldn't truncate " << index_name;
+    }
+    index_.reset();
+    // New records go to a new shard, never to one that may be mapped.
+    writer_.reset(new RecordsWriter(source_, num_shards, shard_size_));
+  }
+  LOG_IF(INFO, Caffe::root_solver()) << "Opened records " << source_;
+}
+
+void Records::Close() {
+  writer_.reset();
+  index_.reset();
+  shards_.clear();
+}
+
+RecordsCursor* Records::NewCursor() {
+  CHECK(index_) << "Records " << source_ << " are not open for reading.";
+  return new RecordsCursor(index_, shards_);
+}
+
+RecordsTransaction* Records::NewTransaction() {
+  CHECK(writer_) << "Records " << source_ << " are not open for writing.";
+  return new RecordsTransaction(writer_.get());
+}
+
+void Records::set_shard_size(uint64_t shard_size) {
+  CHECK_GT(shard_size, 0);
+  shard_size_ = shard_size;
+  if (writer_) {
+    writer_->set_shard_size(shard_size_);
+  }
+}
+
+}  // namespace db
+}  // namespace caffe
@@ -0,0 +1,201 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/util/flat_weights.hpp"
+
+namespace caffe {
+
+namespace {
+
+uint64_t AlignFlatOffset(uint64_t offset) {
+  return (offset + kFlatWeightsAlignment - 1) / kFlatWeightsAlignment
+      * kFlatWeightsAlignment;
+}
+
+template <typename T>
+void AppendPod(const T& value, string* out) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Reads a T at *pos of the index, advancing *pos.
+template <typename T>
+T ReadPod(const char* index, uint64_t index_bytes, uint64_t* pos,
+    const string& filename) {
+  CHECK_LE(*pos + sizeof(T), index_bytes)
+      << "Truncated flat weight index in " << filename;
+  T value;
+  memcpy(&value, index + *pos, sizeof(T));  // NOLINT(caffe/alt_fn)
+  *pos += sizeof(T);
+  return value;
+}
+
+}  // namespace
+
+template <typename Dtype>
+void FlatWeightsWriter::Add(const string& layer_name, int param_id,
+    const Blob<Dtype>& blob) {
+  FlatBlobInfo info;
+  info.layer_name = layer_name;
+  info.param_id = param_id;
+  info.type = sizeof(Dtype) == sizeof(double) ? FLAT_DOUBLE : FLAT_FLOAT;
+  info.shape = blob.shape();
+  info.offset = 0;
+  info.bytes = blob.count() * sizeof(Dtype);
+  blobs_.push_back(info);
+  data_.push_back(blob.count() ? blob.cpu_data() : NULL);
+}
+
+template void FlatWeightsWriter::Add(const string& layer_name, int param_id,
+    const Blob<float>& blob);
+template void FlatWeightsWriter::Add(const string& layer_name, int param_id,
+    const Blob<double>& blob);
+
+void FlatWeightsWriter::Write(const string& filename) const {
+  // The offsets depend on the index size and the index holds the offsets, so
+  // the index is built twice.
+  string index;
+  vector<uint64_t> offsets(blobs_.size(), 0);
+  for (int pass = 0; pass < 2; ++pass) {
+    index.clear();
+    for (int i = 0; i < blobs_.size(); ++i) {
+      const FlatBlobInfo& info = blobs_[i];
+      AppendPod<uint32_t>(info.layer_name.size(), &index);
+      index.append(info.layer_name);
+      AppendPod<uint32_t>(info.param_id, &index);
+      AppendPod<uint32_t>(info.type, &index);
+      AppendPod<uint32_t>(info.shape.size(), &index);
+      for (int j = 0; j < info.shape.size(); ++j) {
+        AppendPod<int64_t>(info.shape[j], &index);
+      }
+      AppendPod<uint64_t>(offsets[i], &index);
+      AppendPod<uint64_t>(info.bytes, &index);
+    }
+    uint64_t offset = sizeof(FlatWeightsHeader) + index.size();
+    for (int i = 0; i < blobs_.size(); ++i) {
+      offsets[i] = AlignFlatOffset(offset);
+      offset = offsets[i] + blobs_[i].bytes;
+    }
+  }
+  FlatWeightsHeader header;
+  memset(&header, 0, sizeof(header));  // NOLINT(caffe/alt_fn)
+  memcpy(header.magic, kFlatWeightsMagic,  // NOLINT(caffe/alt_fn)
+         sizeof(header.magic));
+  header.version = kFlatWeightsVersion;
+  header.num_blobs = blobs_.size();
+  header.index_bytes = index.size();
+  header.file_bytes = blobs_.empty() ? sizeof(header) + index.size() :
+      offsets.back() + blobs_.back().bytes;
+
+  std::ofstream output(filename.c_str(),
+      std::ios::out | std::ios::trunc | std::ios::binary);
+  CHECK(output) << "Couldn't open " << filename << " to save weights.";
+  output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  output.write(index.data(), index.size());
+  uint64_t position = sizeof(header) + index.size();
+  const vector<char> padding(kFlatWeightsAlignment, 0);
+  for (int i = 0; i < blobs_.size(); ++i) {
+    output.write(&padding[0], offsets[i] - position);
+    output.write(static_cast<const char*>(data_[i]), blobs_[i].bytes);
+    position = offsets[i] + blobs_[i].bytes;
+  }
+  CHECK(output) << "Error saving weights to " << filename << ".";
+}
+
+bool FlatWeights::IsFlatWeights(const string& filename) {
+  std::ifstream input(filename.c_str(), std::ios::in | std::ios::binary);
+  char magic[sizeof(kFlatWeightsMagic)];
+  return input.read(magic, sizeof(magic)) &&
+      memcmp(magic, kFlatWeightsMagic, sizeof(magic)) == 0;
+}
+
+FlatWeights::FlatWeights(const string& filename)
+    : filename_(filename), map_(NULL), size_(0) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << filename;
+  struct stat file_stat;
+  CHECK_EQ(fstat(fd, &file_stat), 0) << "Couldn't stat " << filename;
+  size_ = file_stat.st_size;
+  CHECK_GE(size_, sizeof(FlatWeightsHeader))
+      << filename << " is not a flat weight file.";
+  // Private, writable pages: writes go to copies, never to the file.
+  map_ = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  CHECK(map_ != MAP_FAILED) << "Couldn't map " << filename;
+
+  FlatWeightsHeader header;
+  memcpy(&header, map_, sizeof(header));  // NOLINT(caffe/alt_fn)
+  CHECK_EQ(memcmp(header.magic, kFlatWeightsMagic, sizeof(header.magic)), 0)
+      << filename << " is not a flat weight file.";
+  CHECK_EQ(header.version, kFlatWeightsVersion)
+      << "Unsupported flat weight version in " << filename;
+  CHECK_EQ(header.file_bytes, size_) << "Truncated flat weights " << filename;
+  CHECK_LE(sizeof(header) + header.index_bytes, size_)
+      << "Truncated flat weight index in " << filename;
+  const char* index = static_cast<const char*>(map_) + sizeof(header);
+  uint64_t pos = 0;
+  blobs_.resize(header.num_blobs);
+  for (int i = 0; i < blobs_.size(); ++i) {
+    FlatBlobInfo& info = blobs_[i];
+    const uint32_t name_size =
+        ReadPod<uint32_t>(index, header.index_bytes, &pos, filename);
+    CHECK_LE(pos + name_size, header.index_bytes)
+        << "Truncated flat weight index in " << filename;
+    info.layer_name.assign(index + pos, name_size);
+    pos += name_size;
+    info.param_id = ReadPod<uint32_t>(index, header.index_bytes, &pos,
+        filename);
+    const uint32_t type = ReadPod<uint32_t>(index, header.index_bytes, &pos,
+        filename);
+    CHECK(type == FLAT_FLOAT || type == FLAT_DOUBLE)
+        << "Unknown blob type " << type << " in " << filename;
+    info.type = static_cast<FlatWeightsType>(type);
+    const uint32_t num_axes = ReadPod<uint32_t>(index, header.index_bytes,
+        &pos, filename);
+    CHECK_LE(static_cast<int>(num_axes), kMaxBlobAxes)
+        << "Too many axes in " << filename;
+    info.shape.resize(num_axes);
+    uint64_t count = 1;
+    for (int j = 0; j < info.shape.size(); ++j) {
+      info.shape[j] = ReadPod<int64_t>(index, header.index_bytes, &pos,
+          filename);
+      count *= info.shape[j];
+    }
+    info.offset = ReadPod<uint64_t>(index, header.index_bytes, &pos,
+        filename);
+    info.bytes = ReadPod<uint64_t>(index, header.index_bytes, &pos, filename);
+    CHECK_EQ(count * (info.type == FLAT_DOUBLE ? sizeof(double) :
+        sizeof(float)), info.bytes) << "Corrupt blob size in " << filename;
+    CHECK_EQ(info.offset % kFlatWeightsAlignment, 0u)
+        << "Misaligned blob in " << filename;
+    CHECK_LE(info.offset + info.bytes, size_)
+        << "Truncated flat weights " << filename;
+  }
+}
+
+void FlatWeights::AdviseRandom(int i) const {
+  // The blob offsets are aligned for the smallest page size only.
+  const uintptr_t page = sysconf(_SC_PAGESIZE);
+  char* begin = static_cast<char*>(data(i));
+  char* page_begin = reinterpret_cast<char*>(
+      reinterpret_cast<uintptr_t>(begin) / page * page);
+  if (madvise(page_begin, begin + blobs_[i].bytes - page_begin,
+      MADV_RANDOM) != 0) {
+    LOG(WARNING) << "madvise failed for " << blobs_[i].layer_name << " param "
+        << blobs_[i].param_id << " of " << filename_;
+  }
+}
+
+FlatWeights::~FlatWeights() {
+  if (map_ != NULL) {
+    munmap(map_, size_);
+  }
+}
+
+}  // namespace caffe
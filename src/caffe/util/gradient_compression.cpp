@@ -0,0 +1,150 @@
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "caffe/util/gradient_compression.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Orders indices by decreasing magnitude of the referenced values.
+template <typename Dtype>
+struct MagnitudeGreater {
+  explicit MagnitudeGreater(const Dtype* values) : values_(values) {}
+  bool operator()(uint32_t a, uint32_t b) const {
+    return std::fabs(values_[a]) > std::fabs(values_[b]);
+  }
+  const Dtype* values_;
+};
+
+}  // namespace
+
+template <typename Dtype>
+GradientCompressor<Dtype>::GradientCompressor(
+    const GradientCompressionParameter& param, size_t count)
+    : param_(param), count_(count), k_(count), last_bytes_(0),
+      total_bytes_(0) {
+  switch (param_.method()) {
+  case GradientCompressionParameter_Method_NONE:
+    max_bytes_ = count_ * sizeof(Dtype);
+    break;
+  case GradientCompressionParameter_Method_FP16:
+    max_bytes_ = count_ * sizeof(uint16_t);
+    break;
+  case GradientCompressionParameter_Method_TOPK: {
+    CHECK_GT(param_.topk_ratio(), 0) << "topk_ratio must be in (0, 1].";
+    CHECK_LE(param_.topk_ratio(), 1) << "topk_ratio must be in (0, 1].";
+    CHECK_LE(count_, size_t(std::numeric_limits<uint32_t>::max()))
+        << "TOPK compression supports at most 2^32 - 1 parameters.";
+    k_ = static_cast<size_t>(std::ceil(param_.topk_ratio() * count_));
+    k_ = std::max<size_t>(std::min(k_, count_), 1);
+    max_bytes_ = k_ * (sizeof(uint32_t) + sizeof(float));
+    indices_.resize(count_);
+    break;
+  }
+  default:
+    LOG(FATAL) << "Unknown gradient compression method: " << param_.method();
+  }
+  if (param_.method() != GradientCompressionParameter_Method_NONE) {
+    residual_.resize(count_, Dtype(0));
+  }
+}
+
+template <typename Dtype>
+size_t GradientCompressor<Dtype>::Compress(const Dtype* grad, void* buffer) {
+  switch (param_.method()) {
+  case GradientCompressionParameter_Method_NONE:
+    caffe_copy(count_, grad, static_cast<Dtype*>(buffer));
+    last_bytes_ = max_bytes_;
+    break;
+  case GradientCompressionParameter_Method_FP16:
+    last_bytes_ = CompressFP16(grad, buffer);
+    break;
+  case GradientCompressionParameter_Method_TOPK:
+    last_bytes_ = CompressTopK(grad, buffer);
+    break;
+  default:
+    LOG(FATAL) << "Unknown gradient compression method: " << param_.method();
+  }
+  total_bytes_ += last_bytes_;
+  return last_bytes_;
+}
+
+template <typename Dtype>
+size_t GradientCompressor<Dtype>::CompressFP16(const Dtype* grad,
+    void* buffer) {
+  uint16_t* out = static_cast<uint16_t*>(buffer);
+  const bool feedback = param_.error_feedback();
+  for (size_t i = 0; i < count_; ++i) {
+    const Dtype value = feedback ? grad[i] + residual_[i] : grad[i];
+    out[i] = caffe_float_to_half(static_cast<float>(value));
+    if (feedback) {
+      residual_[i] = value - caffe_half_to_float(out[i]);
+    }
+  }
+  return count_ * sizeof(uint16_t);
+}
+
+template <typename Dtype>
+size_t GradientCompressor<Dtype>::CompressTopK(const Dtype* grad,
+    void* buffer) {
+  // residual_ holds the gradient to select from: the accumulated leftovers
+  // plus this iteration's gradient.
+  Dtype* acc = &residual_[0];
+  if (param_.error_feedback()) {
+    caffe_axpy(count_, Dtype(1), grad, acc);
+  } else {
+    caffe_copy(count_, grad, acc);
+  }
+  for (size_t i = 0; i < count_; ++i) {
+    indices_[i] = i;
+  }
+  std::nth_element(indices_.begin(), indices_.begin() + (k_ - 1),
+      indices_.end(), MagnitudeGreater<Dtype>(acc));
+  // Sorted indices make the scatter on the receiving side cache friendly.
+  std::sort(indices_.begin(), indices_.begin() + k_);
+  uint32_t* out_indices = static_cast<uint32_t*>(buffer);
+  float* out_values = reinterpret_cast<float*>(out_indices + k_);
+  for (size_t i = 0; i < k_; ++i) {
+    const uint32_t index = indices_[i];
+    out_indices[i] = index;
+    out_values[i] = static_cast<float>(acc[index]);
+    acc[index] -= out_values[i];
+  }
+  return k_ * (sizeof(uint32_t) + sizeof(float));
+}
+
+template <typename Dtype>
+void GradientCompressor<Dtype>::DecompressAdd(const void* buffer,
+    Dtype* grad) const {
+  switch (param_.method()) {
+  case GradientCompressionParameter_Method_NONE:
+    caffe_axpy(count_, Dtype(1), static_cast<const Dtype*>(buffer), grad);
+    break;
+  case GradientCompressionParameter_Method_FP16: {
+    const uint16_t* in = static_cast<const uint16_t*>(buffer);
+    for (size_t i = 0; i < count_; ++i) {
+      grad[i] += caffe_half_to_float(in[i]);
+    }
+    break;
+  }
+  case GradientCompressionParameter_Method_TOPK: {
+    const uint32_t* in_indices = static_cast<const uint32_t*>(buffer);
+    const float* in_values = reinterpret_cast<const float*>(in_indices + k_);
+    for (size_t i = 0; i < k_; ++i) {
+      grad[in_indices[i]] += in_values[i];
+    }
+    break;
+  }
+  default:
+    LOG(FATAL) << "Unknown gradient compression method: " << param_.method();
+  }
+}
+
+INSTANTIATE_CLASS(GradientCompressor);
+
+}  // namespace caffe
@@ -1,15 +1,33 @@
 #include "caffe/util/hdf5.hpp"
 
+#include <boost/thread/recursive_mutex.hpp>
+
+#include <algorithm>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace caffe {
 
+static boost::recursive_mutex& hdf5_mutex() {
+  static boost::recursive_mutex mutex;
+  return mutex;
+}
+
+HDF5Lock::HDF5Lock() {
+  hdf5_mutex().lock();
+}
+
+HDF5Lock::~HDF5Lock() {
+  hdf5_mutex().unlock();
+}
+
 // Verifies format of data stored in HDF5 file and reshapes blob accordingly.
 template <typename Dtype>
 void hdf5_load_nd_dataset_helper(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
     Blob<Dtype>* blob, bool reshape) {
+  HDF5Lock lock;
   // Verify that the dataset exists.
   CHECK(H5LTfind_dataset(file_id, dataset_name_))
       << "Failed to find HDF5 dataset " << dataset_name_;
@@ -86,6 +104,7 @@ void hdf5_load_nd_dataset_helper(
 template <>
 void hdf5_load_nd_dataset<float>(hid_t file_id, const char* dataset_name_,
         int min_dim, int max_dim, Blob<float>* blob, bool reshape) {
+  HDF5Lock lock;
   hdf5_load_nd_dataset_helper(file_id, dataset_name_, min_dim, max_dim, blob,
                               reshape);
   herr_t status = H5LTread_dataset_float(
@@ -96,6 +115,7 @@ void hdf5_load_nd_dataset<float>(hid_t file_id, const char* dataset_name_,
 template <>
 void hdf5_load_nd_dataset<double>(hid_t file_id, const char* dataset_name_,
         int min_dim, int max_dim, Blob<double>* blob, bool reshape) {
+  HDF5Lock lock;
   hdf5_load_nd_dataset_helper(file_id, dataset_name_, min_dim, max_dim, blob,
                               reshape);
   herr_t status = H5LTread_dataset_double(
@@ -103,10 +123,254 @@ void hdf5_load_nd_dataset<double>(hid_t file_id, const char* dataset_name_,
   CHECK_GE(status, 0) << "Failed to read double dataset " << dataset_name_;
 }
 
+// Reads rows [start, start + rows) of the first axis of a dataset, without
+// reading the rest of it, and reshapes blob to hold them.
+template <typename Dtype>
+static void hdf5_load_nd_dataset_rows_helper(
+    hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
+    hsize_t start, hsize_t rows, Blob<Dtype>* blob, hid_t mem_type) {
+  HDF5Lock lock;
+  vector<int> shape = hdf5_get_dataset_shape(file_id, dataset_name_);
+  const int ndims = shape.size();
+  CHECK_GE(ndims, min_dim);
+  CHECK_LE(ndims, max_dim);
+  CHECK_GE(ndims, 1) << "Cannot read rows of a scalar dataset "
+      << dataset_name_;
+  CHECK_LE(start + rows, static_cast<hsize_t>(shape[0])) << "Rows " << start
+      << " to " << start + rows << " are out of dataset " << dataset_name_;
+  shape[0] = rows;
+  blob->Reshape(shape);
+  if (rows == 0) {
+    return;
+  }
+
+  hid_t dataset_id = H5Dopen2(file_id, dataset_name_, H5P_DEFAULT);
+  CHECK_GE(dataset_id, 0) << "Failed to open HDF5 dataset " << dataset_name_;
+  hid_t file_space = H5Dget_space(dataset_id);
+  vector<hsize_t> offset(shape.size(), 0);
+  vector<hsize_t> count(shape.begin(), shape.end());
+  offset[0] = start;
+  herr_t status = H5Sselect_hyperslab(file_space, H5S_SELECT_SET,
+      offset.data(), NULL, count.data(), NULL);
+  CHECK_GE(status, 0) << "Failed to select rows of " << dataset_name_;
+  hid_t mem_space = H5Screate_simple(count.size(), count.data(), NULL);
+  status = H5Dread(dataset_id, mem_type, mem_space, file_space, H5P_DEFAULT,
+      blob->mutable_cpu_data());
+  CHECK_GE(status, 0) << "Failed to read rows of " << dataset_name_;
+  H5Sclose(mem_space);
+  H5Sclose(file_space);
+  H5Dclose(dataset_id);
+}
+
+template <>
+void hdf5_load_nd_dataset_rows<float>(hid_t file_id,
+    const char* dataset_name_, int min_dim, int max_dim, hsize_t start,
+    hsize_t rows, Blob<float>* blob) {
+  HDF5Lock lock;
+  hdf5_load_nd_dataset_rows_helper(file_id, dataset_name_, min_dim, max_dim,
+      start, rows, blob, H5T_NATIVE_FLOAT);
+}
+
+template <>
+void hdf5_load_nd_dataset_rows<double>(hid_t file_id,
+    const char* dataset_name_, int min_dim, int max_dim, hsize_t start,
+    hsize_t rows, Blob<double>* blob) {
+  HDF5Lock lock;
+  hdf5_load_nd_dataset_rows_helper(file_id, dataset_name_, min_dim, max_dim,
+      start, rows, blob, H5T_NATIVE_DOUBLE);
+}
+
+bool hdf5_get_rows_extents(hid_t file_id, const string& dataset_name,
+    hsize_t start, hsize_t rows, vector<pair<int64_t, int64_t> >* extents) {
+  HDF5Lock lock;
+  hid_t dataset_id = H5Dopen2(file_id, dataset_name.c_str(), H5P_DEFAULT);
+  CHECK_GE(dataset_id, 0) << "Failed to open HDF5 dataset " << dataset_name;
+  hid_t space_id = H5Dget_space(dataset_id);
+  const int ndims = H5Sget_simple_extent_ndims(space_id);
+  CHECK_GE(ndims, 1) << "Cannot read rows of a scalar dataset "
+      << dataset_name;
+  vector<hsize_t> dims(ndims);
+  H5Sget_simple_extent_dims(space_id, dims.data(), NULL);
+  H5Sclose(space_id);
+  rows = std::min(rows, dims[0] - std::min(start, dims[0]));
+  hid_t plist_id = H5Dget_create_plist(dataset_id);
+  bool found = true;
+  switch (H5Pget_layout(plist_id)) {
+  case H5D_COMPACT:
+    // Stored in the object header, which opening the dataset read
+    break;
+  case H5D_CONTIGUOUS: {
+    const haddr_t offset = H5Dget_offset(dataset_id);
+    if (offset == HADDR_UNDEF) {
+      // Never written
+      break;
+    }
+    hid_t type_id = H5Dget_type(dataset_id);
+    int64_t row_bytes = H5Tget_size(type_id);
+    H5Tclose(type_id);
+    for (int i = 1; i < ndims; ++i) {
+      row_bytes *= dims[i];
+    }
+    if (rows > 0) {
+      extents->push_back(make_pair(offset + start * row_bytes,
+          rows * row_bytes));
+    }
+    break;
+  }
+  case H5D_CHUNKED: {
+#if H5_VERSION_GE(1, 10, 5)
+    vector<hsize_t> chunk_dims(ndims);
+    H5Pget_chunk(plist_id, ndims, chunk_dims.data());
+    // Steps through the chunks that hold the rows, the first axis varying
+    // slowest, and looks each up in the chunk index.
+    vector<hsize_t> chunk(ndims, 0);
+    chunk[0] = start / chunk_dims[0] * chunk_dims[0];
+    while (rows > 0 && chunk[0] < start + rows) {
+      haddr_t address;
+      hsize_t size;
+      herr_t status = H5Dget_chunk_info_by_coord(dataset_id, chunk.data(),
+          NULL, &address, &size);
+      CHECK_GE(status, 0) << "Failed to find chunks of " << dataset_name;
+      if (address != HADDR_UNDEF) {
+        extents->push_back(make_pair(address, size));
+      }
+      int axis = ndims - 1;
+      for (; axis > 0; --axis) {
+        chunk[axis] += chunk_dims[axis];
+        if (chunk[axis] < dims[axis]) {
+          break;
+        }
+        chunk[axis] = 0;
+      }
+      if (axis == 0) {
+        chunk[0] += chunk_dims[0];
+      }
+    }
+#else
+    found = false;
+#endif
+    break;
+  }
+  default:
+    found = false;
+  }
+  H5Pclose(plist_id);
+  H5Dclose(dataset_id);
+  return found;
+}
+
+// Creates a dataset with an unlimited first axis, stored in chunks.
+static void hdf5_create_extendible_dataset_helper(hid_t file_id,
+    const string& dataset_name, const vector<int>& row_shape, int chunk_rows,
+    int compression, hid_t file_type) {
+  HDF5Lock lock;
+  CHECK_GT(chunk_rows, 0) << "Chunks of " << dataset_name << " need rows";
+  vector<hsize_t> dims(1, 0), max_dims(1, H5S_UNLIMITED);
+  vector<hsize_t> chunk_dims(1, chunk_rows);
+  for (int i = 0; i < row_shape.size(); ++i) {
+    dims.push_back(row_shape[i]);
+    max_dims.push_back(row_shape[i]);
+    chunk_dims.push_back(row_shape[i]);
+  }
+  hid_t space_id = H5Screate_simple(dims.size(), dims.data(),
+      max_dims.data());
+  hid_t plist_id = H5Pcreate(H5P_DATASET_CREATE);
+  herr_t status = H5Pset_chunk(plist_id, chunk_dims.size(),
+      chunk_dims.data());
+  CHECK_GE(status, 0) << "Failed to set chunks of " << dataset_name;
+  if (compression > 0) {
+    status = H5Pset_deflate(plist_id, compression);
+    CHECK_GE(status, 0) << "Failed to set compression of " << dataset_name;
+  }
+  hid_t dataset_id = H5Dcreate2(file_id, dataset_name.c_str(), file_type,
+      space_id, H5P_DEFAULT, plist_id, H5P_DEFAULT);
+  CHECK_GE(dataset_id, 0) << "Failed to make dataset " << dataset_name;
+  H5Dclose(dataset_id);
+  H5Pclose(plist_id);
+  H5Sclose(space_id);
+}
+
+// Extends a dataset by rows rows, and writes the first rows of blob in them.
+template <typename Dtype>
+static void hdf5_append_nd_dataset_helper(hid_t file_id,
+    const string& dataset_name, const Blob<Dtype>& blob, int rows,
+    hid_t mem_type) {
+  HDF5Lock lock;
+  CHECK_LE(rows, blob.shape(0));
+  hid_t dataset_id = H5Dopen2(file_id, dataset_name.c_str(), H5P_DEFAULT);
+  CHECK_GE(dataset_id, 0) << "Failed to open HDF5 dataset " << dataset_name;
+  hid_t file_space = H5Dget_space(dataset_id);
+  const int ndims = H5Sget_simple_extent_ndims(file_space);
+  CHECK_EQ(ndims, blob.num_axes()) << "Cannot append blob of shape "
+      << blob.shape_string() << " to dataset " << dataset_name;
+  vector<hsize_t> dims(ndims);
+  H5Sget_simple_extent_dims(file_space, dims.data(), NULL);
+  H5Sclose(file_space);
+  for (int i = 1; i < ndims; ++i) {
+    CHECK_EQ(static_cast<int>(dims[i]), blob.shape(i))
+        << "Cannot append blob of shape " << blob.shape_string()
+        << " to dataset " << dataset_name;
+  }
+  vector<hsize_t> offset(ndims, 0);
+  offset[0] = dims[0];
+  dims[0] += rows;
+  herr_t status = H5Dset_extent(dataset_id, dims.data());
+  CHECK_GE(status, 0) << "Failed to extend dataset " << dataset_name;
+
+  file_space = H5Dget_space(dataset_id);
+  vector<hsize_t> count(dims);
+  count[0] = rows;
+  status = H5Sselect_hyperslab(file_space, H5S_SELECT_SET, offset.data(),
+      NULL, count.data(), NULL);
+  CHECK_GE(status, 0) << "Failed to select rows of " << dataset_name;
+  hid_t mem_space = H5Screate_simple(count.size(), count.data(), NULL);
+  status = H5Dwrite(dataset_id, mem_type, mem_space, file_space, H5P_DEFAULT,
+      blob.cpu_data());
+  CHECK_GE(status, 0) << "Failed to append to dataset " << dataset_name;
+  H5Sclose(mem_space);
+  H5Sclose(file_space);
+  H5Dclose(dataset_id);
+}
+
+template <>
+void hdf5_create_extendible_dataset<float>(hid_t file_id,
+    const string& dataset_name, const vector<int>& row_shape, int chunk_rows,
+    int compression) {
+  HDF5Lock lock;
+  hdf5_create_extendible_dataset_helper(file_id, dataset_name, row_shape,
+      chunk_rows, compression, H5T_NATIVE_FLOAT);
+}
+
+template <>
+void hdf5_create_extendible_dataset<double>(hid_t file_id,
+    const string& dataset_name, const vector<int>& row_shape, int chunk_rows,
+    int compression) {
+  HDF5Lock lock;
+  hdf5_create_extendible_dataset_helper(file_id, dataset_name, row_shape,
+      chunk_rows, compression, H5T_NATIVE_DOUBLE);
+}
+
+template <>
+void hdf5_append_nd_dataset<float>(hid_t file_id, const string& dataset_name,
+    const Blob<float>& blob, int rows) {
+  HDF5Lock lock;
+  hdf5_append_nd_dataset_helper(file_id, dataset_name, blob, rows,
+      H5T_NATIVE_FLOAT);
+}
+
+template <>
+void hdf5_append_nd_dataset<double>(hid_t file_id,
+    const string& dataset_name, const Blob<double>& blob, int rows) {
+  HDF5Lock lock;
+  hdf5_append_nd_dataset_helper(file_id, dataset_name, blob, rows,
+      H5T_NATIVE_DOUBLE);
+}
+
 template <>
 void hdf5_save_nd_dataset<float>(
     const hid_t file_id, const string& dataset_name, const Blob<float>& blob,
     bool write_diff) {
+  HDF5Lock lock;
   int num_axes = blob.num_axes();
   hsize_t *dims = new hsize_t[num_axes];
   for (int i = 0; i < num_axes; ++i) {
@@ -128,6 +392,7 @@ template <>
 void hdf5_save_nd_dataset<double>(
     hid_t file_id, const string& dataset_name, const Blob<double>& blob,
     bool write_diff) {
+  HDF5Lock lock;
   int num_axes = blob.num_axes();
   hsize_t *dims = new hsize_t[num_axes];
   for (int i = 0; i < num_axes; ++i) {
@@ -146,6 +411,7 @@ void hdf5_save_nd_dataset<double>(
 }
 
 string hdf5_load_string(hid_t loc_id, const string& dataset_name) {
+  HDF5Lock lock;
   // Get size of dataset
   size_t size;
   H5T_class_t class_;
@@ -163,6 +429,7 @@ string hdf5_load_string(hid_t loc_id, const string& dataset_name) {
 
 void hdf5_save_string(hid_t loc_id, const string& dataset_name,
                       const string& s) {
+  HDF5Lock lock;
   herr_t status = \
     H5LTmake_dataset_string(loc_id, dataset_name.c_str(), s.c_str());
   CHECK_GE(status, 0)
@@ -170,6 +437,7 @@ void hdf5_save_string(hid_t loc_id, const string& dataset_name,
 }
 
 int hdf5_load_int(hid_t loc_id, const string& dataset_name) {
+  HDF5Lock lock;
   int val;
   herr_t status = H5LTread_dataset_int(loc_id, dataset_name.c_str(), &val);
   CHECK_GE(status, 0)
@@ -178,6 +446,7 @@ int hdf5_load_int(hid_t loc_id, const string& dataset_name) {
 }
 
 void hdf5_save_int(hid_t loc_id, const string& dataset_name, int i) {
+  HDF5Lock lock;
   hsize_t one = 1;
   herr_t status = \
     H5LTmake_dataset_int(loc_id, dataset_name.c_str(), 1, &one, &i);
@@ -185,7 +454,26 @@ void hdf5_save_int(hid_t loc_id, const string& dataset_name, int i) {
     << "Failed to save int dataset with name " << dataset_name;
 }
 
+vector<int> hdf5_get_dataset_shape(hid_t loc_id,
+    const string& dataset_name) {
+  HDF5Lock lock;
+  CHECK(H5LTfind_dataset(loc_id, dataset_name.c_str()))
+      << "Failed to find HDF5 dataset " << dataset_name;
+  int ndims;
+  herr_t status = H5LTget_dataset_ndims(loc_id, dataset_name.c_str(), &ndims);
+  CHECK_GE(status, 0) << "Failed to get dataset ndims for " << dataset_name;
+  vector<hsize_t> dims(ndims);
+  H5T_class_t class_;
+  status = H5LTget_dataset_info(
+      loc_id, dataset_name.c_str(), dims.data(), &class_, NULL);
+  CHECK_GE(status, 0) << "Failed to get dataset info for " << dataset_name;
+  CHECK(class_ == H5T_FLOAT || class_ == H5T_INTEGER)
+      << "Unsupported datatype class of " << dataset_name;
+  return vector<int>(dims.begin(), dims.end());
+}
+
 int hdf5_get_num_links(hid_t loc_id) {
+  HDF5Lock lock;
   H5G_info_t info;
   herr_t status = H5Gget_info(loc_id, &info);
   CHECK_GE(status, 0) << "Error while counting HDF5 links.";
@@ -193,6 +481,7 @@ int hdf5_get_num_links(hid_t loc_id) {
 }
 
 string hdf5_get_name_by_idx(hid_t loc_id, int idx) {
+  HDF5Lock lock;
   ssize_t str_size = H5Lget_name_by_idx(
       loc_id, ".", H5_INDEX_NAME, H5_ITER_NATIVE, idx, NULL, 0, H5P_DEFAULT);
   CHECK_GE(str_size, 0) << "Error retrieving HDF5 dataset at index " << idx;
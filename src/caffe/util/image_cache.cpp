@@ -0,0 +1,168 @@
+#include "caffe/util/image_cache.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <map>
+#include <string>
+
+namespace caffe {
+
+namespace {
+
+const char kImageCacheMagic[8] = {'C', 'A', 'F', 'F', 'E', 'I', 'M', 'C'};
+const uint32_t kImageCacheVersion = 2;
+const uint64_t kImageCacheHeaderSize = 4096;
+// Entries start on cache line boundaries
+const uint64_t kEntryAlignment = 64;
+const uint32_t kEntryMagic = 0x45474d49;
+
+struct ImageCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t capacity;
+  // Bytes in use, which is also the offset of the next entry
+  uint64_t used;
+};
+
+struct ImageCacheEntry {
+  uint32_t magic;
+  uint32_t key_size;
+  int32_t rows;
+  int32_t cols;
+  int32_t channels;
+  uint32_t reserved;
+  // Of the whole entry, including the padding
+  uint64_t size;
+};
+
+inline uint64_t PixelOffset(uint64_t key_size) {
+  return (sizeof(ImageCacheEntry) + key_size + 15) / 16 * 16;
+}
+
+inline ImageCacheHeader* Header(char* map) {
+  return reinterpret_cast<ImageCacheHeader*>(map);
+}
+
+}  // namespace
+
+ImageCache::ImageCache(const string& filename, uint64_t capacity)
+    : filename_(filename),
+      capacity_(capacity / kEntryAlignment * kEntryAlignment),
+      map_(NULL), map_size_(kImageCacheHeaderSize + capacity_) {
+  CHECK_GT(capacity_, 0) << "Image cache " << filename_ << " is too small.";
+  int fd = open(filename_.c_str(), O_RDWR | O_CREAT, 0644);
+  CHECK_NE(fd, -1) << "Couldn't open image cache " << filename_;
+  struct stat file_stat;
+  CHECK_EQ(fstat(fd, &file_stat), 0) << "Couldn't stat " << filename_;
+  const bool existing = static_cast<size_t>(file_stat.st_size) == map_size_;
+  if (!existing) {
+    CHECK_EQ(ftruncate(fd, map_size_), 0) << "Couldn't size " << filename_;
+  }
+  void* map = mmap(NULL, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+      0);
+  close(fd);
+  CHECK(map != MAP_FAILED) << "Couldn't map " << filename_;
+  map_ = static_cast<char*>(map);
+  if (!existing || !Load()) {
+    LOG_IF(WARNING, existing) << "Starting over corrupt image cache "
+        << filename_;
+    Reset();
+  }
+  LOG(INFO) << "Image cache " << filename_ << " holds " << index_.size()
+      << " images.";
+}
+
+ImageCache::~ImageCache() {
+  munmap(map_, map_size_);
+}
+
+void ImageCache::Reset() {
+  index_.clear();
+  ImageCacheHeader* header = Header(map_);
+  memset(header, 0, sizeof(*header));  // NOLINT(caffe/alt_fn)
+  memcpy(header->magic, kImageCacheMagic,  // NOLINT(caffe/alt_fn)
+         sizeof(header->magic));
+  header->version = kImageCacheVersion;
+  header->capacity = capacity_;
+}
+
+bool ImageCache::Load() {
+  const ImageCacheHeader& header = *Header(map_);
+  if (memcmp(header.magic, kImageCacheMagic, sizeof(header.magic)) != 0 ||
+      header.version != kImageCacheVersion || header.capacity != capacity_ ||
+      header.used > capacity_) {
+    return false;
+  }
+  const char* entries = map_ + kImageCacheHeaderSize;
+  uint64_t position = 0;
+  while (position < header.used) {
+    const ImageCacheEntry& entry =
+        *reinterpret_cast<const ImageCacheEntry*>(entries + position);
+    if (entry.magic != kEntryMagic || entry.size == 0 ||
+        entry.size > header.used - position ||
+        PixelOffset(entry.key_size) + static_cast<uint64_t>(entry.rows) *
+        entry.cols * entry.channels > entry.size) {
+      index_.clear();
+      return false;
+    }
+    index_[string(entries + position + sizeof(entry), entry.key_size)] =
+        position;
+    position += entry.size;
+  }
+  return true;
+}
+
+bool ImageCache::Lookup(const string& key, CachedImage* image) const {
+  std::map<string, uint64_t>::const_iterator it = index_.find(key);
+  if (it == index_.end()) {
+    return false;
+  }
+  const char* entry_data = map_ + kImageCacheHeaderSize + it->second;
+  const ImageCacheEntry& entry =
+      *reinterpret_cast<const ImageCacheEntry*>(entry_data);
+  image->data = reinterpret_cast<const uint8_t*>(entry_data +
+      PixelOffset(entry.key_size));
+  image->rows = entry.rows;
+  image->cols = entry.cols;
+  image->channels = entry.channels;
+  return true;
+}
+
+void ImageCache::Insert(const string& key, int rows, int cols, int channels,
+    const uint8_t* data) {
+  if (index_.count(key)) {
+    return;
+  }
+  const uint64_t pixels = static_cast<uint64_t>(rows) * cols * channels;
+  const uint64_t size = (PixelOffset(key.size()) + pixels +
+      kEntryAlignment - 1) / kEntryAlignment * kEntryAlignment;
+  ImageCacheHeader* header = Header(map_);
+  if (size > capacity_ - header->used) {
+    DLOG(INFO) << "Image " << key << " doesn't fit in the image cache.";
+    return;
+  }
+  char* entry_data = map_ + kImageCacheHeaderSize + header->used;
+  ImageCacheEntry entry;
+  memset(&entry, 0, sizeof(entry));  // NOLINT(caffe/alt_fn)
+  entry.magic = kEntryMagic;
+  entry.key_size = key.size();
+  entry.rows = rows;
+  entry.cols = cols;
+  entry.channels = channels;
+  entry.size = size;
+  memcpy(entry_data, &entry, sizeof(entry));  // NOLINT(caffe/alt_fn)
+  memcpy(entry_data + sizeof(entry),  // NOLINT(caffe/alt_fn)
+         key.data(), key.size());
+  memcpy(entry_data + PixelOffset(key.size()),  // NOLINT(caffe/alt_fn)
+         data, pixels);
+  // The entry is complete before the header points past it
+  index_[key] = header->used;
+  header->used += size;
+}
+
+}  // namespace caffe
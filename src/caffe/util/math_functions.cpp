@@ -1,6 +1,7 @@
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
 
+#include <cstring>
 #include <limits>
 
 #include "caffe/common.hpp"
@@ -236,6 +237,56 @@ void caffe_abs<double>(const int n, const double* a, double* y) {
     vdAbs(n, a, y);
 }
 
+uint16_t caffe_float_to_half(float value) {
+  uint32_t x;
+  memcpy(&x, &value, sizeof(x));  // NOLINT(caffe/alt_fn)
+  const uint16_t sign = (x >> 16) & 0x8000;
+  x &= 0x7fffffff;
+  if (x >= 0x7f800000) {
+    // Inf stays Inf, NaN stays (quiet) NaN
+    return sign | 0x7c00 | (x > 0x7f800000 ? 0x0200 : 0);
+  }
+  if (x >= 0x477ff000) {
+    // Rounds above the largest half (65504)
+    return sign | 0x7c00;
+  }
+  if (x < 0x38800000) {
+    // Subnormal half: the mantissa is the value in units of 2^-24, which is
+    // exact to compute in float. rint() rounds to nearest even.
+    float magnitude;
+    memcpy(&magnitude, &x, sizeof(x));  // NOLINT(caffe/alt_fn)
+    return sign | static_cast<uint16_t>(rint(magnitude * 16777216.f));
+  }
+  const uint32_t exponent = (x >> 23) - 127 + 15;
+  const uint32_t mantissa = x & 0x7fffff;
+  uint32_t h = (exponent << 10) | (mantissa >> 13);
+  const uint32_t rest = mantissa & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) {
+    // A carry out of the mantissa correctly bumps the exponent
+    ++h;
+  }
+  return sign | static_cast<uint16_t>(h);
+}
+
+float caffe_half_to_float(uint16_t value) {
+  const uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+  const uint32_t exponent = (value >> 10) & 0x1f;
+  const uint32_t mantissa = value & 0x3ff;
+  if (exponent == 0) {
+    const float magnitude = mantissa / 16777216.f;
+    return sign ? -magnitude : magnitude;
+  }
+  uint32_t x;
+  if (exponent == 31) {
+    x = sign | 0x7f800000 | (mantissa << 13);
+  } else {
+    x = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+  }
+  float f;
+  memcpy(&f, &x, sizeof(x));  // NOLINT(caffe/alt_fn)
+  return f;
+}
+
 unsigned int caffe_rng_rand() {
   return (*caffe_rng())();
 }
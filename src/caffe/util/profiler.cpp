@@ -0,0 +1,219 @@
+#include <boost/atomic.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
+
+#include <fstream>  // NOLINT(readability/streams)
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/util/profiler.hpp"
+
+namespace caffe {
+
+class Profiler::sync {
+ public:
+  mutable boost::mutex mutex_;
+};
+
+// Read without the lock by instrumented code on every thread
+static boost::atomic<bool> enabled_(false);
+// Microseconds since the epoch when profiling started
+static boost::atomic<int64_t> start_(0);
+
+static int64_t Microseconds() {
+  static const boost::posix_time::ptime epoch(
+      boost::gregorian::date(1970, 1, 1));
+  return (boost::posix_time::microsec_clock::universal_time() - epoch)
+      .total_microseconds();
+}
+
+// Per thread, as Caffe's own state is
+static boost::thread_specific_ptr<int64_t> thread_allocated_;
+static boost::thread_specific_ptr<int> thread_index_;
+
+Profiler& Profiler::Get() {
+  // Never destroyed, as threads may record until the process exits
+  static Profiler* profiler = new Profiler();
+  return *profiler;
+}
+
+Profiler::Profiler()
+    : sync_(new sync()), threads_(0) {
+  start_ = Microseconds();
+}
+
+bool Profiler::enabled() {
+  return enabled_;
+}
+
+void Profiler::Start() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  events_.clear();
+  start_ = Microseconds();
+  enabled_ = true;
+}
+
+void Profiler::Stop() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  enabled_ = false;
+}
+
+void Profiler::Allocated(size_t bytes) {
+  if (!enabled_) {
+    return;
+  }
+  if (!thread_allocated_.get()) {
+    thread_allocated_.reset(new int64_t(0));
+  }
+  *thread_allocated_ += bytes;
+}
+
+int64_t Profiler::thread_allocated() {
+  return thread_allocated_.get() ? *thread_allocated_ : 0;
+}
+
+int64_t Profiler::Now() const {
+  return Microseconds() - start_;
+}
+
+void Profiler::Record(const char* category, const string& name,
+    int64_t start, int64_t duration, int64_t bytes, double flops) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  if (!enabled_) {
+    return;
+  }
+  if (!thread_index_.get()) {
+    thread_index_.reset(new int(threads_++));
+  }
+  ProfileEvent event;
+  event.category = category;
+  event.name = name;
+  event.thread = *thread_index_;
+  event.start = start;
+  event.duration = duration;
+  event.bytes = bytes;
+  event.flops = flops;
+  events_.push_back(event);
+}
+
+vector<ProfileEvent> Profiler::events() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return events_;
+}
+
+string JsonString(const string& s) {
+  std::ostringstream json;
+  json << '"';
+  for (int i = 0; i < s.size(); ++i) {
+    const unsigned char c = s[i];
+    if (c == '"' || c == '\\') {
+      json << '\\' << c;
+    } else if (c < 0x20) {
+      json << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+           << static_cast<int>(c) << std::dec;
+    } else {
+      json << c;
+    }
+  }
+  json << '"';
+  return json.str();
+}
+
+void Profiler::WriteTrace(const string& filename) const {
+  const vector<ProfileEvent> events = this->events();
+  std::ofstream file(filename.c_str());
+  CHECK(file) << "Failed to open profile trace " << filename;
+  file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+  for (int i = 0; i < events.size(); ++i) {
+    const ProfileEvent& event = events[i];
+    file << (i ? ",\n" : "\n")
+         << "{\"name\": " << JsonString(event.name)
+         << ", \"cat\": \"" << event.category << "\""
+         << ", \"ph\": \"X\", \"pid\": 0, \"tid\": " << event.thread
+         << ", \"ts\": " << event.start << ", \"dur\": " << event.duration
+         << ", \"args\": {\"bytes\": " << event.bytes
+         << ", \"flops\": " << event.flops << "}}";
+  }
+  file << "\n]}\n";
+  CHECK(file) << "Failed to write profile trace " << filename;
+}
+
+string Profiler::Summary() const {
+  const vector<ProfileEvent> events = this->events();
+  // Rows in the order they first occur, which for layers is the net's
+  std::map<std::pair<string, string>, int> index;
+  vector<const ProfileEvent*> rows;
+  vector<int> calls;
+  vector<int64_t> duration, bytes;
+  vector<double> flops;
+  std::map<string, int64_t> category_duration;
+  for (int i = 0; i < events.size(); ++i) {
+    const ProfileEvent& event = events[i];
+    std::pair<string, string> key(event.category, event.name);
+    if (!index.count(key)) {
+      index[key] = rows.size();
+      rows.push_back(&event);
+      calls.push_back(0);
+      duration.push_back(0);
+      bytes.push_back(0);
+      flops.push_back(0);
+    }
+    const int row = index[key];
+    ++calls[row];
+    duration[row] += event.duration;
+    bytes[row] += event.bytes;
+    flops[row] += event.flops;
+    category_duration[event.category] += event.duration;
+  }
+  std::ostringstream summary;
+  summary << std::left << std::setw(9) << "category" << std::setw(24) << "name"
+          << std::right << std::setw(8) << "calls" << std::setw(12)
+          << "total ms" << std::setw(10) << "mean ms" << std::setw(7) << "%"
+          << std::setw(11) << "alloc MB" << std::setw(10) << "GFLOP/s"
+          << "\n" << std::fixed;
+  for (int i = 0; i < rows.size(); ++i) {
+    const int64_t total = category_duration[rows[i]->category];
+    summary << std::left << std::setw(9) << rows[i]->category << std::setw(24)
+            << rows[i]->name << std::right << std::setw(8) << calls[i]
+            << std::setprecision(3) << std::setw(12) << duration[i] / 1000.
+            << std::setw(10) << duration[i] / 1000. / calls[i]
+            << std::setprecision(1) << std::setw(7)
+            << (total ? 100. * duration[i] / total : 0.)
+            << std::setprecision(2) << std::setw(11) << bytes[i] / 1048576.
+            << std::setw(10)
+            << (duration[i] ? flops[i] / duration[i] / 1000. : 0.) << "\n";
+  }
+  return summary.str();
+}
+
+static void SynchronizeDevice() {
+  if (Caffe::mode() == Caffe::GPU) {
+#ifndef CPU_ONLY
+    CUDA_CHECK(cudaDeviceSynchronize());
+#else
+    NO_GPU;
+#endif
+  }
+}
+
+void ProfileScope::Begin(const char* category, const string& name) {
+  category_ = category;
+  name_ = name;
+  flops_ = 0;
+  SynchronizeDevice();
+  start_ = Profiler::Get().Now();
+  bytes_ = Profiler::thread_allocated();
+}
+
+void ProfileScope::End() {
+  SynchronizeDevice();
+  Profiler& profiler = Profiler::Get();
+  profiler.Record(category_, name_, start_, profiler.Now() - start_,
+      Profiler::thread_allocated() - bytes_, flops_);
+}
+
+}  // namespace caffe
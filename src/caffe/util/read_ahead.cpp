@@ -0,0 +1,181 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <exception>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/read_ahead.hpp"
+
+namespace caffe {
+
+class ReadAhead::sync {
+ public:
+  mutable boost::mutex mutex_;
+  boost::condition_variable queued_;
+};
+
+ReadAhead::ReadAhead(int threads, int capacity)
+    : sync_(new sync()), capacity_(capacity), stopping_(false), files_(0),
+      bytes_(0), dropped_(0), seconds_(0) {
+  CHECK_GT(threads, 0) << "Read ahead needs at least one thread.";
+  CHECK_GT(capacity, 0) << "Read ahead needs room for one file.";
+  try {
+    for (int i = 0; i < threads; ++i) {
+      threads_.push_back(shared_ptr<boost::thread>(
+          new boost::thread(&ReadAhead::Work, this)));
+    }
+  } catch (std::exception& e) {
+    LOG(FATAL) << "Thread exception: " << e.what();
+  }
+}
+
+ReadAhead::~ReadAhead() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  stopping_ = true;
+  queue_.clear();
+  lock.unlock();
+  sync_->queued_.notify_all();
+  for (int i = 0; i < threads_.size(); ++i) {
+    threads_[i]->join();
+  }
+}
+
+void ReadAhead::Fetch(const string& filename) {
+  Fetch(boost::bind(&ReadAhead::ReadFile, filename));
+}
+
+void ReadAhead::Fetch(const Reader& reader) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  queue_.push_back(reader);
+  while (queue_.size() > capacity_) {
+    queue_.pop_front();
+    ++dropped_;
+  }
+  lock.unlock();
+  sync_->queued_.notify_one();
+}
+
+int ReadAhead::pending() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return queue_.size();
+}
+
+uint64_t ReadAhead::files() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return files_;
+}
+
+uint64_t ReadAhead::bytes() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return bytes_;
+}
+
+uint64_t ReadAhead::dropped() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return dropped_;
+}
+
+double ReadAhead::seconds() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return seconds_;
+}
+
+string ReadAhead::Summary() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  std::ostringstream summary;
+  summary << files_ << " files, " << bytes_ / 1e6 << " MB read ahead";
+  if (files_ > 0 && seconds_ > 0) {
+    summary << ", " << seconds_ * 1000 / files_ << " ms per file, "
+        << bytes_ / 1e6 / seconds_ << " MB/s per thread";
+  }
+  summary << ", " << queue_.size() << " pending, " << dropped_
+      << " dropped";
+  return summary.str();
+}
+
+void ReadAhead::Work() {
+  CPUTimer timer;
+  while (true) {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    while (!stopping_ && queue_.empty()) {
+      sync_->queued_.wait(lock);
+    }
+    if (stopping_) {
+      return;
+    }
+    const Reader reader = queue_.front();
+    queue_.pop_front();
+    lock.unlock();
+
+    timer.Start();
+    const int64_t bytes = reader();
+    const double seconds = timer.Seconds();
+    if (bytes < 0) {
+      continue;
+    }
+
+    lock.lock();
+    ++files_;
+    bytes_ += bytes;
+    seconds_ += seconds;
+  }
+}
+
+int64_t ReadAhead::ReadFile(const string& filename) {
+  const size_t kBufferSize = 1 << 20;
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    // The data layer reports missing files when it reads them
+    DLOG(WARNING) << "Couldn't read ahead " << filename;
+    return -1;
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+  // The advice alone doesn't make every filesystem fetch the data
+  vector<char> buffer(kBufferSize);
+  int64_t bytes = 0;
+  ssize_t size;
+  while ((size = read(fd, &buffer[0], buffer.size())) > 0) {
+    bytes += size;
+  }
+  close(fd);
+  return bytes;
+}
+
+int64_t ReadAhead::ReadRanges(const string& filename,
+    const vector<pair<int64_t, int64_t> >& ranges) {
+  const int64_t kBufferSize = 1 << 20;
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    DLOG(WARNING) << "Couldn't read ahead " << filename;
+    return -1;
+  }
+  for (int i = 0; i < ranges.size(); ++i) {
+    posix_fadvise(fd, ranges[i].first, ranges[i].second, POSIX_FADV_WILLNEED);
+  }
+  vector<char> buffer(kBufferSize);
+  int64_t bytes = 0;
+  for (int i = 0; i < ranges.size(); ++i) {
+    const int64_t end = ranges[i].first + ranges[i].second;
+    for (int64_t offset = ranges[i].first; offset < end; ) {
+      const ssize_t size = pread(fd, &buffer[0],
+          std::min(kBufferSize, end - offset), offset);
+      if (size <= 0) {
+        break;
+      }
+      offset += size;
+      bytes += size;
+    }
+  }
+  close(fd);
+  return bytes;
+}
+
+}  // namespace caffe
@@ -0,0 +1,83 @@
+#include <boost/thread.hpp>
+#include <exception>
+
+#include "caffe/util/worker_pool.hpp"
+
+namespace caffe {
+
+class WorkerPool::sync {
+ public:
+  boost::mutex mutex_;
+  // Signaled on a new task or on stopping, and when the last worker is done
+  boost::condition_variable start_;
+  boost::condition_variable done_;
+};
+
+WorkerPool::WorkerPool(int size)
+    : size_(size), sync_(new sync()), generation_(0), pending_(0),
+      stopping_(false) {
+  CHECK_GT(size_, 0) << "A worker pool needs at least one worker.";
+  try {
+    for (int worker = 1; worker < size_; ++worker) {
+      threads_.push_back(shared_ptr<boost::thread>(new boost::thread(
+          &WorkerPool::Work, this, worker, Caffe::solver_count(),
+          Caffe::solver_rank(), Caffe::multiprocess())));
+    }
+  } catch (std::exception& e) {
+    LOG(FATAL) << "Thread exception: " << e.what();
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  stopping_ = true;
+  lock.unlock();
+  sync_->start_.notify_all();
+  for (int i = 0; i < threads_.size(); ++i) {
+    threads_[i]->join();
+  }
+}
+
+void WorkerPool::Run(const boost::function<void(int)>& task) {
+  if (size_ == 1) {
+    task(0);
+    return;
+  }
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  task_ = task;
+  pending_ = size_ - 1;
+  ++generation_;
+  lock.unlock();
+  sync_->start_.notify_all();
+  task(0);
+  lock.lock();
+  while (pending_ > 0) {
+    sync_->done_.wait(lock);
+  }
+}
+
+void WorkerPool::Work(int worker, int solver_count, int solver_rank,
+    bool multiprocess) {
+  Caffe::set_solver_count(solver_count);
+  Caffe::set_solver_rank(solver_rank);
+  Caffe::set_multiprocess(multiprocess);
+  unsigned int generation = 0;
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (true) {
+    while (!stopping_ && generation_ == generation) {
+      sync_->start_.wait(lock);
+    }
+    if (stopping_) {
+      return;
+    }
+    generation = generation_;
+    lock.unlock();
+    task_(worker);
+    lock.lock();
+    if (--pending_ == 0) {
+      sync_->done_.notify_one();
+    }
+  }
+}
+
+}  // namespace caffe
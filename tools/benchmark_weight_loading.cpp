@@ -0,0 +1,88 @@
+// This program times loading trained weights into a net, e.g. to compare a
+// .caffemodel against the same weights converted by convert_weights.
+// Usage:
+//    benchmark_weight_loading [FLAGS] MODEL WEIGHTS [WEIGHTS ...]
+
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/flat_weights.hpp"
+#include "caffe/util/math_functions.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_int32(iterations, 5,
+    "The number of times each weight file is loaded");
+DEFINE_bool(map, true,
+    "Map flat weight files instead of copying them into the net");
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Time loading trained weights into a net.\n"
+        "Load is the time spent in CopyTrainedLayersFrom, touch the time\n"
+        "to then read every parameter once (which pages in mapped weights).\n"
+        "Files are read once before timing, so the page cache is warm.\n"
+        "Usage:\n"
+        "    benchmark_weight_loading [FLAGS] MODEL WEIGHTS [WEIGHTS ...]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc < 3) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0],
+        "tools/benchmark_weight_loading");
+    return 1;
+  }
+  CHECK_GT(FLAGS_iterations, 0);
+  Caffe::set_mode(Caffe::CPU);
+
+  for (int i = 2; i < argc; ++i) {
+    const string weights(argv[i]);
+    const bool flat = FlatWeights::IsFlatWeights(weights);
+    double load_ms = 0;
+    double touch_ms = 0;
+    // The first run warms the page cache and is not timed
+    for (int iter = -1; iter < FLAGS_iterations; ++iter) {
+      Net<float> net(argv[1], TEST);
+      CPUTimer timer;
+      timer.Start();
+      if (flat) {
+        net.CopyTrainedLayersFromFlat(weights, FLAGS_map);
+      } else {
+        net.CopyTrainedLayersFrom(weights);
+      }
+      timer.Stop();
+      const double load_iter_ms = timer.MilliSeconds();
+      timer.Start();
+      float sum = 0;
+      const vector<Blob<float>*>& params = net.learnable_params();
+      for (int j = 0; j < params.size(); ++j) {
+        sum += caffe_cpu_asum(params[j]->count(), params[j]->cpu_data());
+      }
+      timer.Stop();
+      if (iter >= 0) {
+        load_ms += load_iter_ms;
+        touch_ms += timer.MilliSeconds();
+      }
+      DLOG(INFO) << "Sum of absolute weights: " << sum;
+    }
+    LOG(INFO) << weights << (flat ? (FLAGS_map ? " (flat, mapped)" :
+        " (flat, copied)") : "") << ": load "
+        << load_ms / FLAGS_iterations << " ms, touch "
+        << touch_ms / FLAGS_iterations << " ms, total "
+        << (load_ms + touch_ms) / FLAGS_iterations << " ms.";
+  }
+  return 0;
+}
@@ -6,12 +6,15 @@ namespace bp = boost::python;
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <algorithm>
 #include <cstring>
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
+#include "boost/thread.hpp"
 #include "caffe/caffe.hpp"
 #include "caffe/util/signal_handler.h"
 
@@ -19,6 +22,7 @@ using caffe::Blob;
 using caffe::Caffe;
 using caffe::Net;
 using caffe::Layer;
+using caffe::LayerCost;
 using caffe::Solver;
 using caffe::shared_ptr;
 using caffe::string;
@@ -35,7 +39,8 @@ DEFINE_string(solver, "",
 DEFINE_string(model, "",
     "The model definition protocol buffer text file.");
 DEFINE_string(phase, "",
-    "Optional; network phase (TRAIN or TEST). Only used for 'time'.");
+    "Optional; network phase (TRAIN or TEST). Only used for 'time' and "
+    "'profile'.");
 DEFINE_int32(level, 0,
     "Optional; network level.");
 DEFINE_string(stage, "",
@@ -54,6 +59,16 @@ DEFINE_string(sigint_effect, "stop",
 DEFINE_string(sighup_effect, "snapshot",
              "Optional; action to take when a SIGHUP signal is received: "
              "snapshot, stop or none.");
+DEFINE_string(profile, "",
+    "Optional; profile the layer passes, solver iterations and data waits "
+    "of train or test, writing a Chrome trace (chrome://tracing) to this "
+    "file and logging a summary per layer.");
+DEFINE_double(peak_gflops, 0,
+    "Optional; the peak GFLOP/s of the device for 'profile'. Measured with "
+    "a matrix multiplication if not given.");
+DEFINE_double(peak_gbps, 0,
+    "Optional; the peak memory bandwidth of the device for 'profile', in "
+    "GB/s. Measured with a copy if not given.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -162,6 +177,23 @@ caffe::SolverAction::Enum GetRequestedAction(
   LOG(FATAL) << "Invalid signal effect \""<< flag_value << "\" was specified";
 }
 
+// Start and finish the profile requested with -profile, if any.
+static void StartProfile() {
+  if (FLAGS_profile.size()) {
+    caffe::Profiler::Get().Start();
+  }
+}
+
+static void FinishProfile() {
+  if (FLAGS_profile.size()) {
+    caffe::Profiler& profiler = caffe::Profiler::Get();
+    profiler.Stop();
+    profiler.WriteTrace(FLAGS_profile);
+    LOG(INFO) << "Profile trace written to " << FLAGS_profile << "\n"
+              << profiler.Summary();
+  }
+}
+
 // Train / Finetune a model.
 int train() {
   CHECK_GT(FLAGS_solver.size(), 0) << "Need a solver definition to train.";
@@ -237,6 +269,7 @@ int train() {
   }
 
   LOG(INFO) << "Starting Optimization";
+  StartProfile();
   if (gpus.size() > 1) {
 #ifdef USE_NCCL
     caffe::NCCL<float> nccl(solver);
@@ -247,6 +280,7 @@ int train() {
   } else {
     solver->Solve();
   }
+  FinishProfile();
   LOG(INFO) << "Optimization Done.";
   return 0;
 }
@@ -279,6 +313,7 @@ int test() {
   Net<float> caffe_net(FLAGS_model, caffe::TEST, FLAGS_level, &stages);
   caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
   LOG(INFO) << "Running for " << FLAGS_iterations << " iterations.";
+  StartProfile();
 
   vector<int> test_score_output_id;
   vector<float> test_score;
@@ -305,6 +340,7 @@ int test() {
       }
     }
   }
+  FinishProfile();
   loss /= FLAGS_iterations;
   LOG(INFO) << "Loss: " << loss;
   for (int i = 0; i < test_score.size(); ++i) {
@@ -417,6 +453,195 @@ int time() {
 }
 RegisterBrewFunction(time);
 
+// Copy count floats repeats times. Run on threads without a Caffe context,
+// so calls memcpy rather than caffe_copy.
+static void CopyRepeatedly(const float* from, float* to, int count,
+    int repeats) {
+  for (int i = 0; i < repeats; ++i) {
+    memcpy(to, from, sizeof(float) * count);  // NOLINT(caffe/alt_fn)
+  }
+}
+
+// Measure the peaks not given by -peak_gflops and -peak_gbps on the current
+// device, as the best of several timed runs of matrix multiplications and
+// copies, after untimed warm-up runs that settle the memory and the clocks.
+// On the CPU the copy is split between the hardware threads, as the
+// multiplication is by the BLAS, so that both peaks are of the whole CPU.
+static void MeasurePeaks(double* gflops, double* gbps) {
+  const int n = 512;
+  const int count = 1 << 24;
+  const int warmup_runs = 2;
+  const int runs = 5;
+  // Operations per run, so that a run is long enough to time
+  const int repeats = 4;
+  Blob<float> a(1, 1, n, n), b(1, 1, n, n), c(1, 1, n, n);
+  Blob<float> from(1, 1, 1, count), to(1, 1, 1, count);
+  caffe::caffe_set(a.count(), 1.f, a.mutable_cpu_data());
+  caffe::caffe_set(b.count(), 1.f, b.mutable_cpu_data());
+  caffe::caffe_set(from.count(), 1.f, from.mutable_cpu_data());
+  const bool gpu = Caffe::mode() == Caffe::GPU;
+  const float* a_data = gpu ? a.gpu_data() : a.cpu_data();
+  const float* b_data = gpu ? b.gpu_data() : b.cpu_data();
+  float* c_data = gpu ? c.mutable_gpu_data() : c.mutable_cpu_data();
+  const float* from_data = gpu ? from.gpu_data() : from.cpu_data();
+  float* to_data = gpu ? to.mutable_gpu_data() : to.mutable_cpu_data();
+  const int num_threads =
+      std::max<int>(boost::thread::hardware_concurrency(), 1);
+  double gemm_ms = 0, copy_ms = 0;
+  Timer timer;
+  for (int run = -warmup_runs; run < runs; ++run) {
+    timer.Start();
+    for (int i = 0; i < repeats; ++i) {
+      if (!gpu) {
+        caffe::caffe_cpu_gemm<float>(CblasNoTrans, CblasNoTrans, n, n, n,
+            1.f, a_data, b_data, 0.f, c_data);
+      } else {
+#ifndef CPU_ONLY
+        caffe::caffe_gpu_gemm<float>(CblasNoTrans, CblasNoTrans, n, n, n,
+            1.f, a_data, b_data, 0.f, c_data);
+#else
+        NO_GPU;
+#endif
+      }
+    }
+    const double gemm = timer.MilliSeconds() / repeats;
+    timer.Start();
+    if (!gpu) {
+      boost::thread_group threads;
+      for (int t = 0; t < num_threads; ++t) {
+        const int begin = static_cast<int64_t>(count) * t / num_threads;
+        const int end = static_cast<int64_t>(count) * (t + 1) / num_threads;
+        threads.create_thread(boost::bind(&CopyRepeatedly,
+            from_data + begin, to_data + begin, end - begin, repeats));
+      }
+      threads.join_all();
+    } else {
+      for (int i = 0; i < repeats; ++i) {
+        caffe::caffe_copy(count, from_data, to_data);
+      }
+    }
+    const double copy = timer.MilliSeconds() / repeats;
+    if (run == 0) {
+      gemm_ms = gemm;
+      copy_ms = copy;
+    } else if (run > 0) {
+      gemm_ms = std::min(gemm_ms, gemm);
+      copy_ms = std::min(copy_ms, copy);
+    }
+  }
+  if (*gflops <= 0) {
+    *gflops = 2. * n * n * n / gemm_ms / 1e6;
+  }
+  if (*gbps <= 0) {
+    // Reading the source and writing the destination
+    *gbps = 2. * count * sizeof(float) / copy_ms / 1e6;
+  }
+}
+
+// Profile: place the time of each layer pass on the roofline of the device.
+int profile() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to profile.";
+  caffe::Phase phase = get_phase_from_flags(caffe::TRAIN);
+  vector<string> stages = get_stages_from_flags();
+
+  // Set device id and mode
+  vector<int> gpus;
+  get_gpus(&gpus);
+  if (gpus.size() != 0) {
+    LOG(INFO) << "Use GPU with device ID " << gpus[0];
+    Caffe::SetDevice(gpus[0]);
+    Caffe::set_mode(Caffe::GPU);
+  } else {
+    LOG(INFO) << "Use CPU.";
+    Caffe::set_mode(Caffe::CPU);
+  }
+  // Instantiate the caffe net.
+  Net<float> caffe_net(FLAGS_model, phase, FLAGS_level, &stages);
+  if (FLAGS_weights.size()) {
+    caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+  }
+  const bool backward = phase == caffe::TRAIN;
+
+  // Do a clean pass, so that memory allocations are done and the profile
+  // sees a steady state.
+  caffe_net.Forward();
+  if (backward) {
+    caffe_net.Backward();
+  }
+  double peak_gflops = FLAGS_peak_gflops;
+  double peak_gbps = FLAGS_peak_gbps;
+  if (peak_gflops <= 0 || peak_gbps <= 0) {
+    MeasurePeaks(&peak_gflops, &peak_gbps);
+  }
+  LOG(INFO) << "Roofline peaks: " << peak_gflops << " GFLOP/s, " << peak_gbps
+            << " GB/s, ridge at " << peak_gflops / peak_gbps << " FLOP/B.";
+
+  caffe::Profiler& profiler = caffe::Profiler::Get();
+  profiler.Start();
+  for (int j = 0; j < FLAGS_iterations; ++j) {
+    caffe_net.Forward();
+    if (backward) {
+      caffe_net.Backward();
+    }
+  }
+  profiler.Stop();
+  if (FLAGS_profile.size()) {
+    profiler.WriteTrace(FLAGS_profile);
+    LOG(INFO) << "Profile trace written to " << FLAGS_profile;
+  }
+  // Microseconds spent in each pass of each layer
+  std::map<std::pair<string, string>, int64_t> micros;
+  const vector<caffe::ProfileEvent> events = profiler.events();
+  for (int i = 0; i < events.size(); ++i) {
+    micros[std::make_pair(string(events[i].category), events[i].name)] +=
+        events[i].duration;
+  }
+
+  const vector<shared_ptr<Layer<float> > >& layers = caffe_net.layers();
+  const vector<vector<Blob<float>*> >& bottom_vecs = caffe_net.bottom_vecs();
+  const vector<vector<Blob<float>*> >& top_vecs = caffe_net.top_vecs();
+  ostringstream report;
+  report << std::left << std::setw(20) << "layer" << std::setw(9) << "pass"
+         << std::right << std::setw(10) << "ms" << std::setw(10) << "GFLOP"
+         << std::setw(10) << "MB" << std::setw(9) << "FLOP/B"
+         << std::setw(10) << "GFLOP/s" << std::setw(9) << "GB/s"
+         << std::setw(9) << "bound" << std::setw(8) << "% roof" << "\n"
+         << std::fixed;
+  for (int i = 0; i < layers.size(); ++i) {
+    const string& name = layers[i]->layer_param().name();
+    const LayerCost cost = layers[i]->Cost(bottom_vecs[i], top_vecs[i]);
+    for (int pass = 0; pass < 2; ++pass) {
+      const char* category = pass ? "backward" : "forward";
+      const std::pair<string, string> key(category, name);
+      if (!micros.count(key)) {
+        continue;
+      }
+      const double seconds = micros[key] / 1e6 / FLAGS_iterations;
+      const double flops = pass ? cost.backward_flops : cost.forward_flops;
+      const double bytes = pass ? cost.backward_bytes : cost.forward_bytes;
+      const double intensity = bytes ? flops / bytes : 0;
+      const double gflops = seconds ? flops / seconds / 1e9 : 0;
+      const double gbps = seconds ? bytes / seconds / 1e9 : 0;
+      // Below the ridge the bandwidth is the roof, above it the arithmetic
+      const bool memory_bound = intensity * peak_gbps < peak_gflops;
+      const double roof = memory_bound ?
+          100. * gbps / peak_gbps : 100. * gflops / peak_gflops;
+      report << std::left << std::setw(20) << name << std::setw(9) << category
+             << std::right << std::setprecision(3) << std::setw(10)
+             << seconds * 1e3 << std::setw(10) << flops / 1e9
+             << std::setprecision(2) << std::setw(10) << bytes / 1e6
+             << std::setw(9) << intensity << std::setw(10) << gflops
+             << std::setw(9) << gbps << std::setw(9)
+             << (memory_bound ? "memory" : "compute")
+             << std::setprecision(1) << std::setw(8) << roof << "\n";
+    }
+  }
+  LOG(INFO) << "Average per layer over " << FLAGS_iterations
+            << " iterations:\n" << report.str();
+  return 0;
+}
+RegisterBrewFunction(profile);
+
 int main(int argc, char** argv) {
   // Print output to stderr (while still logging).
   FLAGS_alsologtostderr = 1;
@@ -429,7 +654,8 @@ int main(int argc, char** argv) {
       "  train           train or finetune a model\n"
       "  test            score a model\n"
       "  device_query    show GPU diagnostic information\n"
-      "  time            benchmark model execution time");
+      "  time            benchmark model execution time\n"
+      "  profile         place the layers of a model on the roofline");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
   if (argc == 2) {
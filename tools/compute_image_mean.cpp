@@ -1,10 +1,12 @@
 #include <stdint.h>
 #include <algorithm>
+#include <cmath>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "boost/scoped_ptr.hpp"
+#include "boost/thread.hpp"
 #include "gflags/gflags.h"
 #include "glog/logging.h"
 
@@ -19,7 +21,116 @@ using std::pair;
 using boost::scoped_ptr;
 
 DEFINE_string(backend, "lmdb",
-        "The backend {leveldb, lmdb} containing the images");
+        "The backend {leveldb, lmdb, records} containing the images");
+DEFINE_int32(threads, 0,
+    "Number of threads reading the database, each its own range of keys; "
+    "0 for one per core");
+DEFINE_double(sample, 1,
+    "Fraction of the records to use, picked by a hash of their keys");
+
+#ifdef USE_OPENCV
+// Adds value to a sum whose rounding error is carried in compensation.
+inline void KahanAdd(double value, double* sum, double* compensation) {
+  const double y = value - *compensation;
+  const double t = *sum + y;
+  *compensation = (t - *sum) - y;
+  *sum = t;
+}
+
+// Sums of the values and squared values of every element of the images.
+class ImageSums {
+ public:
+  explicit ImageSums(int size)
+      : sum_(size, 0), sum_error_(size, 0), square_(size, 0),
+        square_error_(size, 0), count_(0) { }
+
+  void Add(const Datum& datum) {
+    const string& data = datum.data();
+    const int size_in_datum = std::max<int>(datum.data().size(),
+        datum.float_data_size());
+    CHECK_EQ(size_in_datum, sum_.size()) << "Incorrect data field size "
+        << size_in_datum;
+    if (data.size() != 0) {
+      for (int i = 0; i < sum_.size(); ++i) {
+        const double value = static_cast<uint8_t>(data[i]);
+        KahanAdd(value, &sum_[i], &sum_error_[i]);
+        KahanAdd(value * value, &square_[i], &square_error_[i]);
+      }
+    } else {
+      CHECK_EQ(datum.float_data_size(), sum_.size());
+      for (int i = 0; i < sum_.size(); ++i) {
+        const double value = datum.float_data(i);
+        KahanAdd(value, &sum_[i], &sum_error_[i]);
+        KahanAdd(value * value, &square_[i], &square_error_[i]);
+      }
+    }
+    ++count_;
+  }
+
+  void Merge(const ImageSums& other) {
+    for (int i = 0; i < sum_.size(); ++i) {
+      KahanAdd(other.sum_[i], &sum_[i], &sum_error_[i]);
+      KahanAdd(-other.sum_error_[i], &sum_[i], &sum_error_[i]);
+      KahanAdd(other.square_[i], &square_[i], &square_error_[i]);
+      KahanAdd(-other.square_error_[i], &square_[i], &square_error_[i]);
+    }
+    count_ += other.count_;
+  }
+
+  inline double sum(int i) const { return sum_[i] - sum_error_[i]; }
+  inline double square(int i) const { return square_[i] - square_error_[i]; }
+  inline int64_t count() const { return count_; }
+
+ private:
+  vector<double> sum_, sum_error_;
+  vector<double> square_, square_error_;
+  int64_t count_;
+};
+
+// FNV-1a, so that sampling picks the same records whatever the threads.
+inline bool Sampled(const string& key) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (int i = 0; i < key.size(); ++i) {
+    hash = (hash ^ static_cast<uint8_t>(key[i])) * 1099511628211ULL;
+  }
+  return (hash >> 11) * (1.0 / (1ULL << 53)) < FLAGS_sample;
+}
+
+boost::mutex progress_mutex;
+int64_t progress_count = 0;
+
+// Sums the rank-th of count parts of the records. The part is found on the
+// thread, so that the threads seek to their parts in parallel; if the records
+// can't be split, the first thread sums them all.
+void SumImages(db::DB* db, int rank, int count, ImageSums* sums) {
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  if (count > 1 && !cursor->Partition(rank, count)) {
+    if (rank == 0) {
+      LOG(INFO) << "Can't split the records between threads, using one.";
+    } else {
+      return;
+    }
+  }
+  const int kProgressInterval = 10000;
+  int64_t visited = 0;
+  for (; cursor->valid(); cursor->Next()) {
+    if (FLAGS_sample >= 1 || Sampled(cursor->key())) {
+      Datum datum;
+      datum.ParseFromString(cursor->value());
+      DecodeDatumNative(&datum);
+      sums->Add(datum);
+    }
+    if (++visited == kProgressInterval) {
+      boost::mutex::scoped_lock lock(progress_mutex);
+      progress_count += visited;
+      visited = 0;
+      LOG(INFO) << "Processed " << progress_count << " files.";
+    }
+  }
+  boost::mutex::scoped_lock lock(progress_mutex);
+  progress_count += visited;
+}
+#endif  // USE_OPENCV
 
 int main(int argc, char** argv) {
 #ifdef USE_OPENCV
@@ -32,7 +143,8 @@ int main(int argc, char** argv) {
 #endif
 
   gflags::SetUsageMessage("Compute the mean_image of a set of images given by"
-        " a leveldb/lmdb\n"
+        " a leveldb/lmdb/records database, and the mean and standard\n"
+        "deviation of each channel\n"
         "Usage:\n"
         "    compute_image_mean [FLAGS] INPUT_DB [OUTPUT_FILE]\n");
 
@@ -42,66 +154,59 @@ int main(int argc, char** argv) {
     gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/compute_image_mean");
     return 1;
   }
+  CHECK_GT(FLAGS_sample, 0);
+  CHECK_LE(FLAGS_sample, 1);
 
   scoped_ptr<db::DB> db(db::GetDB(FLAGS_backend));
   db->Open(argv[1], db::READ);
-  scoped_ptr<db::Cursor> cursor(db->NewCursor());
 
-  BlobProto sum_blob;
-  int count = 0;
   // load first datum
   Datum datum;
-  datum.ParseFromString(cursor->value());
+  {
+    scoped_ptr<db::Cursor> cursor(db->NewCursor());
+    datum.ParseFromString(cursor->value());
+  }
 
   if (DecodeDatumNative(&datum)) {
     LOG(INFO) << "Decoding Datum";
   }
 
+  BlobProto sum_blob;
   sum_blob.set_num(1);
   sum_blob.set_channels(datum.channels());
   sum_blob.set_height(datum.height());
   sum_blob.set_width(datum.width());
   const int data_size = datum.channels() * datum.height() * datum.width();
-  int size_in_datum = std::max<int>(datum.data().size(),
-                                    datum.float_data_size());
-  for (int i = 0; i < size_in_datum; ++i) {
-    sum_blob.add_data(0.);
+  const int size_in_datum = std::max<int>(datum.data().size(),
+                                          datum.float_data_size());
+  CHECK_EQ(size_in_datum, data_size) << "Incorrect data field size "
+      << size_in_datum;
+
+  // Each thread reads its own part of the records through its own cursor
+  const int num_threads = FLAGS_threads > 0 ? FLAGS_threads :
+      std::max<int>(boost::thread::hardware_concurrency(), 1);
+  LOG(INFO) << "Starting iteration with " << num_threads << " threads";
+  vector<shared_ptr<ImageSums> > sums;
+  boost::thread_group threads;
+  for (int i = 0; i < num_threads; ++i) {
+    sums.push_back(shared_ptr<ImageSums>(new ImageSums(size_in_datum)));
+    threads.create_thread(boost::bind(&SumImages, db.get(), i, num_threads,
+        sums[i].get()));
   }
-  LOG(INFO) << "Starting iteration";
-  while (cursor->valid()) {
-    Datum datum;
-    datum.ParseFromString(cursor->value());
-    DecodeDatumNative(&datum);
-
-    const std::string& data = datum.data();
-    size_in_datum = std::max<int>(datum.data().size(),
-        datum.float_data_size());
-    CHECK_EQ(size_in_datum, data_size) << "Incorrect data field size " <<
-        size_in_datum;
-    if (data.size() != 0) {
-      CHECK_EQ(data.size(), size_in_datum);
-      for (int i = 0; i < size_in_datum; ++i) {
-        sum_blob.set_data(i, sum_blob.data(i) + (uint8_t)data[i]);
-      }
-    } else {
-      CHECK_EQ(datum.float_data_size(), size_in_datum);
-      for (int i = 0; i < size_in_datum; ++i) {
-        sum_blob.set_data(i, sum_blob.data(i) +
-            static_cast<float>(datum.float_data(i)));
-      }
-    }
-    ++count;
-    if (count % 10000 == 0) {
-      LOG(INFO) << "Processed " << count << " files.";
+  threads.join_all();
+  // Pairwise, so that the partial sums being added stay of similar size
+  for (int step = 1; step < num_threads; step *= 2) {
+    for (int i = 0; i + step < num_threads; i += 2 * step) {
+      sums[i]->Merge(*sums[i + step]);
     }
-    cursor->Next();
-  }
-
-  if (count % 10000 != 0) {
-    LOG(INFO) << "Processed " << count << " files.";
   }
-  for (int i = 0; i < sum_blob.data_size(); ++i) {
-    sum_blob.set_data(i, sum_blob.data(i) / count);
+  const ImageSums& total = *sums[0];
+  const int64_t count = total.count();
+  CHECK_GT(count, 0) << "No records were sampled.";
+  LOG(INFO) << "Processed " << progress_count << " files, used " << count
+      << ".";
+  for (int i = 0; i < data_size; ++i) {
+    sum_blob.add_data(total.sum(i) / count);
   }
   // Write to disk
   if (argc == 3) {
@@ -110,13 +215,22 @@ int main(int argc, char** argv) {
   }
   const int channels = sum_blob.channels();
   const int dim = sum_blob.height() * sum_blob.width();
-  std::vector<float> mean_values(channels, 0.0);
   LOG(INFO) << "Number of channels: " << channels;
   for (int c = 0; c < channels; ++c) {
-    for (int i = 0; i < dim; ++i) {
-      mean_values[c] += sum_blob.data(dim * c + i);
+    double channel_sum = 0;
+    double channel_sum_error = 0;
+    double channel_square = 0;
+    double channel_square_error = 0;
+    for (int i = dim * c; i < dim * (c + 1); ++i) {
+      KahanAdd(total.sum(i), &channel_sum, &channel_sum_error);
+      KahanAdd(total.square(i), &channel_square, &channel_square_error);
     }
-    LOG(INFO) << "mean_value channel [" << c << "]: " << mean_values[c] / dim;
+    const double num_values = static_cast<double>(count) * dim;
+    const double mean = (channel_sum - channel_sum_error) / num_values;
+    const double variance = std::max(0.,
+        (channel_square - channel_square_error) / num_values - mean * mean);
+    LOG(INFO) << "mean_value channel [" << c << "]: " << mean;
+    LOG(INFO) << "std_value channel [" << c << "]: " << std::sqrt(variance);
   }
 #else
   LOG(FATAL) << "This tool requires OpenCV; compile with USE_OPENCV.";
@@ -7,14 +7,21 @@
 // should be a list of files as well as their labels, in the format as
 //   subfolder1/file1.JPEG 7
 //   ....
+//
+// Images are read, resized and encoded by a pool of threads, and written to
+// the db in list order by the main thread.
 
+#include <stdint.h>
 #include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "boost/bind.hpp"
+#include "boost/date_time/posix_time/posix_time.hpp"
 #include "boost/scoped_ptr.hpp"
+#include "boost/thread.hpp"
 #include "gflags/gflags.h"
 #include "glog/logging.h"
 
@@ -42,6 +49,142 @@ DEFINE_bool(encoded, false,
     "When this option is on, the encoded image will be save in datum");
 DEFINE_string(encode_type, "",
     "Optional: What type should we encode the image as ('png','jpg',...).");
+DEFINE_int32(threads, 0,
+    "Number of threads reading and encoding images (0: one per core)");
+DEFINE_int32(commit_interval, 10000,
+    "Number of images written per db transaction");
+
+#ifdef USE_OPENCV
+// Reads the images of a list on a pool of threads. The results are handed
+// to a single consumer in list order; the threads run at most a window of
+// images ahead of it, which bounds memory use.
+class ImageReader {
+ public:
+  ImageReader(const vector<pair<string, int> >& lines,
+      const string& root_folder, int resize_height, int resize_width,
+      bool is_color, bool encoded, const string& encode_type, int window)
+      : lines_(lines), root_folder_(root_folder),
+        resize_height_(resize_height), resize_width_(resize_width),
+        is_color_(is_color), encoded_(encoded), encode_type_(encode_type),
+        records_(window), next_(0), taken_(0) {}
+
+  ~ImageReader() {
+    threads_.join_all();
+  }
+
+  void Start(int num_threads) {
+    for (int i = 0; i < num_threads; ++i) {
+      threads_.create_thread(boost::bind(&ImageReader::Read, this));
+    }
+  }
+
+  // Waits for image i and returns the size of its serialized Datum, or 0 if
+  // it could not be read. Image i must not have been taken yet and must be
+  // less than window images ahead of the next image to take.
+  size_t Peek(int i) {
+    boost::mutex::scoped_lock lock(mutex_);
+    Record& record = records_[i % records_.size()];
+    while (record.state == Record::PENDING) {
+      ready_.wait(lock);
+    }
+    return record.state == Record::READY ? record.value.size() : 0;
+  }
+
+  // Waits for the next image in list order. Returns false if it could not
+  // be read; otherwise fills in the serialized Datum, its data size and its
+  // channels * height * width.
+  bool Take(string* value, int* data_size, int* dims) {
+    boost::mutex::scoped_lock lock(mutex_);
+    Record& record = records_[taken_ % records_.size()];
+    while (record.state == Record::PENDING) {
+      ready_.wait(lock);
+    }
+    const bool ok = record.state == Record::READY;
+    value->swap(record.value);
+    record.value.clear();
+    *data_size = record.data_size;
+    *dims = record.dims;
+    record.state = Record::PENDING;
+    ++taken_;
+    lock.unlock();
+    space_.notify_all();
+    return ok;
+  }
+
+ private:
+  struct Record {
+    enum State { PENDING, READY, FAILED };
+    Record() : state(PENDING), data_size(0), dims(0) {}
+    State state;
+    string value;
+    int data_size;
+    int dims;
+  };
+
+  void Read() {
+    Datum datum;
+    string value;
+    while (true) {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (next_ < lines_.size() && next_ >= taken_ + records_.size()) {
+        space_.wait(lock);
+      }
+      if (next_ >= lines_.size()) {
+        return;
+      }
+      const int line_id = next_++;
+      lock.unlock();
+
+      std::string enc = encode_type_;
+      if (encoded_ && !enc.size()) {
+        // Guess the encoding type from the file name
+        string fn = lines_[line_id].first;
+        size_t p = fn.rfind('.');
+        if ( p == fn.npos )
+          LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
+        enc = fn.substr(p+1);
+        std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
+      }
+      const bool status = ReadImageToDatum(root_folder_ +
+          lines_[line_id].first, lines_[line_id].second, resize_height_,
+          resize_width_, is_color_, enc, &datum);
+      if (status) {
+        CHECK(datum.SerializeToString(&value));
+      }
+
+      lock.lock();
+      Record& record = records_[line_id % records_.size()];
+      record.state = status ? Record::READY : Record::FAILED;
+      if (status) {
+        record.value.swap(value);
+        record.data_size = datum.data().size();
+        record.dims = datum.channels() * datum.height() * datum.width();
+      }
+      lock.unlock();
+      ready_.notify_all();
+    }
+  }
+
+  const vector<pair<string, int> >& lines_;
+  const string root_folder_;
+  const int resize_height_;
+  const int resize_width_;
+  const bool is_color_;
+  const bool encoded_;
+  const string encode_type_;
+
+  boost::mutex mutex_;
+  boost::condition_variable ready_;
+  boost::condition_variable space_;
+  vector<Record> records_;
+  // Next image to read, and number of images taken by the consumer
+  int next_;
+  int taken_;
+  boost::thread_group threads_;
+
+  DISABLE_COPY_AND_ASSIGN(ImageReader);
+};
+#endif  // USE_OPENCV
 
 int main(int argc, char** argv) {
 #ifdef USE_OPENCV
@@ -94,64 +237,89 @@ int main(int argc, char** argv) {
   int resize_height = std::max<int>(0, FLAGS_resize_height);
   int resize_width = std::max<int>(0, FLAGS_resize_width);
 
-  // Create new DB
+  int num_threads = FLAGS_threads;
+  if (num_threads <= 0) {
+    num_threads = std::max<int>(1, boost::thread::hardware_concurrency());
+  }
+  const int commit_interval = std::max(1, FLAGS_commit_interval);
+  const int window = 32 * num_threads;
+  ImageReader reader(lines, argv[1], resize_height, resize_width, is_color,
+      encoded, encode_type, window);
+  reader.Start(num_threads);
+  LOG(INFO) << "Reading images on " << num_threads << " threads.";
+
+  // Create new DB, sized from the first images
   scoped_ptr<db::DB> db(db::GetDB(FLAGS_backend));
   db->Open(argv[3], db::NEW);
+  const int num_samples = std::min<int>(lines.size(), window);
+  size_t sample_bytes = 0;
+  int sample_count = 0;
+  for (int line_id = 0; line_id < num_samples; ++line_id) {
+    const size_t bytes = reader.Peek(line_id);
+    if (bytes > 0) {
+      // The key is the 8 digit line number, '_' and the file name
+      sample_bytes += bytes + 9 + lines[line_id].first.size();
+      ++sample_count;
+    }
+  }
+  if (sample_count > 0) {
+    db->Reserve(lines.size(), sample_bytes / sample_count * lines.size());
+  }
   scoped_ptr<db::Transaction> txn(db->NewTransaction());
 
   // Storing to db
-  std::string root_folder(argv[1]);
-  Datum datum;
+  string value;
   int count = 0;
+  int pending = 0;
+  int failed = 0;
   int data_size = 0;
   bool data_size_initialized = false;
+  uint64_t bytes = 0;
+  const boost::posix_time::ptime start_time =
+      boost::posix_time::microsec_clock::local_time();
 
   for (int line_id = 0; line_id < lines.size(); ++line_id) {
-    bool status;
-    std::string enc = encode_type;
-    if (encoded && !enc.size()) {
-      // Guess the encoding type from the file name
-      string fn = lines[line_id].first;
-      size_t p = fn.rfind('.');
-      if ( p == fn.npos )
-        LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
-      enc = fn.substr(p+1);
-      std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
+    int size;
+    int dims;
+    if (!reader.Take(&value, &size, &dims)) {
+      ++failed;
+      continue;
     }
-    status = ReadImageToDatum(root_folder + lines[line_id].first,
-        lines[line_id].second, resize_height, resize_width, is_color,
-        enc, &datum);
-    if (status == false) continue;
     if (check_size) {
       if (!data_size_initialized) {
-        data_size = datum.channels() * datum.height() * datum.width();
+        data_size = dims;
         data_size_initialized = true;
       } else {
-        const std::string& data = datum.data();
-        CHECK_EQ(data.size(), data_size) << "Incorrect data field size "
-            << data.size();
+        CHECK_EQ(size, data_size) << "Incorrect data field size " << size;
       }
     }
     // sequential
     string key_str = caffe::format_int(line_id, 8) + "_" + lines[line_id].first;
 
     // Put in db
-    string out;
-    CHECK(datum.SerializeToString(&out));
-    txn->Put(key_str, out);
+    txn->Put(key_str, value);
+    bytes += value.size();
+    ++count;
 
-    if (++count % 1000 == 0) {
+    if (++pending == commit_interval || line_id + 1 == lines.size()) {
       // Commit db
       txn->Commit();
       txn.reset(db->NewTransaction());
-      LOG(INFO) << "Processed " << count << " files.";
+      pending = 0;
+      const float seconds = std::max(1e-3f, (
+          boost::posix_time::microsec_clock::local_time() - start_time)
+          .total_milliseconds() / 1000.f);
+      LOG(INFO) << "Processed " << line_id + 1 << " of " << lines.size()
+          << " files (" << count / seconds << " files/s, "
+          << bytes / seconds / (1 << 20) << " MB/s).";
     }
   }
-  // write the last batch
-  if (count % 1000 != 0) {
+  // write the last batch, if the list ends with unreadable images
+  if (pending > 0) {
     txn->Commit();
-    LOG(INFO) << "Processed " << count << " files.";
   }
+  LOG(INFO) << "Wrote " << count << " files (" << (bytes >> 20) << " MB); "
+      << failed << " could not be read.";
 #else
   LOG(FATAL) << "This tool requires OpenCV; compile with USE_OPENCV.";
 #endif  // USE_OPENCV
@@ -0,0 +1,109 @@
+// This program converts trained weights (.caffemodel or .caffemodel.h5) to
+// the flat weight format, which Net::CopyTrainedLayersFrom can map without
+// parsing.
+// Usage:
+//    convert_weights [FLAGS] INPUT_WEIGHTS OUTPUT_FLAT_WEIGHTS
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "hdf5.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/flat_weights.hpp"
+#include "caffe/util/hdf5.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_bool(double, false,
+    "Store the weights in double instead of single precision");
+
+template <typename Dtype>
+void AddBinaryProtoWeights(const string& filename, FlatWeightsWriter* writer,
+    vector<shared_ptr<Blob<Dtype> > >* blobs) {
+  NetParameter param;
+  ReadNetParamsFromBinaryFileOrDie(filename, &param);
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer = param.layer(i);
+    for (int j = 0; j < layer.blobs_size(); ++j) {
+      shared_ptr<Blob<Dtype> > blob(new Blob<Dtype>());
+      blob->FromProto(layer.blobs(j));
+      blobs->push_back(blob);
+      writer->Add(layer.name(), j, *blob);
+    }
+  }
+}
+
+template <typename Dtype>
+void AddHDF5Weights(const string& filename, FlatWeightsWriter* writer,
+    vector<shared_ptr<Blob<Dtype> > >* blobs) {
+  hid_t file_hid = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  CHECK_GE(file_hid, 0) << "Couldn't open " << filename;
+  hid_t data_hid = H5Gopen2(file_hid, "data", H5P_DEFAULT);
+  CHECK_GE(data_hid, 0) << "Error reading weights from " << filename;
+  const int num_layers = hdf5_get_num_links(data_hid);
+  for (int i = 0; i < num_layers; ++i) {
+    const string layer_name = hdf5_get_name_by_idx(data_hid, i);
+    hid_t layer_hid = H5Gopen2(data_hid, layer_name.c_str(), H5P_DEFAULT);
+    CHECK_GE(layer_hid, 0) << "Error reading weights from " << filename;
+    // Params of weight-sharing layers may be missing, so go by dataset name
+    const int num_params = hdf5_get_num_links(layer_hid);
+    for (int j = 0; j < num_params; ++j) {
+      const string dataset_name = hdf5_get_name_by_idx(layer_hid, j);
+      shared_ptr<Blob<Dtype> > blob(new Blob<Dtype>());
+      hdf5_load_nd_dataset(layer_hid, dataset_name.c_str(), 0, kMaxBlobAxes,
+          blob.get(), true);
+      blobs->push_back(blob);
+      writer->Add(layer_name, atoi(dataset_name.c_str()), *blob);
+    }
+    H5Gclose(layer_hid);
+  }
+  H5Gclose(data_hid);
+  H5Fclose(file_hid);
+}
+
+template <typename Dtype>
+void ConvertWeights(const string& input, const string& output) {
+  FlatWeightsWriter writer;
+  vector<shared_ptr<Blob<Dtype> > > blobs;
+  if (H5Fis_hdf5(input.c_str())) {
+    AddHDF5Weights(input, &writer, &blobs);
+  } else {
+    AddBinaryProtoWeights(input, &writer, &blobs);
+  }
+  writer.Write(output);
+  LOG(INFO) << "Wrote " << blobs.size() << " blobs to " << output;
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Convert trained weights to the flat weight\n"
+        "format, which loads without parsing.\n"
+        "Usage:\n"
+        "    convert_weights [FLAGS] INPUT_WEIGHTS OUTPUT_FLAT_WEIGHTS\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/convert_weights");
+    return 1;
+  }
+
+  if (FLAGS_double) {
+    ConvertWeights<double>(argv[1], argv[2]);
+  } else {
+    ConvertWeights<float>(argv[1], argv[2]);
+  }
+  return 0;
+}
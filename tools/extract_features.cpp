@@ -1,24 +1,357 @@
+// This program extracts features of the data produced by a trained net into
+// LevelDB or LMDB datasets of Datum, one per feature.
+//
+// With db_type matrix (or matrix_fp16), each feature is written as a dense
+// row-major matrix of float (or IEEE half) values instead, which can be
+// memory mapped for retrieval:
+//   NAME       64 byte MatrixHeader, then the rows from the data offset on
+//   NAME.ids   one int64 id per row, the value of the --id_blob blob (the
+//              label by default) or else the row number
+// Data is loaded by the prefetch threads of the data layers, forward passes
+// run on --replicas threads with a net each, and the main thread writes. The
+// replicas each read their part of the records of the (single) Data layer, and
+// write the rows of those records where a single net would have, so the output
+// does not depend on the number of replicas.
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <queue>
 #include <string>
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
+#include "boost/scoped_ptr.hpp"
+#include "boost/thread.hpp"
+#include "gflags/gflags.h"
 #include "google/protobuf/text_format.h"
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
+#include "caffe/layers/data_layer.hpp"
 #include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/upgrade_proto.hpp"
 
 using caffe::Blob;
 using caffe::Caffe;
 using caffe::Datum;
 using caffe::Net;
+using caffe::NetParameter;
 using std::string;
+using std::vector;
 namespace db = caffe::db;
 
+DEFINE_int32(replicas, 1,
+    "Number of nets extracting in parallel (matrix output only), on "
+    "consecutive GPUs from DEVICE_ID in GPU mode. Each reads its own part "
+    "of the records of the net's Data layer, which must be its only input.");
+DEFINE_string(id_blob, "label",
+    "Blob with one id per row for the id index of the matrix output.");
+
+const char kMatrixMagic[8] = {'C', 'A', 'F', 'F', 'E', 'M', 'A', 'T'};
+const uint32_t kMatrixVersion = 1;
+// Keeps the rows page aligned for mapping
+const uint64_t kMatrixDataOffset = 4096;
+
+enum MatrixType { MATRIX_FLOAT = 0, MATRIX_FP16 = 1 };
+
+struct MatrixHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t type;
+  uint64_t rows;
+  uint64_t cols;
+  uint64_t data_offset;
+  char reserved[24];
+};
+
+// Consecutive rows of one feature of one batch, on their way to the writer.
+struct FeatureRows {
+  int feature;
+  // Rows of the feature per forward pass
+  int batch_rows;
+  uint64_t first_row;
+  int num_rows;
+  uint64_t cols;
+  vector<char> data;
+  vector<int64_t> ids;
+};
+
+class RowsQueue {
+ public:
+  void push(FeatureRows* rows) {
+    boost::mutex::scoped_lock lock(mutex_);
+    queue_.push(rows);
+    condition_.notify_one();
+  }
+  FeatureRows* pop() {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (queue_.empty()) {
+      condition_.wait(lock);
+    }
+    FeatureRows* rows = queue_.front();
+    queue_.pop();
+    return rows;
+  }
+
+ private:
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+  std::queue<FeatureRows*> queue_;
+};
+
+// Writes the rows of one feature, in any order, to their final place.
+class MatrixWriter {
+ public:
+  MatrixWriter(const string& filename, MatrixType type, uint64_t rows,
+      uint64_t cols)
+      : filename_(filename), rows_(rows), cols_(cols),
+        element_size_(type == MATRIX_FP16 ? sizeof(uint16_t) : sizeof(float)) {
+    MatrixHeader header;
+    memset(&header, 0, sizeof(header));  // NOLINT(caffe/alt_fn)
+    memcpy(header.magic, kMatrixMagic,  // NOLINT(caffe/alt_fn)
+           sizeof(header.magic));
+    header.version = kMatrixVersion;
+    header.type = type;
+    header.rows = rows;
+    header.cols = cols;
+    header.data_offset = kMatrixDataOffset;
+    data_fd_ = Create(filename_, kMatrixDataOffset + rows * cols *
+        element_size_);
+    Write(data_fd_, &header, sizeof(header), 0, filename_);
+    const string ids_filename = filename_ + ".ids";
+    ids_fd_ = Create(ids_filename, rows * sizeof(int64_t));
+  }
+  ~MatrixWriter() {
+    CHECK_EQ(close(data_fd_), 0) << "Error writing " << filename_;
+    CHECK_EQ(close(ids_fd_), 0) << "Error writing " << filename_ << ".ids";
+  }
+
+  void Write(const FeatureRows& rows) {
+    CHECK_EQ(rows.cols, cols_) << "Feature size changed in " << filename_;
+    CHECK_LE(rows.first_row + rows.num_rows, rows_);
+    Write(data_fd_, &rows.data[0], rows.data.size(),
+        kMatrixDataOffset + rows.first_row * cols_ * element_size_,
+        filename_);
+    Write(ids_fd_, &rows.ids[0], rows.ids.size() * sizeof(int64_t),
+        rows.first_row * sizeof(int64_t), filename_ + ".ids");
+  }
+
+ private:
+  static int Create(const string& filename, uint64_t size) {
+    int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    CHECK_NE(fd, -1) << "Couldn't create " << filename;
+    CHECK_EQ(ftruncate(fd, size), 0) << "Couldn't size " << filename;
+    return fd;
+  }
+  static void Write(int fd, const void* data, size_t size, uint64_t offset,
+      const string& filename) {
+    const char* begin = static_cast<const char*>(data);
+    while (size > 0) {
+      ssize_t written = pwrite(fd, begin, size, offset);
+      CHECK_GT(written, 0) << "Error writing " << filename;
+      begin += written;
+      size -= written;
+      offset += written;
+    }
+  }
+
+  const string filename_;
+  const uint64_t rows_;
+  const uint64_t cols_;
+  const size_t element_size_;
+  int data_fd_;
+  int ids_fd_;
+};
+
+// What the replicas of a matrix extraction share.
+struct MatrixExtraction {
+  string pretrained_binary_proto;
+  string feature_extraction_proto;
+  vector<string> blob_names;
+  int num_mini_batches;
+  MatrixType type;
+  bool gpu;
+  int device_id;
+  // The batch size and record count of the Data layer, with replicas only
+  int batch_size;
+  uint64_t num_records;
+  // FeatureRows not in use, and those filled for the writer
+  RowsQueue free_rows;
+  RowsQueue full_rows;
+};
+
+// The row of the item read-th read by a replica, where a single net would
+// have written it.
+uint64_t ReplicaRow(const MatrixExtraction& extraction, int replica,
+    uint64_t read) {
+  if (FLAGS_replicas == 1) {
+    return read;
+  }
+  return caffe::PartitionedReadPosition(read, replica, FLAGS_replicas,
+      extraction.num_records);
+}
+
+template<typename Dtype>
+void extract_replica(MatrixExtraction* extraction, int replica) {
+  // Caffe's mode and solver rank are per thread
+  if (extraction->gpu) {
+    Caffe::SetDevice(extraction->device_id + replica);
+    Caffe::set_mode(Caffe::GPU);
+  } else {
+    Caffe::set_mode(Caffe::CPU);
+  }
+  Caffe::set_solver_count(FLAGS_replicas);
+  Caffe::set_solver_rank(replica);
+  NetParameter param;
+  caffe::ReadNetParamsFromTextFileOrDie(extraction->feature_extraction_proto,
+      &param);
+  param.mutable_state()->set_phase(caffe::TEST);
+  for (int i = 0; i < param.layer_size(); ++i) {
+    if (param.layer(i).type() == "Data") {
+      param.mutable_layer(i)->mutable_data_param()->set_partition_test(true);
+    }
+  }
+  Net<Dtype> net(param);
+  net.CopyTrainedLayersFrom(extraction->pretrained_binary_proto);
+  const vector<string>& blob_names = extraction->blob_names;
+  for (size_t i = 0; i < blob_names.size(); ++i) {
+    CHECK(net.has_blob(blob_names[i]))
+        << "Unknown feature blob name " << blob_names[i]
+        << " in the network " << extraction->feature_extraction_proto;
+  }
+
+  const uint64_t num_mini_batches = extraction->num_mini_batches;
+  for (uint64_t forward = 0; ; ++forward) {
+    // Stop once the first record of the next batch is past the output
+    if (FLAGS_replicas == 1 ? forward == num_mini_batches :
+        ReplicaRow(*extraction, replica, forward * extraction->batch_size) >=
+        num_mini_batches * extraction->batch_size) {
+      break;
+    }
+    net.Forward();
+    const Blob<Dtype>* id_blob = net.has_blob(FLAGS_id_blob) ?
+        net.blob_by_name(FLAGS_id_blob).get() : NULL;
+    for (int i = 0; i < blob_names.size(); ++i) {
+      const Blob<Dtype>& feature_blob = *net.blob_by_name(blob_names[i]);
+      const int batch_rows = feature_blob.num();
+      if (FLAGS_replicas > 1) {
+        CHECK_EQ(batch_rows, extraction->batch_size) << "Feature blob "
+            << blob_names[i] << " must have one row per record";
+      }
+      const uint64_t total_rows = num_mini_batches * batch_rows;
+      const uint64_t first_read = forward * batch_rows;
+      const bool has_ids = id_blob != NULL && id_blob->count() == batch_rows;
+      const int cols = feature_blob.count() / batch_rows;
+      // Every run of rows consecutive in the output goes in one FeatureRows
+      int begin = 0;
+      while (begin < batch_rows) {
+        const uint64_t row = ReplicaRow(*extraction, replica,
+            first_read + begin);
+        int end = begin + 1;
+        while (end < batch_rows && ReplicaRow(*extraction, replica,
+            first_read + end) == row + (end - begin)) {
+          ++end;
+        }
+        if (row >= total_rows) {
+          // Read past the output by the last batch of this replica
+          begin = end;
+          continue;
+        }
+        end = std::min<uint64_t>(end, begin + (total_rows - row));
+        FeatureRows* rows = extraction->free_rows.pop();
+        rows->feature = i;
+        rows->batch_rows = batch_rows;
+        rows->first_row = row;
+        rows->num_rows = end - begin;
+        rows->cols = cols;
+        const int count = rows->num_rows * cols;
+        const Dtype* feature_data = feature_blob.cpu_data() +
+            feature_blob.offset(begin);
+        if (extraction->type == MATRIX_FP16) {
+          rows->data.resize(count * sizeof(uint16_t));
+          uint16_t* data = reinterpret_cast<uint16_t*>(&rows->data[0]);
+          for (int j = 0; j < count; ++j) {
+            data[j] = caffe::caffe_float_to_half(feature_data[j]);
+          }
+        } else {
+          rows->data.resize(count * sizeof(float));
+          float* data = reinterpret_cast<float*>(&rows->data[0]);
+          for (int j = 0; j < count; ++j) {
+            data[j] = feature_data[j];
+          }
+        }
+        rows->ids.resize(rows->num_rows);
+        for (int n = 0; n < rows->num_rows; ++n) {
+          rows->ids[n] = has_ids ?
+              static_cast<int64_t>(id_blob->cpu_data()[begin + n]) : row + n;
+        }
+        extraction->full_rows.push(rows);
+        begin = end;
+      }
+    }
+  }
+}
+
+template<typename Dtype>
+int extract_features_to_matrix(MatrixExtraction* extraction,
+    const vector<string>& dataset_names) {
+  CHECK_GT(FLAGS_replicas, 0);
+  const int num_features = extraction->blob_names.size();
+  // Two batches per replica and feature in flight keep every thread busy
+  vector<FeatureRows> rows(2 * FLAGS_replicas * num_features);
+  for (int i = 0; i < rows.size(); ++i) {
+    extraction->free_rows.push(&rows[i]);
+  }
+  boost::thread_group replicas;
+  for (int i = 0; i < FLAGS_replicas; ++i) {
+    replicas.create_thread(boost::bind(&extract_replica<Dtype>, extraction,
+        i));
+  }
+
+  LOG(ERROR)<< "Extracting Features";
+  vector<boost::shared_ptr<MatrixWriter> > writers(num_features);
+  vector<uint64_t> num_rows(num_features, 0);
+  vector<uint64_t> total_rows(num_features, 0);
+  int complete_features = 0;
+  while (complete_features < num_features) {
+    FeatureRows* feature_rows = extraction->full_rows.pop();
+    const int feature = feature_rows->feature;
+    if (!writers[feature]) {
+      total_rows[feature] = static_cast<uint64_t>(feature_rows->batch_rows) *
+          extraction->num_mini_batches;
+      writers[feature].reset(new MatrixWriter(dataset_names[feature],
+          extraction->type, total_rows[feature], feature_rows->cols));
+    }
+    writers[feature]->Write(*feature_rows);
+    const uint64_t previous_rows = num_rows[feature];
+    num_rows[feature] += feature_rows->num_rows;
+    if (num_rows[feature] == total_rows[feature]) {
+      ++complete_features;
+    }
+    if (num_rows[feature] / 1000 != previous_rows / 1000) {
+      LOG(ERROR)<< "Extracted features of " << num_rows[feature] <<
+          " query images for feature blob " << extraction->blob_names[feature];
+    }
+    extraction->free_rows.push(feature_rows);
+  }
+  replicas.join_all();
+  for (int i = 0; i < num_features; ++i) {
+    writers[i].reset();
+    LOG(ERROR)<< "Extracted features of " << num_rows[i] <<
+        " query images for feature blob " << extraction->blob_names[i];
+  }
+  LOG(ERROR)<< "Successfully extracted the features!";
+  return 0;
+}
+
 template<typename Dtype>
 int feature_extraction_pipeline(int argc, char** argv);
 
@@ -30,6 +363,10 @@ int main(int argc, char** argv) {
 template<typename Dtype>
 int feature_extraction_pipeline(int argc, char** argv) {
   ::google::InitGoogleLogging(argv[0]);
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
   const int num_required_args = 7;
   if (argc < num_required_args) {
     LOG(ERROR)<<
@@ -39,6 +376,9 @@ int feature_extraction_pipeline(int argc, char** argv) {
     "  feature_extraction_proto_file  extract_feature_blob_name1[,name2,...]"
     "  save_feature_dataset_name1[,name2,...]  num_mini_batches  db_type"
     "  [CPU/GPU] [DEVICE_ID=0]\n"
+    "db_type is leveldb, lmdb, records, matrix or matrix_fp16; the matrix"
+    " outputs are dense memory-mappable files and take --replicas and"
+    " --id_blob.\n"
     "Note: you can extract multiple features in one pass by specifying"
     " multiple feature blob names and dataset names separated by ','."
     " The names cannot contain white space characters and the number of blobs"
@@ -48,9 +388,11 @@ int feature_extraction_pipeline(int argc, char** argv) {
   int arg_pos = num_required_args;
 
   arg_pos = num_required_args;
+  bool gpu = false;
+  int device_id = 0;
   if (argc > arg_pos && strcmp(argv[arg_pos], "GPU") == 0) {
     LOG(ERROR)<< "Using GPU";
-    int device_id = 0;
+    gpu = true;
     if (argc > arg_pos + 1) {
       device_id = atoi(argv[arg_pos + 1]);
       CHECK_GE(device_id, 0);
@@ -94,9 +436,6 @@ int feature_extraction_pipeline(int argc, char** argv) {
    }
    */
   std::string feature_extraction_proto(argv[++arg_pos]);
-  boost::shared_ptr<Net<Dtype> > feature_extraction_net(
-      new Net<Dtype>(feature_extraction_proto, caffe::TEST));
-  feature_extraction_net->CopyTrainedLayersFrom(pretrained_binary_proto);
 
   std::string extract_feature_blob_names(argv[++arg_pos]);
   std::vector<std::string> blob_names;
@@ -110,17 +449,67 @@ int feature_extraction_pipeline(int argc, char** argv) {
       " the number of blob names and dataset names must be equal";
   size_t num_features = blob_names.size();
 
+  int num_mini_batches = atoi(argv[++arg_pos]);
+  const string db_type = argv[++arg_pos];
+
+  if (db_type == "matrix" || db_type == "matrix_fp16") {
+    CHECK_GT(num_mini_batches, 0);
+    MatrixExtraction extraction;
+    extraction.pretrained_binary_proto = pretrained_binary_proto;
+    extraction.feature_extraction_proto = feature_extraction_proto;
+    extraction.blob_names = blob_names;
+    extraction.num_mini_batches = num_mini_batches;
+    extraction.type = db_type == "matrix" ? MATRIX_FLOAT : MATRIX_FP16;
+    extraction.gpu = gpu;
+    extraction.device_id = device_id;
+    extraction.batch_size = 0;
+    extraction.num_records = 0;
+    if (FLAGS_replicas > 1) {
+      // The replicas can only split the records of a Data layer that reads
+      // them in order
+      NetParameter param;
+      caffe::ReadNetParamsFromTextFileOrDie(feature_extraction_proto, &param);
+      const caffe::LayerParameter* data_layer = NULL;
+      for (int i = 0; i < param.layer_size(); ++i) {
+        const caffe::LayerParameter& layer = param.layer(i);
+        if (layer.type() == "Data") {
+          CHECK(data_layer == NULL) << "Replicas need a single Data layer";
+          data_layer = &layer;
+        } else {
+          CHECK_GT(layer.bottom_size(), 0) << "Every replica would read all "
+              "the input of layer " << layer.name() << ", which is not a "
+              "Data layer";
+        }
+      }
+      CHECK(data_layer != NULL) << "Replicas need a Data layer";
+      const caffe::DataParameter& data_param = data_layer->data_param();
+      CHECK(!data_param.shuffle() && data_param.shuffle_buffer() == 0)
+          << "Replicas can't extract the records of a shuffled Data layer";
+      extraction.batch_size = data_param.batch_size();
+      boost::scoped_ptr<db::DB> db(db::GetDB(data_param.backend()));
+      db->Open(data_param.source(), db::READ);
+      boost::scoped_ptr<db::Cursor> cursor(db->NewCursor());
+      for (; cursor->valid(); cursor->Next()) {
+        ++extraction.num_records;
+      }
+      CHECK_GT(extraction.num_records, 0) << "No records in "
+          << data_param.source();
+    }
+    return extract_features_to_matrix<Dtype>(&extraction, dataset_names);
+  }
+  CHECK_EQ(FLAGS_replicas, 1) << "Only the matrix outputs use replicas";
+
+  boost::shared_ptr<Net<Dtype> > feature_extraction_net(
+      new Net<Dtype>(feature_extraction_proto, caffe::TEST));
+  feature_extraction_net->CopyTrainedLayersFrom(pretrained_binary_proto);
   for (size_t i = 0; i < num_features; i++) {
     CHECK(feature_extraction_net->has_blob(blob_names[i]))
         << "Unknown feature blob name " << blob_names[i]
         << " in the network " << feature_extraction_proto;
   }
 
-  int num_mini_batches = atoi(argv[++arg_pos]);
-
   std::vector<boost::shared_ptr<db::DB> > feature_dbs;
   std::vector<boost::shared_ptr<db::Transaction> > txns;
-  const char* db_type = argv[++arg_pos];
   for (size_t i = 0; i < num_features; ++i) {
     LOG(INFO)<< "Opening dataset " << dataset_names[i];
     boost::shared_ptr<db::DB> db(db::GetDB(db_type));